@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ * \brief Cache building without a display, geeqie --batch
+ *
+ * Runs before gtk_init(), so only the GLib main loop and the loaders are
+ * used: the thumbnails are made by ThumbLoader, the similarity cache by
+ * CacheLoader. Layouts in the configuration are not opened.
+ *
+ * Each job takes a file through all the requested tasks, the number of
+ * jobs is the number of images decoded at the same time by the image
+ * loader threads.
+ */
+
+#include "main.h"
+#include "batch.h"
+
+#include "cache.h"
+#include "cache-loader.h"
+#include "filedata.h"
+#include "filefilter.h"
+#include "thumb.h"
+#include "ui_fileops.h"
+
+typedef enum {
+	BATCH_THUMBNAILS	= 1 << 0,
+	BATCH_SIMILARITY	= 1 << 1,
+	BATCH_CHECKSUM		= 1 << 2,
+	BATCH_EXIF_DATE		= 1 << 3,
+	BATCH_ALL		= (1 << 4) - 1
+} BatchTask;
+
+typedef struct _BatchData BatchData;
+struct _BatchData
+{
+	BatchTask tasks;
+	gboolean recurse;
+	gint jobs;
+
+	GList *list;		/* FileData of the files to do */
+	GList *list_dir;	/* FileData of the folders to read */
+	gint running;
+	gboolean starting;	/* in batch_next(), jobs done at once do not recurse */
+
+	GMainLoop *loop;
+
+	/* summary */
+	gint folders;
+	gint files;
+	gint thumbs;
+	gint sim_files;
+	gint skipped;
+	gint failed;
+};
+
+typedef struct _BatchJob BatchJob;
+struct _BatchJob
+{
+	BatchData *bd;
+	FileData *fd;
+	ThumbLoader *tl;
+	CacheLoader *cl;
+	gboolean failed;
+};
+
+static void batch_next(BatchData *bd);
+
+static void batch_help(void)
+{
+	print_term(FALSE, _("Usage: geeqie --batch [options] <folder> ...\n\n"));
+	print_term(FALSE, _("Builds the caches of the folders and exits, no display is needed.\n\n"));
+	print_term(FALSE, _("  -r, --recurse                    include subfolders\n"));
+	print_term(FALSE, _("  -j, --threads=<N>                images processed at the same time, default one per processor\n"));
+	print_term(FALSE, _("      --thumbnails                 create thumbnails\n"));
+	print_term(FALSE, _("      --similarity                 store image similarity data and dimensions\n"));
+	print_term(FALSE, _("      --checksum                   store MD5 checksums\n"));
+	print_term(FALSE, _("      --exif-date                  store the EXIF date\n"));
+	print_term(FALSE, _("  -h, --help                       show this message\n\n"));
+	print_term(FALSE, _("Without a task option, all of them are run.\n"));
+}
+
+static void batch_read_folder(BatchData *bd, FileData *dir_fd)
+{
+	GList *list_f = NULL;
+	GList *list_d = NULL;
+
+	if (!filelist_read(dir_fd, &list_f, bd->recurse ? &list_d : NULL))
+		{
+		printf_term(TRUE, _("Can not read folder: %s\n"), dir_fd->path);
+		bd->failed++;
+		return;
+		}
+	bd->folders++;
+
+	list_f = filelist_sort_path(filelist_filter(list_f, FALSE));
+	list_d = filelist_sort_path(filelist_filter(list_d, TRUE));
+
+	bd->list = g_list_concat(list_f, bd->list);
+	bd->list_dir = g_list_concat(list_d, bd->list_dir);
+}
+
+static void batch_job_done(BatchJob *job)
+{
+	BatchData *bd = job->bd;
+
+	if (job->failed)
+		{
+		DEBUG_1("batch: failed %s", job->fd->path);
+		bd->failed++;
+		}
+
+	file_data_unref(job->fd);
+	g_free(job);
+
+	bd->running--;
+	if (!bd->starting) batch_next(bd);
+}
+
+static CacheDataType batch_cache_mask(BatchData *bd, FileData *fd)
+{
+	CacheDataType mask = CACHE_LOADER_NONE;
+
+	if (fd->format_class != FORMAT_CLASS_IMAGE && fd->format_class != FORMAT_CLASS_RAWIMAGE) return mask;
+
+	if (bd->tasks & BATCH_SIMILARITY) mask |= CACHE_LOADER_SIMILARITY | CACHE_LOADER_DIMENSIONS;
+	if (bd->tasks & BATCH_CHECKSUM) mask |= CACHE_LOADER_MD5SUM;
+	if (bd->tasks & BATCH_EXIF_DATE) mask |= CACHE_LOADER_DATE;
+
+	return mask;
+}
+
+static void batch_cache_done_cb(CacheLoader *cl, gint error, gpointer data)
+{
+	BatchJob *job = data;
+
+	if (error) job->failed = TRUE;
+	if (cl->done_mask != CACHE_LOADER_NONE) job->bd->sim_files++;
+
+	cache_loader_free(cl);
+	job->cl = NULL;
+
+	batch_job_done(job);
+}
+
+static void batch_job_cache(BatchJob *job)
+{
+	CacheDataType mask = batch_cache_mask(job->bd, job->fd);
+
+	if (mask != CACHE_LOADER_NONE)
+		{
+		job->cl = cache_loader_new(job->fd, mask, batch_cache_done_cb, job);
+		if (job->cl) return;
+		job->failed = TRUE;
+		}
+
+	batch_job_done(job);
+}
+
+static void batch_thumb_done_cb(ThumbLoader *tl, gpointer data)
+{
+	BatchJob *job = data;
+
+	if (!thumb_loader_cache_hit(tl)) job->bd->thumbs++;
+
+	thumb_loader_free(job->tl);
+	job->tl = NULL;
+
+	/* the thumbnail is not needed afterwards */
+	file_data_set_thumb_pixbuf(job->fd, NULL);
+
+	batch_job_cache(job);
+}
+
+static void batch_thumb_error_cb(ThumbLoader *tl, gpointer data)
+{
+	BatchJob *job = data;
+
+	job->failed = TRUE;
+
+	thumb_loader_free(job->tl);
+	job->tl = NULL;
+
+	batch_job_cache(job);
+}
+
+/* the classes the thumbnail loaders make thumbnails of */
+static gboolean batch_thumb_class(FileData *fd)
+{
+	return (fd->format_class == FORMAT_CLASS_IMAGE ||
+		fd->format_class == FORMAT_CLASS_RAWIMAGE ||
+		fd->format_class == FORMAT_CLASS_VIDEO ||
+		fd->format_class == FORMAT_CLASS_COLLECTION ||
+		fd->format_class == FORMAT_CLASS_DOCUMENT);
+}
+
+static void batch_job_start(BatchData *bd, FileData *fd)
+{
+	BatchJob *job;
+
+	job = g_new0(BatchJob, 1);
+	job->bd = bd;
+	job->fd = fd;
+
+	bd->files++;
+	bd->running++;
+
+	if ((bd->tasks & BATCH_THUMBNAILS) && batch_thumb_class(fd))
+		{
+		job->tl = thumb_loader_new(options->thumbnails.max_width, options->thumbnails.max_height);
+		thumb_loader_set_callbacks(job->tl, batch_thumb_done_cb, batch_thumb_error_cb, NULL, job);
+		thumb_loader_set_cache(job->tl, TRUE, FALSE, FALSE);
+		if (thumb_loader_start(job->tl, fd)) return;
+
+		/* a file known to fail is not tried again on each run */
+		if (thumb_loader_cache_hit(job->tl))
+			{
+			bd->skipped++;
+			}
+		else
+			{
+			job->failed = TRUE;
+			}
+		thumb_loader_free(job->tl);
+		job->tl = NULL;
+		file_data_set_thumb_pixbuf(fd, NULL);
+		}
+
+	batch_job_cache(job);
+}
+
+static FileData *batch_next_file(BatchData *bd)
+{
+	FileData *fd;
+
+	while (!bd->list && bd->list_dir)
+		{
+		FileData *dir_fd = bd->list_dir->data;
+
+		bd->list_dir = g_list_delete_link(bd->list_dir, bd->list_dir);
+		batch_read_folder(bd, dir_fd);
+		file_data_unref(dir_fd);
+		}
+
+	if (!bd->list) return NULL;
+
+	fd = bd->list->data;
+	bd->list = g_list_delete_link(bd->list, bd->list);
+
+	return fd;
+}
+
+static void batch_next(BatchData *bd)
+{
+	bd->starting = TRUE;
+	while (bd->running < bd->jobs)
+		{
+		FileData *fd = batch_next_file(bd);
+
+		if (!fd) break;
+		batch_job_start(bd, fd);
+		}
+	bd->starting = FALSE;
+
+	if (bd->running == 0) g_main_loop_quit(bd->loop);
+}
+
+static gboolean batch_start_cb(gpointer data)
+{
+	batch_next(data);
+
+	return FALSE;
+}
+
+static gboolean batch_parse_args(BatchData *bd, gint argc, gchar *argv[])
+{
+	gint i;
+
+	for (i = 0; i < argc; i++)
+		{
+		const gchar *arg = argv[i];
+
+		if (strcmp(arg, "-r") == 0 || strcmp(arg, "--recurse") == 0)
+			{
+			bd->recurse = TRUE;
+			}
+		else if (strncmp(arg, "--threads=", 10) == 0)
+			{
+			bd->jobs = atoi(arg + 10);
+			}
+		else if (strcmp(arg, "-j") == 0 && i + 1 < argc)
+			{
+			bd->jobs = atoi(argv[++i]);
+			}
+		else if (strcmp(arg, "--thumbnails") == 0)
+			{
+			bd->tasks |= BATCH_THUMBNAILS;
+			}
+		else if (strcmp(arg, "--similarity") == 0)
+			{
+			bd->tasks |= BATCH_SIMILARITY;
+			}
+		else if (strcmp(arg, "--checksum") == 0)
+			{
+			bd->tasks |= BATCH_CHECKSUM;
+			}
+		else if (strcmp(arg, "--exif-date") == 0)
+			{
+			bd->tasks |= BATCH_EXIF_DATE;
+			}
+		else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+			{
+			batch_help();
+			return FALSE;
+			}
+		else if (strncmp(arg, "--debug", 7) == 0)
+			{
+			/* already handled in main() */
+			}
+		else if (arg[0] == '-')
+			{
+			printf_term(TRUE, _("Invalid option: %s\n"), arg);
+			batch_help();
+			return FALSE;
+			}
+		else
+			{
+			gchar *path = expand_tilde(arg);
+			gchar *abs_path;
+
+			if (g_path_is_absolute(path))
+				{
+				abs_path = g_strdup(path);
+				}
+			else
+				{
+				gchar *cwd = get_current_dir();
+
+				abs_path = g_build_filename(cwd, path, NULL);
+				g_free(cwd);
+				}
+			parse_out_relatives(abs_path);
+
+			if (isdir(abs_path))
+				{
+				bd->list_dir = g_list_append(bd->list_dir, file_data_new_dir(abs_path));
+				}
+			else
+				{
+				printf_term(TRUE, _("Not a folder: %s\n"), arg);
+				}
+			g_free(abs_path);
+			g_free(path);
+			}
+		}
+
+	if (!bd->list_dir)
+		{
+		batch_help();
+		return FALSE;
+		}
+
+	if (bd->tasks == 0) bd->tasks = BATCH_ALL;
+	if (bd->jobs <= 0) bd->jobs = g_get_num_processors();
+
+	return TRUE;
+}
+
+/**
+ * \brief Builds the caches of the folders in \a argv
+ * \returns The exit status
+ *
+ * Called by main() instead of starting the GUI, with the arguments
+ * following --batch.
+ */
+gint batch_main(gint argc, gchar *argv[])
+{
+	BatchData *bd;
+	gint64 start_time;
+	gint ret;
+
+	batch_mode = TRUE;
+
+	options = init_options(NULL);
+	setup_default_options(options);
+
+	if (!load_options(options))
+		{
+		filter_add_defaults();
+		filter_rebuild();
+		}
+
+	/* there is no point in running without storing the results */
+	options->thumbnails.enable_caching = TRUE;
+
+	bd = g_new0(BatchData, 1);
+	if (!batch_parse_args(bd, argc, argv))
+		{
+		filelist_free(bd->list_dir);
+		g_free(bd);
+		return 1;
+		}
+
+	start_time = g_get_monotonic_time();
+
+	bd->loop = g_main_loop_new(NULL, FALSE);
+	g_idle_add(batch_start_cb, bd);
+	g_main_loop_run(bd->loop);
+	g_main_loop_unref(bd->loop);
+
+	printf_term(FALSE, _("%d folders, %d files, %d thumbnails, %d similarity cache entries updated, %d skipped, %d failed in %.1f seconds\n"),
+		    bd->folders, bd->files, bd->thumbs, bd->sim_files, bd->skipped, bd->failed,
+		    (g_get_monotonic_time() - start_time) / 1000000.0);
+
+	ret = (bd->failed > 0) ? 2 : 0;
+	g_free(bd);
+
+	return ret;
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,1336 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ * \brief Benchmarks of the core pipelines, geeqie --bench and make bench
+ *
+ * The fixtures are generated in a temporary folder from a fixed seed, so
+ * runs need no network and no sample images, and are comparable between
+ * releases. The default options are used, the configuration is not read.
+ *
+ * Each case is run once to warm up, then timed for the number of
+ * iterations. One JSON object is written per case:
+ * \code
+ * {"name":"decode","case":"jpeg","iterations":10,"ops":1,"min_us":...,"median_us":...,"mean_us":...,"max_us":...,"mb_per_s":...}
+ * \endcode
+ * "ops" is the number of operations in one iteration, "mb_per_s" is given
+ * when the case reads data. The first line describes the run.
+ *
+ * Rendering needs a display, without one the render cases are skipped.
+ */
+
+#include "main.h"
+#include "bench.h"
+
+#include "cache.h"
+#include "collect.h"
+#include "collect-io.h"
+#include "exif.h"
+#include "filecache.h"
+#include "filedata.h"
+#include "filefilter.h"
+#include "image-load.h"
+#include "image_load_dds.h"
+#include "image_load_djvu.h"
+#include "image_load_gdk.h"
+#include "image_load_heif.h"
+#include "image_load_j2k.h"
+#include "image_load_jpeg.h"
+#include "image_load_pdf.h"
+#include "image_load_tiff.h"
+#include "image_load_webp.h"
+#include "md5-util.h"
+#include "pixbuf-renderer.h"
+#include "similar.h"
+#include "thumb_standard.h"
+#include "ui_fileops.h"
+
+#include <glib/gstdio.h>
+
+#if defined(HAVE_PDF) && defined(CAIRO_HAS_PDF_SURFACE)
+#include <cairo-pdf.h>
+#endif
+#ifdef HAVE_HEIF
+#include <libheif/heif.h>
+#endif
+#ifdef HAVE_J2K
+#include "openjpeg.h"
+#endif
+#ifdef HAVE_WEBP
+#include <webp/encode.h>
+#endif
+
+#define BENCH_SEED 20160101
+#define BENCH_ITERATIONS_DEFAULT 10
+#define BENCH_SIZE_DEFAULT 2048		/* width of the fixture images, the height is 3/4 of it */
+
+#define BENCH_TREE_FOLDERS 10
+#define BENCH_TREE_FILES 1000		/* in each folder of the tree */
+#define BENCH_RANDOM_SIZE (16 * 1024 * 1024)
+#define BENCH_SIM_COMPARES 1000
+
+#define BENCH_VIEW_WIDTH 1280
+#define BENCH_VIEW_HEIGHT 800
+
+typedef gboolean (*BenchFunc)(gpointer data);
+
+typedef struct _BenchData BenchData;
+struct _BenchData
+{
+	gint iterations;
+	gint size;
+	gchar **names;		/* benchmarks to run, NULL for all */
+	gboolean keep;
+
+	FILE *out;
+	gchar *dir;		/* the fixtures */
+	GMainLoop *loop;
+	gint failed;
+};
+
+static const gchar *bench_names[] = {
+	"decode", "thumbnail", "similarity", "md5", "filelist", "file_cache", "render", "exif", "collection", NULL
+};
+
+static void bench_help(void)
+{
+	print_term(FALSE, _("Usage: geeqie --bench [options] [benchmark ...]\n\n"));
+	print_term(FALSE, _("Runs benchmarks on generated images and writes the timings as JSON lines.\n\n"));
+	print_term(FALSE, _("      --iterations=<N>             timed runs of each case, default 10\n"));
+	print_term(FALSE, _("      --size=<N>                   width of the generated images, default 2048\n"));
+	print_term(FALSE, _("      --output=<FILE>              write the results to FILE instead of the standard output\n"));
+	print_term(FALSE, _("      --keep                       do not delete the generated files\n"));
+	print_term(FALSE, _("  -h, --help                       show this message\n\n"));
+	print_term(FALSE, _("Benchmarks: decode thumbnail similarity md5 filelist file_cache render exif collection\n"));
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * timing
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean bench_enabled(BenchData *bd, const gchar *name)
+{
+	return !bd->names || g_strv_contains((const gchar * const *)bd->names, name);
+}
+
+static void bench_print_status(BenchData *bd, const gchar *name, const gchar *variant, const gchar *key, const gchar *text)
+{
+	fprintf(bd->out, "{\"name\":\"%s\",\"case\":\"%s\",\"%s\":\"%s\"}\n", name, variant, key, text);
+	fflush(bd->out);
+}
+
+static gint bench_time_compare(gconstpointer a, gconstpointer b)
+{
+	gint64 ta = *(const gint64 *)a;
+	gint64 tb = *(const gint64 *)b;
+
+	return (ta > tb) - (ta < tb);
+}
+
+/**
+ * \brief Times \a func and writes the result
+ * \param ops The number of operations done by one call of \a func
+ * \param bytes The data read by one call of \a func, or 0
+ */
+static void bench_run(BenchData *bd, const gchar *name, const gchar *variant,
+		      guint ops, gsize bytes, BenchFunc func, gpointer data)
+{
+	gint64 *times;
+	gint64 total = 0;
+	gint64 median;
+	gint i;
+
+	DEBUG_1("bench: %s %s", name, variant);
+
+	/* warm up, and check that the case works at all */
+	if (!func(data))
+		{
+		bench_print_status(bd, name, variant, "error", "failed");
+		bd->failed++;
+		return;
+		}
+
+	times = g_new(gint64, bd->iterations);
+	for (i = 0; i < bd->iterations; i++)
+		{
+		gint64 start = g_get_monotonic_time();
+
+		func(data);
+		times[i] = g_get_monotonic_time() - start;
+		total += times[i];
+		}
+	qsort(times, bd->iterations, sizeof(gint64), bench_time_compare);
+	median = times[bd->iterations / 2];
+
+	fprintf(bd->out, "{\"name\":\"%s\",\"case\":\"%s\",\"iterations\":%d,\"ops\":%u,"
+		"\"min_us\":%" G_GINT64_FORMAT ",\"median_us\":%" G_GINT64_FORMAT ",\"mean_us\":%.1f,\"max_us\":%" G_GINT64_FORMAT,
+		name, variant, bd->iterations, ops,
+		times[0], median, (gdouble)total / bd->iterations, times[bd->iterations - 1]);
+	if (bytes > 0)
+		{
+		/* bytes per microsecond are MB per second */
+		fprintf(bd->out, ",\"mb_per_s\":%.1f", (gdouble)bytes / MAX(median, 1));
+		}
+	fprintf(bd->out, "}\n");
+	fflush(bd->out);
+
+	g_free(times);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * fixtures
+ *-----------------------------------------------------------------------------
+ */
+
+static gchar *bench_path(BenchData *bd, const gchar *name)
+{
+	return g_build_filename(bd->dir, name, NULL);
+}
+
+/* gradients with some noise, so that the images compress like photos */
+static GdkPixbuf *bench_fixture_pixbuf(gint width, gint height)
+{
+	GdkPixbuf *pixbuf;
+	GRand *rand;
+	guchar *pix;
+	gint rowstride;
+	gint x, y;
+
+	pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	pix = gdk_pixbuf_get_pixels(pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	rand = g_rand_new_with_seed(BENCH_SEED);
+
+	for (y = 0; y < height; y++)
+		{
+		guchar *p = pix + y * rowstride;
+
+		for (x = 0; x < width; x++)
+			{
+			gint noise = g_rand_int_range(rand, 0, 24);
+
+			*p++ = CLAMP(x * 255 / width + noise, 0, 255);
+			*p++ = CLAMP(y * 255 / height + noise, 0, 255);
+			*p++ = CLAMP(((x / 64 + y / 64) & 1) * 128 + (x + y) % 128 - noise, 0, 255);
+			}
+		}
+
+	g_rand_free(rand);
+
+	return pixbuf;
+}
+
+static void bench_put_u16(GByteArray *array, guint16 value)
+{
+	guint8 b[2] = { value & 0xff, value >> 8 };
+
+	g_byte_array_append(array, b, 2);
+}
+
+static void bench_put_u32(GByteArray *array, guint32 value)
+{
+	guint8 b[4] = { value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24 };
+
+	g_byte_array_append(array, b, 4);
+}
+
+static void bench_put_ifd_entry(GByteArray *array, guint16 tag, guint16 type, guint32 count, guint32 value)
+{
+	bench_put_u16(array, tag);
+	bench_put_u16(array, type);
+	bench_put_u32(array, count);
+	bench_put_u32(array, value);
+}
+
+/* a small Exif APP1 segment, the JPEG writer of GdkPixbuf can not add one */
+static GByteArray *bench_exif_segment(void)
+{
+	static const gchar make[] = "Geeqie";
+	static const gchar model[] = "bench";
+	static const gchar date[] = "2016:01:01 12:00:00";
+	GByteArray *tiff;
+	GByteArray *segment;
+	guint32 data = 8 + 2 + 4 * 12 + 4;
+
+	tiff = g_byte_array_new();
+	g_byte_array_append(tiff, (const guint8 *)"II*\0", 4);
+	bench_put_u32(tiff, 8);
+
+	bench_put_u16(tiff, 4);
+	bench_put_ifd_entry(tiff, 0x010f, 2, sizeof(make), data);
+	bench_put_ifd_entry(tiff, 0x0110, 2, sizeof(model), data + sizeof(make));
+	bench_put_ifd_entry(tiff, 0x0112, 3, 1, 1);
+	bench_put_ifd_entry(tiff, 0x0132, 2, sizeof(date), data + sizeof(make) + sizeof(model));
+	bench_put_u32(tiff, 0);
+
+	g_byte_array_append(tiff, (const guint8 *)make, sizeof(make));
+	g_byte_array_append(tiff, (const guint8 *)model, sizeof(model));
+	g_byte_array_append(tiff, (const guint8 *)date, sizeof(date));
+
+	segment = g_byte_array_new();
+	g_byte_array_append(segment, (const guint8 *)"\xff\xe1", 2);
+	g_byte_array_append(segment, (const guint8 *)"\0\0", 2);
+	g_byte_array_append(segment, (const guint8 *)"Exif\0\0", 6);
+	g_byte_array_append(segment, tiff->data, tiff->len);
+
+	/* big endian length, without the marker */
+	segment->data[2] = (segment->len - 2) >> 8;
+	segment->data[3] = (segment->len - 2) & 0xff;
+
+	g_byte_array_free(tiff, TRUE);
+
+	return segment;
+}
+
+static gboolean bench_fixture_jpeg(BenchData *bd, GdkPixbuf *pixbuf)
+{
+	gchar *buf;
+	gsize len;
+	GByteArray *out;
+	gchar *path;
+	gboolean ret;
+
+	if (!gdk_pixbuf_save_to_buffer(pixbuf, &buf, &len, "jpeg", NULL, "quality", "90", NULL)) return FALSE;
+
+	out = bench_exif_segment();
+	g_byte_array_prepend(out, (const guint8 *)buf, 2);
+	g_byte_array_append(out, (const guint8 *)buf + 2, len - 2);
+	g_free(buf);
+
+	path = bench_path(bd, "image.jpg");
+	ret = g_file_set_contents(path, (const gchar *)out->data, out->len, NULL);
+	g_free(path);
+	g_byte_array_free(out, TRUE);
+
+	return ret;
+}
+
+/* uncompressed X8R8G8B8 with the whole mipmap chain */
+static void bench_fixture_dds(BenchData *bd, GdkPixbuf *pixbuf)
+{
+	GByteArray *out;
+	gchar *path;
+	gint width = gdk_pixbuf_get_width(pixbuf);
+	gint height = gdk_pixbuf_get_height(pixbuf);
+	gint mipmaps = 1;
+	gint w, h;
+	gint i;
+
+	for (w = width, h = height; w > 1 || h > 1; w = MAX(w / 2, 1), h = MAX(h / 2, 1)) mipmaps++;
+
+	out = g_byte_array_new();
+	g_byte_array_append(out, (const guint8 *)"DDS ", 4);
+	bench_put_u32(out, 124);
+	bench_put_u32(out, 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000); /* caps, size, pitch, pixel format, mipmaps */
+	bench_put_u32(out, height);
+	bench_put_u32(out, width);
+	bench_put_u32(out, width * 4);
+	bench_put_u32(out, 0);
+	bench_put_u32(out, mipmaps);
+	for (i = 0; i < 11; i++) bench_put_u32(out, 0);
+
+	/* pixel format, RGB without alpha */
+	bench_put_u32(out, 32);
+	bench_put_u32(out, 0x40);
+	bench_put_u32(out, 0);
+	bench_put_u32(out, 32);
+	bench_put_u32(out, 0x00ff0000);
+	bench_put_u32(out, 0x0000ff00);
+	bench_put_u32(out, 0x000000ff);
+	bench_put_u32(out, 0);
+
+	bench_put_u32(out, 0x1000 | 0x8 | 0x400000); /* texture, complex, mipmap */
+	for (i = 0; i < 4; i++) bench_put_u32(out, 0);
+
+	for (w = width, h = height, i = 0; i < mipmaps; w = MAX(w / 2, 1), h = MAX(h / 2, 1), i++)
+		{
+		GdkPixbuf *level;
+		const guchar *pix;
+		gint rowstride;
+		gint x, y;
+
+		level = (i == 0) ? g_object_ref(pixbuf) : gdk_pixbuf_scale_simple(pixbuf, w, h, GDK_INTERP_BILINEAR);
+		pix = gdk_pixbuf_get_pixels(level);
+		rowstride = gdk_pixbuf_get_rowstride(level);
+
+		for (y = 0; y < h; y++)
+			{
+			const guchar *p = pix + y * rowstride;
+
+			for (x = 0; x < w; x++, p += 3)
+				{
+				guint8 b[4] = { p[2], p[1], p[0], 0xff };
+
+				g_byte_array_append(out, b, 4);
+				}
+			}
+		g_object_unref(level);
+		}
+
+	path = bench_path(bd, "image.dds");
+	g_file_set_contents(path, (const gchar *)out->data, out->len, NULL);
+	g_free(path);
+	g_byte_array_free(out, TRUE);
+}
+
+#ifdef HAVE_WEBP
+static void bench_fixture_webp(BenchData *bd, GdkPixbuf *pixbuf)
+{
+	uint8_t *out = NULL;
+	size_t len;
+	gchar *path;
+
+	len = WebPEncodeRGB(gdk_pixbuf_get_pixels(pixbuf), gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf),
+			    gdk_pixbuf_get_rowstride(pixbuf), 90, &out);
+	if (len > 0)
+		{
+		path = bench_path(bd, "image.webp");
+		g_file_set_contents(path, (const gchar *)out, len, NULL);
+		g_free(path);
+		}
+	free(out);
+}
+#endif
+
+#ifdef HAVE_HEIF
+/* with an embedded thumbnail, as cameras write them; fails without an HEVC encoder */
+static void bench_fixture_heif(BenchData *bd, GdkPixbuf *pixbuf)
+{
+	struct heif_context *ctx;
+	struct heif_encoder *encoder = NULL;
+	struct heif_image *image = NULL;
+	struct heif_image_handle *handle = NULL;
+	struct heif_error err;
+	gint width = gdk_pixbuf_get_width(pixbuf);
+	gint height = gdk_pixbuf_get_height(pixbuf);
+
+	ctx = heif_context_alloc();
+	err = heif_context_get_encoder_for_format(ctx, heif_compression_HEVC, &encoder);
+	if (err.code == heif_error_Ok)
+		{
+		err = heif_image_create(width, height, heif_colorspace_RGB, heif_chroma_interleaved_RGB, &image);
+		}
+	if (err.code == heif_error_Ok)
+		{
+		err = heif_image_add_plane(image, heif_channel_interleaved, width, height, 8);
+		}
+	if (err.code == heif_error_Ok)
+		{
+		uint8_t *plane;
+		int stride;
+		gint y;
+
+		plane = heif_image_get_plane(image, heif_channel_interleaved, &stride);
+		for (y = 0; y < height; y++)
+			{
+			memcpy(plane + y * stride, gdk_pixbuf_get_pixels(pixbuf) + y * gdk_pixbuf_get_rowstride(pixbuf), width * 3);
+			}
+
+		heif_encoder_set_lossy_quality(encoder, 90);
+		err = heif_context_encode_image(ctx, image, encoder, NULL, &handle);
+		}
+	if (err.code == heif_error_Ok)
+		{
+		err = heif_context_encode_thumbnail(ctx, image, handle, encoder, NULL, 320, NULL);
+		}
+	if (err.code == heif_error_Ok)
+		{
+		gchar *path = bench_path(bd, "image.heic");
+
+		heif_context_write_to_file(ctx, path);
+		g_free(path);
+		}
+
+	if (handle) heif_image_handle_release(handle);
+	if (image) heif_image_release(image);
+	if (encoder) heif_encoder_release(encoder);
+	heif_context_free(ctx);
+}
+#endif
+
+#ifdef HAVE_J2K
+static void bench_fixture_j2k(BenchData *bd, GdkPixbuf *pixbuf)
+{
+	opj_cparameters_t parameters;
+	opj_image_cmptparm_t cmptparm[3];
+	opj_image_t *image;
+	opj_codec_t *codec;
+	opj_stream_t *stream;
+	const guchar *pix = gdk_pixbuf_get_pixels(pixbuf);
+	gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	gint width = gdk_pixbuf_get_width(pixbuf);
+	gint height = gdk_pixbuf_get_height(pixbuf);
+	gchar *path;
+	gboolean ret;
+	gint c, x, y;
+
+	opj_set_default_encoder_parameters(&parameters);
+	parameters.tcp_numlayers = 1;
+	parameters.tcp_rates[0] = 20;
+	parameters.cp_disto_alloc = 1;
+
+	memset(cmptparm, 0, sizeof(cmptparm));
+	for (c = 0; c < 3; c++)
+		{
+		cmptparm[c].prec = 8;
+		cmptparm[c].dx = 1;
+		cmptparm[c].dy = 1;
+		cmptparm[c].w = width;
+		cmptparm[c].h = height;
+		}
+
+	image = opj_image_create(3, cmptparm, OPJ_CLRSPC_SRGB);
+	if (!image) return;
+	image->x1 = width;
+	image->y1 = height;
+
+	for (y = 0; y < height; y++)
+		{
+		for (x = 0; x < width; x++)
+			{
+			for (c = 0; c < 3; c++)
+				{
+				image->comps[c].data[y * width + x] = pix[y * rowstride + x * 3 + c];
+				}
+			}
+		}
+
+	path = bench_path(bd, "image.jp2");
+	codec = opj_create_compress(OPJ_CODEC_JP2);
+	stream = opj_stream_create_default_file_stream(path, OPJ_FALSE);
+	ret = (stream &&
+	       opj_setup_encoder(codec, &parameters, image) &&
+	       opj_start_compress(codec, image, stream) &&
+	       opj_encode(codec, stream) &&
+	       opj_end_compress(codec, stream));
+	if (stream) opj_stream_destroy(stream);
+	opj_destroy_codec(codec);
+	opj_image_destroy(image);
+
+	if (!ret) g_unlink(path);
+	g_free(path);
+}
+#endif
+
+#if defined(HAVE_PDF) && defined(CAIRO_HAS_PDF_SURFACE)
+/* one page holding the image */
+static void bench_fixture_pdf(BenchData *bd, GdkPixbuf *pixbuf)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	gchar *path;
+
+	path = bench_path(bd, "image.pdf");
+	surface = cairo_pdf_surface_create(path, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf));
+	cr = cairo_create(surface);
+	gdk_cairo_set_source_pixbuf(cr, pixbuf, 0, 0);
+	cairo_paint(cr);
+	cairo_show_page(cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	g_free(path);
+}
+#endif
+
+static void bench_fixture_tree(BenchData *bd)
+{
+	static const gchar *extensions[] = { "jpg", "png", "cr2", "xmp", "txt" };
+	GString *collection;
+	gchar *path;
+	gint i, j;
+
+	collection = g_string_new("#" GQ_APPNAME " collection\n");
+
+	for (i = 0; i < BENCH_TREE_FOLDERS; i++)
+		{
+		gchar *name = g_strdup_printf("tree" G_DIR_SEPARATOR_S "folder%02d", i);
+		gchar *folder = bench_path(bd, name);
+
+		g_mkdir_with_parents(folder, 0755);
+
+		for (j = 0; j < BENCH_TREE_FILES; j++)
+			{
+			gchar *file = g_strdup_printf("%s" G_DIR_SEPARATOR_S "img%04d.%s", folder, j / 2, extensions[j % G_N_ELEMENTS(extensions)]);
+
+			g_file_set_contents(file, "", 0, NULL);
+			if (j % G_N_ELEMENTS(extensions) < 3) g_string_append_printf(collection, "\"%s\"\n", file);
+			g_free(file);
+			}
+
+		g_free(folder);
+		g_free(name);
+		}
+
+	g_string_append(collection, "#end\n");
+
+	path = bench_path(bd, "bench.gqv");
+	g_file_set_contents(path, collection->str, collection->len, NULL);
+	g_free(path);
+	g_string_free(collection, TRUE);
+}
+
+static void bench_fixture_random(BenchData *bd)
+{
+	GRand *rand;
+	guint32 *buf;
+	gchar *path;
+	guint i;
+
+	rand = g_rand_new_with_seed(BENCH_SEED);
+	buf = g_new(guint32, BENCH_RANDOM_SIZE / sizeof(guint32));
+	for (i = 0; i < BENCH_RANDOM_SIZE / sizeof(guint32); i++) buf[i] = g_rand_int(rand);
+
+	path = bench_path(bd, "random.bin");
+	g_file_set_contents(path, (const gchar *)buf, BENCH_RANDOM_SIZE, NULL);
+	g_free(path);
+
+	g_free(buf);
+	g_rand_free(rand);
+}
+
+static gboolean bench_fixtures(BenchData *bd)
+{
+	GdkPixbuf *pixbuf;
+	gchar *path;
+	GError *error = NULL;
+
+	bd->dir = g_dir_make_tmp("geeqie-bench-XXXXXX", &error);
+	if (!bd->dir)
+		{
+		printf_term(TRUE, _("Can not create a temporary folder: %s\n"), error->message);
+		g_error_free(error);
+		return FALSE;
+		}
+
+	pixbuf = bench_fixture_pixbuf(bd->size, bd->size * 3 / 4);
+
+	if (!bench_fixture_jpeg(bd, pixbuf))
+		{
+		printf_term(TRUE, _("Can not create the test images in %s\n"), bd->dir);
+		g_object_unref(pixbuf);
+		return FALSE;
+		}
+
+	/* the writers that GdkPixbuf may lack are only skipped */
+	path = bench_path(bd, "image.png");
+	gdk_pixbuf_save(pixbuf, path, "png", NULL, NULL);
+	g_free(path);
+	path = bench_path(bd, "image.tif");
+	gdk_pixbuf_save(pixbuf, path, "tiff", NULL, NULL);
+	g_free(path);
+	path = bench_path(bd, "image.bmp");
+	gdk_pixbuf_save(pixbuf, path, "bmp", NULL, NULL);
+	g_free(path);
+
+	/* there is no DjVu writer, those cases are always skipped */
+	bench_fixture_dds(bd, pixbuf);
+#ifdef HAVE_WEBP
+	bench_fixture_webp(bd, pixbuf);
+#endif
+#ifdef HAVE_HEIF
+	bench_fixture_heif(bd, pixbuf);
+#endif
+#ifdef HAVE_J2K
+	bench_fixture_j2k(bd, pixbuf);
+#endif
+#if defined(HAVE_PDF) && defined(CAIRO_HAS_PDF_SURFACE)
+	bench_fixture_pdf(bd, pixbuf);
+#endif
+
+	g_object_unref(pixbuf);
+
+	bench_fixture_tree(bd);
+	bench_fixture_random(bd);
+
+	return TRUE;
+}
+
+static void bench_remove_tree(const gchar *path)
+{
+	GDir *dir;
+	const gchar *name;
+
+	dir = g_dir_open(path, 0, NULL);
+	if (dir)
+		{
+		while ((name = g_dir_read_name(dir)))
+			{
+			gchar *child = g_build_filename(path, name, NULL);
+
+			if (g_file_test(child, G_FILE_TEST_IS_DIR))
+				bench_remove_tree(child);
+			else
+				g_unlink(child);
+			g_free(child);
+			}
+		g_dir_close(dir);
+		}
+	g_rmdir(path);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * decode, by loader backend
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct _BenchDecode BenchDecode;
+struct _BenchDecode
+{
+	ImageLoaderBackend backend;
+	gchar *buf;
+	gsize len;
+};
+
+static void bench_decode_area_updated_cb(gpointer loader, guint x, guint y, guint w, guint h, gpointer data)
+{
+}
+
+static void bench_decode_size_cb(gpointer loader, gint width, gint height, gpointer data)
+{
+}
+
+static void bench_decode_area_prepared_cb(gpointer loader, gpointer data)
+{
+}
+
+static gboolean bench_decode_cb(gpointer data)
+{
+	BenchDecode *bdec = data;
+	gpointer loader;
+	gboolean ret;
+
+	loader = bdec->backend.loader_new(bench_decode_area_updated_cb, bench_decode_size_cb,
+					  bench_decode_area_prepared_cb, NULL);
+	if (bdec->backend.load)
+		ret = bdec->backend.load(loader, (const guchar *)bdec->buf, bdec->len, NULL);
+	else
+		ret = bdec->backend.write(loader, (const guchar *)bdec->buf, bdec->len, NULL);
+	bdec->backend.close(loader, NULL);
+
+	ret = ret && bdec->backend.get_pixbuf(loader) != NULL;
+	bdec->backend.free(loader);
+
+	return ret;
+}
+
+static void bench_decode_case(BenchData *bd, const gchar *variant, const gchar *file,
+			      void (*backend_set)(ImageLoaderBackend *funcs))
+{
+	BenchDecode bdec;
+	gchar *path;
+
+	path = bench_path(bd, file);
+	memset(&bdec, 0, sizeof(bdec));
+	if (!g_file_get_contents(path, &bdec.buf, &bdec.len, NULL))
+		{
+		bench_print_status(bd, "decode", variant, "skipped", "no image writer");
+		g_free(path);
+		return;
+		}
+	g_free(path);
+
+	backend_set(&bdec.backend);
+	bench_run(bd, "decode", variant, 1, bdec.len, bench_decode_cb, &bdec);
+
+	g_free(bdec.buf);
+}
+
+static void bench_decode(BenchData *bd)
+{
+#ifdef HAVE_JPEG
+	bench_decode_case(bd, "jpeg", "image.jpg", image_loader_backend_set_jpeg);
+#endif
+	bench_decode_case(bd, "jpeg-gdk-pixbuf", "image.jpg", image_loader_backend_set_default);
+#ifdef HAVE_TIFF
+	bench_decode_case(bd, "tiff", "image.tif", image_loader_backend_set_tiff);
+#endif
+	bench_decode_case(bd, "png", "image.png", image_loader_backend_set_default);
+	bench_decode_case(bd, "bmp", "image.bmp", image_loader_backend_set_default);
+	bench_decode_case(bd, "dds", "image.dds", image_loader_backend_set_dds);
+#ifdef HAVE_WEBP
+	bench_decode_case(bd, "webp", "image.webp", image_loader_backend_set_webp);
+#endif
+#ifdef HAVE_HEIF
+	bench_decode_case(bd, "heif", "image.heic", image_loader_backend_set_heif);
+#endif
+#ifdef HAVE_J2K
+	bench_decode_case(bd, "j2k", "image.jp2", image_loader_backend_set_j2k);
+#endif
+#ifdef HAVE_PDF
+	bench_decode_case(bd, "pdf", "image.pdf", image_loader_backend_set_pdf);
+#endif
+#ifdef HAVE_DJVU
+	bench_decode_case(bd, "djvu", "image.djvu", image_loader_backend_set_djvu);
+#endif
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * thumbnail, the standard loader without the cache
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct _BenchThumb BenchThumb;
+struct _BenchThumb
+{
+	BenchData *bd;
+	FileData *fd;
+	gboolean ok;
+};
+
+static void bench_thumb_done_cb(ThumbLoaderStd *tl, gpointer data)
+{
+	BenchThumb *bt = data;
+
+	bt->ok = (bt->fd->thumb_pixbuf != NULL);
+	g_main_loop_quit(bt->bd->loop);
+}
+
+static void bench_thumb_error_cb(ThumbLoaderStd *tl, gpointer data)
+{
+	BenchThumb *bt = data;
+
+	bt->ok = FALSE;
+	g_main_loop_quit(bt->bd->loop);
+}
+
+static gboolean bench_thumb_cb(gpointer data)
+{
+	BenchThumb *bt = data;
+	ThumbLoaderStd *tl;
+
+	tl = thumb_loader_std_new(options->thumbnails.max_width, options->thumbnails.max_height);
+	thumb_loader_std_set_callbacks(tl, bench_thumb_done_cb, bench_thumb_error_cb, NULL, bt);
+	thumb_loader_std_set_cache(tl, FALSE, FALSE, FALSE);
+
+	bt->ok = FALSE;
+	if (thumb_loader_std_start(tl, bt->fd)) g_main_loop_run(bt->bd->loop);
+	thumb_loader_std_free(tl);
+
+	file_data_set_thumb_pixbuf(bt->fd, NULL);
+
+	return bt->ok;
+}
+
+static void bench_thumbnail_case(BenchData *bd, const gchar *variant, const gchar *file)
+{
+	BenchThumb bt;
+	gchar *path;
+
+	path = bench_path(bd, file);
+	if (!g_file_test(path, G_FILE_TEST_EXISTS))
+		{
+		bench_print_status(bd, "thumbnail", variant, "skipped", "no image writer");
+		g_free(path);
+		return;
+		}
+
+	bt.bd = bd;
+	bt.fd = file_data_new_no_grouping(path);
+	g_free(path);
+
+	bench_run(bd, "thumbnail", variant, 1, 0, bench_thumb_cb, &bt);
+
+	file_data_unref(bt.fd);
+}
+
+/* the backends decoding at a reduced size, the decode cases give the
+ * full size cost of the same files */
+static void bench_thumbnail(BenchData *bd)
+{
+	bench_thumbnail_case(bd, "jpeg", "image.jpg");
+	bench_thumbnail_case(bd, "dds", "image.dds");
+#ifdef HAVE_WEBP
+	bench_thumbnail_case(bd, "webp", "image.webp");
+#endif
+#ifdef HAVE_HEIF
+	bench_thumbnail_case(bd, "heif", "image.heic");
+#endif
+#ifdef HAVE_J2K
+	bench_thumbnail_case(bd, "j2k", "image.jp2");
+#endif
+#ifdef HAVE_PDF
+	bench_thumbnail_case(bd, "pdf", "image.pdf");
+#endif
+#ifdef HAVE_DJVU
+	bench_thumbnail_case(bd, "djvu", "image.djvu");
+#endif
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * similarity
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct _BenchSim BenchSim;
+struct _BenchSim
+{
+	GdkPixbuf *pixbuf;
+	ImageSimilarityData *a;
+	ImageSimilarityData *b;
+};
+
+static gboolean bench_sim_fill_cb(gpointer data)
+{
+	BenchSim *bs = data;
+	ImageSimilarityData *sd;
+
+	sd = image_sim_new();
+	image_sim_fill_data(sd, bs->pixbuf);
+	image_sim_free(sd);
+
+	return TRUE;
+}
+
+static gboolean bench_sim_compare_cb(gpointer data)
+{
+	BenchSim *bs = data;
+	gint i;
+
+	for (i = 0; i < BENCH_SIM_COMPARES; i++) image_sim_compare(bs->a, bs->b);
+
+	return TRUE;
+}
+
+static void bench_similarity(BenchData *bd)
+{
+	BenchSim bs;
+	GdkPixbuf *flipped;
+	gchar *path;
+
+	path = bench_path(bd, "image.jpg");
+	bs.pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+	g_free(path);
+	if (!bs.pixbuf)
+		{
+		bench_print_status(bd, "similarity", "fill", "error", "failed");
+		bd->failed++;
+		return;
+		}
+
+	bench_run(bd, "similarity", "fill", 1, 0, bench_sim_fill_cb, &bs);
+
+	flipped = gdk_pixbuf_flip(bs.pixbuf, TRUE);
+	bs.a = image_sim_new_from_pixbuf(bs.pixbuf);
+	bs.b = image_sim_new_from_pixbuf(flipped);
+	bench_run(bd, "similarity", "compare", BENCH_SIM_COMPARES, 0, bench_sim_compare_cb, &bs);
+
+	image_sim_free(bs.a);
+	image_sim_free(bs.b);
+	g_object_unref(flipped);
+	g_object_unref(bs.pixbuf);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * md5
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean bench_md5_cb(gpointer data)
+{
+	guchar digest[16];
+
+	return md5_get_digest_from_file(data, digest);
+}
+
+static void bench_md5(BenchData *bd)
+{
+	gchar *path = bench_path(bd, "random.bin");
+
+	bench_run(bd, "md5", "16 MiB", 1, BENCH_RANDOM_SIZE, bench_md5_cb, path);
+	g_free(path);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * folder reading
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean bench_filelist_folder_cb(gpointer data)
+{
+	FileData *dir_fd;
+	GList *files = NULL;
+	GList *dirs = NULL;
+	gboolean ret;
+
+	dir_fd = file_data_new_dir(data);
+	ret = filelist_read(dir_fd, &files, &dirs);
+	ret = ret && files;
+	filelist_free(files);
+	filelist_free(dirs);
+	file_data_unref(dir_fd);
+
+	return ret;
+}
+
+static gboolean bench_filelist_tree_cb(gpointer data)
+{
+	FileData *dir_fd;
+	GList *files;
+	gboolean ret;
+
+	dir_fd = file_data_new_dir(data);
+	files = filelist_recursive(dir_fd);
+	ret = (files != NULL);
+	filelist_free(files);
+	file_data_unref(dir_fd);
+
+	return ret;
+}
+
+static void bench_filelist(BenchData *bd)
+{
+	gchar *folder = bench_path(bd, "tree" G_DIR_SEPARATOR_S "folder00");
+	gchar *tree = bench_path(bd, "tree");
+
+	bench_run(bd, "filelist", "folder", BENCH_TREE_FILES, 0, bench_filelist_folder_cb, folder);
+	bench_run(bd, "filelist", "tree", BENCH_TREE_FILES * BENCH_TREE_FOLDERS, 0, bench_filelist_tree_cb, tree);
+
+	g_free(tree);
+	g_free(folder);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * file cache
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct _BenchFileCache BenchFileCache;
+struct _BenchFileCache
+{
+	FileCacheData *fc;
+	GList *files;
+	guint count;
+};
+
+static void bench_file_cache_release_cb(FileData *fd)
+{
+}
+
+static gboolean bench_file_cache_cb(gpointer data)
+{
+	BenchFileCache *bfc = data;
+	GList *work;
+	gboolean ret = TRUE;
+
+	for (work = bfc->files; work; work = work->next)
+		{
+		if (!file_cache_get(bfc->fc, work->data)) ret = FALSE;
+		}
+
+	return ret;
+}
+
+static void bench_file_cache(BenchData *bd)
+{
+	BenchFileCache bfc;
+	FileData *dir_fd;
+	gchar *folder;
+	GList *work;
+
+	folder = bench_path(bd, "tree" G_DIR_SEPARATOR_S "folder00");
+	dir_fd = file_data_new_dir(folder);
+	g_free(folder);
+
+	bfc.files = NULL;
+	filelist_read(dir_fd, &bfc.files, NULL);
+	file_data_unref(dir_fd);
+
+	bfc.fc = file_cache_new(bench_file_cache_release_cb, G_MAXULONG);
+	for (work = bfc.files; work; work = work->next) file_cache_put(bfc.fc, work->data, 1);
+	bfc.count = g_list_length(bfc.files);
+
+	bench_run(bd, "file_cache", "get", bfc.count, 0, bench_file_cache_cb, &bfc);
+
+	/* there is no way to free a cache, empty it */
+	file_cache_set_max_size(bfc.fc, 0);
+	filelist_free(bfc.files);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * tile rendering
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct _BenchRender BenchRender;
+struct _BenchRender
+{
+	PixbufRenderer *pr;
+	GdkPixbuf *pixbuf;
+	gdouble zoom;
+};
+
+static gboolean bench_render_cb(gpointer data)
+{
+	BenchRender *br = data;
+
+	pixbuf_renderer_set_pixbuf(br->pr, br->pixbuf, br->zoom);
+	while (gtk_events_pending()) gtk_main_iteration();
+
+	return TRUE;
+}
+
+static void bench_render(BenchData *bd)
+{
+	/* zoom of the renderer: 0 fits, negative values reduce */
+	static const struct { gdouble zoom; const gchar *variant; } zooms[] = {
+		{ 0.0, "fit" }, { -4.0, "25%" }, { 1.0, "100%" }, { 2.0, "200%" }
+	};
+	BenchRender br;
+	GtkWidget *window;
+	gchar *path;
+	guint i;
+
+	if (!gtk_init_check(NULL, NULL))
+		{
+		bench_print_status(bd, "render", "", "skipped", "no display");
+		return;
+		}
+
+	path = bench_path(bd, "image.jpg");
+	br.pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+	g_free(path);
+	if (!br.pixbuf)
+		{
+		bench_print_status(bd, "render", "", "error", "failed");
+		bd->failed++;
+		return;
+		}
+
+	window = gtk_offscreen_window_new();
+	br.pr = pixbuf_renderer_new();
+	gtk_widget_set_size_request(GTK_WIDGET(br.pr), BENCH_VIEW_WIDTH, BENCH_VIEW_HEIGHT);
+	gtk_container_add(GTK_CONTAINER(window), GTK_WIDGET(br.pr));
+	gtk_widget_show_all(window);
+	while (gtk_events_pending()) gtk_main_iteration();
+
+	for (i = 0; i < G_N_ELEMENTS(zooms); i++)
+		{
+		br.zoom = zooms[i].zoom;
+		bench_run(bd, "render", zooms[i].variant, 1, 0, bench_render_cb, &br);
+		}
+
+	gtk_widget_destroy(window);
+	g_object_unref(br.pixbuf);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * exif, collection
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean bench_exif_cb(gpointer data)
+{
+	ExifData *exif;
+
+	exif = exif_read(data, NULL, NULL);
+	if (!exif) return FALSE;
+	exif_free(exif);
+
+	return TRUE;
+}
+
+static void bench_exif(BenchData *bd)
+{
+	gchar *path = bench_path(bd, "image.jpg");
+
+	bench_run(bd, "exif", "jpeg", 1, 0, bench_exif_cb, path);
+	g_free(path);
+}
+
+static gboolean bench_collection_cb(gpointer data)
+{
+	CollectionData *cd;
+	gboolean ret;
+
+	cd = collection_new(NULL);
+	ret = collection_load(cd, data, COLLECTION_LOAD_NONE);
+	ret = ret && cd->list;
+	collection_free(cd);
+
+	return ret;
+}
+
+static void bench_collection(BenchData *bd)
+{
+	gchar *path = bench_path(bd, "bench.gqv");
+
+	bench_run(bd, "collection", "load", BENCH_TREE_FOLDERS * BENCH_TREE_FILES * 3 / 5, 0, bench_collection_cb, path);
+	g_free(path);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * main
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean bench_parse_args(BenchData *bd, gint argc, gchar *argv[], gchar **output)
+{
+	GPtrArray *names = NULL;
+	gint i;
+
+	for (i = 0; i < argc; i++)
+		{
+		const gchar *arg = argv[i];
+
+		if (strncmp(arg, "--iterations=", 13) == 0)
+			{
+			bd->iterations = atoi(arg + 13);
+			}
+		else if (strncmp(arg, "--size=", 7) == 0)
+			{
+			bd->size = atoi(arg + 7);
+			}
+		else if (strncmp(arg, "--output=", 9) == 0)
+			{
+			g_free(*output);
+			*output = g_strdup(arg + 9);
+			}
+		else if (strcmp(arg, "--keep") == 0)
+			{
+			bd->keep = TRUE;
+			}
+		else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+			{
+			bench_help();
+			return FALSE;
+			}
+		else if (strncmp(arg, "--debug", 7) == 0)
+			{
+			/* already handled in main() */
+			}
+		else if (arg[0] != '-' && g_strv_contains(bench_names, arg))
+			{
+			if (!names) names = g_ptr_array_new();
+			g_ptr_array_add(names, g_strdup(arg));
+			}
+		else
+			{
+			printf_term(TRUE, _("Invalid option: %s\n"), arg);
+			bench_help();
+			if (names) g_ptr_array_free(names, TRUE);
+			return FALSE;
+			}
+		}
+
+	if (names)
+		{
+		g_ptr_array_add(names, NULL);
+		bd->names = (gchar **)g_ptr_array_free(names, FALSE);
+		}
+
+	if (bd->iterations <= 0) bd->iterations = BENCH_ITERATIONS_DEFAULT;
+	if (bd->size < 64) bd->size = BENCH_SIZE_DEFAULT;
+
+	return TRUE;
+}
+
+/**
+ * \brief Runs the benchmarks selected in \a argv
+ * \returns The exit status
+ *
+ * Called by main() instead of starting the GUI, with the arguments
+ * following --bench.
+ */
+gint bench_main(gint argc, gchar *argv[])
+{
+	BenchData *bd;
+	gchar *output = NULL;
+	gint ret;
+
+	batch_mode = TRUE;
+
+	/* the defaults, so that results do not depend on the configuration */
+	options = init_options(NULL);
+	setup_default_options(options);
+	filter_add_defaults();
+	filter_rebuild();
+
+	bd = g_new0(BenchData, 1);
+	if (!bench_parse_args(bd, argc, argv, &output))
+		{
+		g_free(output);
+		g_free(bd);
+		return 1;
+		}
+
+	bd->out = output ? g_fopen(output, "w") : stdout;
+	if (!bd->out)
+		{
+		printf_term(TRUE, _("Can not write to %s\n"), output);
+		g_free(output);
+		g_strfreev(bd->names);
+		g_free(bd);
+		return 1;
+		}
+
+	if (!bench_fixtures(bd))
+		{
+		ret = 1;
+		}
+	else
+		{
+		fprintf(bd->out, "{\"geeqie\":\"%s\",\"glib\":\"%u.%u.%u\",\"processors\":%u,\"iterations\":%d,\"size\":%d}\n",
+			VERSION, glib_major_version, glib_minor_version, glib_micro_version,
+			g_get_num_processors(), bd->iterations, bd->size);
+
+		bd->loop = g_main_loop_new(NULL, FALSE);
+
+		if (bench_enabled(bd, "decode")) bench_decode(bd);
+		if (bench_enabled(bd, "thumbnail")) bench_thumbnail(bd);
+		if (bench_enabled(bd, "similarity")) bench_similarity(bd);
+		if (bench_enabled(bd, "md5")) bench_md5(bd);
+		if (bench_enabled(bd, "filelist")) bench_filelist(bd);
+		if (bench_enabled(bd, "file_cache")) bench_file_cache(bd);
+		if (bench_enabled(bd, "render")) bench_render(bd);
+		if (bench_enabled(bd, "exif")) bench_exif(bd);
+		if (bench_enabled(bd, "collection")) bench_collection(bd);
+
+		g_main_loop_unref(bd->loop);
+
+		ret = (bd->failed > 0) ? 2 : 0;
+		}
+
+	if (bd->dir)
+		{
+		if (bd->keep)
+			printf_term(FALSE, _("The generated files are in %s\n"), bd->dir);
+		else
+			bench_remove_tree(bd->dir);
+		}
+
+	if (bd->out != stdout) fclose(bd->out);
+	g_free(bd->dir);
+	g_strfreev(bd->names);
+	g_free(output);
+	g_free(bd);
+
+	return ret;
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
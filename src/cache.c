@@ -768,4 +768,40 @@ const gchar *get_metadata_cache_dir(void)
 	return metadata_cache_dir;
 }
 
+const gchar *get_color_cache_dir(void)
+{
+	static gchar *color_cache_dir = NULL;
+
+	if (color_cache_dir) return color_cache_dir;
+
+	if (USE_XDG)
+		{
+		color_cache_dir = g_build_filename(xdg_cache_home_get(), GQ_APPNAME_LC, GQ_CACHE_COLOR, NULL);
+		}
+	else
+		{
+		color_cache_dir = g_build_filename(get_rc_dir(), GQ_CACHE_COLOR, NULL);
+		}
+
+	return color_cache_dir;
+}
+
+const gchar *get_thumbnails_pack_dir(void)
+{
+	static gchar *thumbnails_pack_dir = NULL;
+
+	if (thumbnails_pack_dir) return thumbnails_pack_dir;
+
+	if (USE_XDG)
+		{
+		thumbnails_pack_dir = g_build_filename(xdg_cache_home_get(), GQ_APPNAME_LC, GQ_CACHE_THUMB_PACK, NULL);
+		}
+	else
+		{
+		thumbnails_pack_dir = g_build_filename(get_rc_dir(), GQ_CACHE_THUMB_PACK, NULL);
+		}
+
+	return thumbnails_pack_dir;
+}
+
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
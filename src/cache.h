@@ -28,6 +28,8 @@
 
 #define GQ_CACHE_THUMB		"thumbnails"
 #define GQ_CACHE_METADATA    	"metadata"
+#define GQ_CACHE_COLOR		"color"
+#define GQ_CACHE_THUMB_PACK	"thumbnails-pack"
 
 #define GQ_CACHE_LOCAL_THUMB    ".thumbnails"
 #define GQ_CACHE_LOCAL_METADATA ".metadata"
@@ -82,6 +84,8 @@ gchar *cache_find_location(CacheType type, const gchar *source);
 const gchar *get_thumbnails_cache_dir(void);
 const gchar *get_thumbnails_standard_cache_dir(void);
 const gchar *get_metadata_cache_dir(void);
+const gchar *get_color_cache_dir(void);
+const gchar *get_thumbnails_pack_dir(void);
 
 #endif
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
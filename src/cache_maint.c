@@ -26,6 +26,7 @@
 #include "filedata.h"
 #include "layout.h"
 #include "thumb.h"
+#include "thumb_pack.h"
 #include "thumb_standard.h"
 #include "ui_fileops.h"
 #include "ui_misc.h"
@@ -34,13 +35,43 @@
 #include "ui_utildlg.h"
 #include "window.h"
 
+#include <errno.h>
+
+
+typedef struct _CacheClean CacheClean;
+typedef void (*CacheCleanDoneFunc)(CacheClean *cc, gpointer data);
+
+struct _CacheClean
+{
+	gboolean shared;	/* the shared thumbnail cache, else a Geeqie cache folder */
+	gboolean clear;
+	gint days;
+	gsize base_len;		/* length of the cache folder, the rest mirrors the source path */
+
+	/* updated from the worker threads */
+	gint jobs;
+	gint checked;
+	gint removed;
+	gint failed;
+	gint total;
+	gint abort;
+
+#ifdef HAVE_GTHREAD
+	GThreadPool *pool;
+#else
+	GQueue queue;
+	guint idle_id; /* event source id */
+#endif
+
+	CacheCleanDoneFunc func_done;
+	gpointer data;
+};
 
 typedef struct _CMData CMData;
 struct _CMData
 {
-	GList *list;
-	GList *done_list;
-	guint idle_id; /* event source id */
+	CacheClean *cc;
+	guint update_id; /* event source id */
 	GenericDialog *gd;
 	GtkWidget *entry;
 	GtkWidget *spinner;
@@ -56,207 +87,508 @@ struct _CMData
 
 /*
  *-------------------------------------------------------------------
- * cache maintenance
+ * parallel cache cleaning
  *-------------------------------------------------------------------
  */
 
-static gchar *extension_find_dot(gchar *path)
+/* files of the shared cache validated by one job */
+#define CACHE_CLEAN_BATCH 256
+
+/* the work mostly waits for the disk, more threads than cores help */
+#define CACHE_CLEAN_THREADS_MIN 4
+
+typedef struct _CacheCleanDir CacheCleanDir;
+struct _CacheCleanDir
 {
-	gchar *dot = NULL;
+	gchar *path;		/* locale encoded */
+	CacheCleanDir *parent;	/* NULL for a top folder, which is never removed */
+	gint pending;		/* this folder and its subfolders not yet done */
+};
+
+typedef struct _CacheCleanJob CacheCleanJob;
+struct _CacheCleanJob
+{
+	CacheCleanDir *dir;	/* folder to read */
+	GPtrArray *files;	/* or files of the shared cache to validate */
+};
+
+static const gchar *cache_clean_extensions[] = {
+	GQ_CACHE_EXT_XMP_METADATA,
+	GQ_CACHE_EXT_METADATA,
+	GQ_CACHE_EXT_SIM,
+	GQ_CACHE_EXT_THUMB,
+	NULL
+};
+
+static gboolean cache_clean_done_cb(gpointer data)
+{
+	CacheClean *cc = data;
 
-	if (!path) return NULL;
+	if (cc->func_done) cc->func_done(cc, cc->data);
 
-	while (*path != '\0')
+#ifdef HAVE_GTHREAD
+	g_thread_pool_free(cc->pool, TRUE, FALSE);
+#else
+	if (cc->idle_id) g_source_remove(cc->idle_id);
+#endif
+	g_free(cc);
+
+	return FALSE;
+}
+
+static void cache_clean_job_done(CacheClean *cc)
+{
+	if (g_atomic_int_dec_and_test(&cc->jobs))
 		{
-		if (*path == '.') dot = path;
-		path++;
+		g_idle_add(cache_clean_done_cb, cc);
 		}
+}
 
-	return dot;
+static void cache_clean_push(CacheClean *cc, CacheCleanDir *dir, GPtrArray *files)
+{
+	CacheCleanJob *job;
+
+	job = g_new0(CacheCleanJob, 1);
+	job->dir = dir;
+	job->files = files;
+
+	g_atomic_int_inc(&cc->jobs);
+#ifdef HAVE_GTHREAD
+	g_thread_pool_push(cc->pool, job, NULL);
+#else
+	g_queue_push_tail(&cc->queue, job);
+#endif
 }
 
-static gboolean isempty(const gchar *path)
+static void cache_clean_push_dir(CacheClean *cc, CacheCleanDir *parent, gchar *path)
 {
-	DIR *dp;
-	struct dirent *dir;
-	gchar *pathl;
+	CacheCleanDir *dir;
 
-	pathl = path_from_utf8(path);
-	dp = opendir(pathl);
-	g_free(pathl);
-	if (!dp) return FALSE;
+	dir = g_new0(CacheCleanDir, 1);
+	dir->path = path;
+	dir->parent = parent;
+	dir->pending = 1;
+	if (parent) g_atomic_int_inc(&parent->pending);
 
-	while ((dir = readdir(dp)) != NULL)
+	cache_clean_push(cc, dir, NULL);
+}
+
+static void cache_clean_dir_done(CacheClean *cc, CacheCleanDir *dir)
+{
+	while (dir && g_atomic_int_dec_and_test(&dir->pending))
 		{
-		gchar *name = dir->d_name;
+		CacheCleanDir *parent = dir->parent;
 
-		if (!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) )
-			{
-			closedir(dp);
-			return FALSE;
-			}
-		}
+		/* fails unless the folder is empty, which is all we want */
+		if (parent && !g_atomic_int_get(&cc->abort)) rmdir(dir->path);
 
-	closedir(dp);
-	return TRUE;
+		g_free(dir->path);
+		g_free(dir);
+		dir = parent;
+		}
 }
 
-static void cache_maintain_home_close(CMData *cm)
+static void cache_clean_remove(CacheClean *cc, const gchar *path)
 {
-	if (cm->idle_id) g_source_remove(cm->idle_id);
-	if (cm->gd) generic_dialog_close(cm->gd);
-	filelist_free(cm->list);
-	g_list_free(cm->done_list);
-	g_free(cm);
+	if (unlink(path) == 0)
+		{
+		g_atomic_int_inc(&cc->removed);
+		}
+	else
+		{
+		g_atomic_int_inc(&cc->failed);
+		}
 }
 
-static void cache_maintain_home_stop(CMData *cm)
+/* the name of the source file of a file of the Geeqie cache */
+static gchar *cache_clean_source_name(const gchar *name)
 {
-	if (cm->idle_id)
+	gsize len = strlen(name);
+	const gchar *dot;
+	gint i;
+
+	for (i = 0; cache_clean_extensions[i]; i++)
 		{
-		g_source_remove(cm->idle_id);
-		cm->idle_id = 0;
+		gsize ext_len = strlen(cache_clean_extensions[i]);
+
+		if (len > ext_len && strcmp(name + len - ext_len, cache_clean_extensions[i]) == 0)
+			{
+			return g_strndup(name, len - ext_len);
+			}
 		}
 
-	if (!cm->remote)
+	dot = strrchr(name, '.');
+	return dot ? g_strndup(name, dot - name) : g_strdup(name);
+}
+
+/**
+ * \brief Reads the names in a folder into a set, one readdir instead of a stat per file.
+ *
+ * Returns NULL if the folder exists but can not be read.
+ */
+static GHashTable *cache_clean_read_names(const gchar *path)
+{
+	GHashTable *names;
+	struct dirent *entry;
+	DIR *dp;
+
+	names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	dp = opendir(path);
+	if (!dp)
 		{
-		gtk_entry_set_text(GTK_ENTRY(cm->entry), _("done"));
-		spinner_set_interval(cm->spinner, -1);
+		if (errno == ENOENT || errno == ENOTDIR) return names;
 
-		gtk_widget_set_sensitive(cm->button_stop, FALSE);
-		gtk_widget_set_sensitive(cm->button_close, TRUE);
+		g_hash_table_destroy(names);
+		return NULL;
 		}
+
+	while ((entry = readdir(dp)) != NULL)
+		{
+		g_hash_table_add(names, g_strdup(entry->d_name));
+		}
+	closedir(dp);
+
+	return names;
 }
 
-static gboolean cache_maintain_home_cb(gpointer data)
+static gboolean cache_clean_is_dir(const gchar *path, struct dirent *entry)
 {
-	CMData *cm = data;
-	GList *dlist = NULL;
-	GList *list = NULL;
-	FileData *fd;
-	gboolean just_done = FALSE;
-	gboolean still_have_a_file = TRUE;
-	gsize base_length;
-	const gchar *cache_folder;
-	gboolean filter_disable;
+	struct stat st;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (entry->d_type != DT_UNKNOWN) return (entry->d_type == DT_DIR);
+#endif
 
-	if (cm->metadata)
+	return (lstat(path, &st) == 0 && S_ISDIR(st.st_mode));
+}
+
+/* a folder of the Geeqie cache, mirroring the source folder */
+static void cache_clean_home_dir(CacheClean *cc, CacheCleanDir *dir)
+{
+	GPtrArray *files;
+	GHashTable *sources = NULL;
+	struct dirent *entry;
+	DIR *dp;
+	guint i;
+
+	dp = opendir(dir->path);
+	if (!dp) return;
+
+	files = g_ptr_array_new_with_free_func(g_free);
+	while ((entry = readdir(dp)) != NULL)
 		{
-		cache_folder = get_metadata_cache_dir();
+		const gchar *name = entry->d_name;
+		gchar *path;
+
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		path = g_build_filename(dir->path, name, NULL);
+		if (cache_clean_is_dir(path, entry))
+			{
+			cache_clean_push_dir(cc, dir, path);
+			}
+		else
+			{
+			g_ptr_array_add(files, path);
+			}
 		}
-	else
+	closedir(dp);
+
+	if (!cc->clear && files->len > 0)
 		{
-		cache_folder = get_thumbnails_cache_dir();
-		}
+		const gchar *source_dir = dir->path + cc->base_len;
 
-	base_length = strlen(cache_folder);
+		sources = cache_clean_read_names(source_dir[0] ? source_dir : G_DIR_SEPARATOR_S);
+		if (!sources)
+			{
+			/* unreadable source folder, keep everything */
+			g_atomic_int_add(&cc->checked, files->len);
+			g_ptr_array_free(files, TRUE);
+			return;
+			}
+		}
 
-	if (!cm->list)
+	for (i = 0; i < files->len && !g_atomic_int_get(&cc->abort); i++)
 		{
-		DEBUG_1("purge chk done.");
-		cm->idle_id = 0;
-		cache_maintain_home_stop(cm);
-		return FALSE;
+		const gchar *path = files->pdata[i];
+		gboolean remove = cc->clear;
+
+		if (!remove)
+			{
+			gchar *source;
+
+			source = cache_clean_source_name(path + strlen(dir->path) + 1);
+			remove = !g_hash_table_contains(sources, source);
+			g_free(source);
+			}
+
+		if (remove) cache_clean_remove(cc, path);
+		g_atomic_int_inc(&cc->checked);
 		}
 
-	fd = cm->list->data;
+	if (sources) g_hash_table_destroy(sources);
+	g_ptr_array_free(files, TRUE);
+}
 
-	DEBUG_1("purge chk (%d) \"%s\"", (cm->clear && !cm->metadata), fd->path);
+/* a folder of the shared cache, split into batches */
+static void cache_clean_shared_dir(CacheClean *cc, CacheCleanDir *dir)
+{
+	GPtrArray *batch = NULL;
+	struct dirent *entry;
+	DIR *dp;
 
-/**
- * It is necessary to disable the file filter when clearing the cache,
- * otherwise the .sim (file similarity) files are not deleted.
- */
-	filter_disable = options->file_filter.disable;
-	options->file_filter.disable = TRUE;
+	dp = opendir(dir->path);
+	if (!dp) return;
 
-	if (g_list_find(cm->done_list, fd) == NULL)
+	while ((entry = readdir(dp)) != NULL && !g_atomic_int_get(&cc->abort))
 		{
-		cm->done_list = g_list_prepend(cm->done_list, fd);
+		const gchar *name = entry->d_name;
+		gchar *path;
 
-		if (filelist_read(fd, &list, &dlist))
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		path = g_build_filename(dir->path, name, NULL);
+		if (cache_clean_is_dir(path, entry))
 			{
-			GList *work;
+			g_free(path);
+			continue;
+			}
 
-			just_done = TRUE;
-			still_have_a_file = FALSE;
+		if (!batch) batch = g_ptr_array_new_with_free_func(g_free);
+		g_ptr_array_add(batch, path);
 
-			work = list;
-			while (work)
-				{
-				FileData *fd_list = work->data;
-				gchar *path_buf = g_strdup(fd_list->path);
-				gchar *dot;
-
-				dot = extension_find_dot(path_buf);
-
-				if (dot) *dot = '\0';
-				if ((!cm->metadata && cm->clear) ||
-				    (strlen(path_buf) > base_length && !isfile(path_buf + base_length)) )
-					{
-					if (dot) *dot = '.';
-					if (!unlink_file(path_buf)) log_printf("failed to delete:%s\n", path_buf);
-					}
-				else
-					{
-					still_have_a_file = TRUE;
-					}
-				g_free(path_buf);
-				work = work->next;
-				}
+		if (batch->len == CACHE_CLEAN_BATCH)
+			{
+			g_atomic_int_add(&cc->total, batch->len);
+			cache_clean_push(cc, NULL, batch);
+			batch = NULL;
 			}
 		}
-	options->file_filter.disable = filter_disable;
+	closedir(dp);
 
-	filelist_free(list);
+	if (batch)
+		{
+		g_atomic_int_add(&cc->total, batch->len);
+		cache_clean_push(cc, NULL, batch);
+		}
+}
 
-	cm->list = g_list_concat(dlist, cm->list);
+static void cache_clean_shared_files(CacheClean *cc, GPtrArray *files)
+{
+	guint i;
 
-	if (cm->list && g_list_find(cm->done_list, cm->list->data) != NULL)
+	for (i = 0; i < files->len && !g_atomic_int_get(&cc->abort); i++)
 		{
-		/* check if the dir is empty */
+		const gchar *path = files->pdata[i];
 
-		if (cm->list->data == fd && just_done)
+		if (cc->clear || !thumb_std_thumb_file_check(path, cc->days))
 			{
-			if (!still_have_a_file && !dlist && cm->list->next && !rmdir_utf8(fd->path))
-				{
-				log_printf("Unable to delete dir: %s\n", fd->path);
-				}
+			cache_clean_remove(cc, path);
+			}
+		g_atomic_int_inc(&cc->checked);
+		}
+}
+
+static void cache_clean_job_run(CacheClean *cc, CacheCleanJob *job)
+{
+	if (!g_atomic_int_get(&cc->abort))
+		{
+		if (job->files)
+			{
+			cache_clean_shared_files(cc, job->files);
+			}
+		else if (cc->shared)
+			{
+			cache_clean_shared_dir(cc, job->dir);
 			}
 		else
 			{
-			/* must re-check for an empty dir */
-			if (isempty(fd->path) && cm->list->next && !rmdir_utf8(fd->path))
-				{
-				log_printf("Unable to delete dir: %s\n", fd->path);
-				}
+			cache_clean_home_dir(cc, job->dir);
 			}
+		}
 
-		fd = cm->list->data;
-		cm->done_list = g_list_remove(cm->done_list, fd);
-		cm->list = g_list_remove(cm->list, fd);
-		file_data_unref(fd);
+	if (job->dir) cache_clean_dir_done(cc, job->dir);
+	if (job->files) g_ptr_array_free(job->files, TRUE);
+	g_free(job);
+
+	cache_clean_job_done(cc);
+}
+
+#ifdef HAVE_GTHREAD
+static void cache_clean_thread_cb(gpointer data, gpointer user_data)
+{
+	cache_clean_job_run(user_data, data);
+}
+#else
+static gboolean cache_clean_idle_cb(gpointer data)
+{
+	CacheClean *cc = data;
+	CacheCleanJob *job;
+
+	job = g_queue_pop_head(&cc->queue);
+	if (!job)
+		{
+		cc->idle_id = 0;
+		return FALSE;
 		}
 
-	if (cm->list && !cm->remote)
+	cache_clean_job_run(cc, job);
+	return TRUE;
+}
+#endif
+
+/**
+ * \brief Cleans or clears a cache, the folders are processed in parallel
+ * \param shared The shared thumbnail cache, otherwise the Geeqie cache in \a folder
+ * \param folder The Geeqie thumbnail or metadata cache
+ * \param clear Remove all files, otherwise only orphaned or outdated ones
+ * \param func_done Called in the main thread when done, the CacheClean is freed after it returns
+ */
+static CacheClean *cache_clean_start(gboolean shared, const gchar *folder, gboolean clear, gint days,
+				     CacheCleanDoneFunc func_done, gpointer data)
+{
+	CacheClean *cc;
+
+	cc = g_new0(CacheClean, 1);
+	cc->shared = shared;
+	cc->clear = clear;
+	cc->days = days;
+	cc->func_done = func_done;
+	cc->data = data;
+
+	/* held until all the top folders are queued */
+	cc->jobs = 1;
+
+#ifdef HAVE_GTHREAD
+	cc->pool = g_thread_pool_new(cache_clean_thread_cb, cc,
+				     MAX(g_get_num_processors(), CACHE_CLEAN_THREADS_MIN), FALSE, NULL);
+#else
+	cc->idle_id = g_idle_add(cache_clean_idle_cb, cc);
+#endif
+
+	if (shared)
 		{
-		const gchar *buf;
+		const gchar *subfolders[] = { THUMB_FOLDER_NORMAL, THUMB_FOLDER_LARGE, THUMB_FOLDER_FAIL, NULL };
+		gint i;
 
-		fd = cm->list->data;
-		if (strlen(fd->path) > base_length)
+		for (i = 0; subfolders[i]; i++)
 			{
-			buf = fd->path + base_length;
-			}
-		else
-			{
-			buf = "...";
+			gchar *path = g_build_filename(get_thumbnails_standard_cache_dir(), subfolders[i], NULL);
+
+			cache_clean_push_dir(cc, NULL, path_from_utf8(path));
+			g_free(path);
 			}
-		gtk_entry_set_text(GTK_ENTRY(cm->entry), buf);
 		}
+	else
+		{
+		gchar *path = path_from_utf8(folder);
+
+		cc->base_len = strlen(path);
+		cache_clean_push_dir(cc, NULL, path);
+		}
+
+	cache_clean_job_done(cc);
+
+	return cc;
+}
+
+/* the CacheClean is freed when the running jobs are done, func_done is not called */
+static void cache_clean_stop(CacheClean *cc)
+{
+	if (!cc) return;
+
+	g_atomic_int_set(&cc->abort, TRUE);
+	cc->func_done = NULL;
+}
+
+static gchar *cache_clean_get_status(CacheClean *cc)
+{
+	gint checked = g_atomic_int_get(&cc->checked);
+	gint removed = g_atomic_int_get(&cc->removed);
+
+	return g_strdup_printf(_("%d checked, %d removed"), checked, removed);
+}
+
+static gint cache_maintain_remote_running = 0;
+
+static void cache_clean_remote_done_cb(CacheClean *cc, gpointer data)
+{
+	const gchar *name = data;
+
+	log_printf(_("%s: %d files checked, %d removed, %d could not be removed\n"), name,
+		   g_atomic_int_get(&cc->checked), g_atomic_int_get(&cc->removed), g_atomic_int_get(&cc->failed));
+
+	cache_maintain_remote_running--;
+}
+
+/**
+ * \brief TRUE while cache maintenance started by a remote command runs
+ */
+gboolean cache_maintain_remote_busy(void)
+{
+	return (cache_maintain_remote_running > 0);
+}
+
+
+/*
+ *-------------------------------------------------------------------
+ * cache maintenance
+ *-------------------------------------------------------------------
+ */
+
+static void cache_maintain_home_close(CMData *cm)
+{
+	if (cm->update_id) g_source_remove(cm->update_id);
+	cache_clean_stop(cm->cc);
+	if (cm->gd) generic_dialog_close(cm->gd);
+	g_free(cm);
+}
+
+static void cache_maintain_home_stop(CMData *cm)
+{
+	if (cm->update_id)
+		{
+		g_source_remove(cm->update_id);
+		cm->update_id = 0;
+		}
+
+	cache_clean_stop(cm->cc);
+	cm->cc = NULL;
+
+	gtk_entry_set_text(GTK_ENTRY(cm->entry), _("done"));
+	spinner_set_interval(cm->spinner, -1);
+
+	gtk_widget_set_sensitive(cm->button_stop, FALSE);
+	gtk_widget_set_sensitive(cm->button_close, TRUE);
+}
+
+static gboolean cache_maintain_home_update_cb(gpointer data)
+{
+	CMData *cm = data;
+	gchar *buf;
+
+	buf = cache_clean_get_status(cm->cc);
+	gtk_entry_set_text(GTK_ENTRY(cm->entry), buf);
+	g_free(buf);
 
 	return TRUE;
 }
 
+static void cache_maintain_home_done_cb(CacheClean *cc, gpointer data)
+{
+	CMData *cm = data;
+	gchar *buf;
+
+	DEBUG_1("purge chk done.");
+
+	buf = cache_clean_get_status(cc);
+	cm->cc = NULL;
+	cache_maintain_home_stop(cm);
+	gtk_entry_set_text(GTK_ENTRY(cm->entry), buf);
+	g_free(buf);
+}
+
 static void cache_maintain_home_close_cb(GenericDialog *gd, gpointer data)
 {
 	CMData *cm = data;
@@ -266,6 +598,46 @@ static void cache_maintain_home_close_cb(GenericDialog *gd, gpointer data)
 	cache_maintain_home_close(cm);
 }
 
+/* color tables not used for this long are removed on clean up */
+#define CACHE_COLOR_DAYS 30
+
+/* the color tables are few and small, they are removed in the main thread */
+static void cache_maintain_color(gboolean clear)
+{
+	gchar *pathl;
+	struct dirent *entry;
+	DIR *dp;
+	time_t limit;
+
+	pathl = path_from_utf8(get_color_cache_dir());
+	dp = opendir(pathl);
+	if (!dp)
+		{
+		g_free(pathl);
+		return;
+		}
+
+	limit = time(NULL) - (time_t)CACHE_COLOR_DAYS * 24 * 60 * 60;
+	while ((entry = readdir(dp)) != NULL)
+		{
+		const gchar *name = entry->d_name;
+		gchar *path;
+		struct stat st;
+
+		if (name[0] == '.') continue;
+
+		path = g_build_filename(pathl, name, NULL);
+		if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+		    (clear || st.st_mtime < limit) && unlink(path) != 0)
+			{
+			DEBUG_1("Failed to remove color table %s", path);
+			}
+		g_free(path);
+		}
+	closedir(dp);
+	g_free(pathl);
+}
+
 static void cache_maintain_home_stop_cb(GenericDialog *gd, gpointer data)
 {
 	CMData *cm = data;
@@ -273,12 +645,9 @@ static void cache_maintain_home_stop_cb(GenericDialog *gd, gpointer data)
 	cache_maintain_home_stop(cm);
 }
 
-/* sorry for complexity (cm->done_list), but need it to remove empty dirs */
 void cache_maintain_home(gboolean metadata, gboolean clear, GtkWidget *parent)
 {
 	CMData *cm;
-	GList *dlist;
-	FileData *dir_fd;
 	const gchar *msg;
 	const gchar *cache_folder;
 	GtkWidget *hbox;
@@ -290,20 +659,12 @@ void cache_maintain_home(gboolean metadata, gboolean clear, GtkWidget *parent)
 	else
 		{
 		cache_folder = get_thumbnails_cache_dir();
+		cache_maintain_color(clear);
 		}
 
-	dir_fd = file_data_new_dir(cache_folder);
-	if (!filelist_read(dir_fd, NULL, &dlist))
-		{
-		file_data_unref(dir_fd);
-		return;
-		}
-
-	dlist = g_list_append(dlist, dir_fd);
+	if (!isdir(cache_folder)) return;
 
 	cm = g_new0(CMData, 1);
-	cm->list = dlist;
-	cm->done_list = NULL;
 	cm->clear = clear;
 	cm->metadata = metadata;
 	cm->remote = FALSE;
@@ -351,14 +712,13 @@ void cache_maintain_home(gboolean metadata, gboolean clear, GtkWidget *parent)
 
 	gtk_widget_show(cm->gd->dialog);
 
-	cm->idle_id = g_idle_add(cache_maintain_home_cb, cm);
+	cm->cc = cache_clean_start(FALSE, cache_folder, clear && !metadata, 0,
+				   cache_maintain_home_done_cb, cm);
+	cm->update_id = g_timeout_add(200, cache_maintain_home_update_cb, cm);
 }
 
 void cache_maintain_home_remote(gboolean metadata, gboolean clear)
 {
-	CMData *cm;
-	GList *dlist;
-	FileData *dir_fd;
 	const gchar *cache_folder;
 
 	if (metadata)
@@ -368,25 +728,14 @@ void cache_maintain_home_remote(gboolean metadata, gboolean clear)
 	else
 		{
 		cache_folder = get_thumbnails_cache_dir();
+		cache_maintain_color(clear);
 		}
 
-	dir_fd = file_data_new_dir(cache_folder);
-	if (!filelist_read(dir_fd, NULL, &dlist))
-		{
-		file_data_unref(dir_fd);
-		return;
-		}
-
-	dlist = g_list_append(dlist, dir_fd);
+	if (!isdir(cache_folder)) return;
 
-	cm = g_new0(CMData, 1);
-	cm->list = dlist;
-	cm->done_list = NULL;
-	cm->clear = clear;
-	cm->metadata = metadata;
-	cm->remote = TRUE;
-
-	cm->idle_id = g_idle_add(cache_maintain_home_cb, cm);
+	cache_maintain_remote_running++;
+	cache_clean_start(FALSE, cache_folder, clear && !metadata, 0,
+			  cache_clean_remote_done_cb, (gpointer)cache_folder);
 }
 
 static void cache_file_move(const gchar *src, const gchar *dest)
@@ -579,6 +928,9 @@ struct _CleanData
 	gboolean remote;
 
 	guint idle_id; /* event source id */
+
+	CacheClean *cc;		/* standard cache cleaning */
+	guint update_id;	/* event source id */
 };
 
 static void cache_manager_render_reset(CleanData *cd)
@@ -864,32 +1216,27 @@ static void cache_manager_standard_clean_close_cb(GenericDialog *gd, gpointer da
 
 	generic_dialog_close(cd->gd);
 
-	thumb_loader_std_thumb_file_validate_cancel(cd->tl);
-	filelist_free(cd->list);
+	if (cd->update_id) g_source_remove(cd->update_id);
+	cache_clean_stop(cd->cc);
 	g_free(cd);
 }
 
 static void cache_manager_standard_clean_done(CleanData *cd)
 {
-	if (!cd->remote)
-		{
-		gtk_widget_set_sensitive(cd->button_stop, FALSE);
-		gtk_widget_set_sensitive(cd->button_close, TRUE);
+	gtk_widget_set_sensitive(cd->button_stop, FALSE);
+	gtk_widget_set_sensitive(cd->button_close, TRUE);
 
-		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(cd->progress), 1.0);
-		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(cd->progress), _("done"));
-		}
-	if (cd->idle_id)
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(cd->progress), 1.0);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(cd->progress), _("done"));
+
+	if (cd->update_id)
 		{
-		g_source_remove(cd->idle_id);
-		cd->idle_id = 0;
+		g_source_remove(cd->update_id);
+		cd->update_id = 0;
 		}
 
-	thumb_loader_std_thumb_file_validate_cancel(cd->tl);
-	cd->tl = NULL;
-
-	filelist_free(cd->list);
-	cd->list = NULL;
+	cache_clean_stop(cd->cc);
+	cd->cc = NULL;
 }
 
 static void cache_manager_standard_clean_stop_cb(GenericDialog *gd, gpointer data)
@@ -899,137 +1246,46 @@ static void cache_manager_standard_clean_stop_cb(GenericDialog *gd, gpointer dat
 	cache_manager_standard_clean_done(cd);
 }
 
-static gint cache_manager_standard_clean_clear_cb(gpointer data)
+static gboolean cache_manager_standard_clean_update_cb(gpointer data)
 {
 	CleanData *cd = data;
+	gint total = g_atomic_int_get(&cd->cc->total);
 
-	if (cd->list)
+	if (total != 0)
 		{
-		FileData *next_fd;
-
-		next_fd = cd->list->data;
-		cd->list = g_list_remove(cd->list, next_fd);
-
-		DEBUG_1("thumb removed: %s", next_fd->path);
-
-		unlink_file(next_fd->path);
-		file_data_unref(next_fd);
-
-		cd->count_done++;
-		if (!cd->remote)
-			{
-			if (cd->count_total != 0)
-				{
-				gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(cd->progress),
-							      (gdouble)cd->count_done / cd->count_total);
-				}
-			}
-
-		return TRUE;
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(cd->progress),
+					      (gdouble)g_atomic_int_get(&cd->cc->checked) / total);
 		}
 
-	cd->idle_id = 0;
-	cache_manager_standard_clean_done(cd);
-	return FALSE;
+	return TRUE;
 }
 
-static void cache_manager_standard_clean_valid_cb(const gchar *path, gboolean valid, gpointer data)
+static void cache_manager_standard_clean_done_cb(CacheClean *cc, gpointer data)
 {
 	CleanData *cd = data;
 
-	if (path)
-		{
-		if (!valid)
-			{
-			DEBUG_1("thumb cleaned: %s", path);
-			unlink_file(path);
-			}
+	DEBUG_1("thumbs cleaned: %d checked, %d removed",
+		g_atomic_int_get(&cc->checked), g_atomic_int_get(&cc->removed));
 
-		cd->count_done++;
-		if (!cd->remote)
-			{
-			if (cd->count_total != 0)
-				{
-				gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(cd->progress),
-							      (gdouble)cd->count_done / cd->count_total);
-				}
-			}
-		}
-
-	cd->tl = NULL;
-	if (cd->list)
-		{
-		FileData *next_fd;
-
-		next_fd = cd->list->data;
-		cd->list = g_list_remove(cd->list, next_fd);
-
-		cd->tl = thumb_loader_std_thumb_file_validate(next_fd->path, cd->days,
-							      cache_manager_standard_clean_valid_cb, cd);
-		file_data_unref(next_fd);
-		}
-	else
-		{
-		cache_manager_standard_clean_done(cd);
-		}
+	cd->cc = NULL;
+	cache_manager_standard_clean_done(cd);
 }
 
-static void cache_manager_standard_clean_start(GenericDialog *gd, gpointer data)
+static void cache_manager_standard_clean_start_cb(GenericDialog *gd, gpointer data)
 {
 	CleanData *cd = data;
-	GList *list;
-	gchar *path;
-	FileData *dir_fd;
-
-	if (!cd->remote)
-	{
-		if (cd->list || !gtk_widget_get_sensitive(cd->button_start)) return;
-
-		gtk_widget_set_sensitive(cd->button_start, FALSE);
-		gtk_widget_set_sensitive(cd->button_stop, TRUE);
-		gtk_widget_set_sensitive(cd->button_close, FALSE);
-
-		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(cd->progress), _("running..."));
-	}
 
-	path = g_build_filename(get_thumbnails_standard_cache_dir(), THUMB_FOLDER_NORMAL, NULL);
-	dir_fd = file_data_new_dir(path);
-	filelist_read(dir_fd, &list, NULL);
-	cd->list = list;
-	file_data_unref(dir_fd);
-	g_free(path);
-
-	path = g_build_filename(get_thumbnails_standard_cache_dir(), THUMB_FOLDER_LARGE, NULL);
-	dir_fd = file_data_new_dir(path);
-	filelist_read(dir_fd, &list, NULL);
-	cd->list = g_list_concat(cd->list, list);
-	file_data_unref(dir_fd);
-	g_free(path);
+	if (cd->cc || !gtk_widget_get_sensitive(cd->button_start)) return;
 
-	path = g_build_filename(get_thumbnails_standard_cache_dir(), THUMB_FOLDER_FAIL, NULL);
-	dir_fd = file_data_new_dir(path);
-	filelist_read(dir_fd, &list, NULL);
-	cd->list = g_list_concat(cd->list, list);
-	file_data_unref(dir_fd);
-	g_free(path);
+	gtk_widget_set_sensitive(cd->button_start, FALSE);
+	gtk_widget_set_sensitive(cd->button_stop, TRUE);
+	gtk_widget_set_sensitive(cd->button_close, FALSE);
 
-	cd->count_total = g_list_length(cd->list);
-	cd->count_done = 0;
-
-	/* start iterating */
-	if (cd->clear)
-		{
-		cd->idle_id = g_idle_add(cache_manager_standard_clean_clear_cb, cd);
-		}
-	else
-		{
-		cache_manager_standard_clean_valid_cb(NULL, TRUE, cd);
-		}
-}
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(cd->progress), _("running..."));
 
-static void cache_manager_standard_clean_start_cb(GenericDialog *gd, gpointer data)
-{
-	cache_manager_standard_clean_start(gd, data);
+	cd->cc = cache_clean_start(TRUE, NULL, cd->clear, cd->days,
+				   cache_manager_standard_clean_done_cb, cd);
+	cd->update_id = g_timeout_add(200, cache_manager_standard_clean_update_cb, cd);
 }
 
 static void cache_manager_standard_process(GtkWidget *widget, gboolean clear)
@@ -1077,24 +1333,15 @@ static void cache_manager_standard_process(GtkWidget *widget, gboolean clear)
 	gtk_widget_show(cd->progress);
 
 	cd->days = 30;
-	cd->tl = NULL;
-	cd->idle_id = 0;
 
 	gtk_widget_show(cd->gd->dialog);
 }
 
 void cache_manager_standard_process_remote(gboolean clear)
 {
-	CleanData *cd;
-
-	cd = g_new0(CleanData, 1);
-	cd->clear = clear;
-	cd->days = 30;
-	cd->tl = NULL;
-	cd->idle_id = 0;
-	cd->remote = TRUE;
-
-	cache_manager_standard_clean_start(NULL, cd);
+	cache_maintain_remote_running++;
+	cache_clean_start(TRUE, NULL, clear, 30,
+			  cache_clean_remote_done_cb, (gpointer)get_thumbnails_standard_cache_dir());
 }
 
 static void cache_manager_standard_clean_cb(GtkWidget *widget, gpointer data)
@@ -1108,17 +1355,238 @@ static void cache_manager_standard_clear_cb(GtkWidget *widget, gpointer data)
 }
 
 
-static void cache_manager_main_clean_cb(GtkWidget *widget, gpointer data)
+static void dummy_cancel_cb(GenericDialog *gd, gpointer data)
 {
-	cache_maintain_home(FALSE, FALSE, widget);
+	/* no op, only so cancel button appears */
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * packed thumbnail store
+ *-----------------------------------------------------------------------------
+ */
 
-static void dummy_cancel_cb(GenericDialog *gd, gpointer data)
+#define CACHE_PACK_EXPORT_STEP 16
+
+typedef enum {
+	CACHE_PACK_COMPACT,
+	CACHE_PACK_EXPORT
+} CachePackAction;
+
+typedef struct _PackData PackData;
+struct _PackData
 {
-	/* no op, only so cancel button appears */
+	GenericDialog *gd;
+	CachePackAction action;
+
+	ThumbPackCompact *pc;
+	ThumbPackIter *pi;
+
+	GtkWidget *button_close;
+	GtkWidget *button_stop;
+	GtkWidget *button_start;
+	GtkWidget *progress;
+
+	guint idle_id; /* event source id */
+};
+
+static void cache_manager_pack_done(PackData *pd)
+{
+	if (pd->idle_id)
+		{
+		g_source_remove(pd->idle_id);
+		pd->idle_id = 0;
+		}
+
+	thumb_pack_compact_free(pd->pc);
+	pd->pc = NULL;
+	thumb_pack_iter_free(pd->pi);
+	pd->pi = NULL;
+
+	gtk_widget_set_sensitive(pd->button_stop, FALSE);
+	gtk_widget_set_sensitive(pd->button_close, TRUE);
+
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pd->progress), 1.0);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(pd->progress), _("done"));
 }
 
+static gboolean cache_manager_pack_cb(gpointer data)
+{
+	PackData *pd = data;
+	gdouble progress = 1.0;
+	gboolean more;
+
+	if (pd->action == CACHE_PACK_COMPACT)
+		{
+		more = thumb_pack_compact_step(pd->pc, &progress);
+		if (!more) thumb_pack_compact_finish(pd->pc);
+		}
+	else
+		{
+		gint i;
+
+		more = TRUE;
+		for (i = 0; i < CACHE_PACK_EXPORT_STEP && more; i++)
+			{
+			gchar *path;
+			ThumbPackSize size;
+			time_t mtime;
+			GdkPixbuf *pixbuf;
+
+			more = thumb_pack_iter_next(pd->pi, &path, &size, &mtime, &pixbuf);
+			if (more)
+				{
+				thumb_std_pack_export(path, size, mtime, pixbuf);
+				g_object_unref(pixbuf);
+				g_free(path);
+				}
+			}
+
+		progress = thumb_pack_iter_get_progress(pd->pi);
+		}
+
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pd->progress), progress);
+	if (more) return TRUE;
+
+	pd->idle_id = 0;
+	cache_manager_pack_done(pd);
+	return FALSE;
+}
+
+static void cache_manager_pack_close_cb(GenericDialog *gd, gpointer data)
+{
+	PackData *pd = data;
+
+	if (!gtk_widget_get_sensitive(pd->button_close)) return;
+
+	generic_dialog_close(pd->gd);
+	g_free(pd);
+}
+
+static void cache_manager_pack_stop_cb(GenericDialog *gd, gpointer data)
+{
+	PackData *pd = data;
+
+	cache_manager_pack_done(pd);
+}
+
+static void cache_manager_pack_start_cb(GenericDialog *gd, gpointer data)
+{
+	PackData *pd = data;
+
+	if (!gtk_widget_get_sensitive(pd->button_start)) return;
+
+	gtk_widget_set_sensitive(pd->button_start, FALSE);
+	gtk_widget_set_sensitive(pd->button_stop, TRUE);
+	gtk_widget_set_sensitive(pd->button_close, FALSE);
+
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(pd->progress), _("running..."));
+
+	if (pd->action == CACHE_PACK_COMPACT)
+		{
+		pd->pc = thumb_pack_compact_new();
+		if (!pd->pc)
+			{
+			cache_manager_pack_done(pd);
+			gtk_progress_bar_set_text(GTK_PROGRESS_BAR(pd->progress), _("Thumbnail store is in use"));
+			return;
+			}
+		}
+	else
+		{
+		pd->pi = thumb_pack_iter_new();
+		if (!pd->pi)
+			{
+			cache_manager_pack_done(pd);
+			return;
+			}
+		}
+
+	pd->idle_id = g_idle_add(cache_manager_pack_cb, pd);
+}
+
+static void cache_manager_pack_process(GtkWidget *widget, CachePackAction action)
+{
+	PackData *pd;
+	const gchar *stock_id;
+	const gchar *msg;
+
+	pd = g_new0(PackData, 1);
+	pd->action = action;
+
+	if (action == CACHE_PACK_EXPORT)
+		{
+		stock_id = GTK_STOCK_SAVE;
+		msg = _("Exporting packed thumbnails to the shared cache...");
+		}
+	else
+		{
+		stock_id = GTK_STOCK_CLEAR;
+		msg = _("Compacting packed thumbnails...");
+		}
+
+	pd->gd = generic_dialog_new(_("Maintenance"),
+				    "pack_maintenance",
+				    widget, FALSE,
+				    NULL, pd);
+	pd->gd->cancel_cb = cache_manager_pack_close_cb;
+	pd->button_close = generic_dialog_add_button(pd->gd, GTK_STOCK_CLOSE, NULL,
+						     cache_manager_pack_close_cb, FALSE);
+	pd->button_start = generic_dialog_add_button(pd->gd, GTK_STOCK_OK, _("S_tart"),
+						     cache_manager_pack_start_cb, FALSE);
+	pd->button_stop = generic_dialog_add_button(pd->gd, GTK_STOCK_STOP, NULL,
+						    cache_manager_pack_stop_cb, FALSE);
+	gtk_widget_set_sensitive(pd->button_stop, FALSE);
+
+	generic_dialog_add_message(pd->gd, stock_id, msg, NULL, FALSE);
+
+	pd->progress = gtk_progress_bar_new();
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(pd->progress), _("click start to begin"));
+#if GTK_CHECK_VERSION(3,0,0)
+	gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(pd->progress), TRUE);
+#endif
+	gtk_box_pack_start(GTK_BOX(pd->gd->vbox), pd->progress, FALSE, FALSE, 0);
+	gtk_widget_show(pd->progress);
+
+	gtk_widget_show(pd->gd->dialog);
+}
+
+static void cache_manager_pack_compact_cb(GtkWidget *widget, gpointer data)
+{
+	cache_manager_pack_process(widget, CACHE_PACK_COMPACT);
+}
+
+static void cache_manager_pack_export_cb(GtkWidget *widget, gpointer data)
+{
+	cache_manager_pack_process(widget, CACHE_PACK_EXPORT);
+}
+
+static void cache_manager_pack_clear_ok_cb(GenericDialog *gd, gpointer data)
+{
+	thumb_pack_clear();
+}
+
+static void cache_manager_pack_clear_cb(GtkWidget *widget, gpointer data)
+{
+	GenericDialog *gd;
+
+	gd = generic_dialog_new(_("Clear cache"),
+				"clear_pack", widget, TRUE,
+				dummy_cancel_cb, NULL);
+	generic_dialog_add_message(gd, GTK_STOCK_DIALOG_QUESTION, _("Clear cache"),
+				   _("This will remove all packed thumbnails, continue?"), TRUE);
+	generic_dialog_add_button(gd, GTK_STOCK_OK, NULL, cache_manager_pack_clear_ok_cb, TRUE);
+
+	gtk_widget_show(gd->dialog);
+}
+
+
+static void cache_manager_main_clean_cb(GtkWidget *widget, gpointer data)
+{
+	cache_maintain_home(FALSE, FALSE, widget);
+}
+
+
 static void cache_manager_main_clear_ok_cb(GenericDialog *gd, gpointer data)
 {
 	cache_maintain_home(FALSE, TRUE, NULL);
@@ -1192,7 +1660,13 @@ void cache_manager_show(void)
 	GtkWidget *button;
 	GtkWidget *table;
 	GtkSizeGroup *sizegroup;
+	GtkWidget *label;
 	gchar *path;
+	gchar *buf;
+	gchar *buf_live;
+	guint count;
+	guint64 size;
+	guint64 live_size;
 
 	if (cache_manager)
 		{
@@ -1253,6 +1727,37 @@ void cache_manager_show(void)
 	gtk_size_group_add_widget(sizegroup, button);
 	pref_table_label(table, 1, 1, _("Delete all cached thumbnails."), 0.0);
 
+	group = pref_group_new(gd->vbox, FALSE, _("Packed thumbnail store"), GTK_ORIENTATION_VERTICAL);
+
+	cache_manager_location_label(group, get_thumbnails_pack_dir());
+
+	thumb_pack_get_usage(&count, &size, &live_size);
+	buf = text_from_size_abrev(size);
+	buf_live = text_from_size_abrev(live_size);
+	path = g_strdup_printf(_("%u thumbnails, %s in use of %s"), count, buf_live, buf);
+	label = pref_label_new(group, path);
+	gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+	g_free(path);
+	g_free(buf_live);
+	g_free(buf);
+
+	table = pref_table_new(group, 2, 3, FALSE, FALSE);
+
+	button = pref_table_button(table, 0, 0, GTK_STOCK_CLEAR, _("Compact"), FALSE,
+				   G_CALLBACK(cache_manager_pack_compact_cb), cache_manager);
+	gtk_size_group_add_widget(sizegroup, button);
+	pref_table_label(table, 1, 0, _("Remove orphaned, outdated and replaced thumbnails."), 0.0);
+
+	button = pref_table_button(table, 0, 1, GTK_STOCK_SAVE, _("Export"), FALSE,
+				   G_CALLBACK(cache_manager_pack_export_cb), cache_manager);
+	gtk_size_group_add_widget(sizegroup, button);
+	pref_table_label(table, 1, 1, _("Copy all packed thumbnails to the shared cache."), 0.0);
+
+	button = pref_table_button(table, 0, 2, GTK_STOCK_DELETE, _("Clear cache"), FALSE,
+				   G_CALLBACK(cache_manager_pack_clear_cb), cache_manager);
+	gtk_size_group_add_widget(sizegroup, button);
+	pref_table_label(table, 1, 2, _("Delete all packed thumbnails."), 0.0);
+
 	group = pref_group_new(gd->vbox, FALSE, _("Create thumbnails"), GTK_ORIENTATION_VERTICAL);
 
 	table = pref_table_new(group, 2, 1, FALSE, FALSE);
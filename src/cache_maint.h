@@ -30,5 +30,7 @@ void cache_manager_show(void);
 void cache_maintain_home_remote(gboolean metadata, gboolean clear);
 void cache_manager_standard_process_remote(gboolean clear);
 void cache_manager_render_remote(const gchar *path, gboolean recurse, gboolean local);
+gboolean cache_maintain_remote_busy(void);
+
 #endif
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -197,10 +197,8 @@ static gint collection_list_sort_cb(gconstpointer a, gconstpointer b)
 			break;
 		}
 
-	if (options->file_sort.case_sensitive)
-		return strcmp(cia->fd->collate_key_name, cib->fd->collate_key_name);
-	else
-		return strcmp(cia->fd->collate_key_name_nocase, cib->fd->collate_key_name_nocase);
+	return strcmp(file_data_get_collate_key(cia->fd, options->file_sort.case_sensitive),
+		      file_data_get_collate_key(cib->fd, options->file_sort.case_sensitive));
 }
 
 GList *collection_list_sort(GList *list, SortType method)
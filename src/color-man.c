@@ -22,7 +22,9 @@
 #include "main.h"
 #include "color-man.h"
 
+#include "cache.h"
 #include "image.h"
+#include "secure_save.h"
 #include "ui_fileops.h"
 
 
@@ -34,6 +36,7 @@
 #else
 #include <lcms.h>
 #endif
+#include <utime.h>
 
 
 typedef struct _ColorManCache ColorManCache;
@@ -50,20 +53,48 @@ struct _ColorManCache {
 
 	gboolean has_alpha;
 
+	guint16 *lut; /* COLOR_MAN_LUT_GRID^3 RGB nodes, replaces transform when set */
+
 	gint refcount;
 };
 
-/* pixels to transform per idle call */
+/* pixels to transform per idle call, also the smallest band given to a thread */
 #define COLOR_MAN_CHUNK_SIZE 81900
 
+/* nodes per axis of the 3D lookup table, 33 keeps the 8 bit error below one level */
+#define COLOR_MAN_LUT_GRID 33
+#define COLOR_MAN_LUT_SIZE (COLOR_MAN_LUT_GRID * COLOR_MAN_LUT_GRID * COLOR_MAN_LUT_GRID * 3)
+#define COLOR_MAN_LUT_MAGIC "GQCLUT01"
+
+/* grid cell and 1/256 fraction for each 8 bit input level */
+static guint8 color_man_lut_index[256];
+static guint16 color_man_lut_frac[256];
+
 
 static void color_man_lib_init(void)
 {
 	static gboolean init_done = FALSE;
+	gint i;
 
 	if (init_done) return;
 	init_done = TRUE;
 
+	for (i = 0; i < 256; i++)
+		{
+		guint pos = i * ((COLOR_MAN_LUT_GRID - 1) << 8) / 255;
+
+		if ((pos >> 8) >= COLOR_MAN_LUT_GRID - 1)
+			{
+			color_man_lut_index[i] = COLOR_MAN_LUT_GRID - 2;
+			color_man_lut_frac[i] = 256;
+			}
+		else
+			{
+			color_man_lut_index[i] = pos >> 8;
+			color_man_lut_frac[i] = pos & 0xff;
+			}
+		}
+
 #ifndef HAVE_LCMS2
 	cmsErrorAction(LCMS_ERROR_IGNORE);
 #endif
@@ -76,6 +107,228 @@ static cmsHPROFILE color_man_create_adobe_comp(void)
 	return cmsOpenProfileFromMem(ClayRGB1998_icc, ClayRGB1998_icc_len);
 }
 
+/*
+ *-------------------------------------------------------------------
+ * 3D lookup table
+ *-------------------------------------------------------------------
+ */
+
+static void color_man_lut_checksum_profile(GChecksum *checksum, ColorManProfileType type, const gchar *file,
+					   guchar *data, guint data_len)
+{
+	gchar *buf = NULL;
+	gsize len = 0;
+
+	g_checksum_update(checksum, (const guchar *)&type, sizeof(type));
+
+	switch (type)
+		{
+		case COLOR_PROFILE_FILE:
+			if (file)
+				{
+				gchar *pathl = path_from_utf8(file);
+
+				if (g_file_get_contents(pathl, &buf, &len, NULL))
+					{
+					g_checksum_update(checksum, (const guchar *)buf, len);
+					g_free(buf);
+					}
+				g_free(pathl);
+				}
+			break;
+		case COLOR_PROFILE_MEM:
+			if (data) g_checksum_update(checksum, data, data_len);
+			break;
+		default:
+			break;
+		}
+}
+
+/**
+ * \brief Path of the on-disk table for a profile pair
+ *
+ * The name is a hash of the profile contents and the render intent, so a
+ * table is shared by every image with the same embedded profile and goes
+ * stale by itself when a profile file is replaced.
+ */
+static gchar *color_man_lut_path(ColorManProfileType in_type, const gchar *in_file,
+				 guchar *in_data, guint in_data_len,
+				 ColorManProfileType out_type, const gchar *out_file,
+				 guchar *out_data, guint out_data_len)
+{
+	GChecksum *checksum;
+	gint intent = options->color_profile.render_intent;
+	gint grid = COLOR_MAN_LUT_GRID;
+	gchar *name;
+	gchar *path;
+
+	checksum = g_checksum_new(G_CHECKSUM_SHA1);
+	color_man_lut_checksum_profile(checksum, in_type, in_file, in_data, in_data_len);
+	color_man_lut_checksum_profile(checksum, out_type, out_file, out_data, out_data_len);
+	g_checksum_update(checksum, (const guchar *)&intent, sizeof(intent));
+	g_checksum_update(checksum, (const guchar *)&grid, sizeof(grid));
+
+	name = g_strconcat(g_checksum_get_string(checksum), ".lut", NULL);
+	path = g_build_filename(get_color_cache_dir(), name, NULL);
+	g_free(name);
+	g_checksum_free(checksum);
+
+	return path;
+}
+
+static guint16 *color_man_lut_load(const gchar *path)
+{
+	gchar *pathl;
+	gchar *buf = NULL;
+	gsize len = 0;
+	guint16 *lut = NULL;
+
+	pathl = path_from_utf8(path);
+	if (g_file_get_contents(pathl, &buf, &len, NULL) &&
+	    len == strlen(COLOR_MAN_LUT_MAGIC) + COLOR_MAN_LUT_SIZE * sizeof(guint16) &&
+	    memcmp(buf, COLOR_MAN_LUT_MAGIC, strlen(COLOR_MAN_LUT_MAGIC)) == 0)
+		{
+		lut = g_memdup(buf + strlen(COLOR_MAN_LUT_MAGIC), COLOR_MAN_LUT_SIZE * sizeof(guint16));
+
+		/* keeps the table through the cache clean up */
+		utime(pathl, NULL);
+		}
+	g_free(buf);
+	g_free(pathl);
+
+	return lut;
+}
+
+static void color_man_lut_save(const gchar *path, const guint16 *lut)
+{
+	SecureSaveInfo *ssi;
+	gchar *pathl;
+
+	if (!recursive_mkdir_if_not_exists(get_color_cache_dir(), 0755)) return;
+
+	pathl = path_from_utf8(path);
+	ssi = secure_open(pathl);
+	if (ssi)
+		{
+		secure_fwrite(COLOR_MAN_LUT_MAGIC, strlen(COLOR_MAN_LUT_MAGIC), 1, ssi);
+		secure_fwrite(lut, sizeof(guint16), COLOR_MAN_LUT_SIZE, ssi);
+		if (secure_close(ssi))
+			{
+			log_printf(_("error saving color table %s: %s\n"), path, secsave_strerror(secsave_errno));
+			}
+		}
+	g_free(pathl);
+}
+
+/**
+ * \brief Sample the profile transform on a regular RGB grid
+ *
+ * The grid is transformed at 16 bits so that interpolating between nodes
+ * does not add rounding on top of the 8 bit output.
+ */
+static guint16 *color_man_lut_build(cmsHPROFILE profile_in, cmsHPROFILE profile_out)
+{
+	cmsHTRANSFORM transform;
+	guint16 *grid;
+	guint16 *lut;
+	guint16 *p;
+	gint r, g, b;
+
+	transform = cmsCreateTransform(profile_in, TYPE_RGB_16,
+				       profile_out, TYPE_RGB_16,
+				       options->color_profile.render_intent, 0);
+	if (!transform) return NULL;
+
+	grid = g_new(guint16, COLOR_MAN_LUT_SIZE);
+	p = grid;
+	for (r = 0; r < COLOR_MAN_LUT_GRID; r++)
+		for (g = 0; g < COLOR_MAN_LUT_GRID; g++)
+			for (b = 0; b < COLOR_MAN_LUT_GRID; b++)
+				{
+				*p++ = r * 65535 / (COLOR_MAN_LUT_GRID - 1);
+				*p++ = g * 65535 / (COLOR_MAN_LUT_GRID - 1);
+				*p++ = b * 65535 / (COLOR_MAN_LUT_GRID - 1);
+				}
+
+	lut = g_new(guint16, COLOR_MAN_LUT_SIZE);
+	cmsDoTransform(transform, grid, lut, COLOR_MAN_LUT_SIZE / 3);
+
+	cmsDeleteTransform(transform);
+	g_free(grid);
+
+	return lut;
+}
+
+/**
+ * \brief Correct a run of pixels with tetrahedral interpolation in the table
+ */
+static void color_man_lut_apply(const guint16 *lut, guchar *pix, gint w, gint bpp)
+{
+	const gint sr = COLOR_MAN_LUT_GRID * COLOR_MAN_LUT_GRID * 3;
+	const gint sg = COLOR_MAN_LUT_GRID * 3;
+	const gint sb = 3;
+	gint i;
+
+	for (i = 0; i < w; i++, pix += bpp)
+		{
+		const guint16 *p0, *p1, *p2, *p3;
+		guint fr, fg, fb;
+		guint w0, w1, w2, w3;
+		gint c;
+
+		fr = color_man_lut_frac[pix[0]];
+		fg = color_man_lut_frac[pix[1]];
+		fb = color_man_lut_frac[pix[2]];
+
+		p0 = lut + color_man_lut_index[pix[0]] * sr + color_man_lut_index[pix[1]] * sg + color_man_lut_index[pix[2]] * sb;
+		p3 = p0 + sr + sg + sb;
+
+		if (fr >= fg)
+			{
+			if (fg >= fb)
+				{
+				p1 = p0 + sr; p2 = p1 + sg;
+				w0 = 256 - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+				}
+			else if (fr >= fb)
+				{
+				p1 = p0 + sr; p2 = p1 + sb;
+				w0 = 256 - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+				}
+			else
+				{
+				p1 = p0 + sb; p2 = p1 + sr;
+				w0 = 256 - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+				}
+			}
+		else
+			{
+			if (fr >= fb)
+				{
+				p1 = p0 + sg; p2 = p1 + sr;
+				w0 = 256 - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+				}
+			else if (fg >= fb)
+				{
+				p1 = p0 + sg; p2 = p1 + sb;
+				w0 = 256 - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+				}
+			else
+				{
+				p1 = p0 + sb; p2 = p1 + sg;
+				w0 = 256 - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+				}
+			}
+
+		for (c = 0; c < 3; c++)
+			{
+			guint v = p0[c] * w0 + p1[c] * w1 + p2[c] * w2 + p3[c] * w3;
+
+			pix[c] = ((v >> 8) + 128) / 257;
+			}
+		}
+}
+
 /*
  *-------------------------------------------------------------------
  * color transform cache
@@ -100,6 +353,7 @@ static void color_man_cache_unref(ColorManCache *cc)
 	if (cc->refcount < 1)
 		{
 		if (cc->transform) cmsDeleteTransform(cc->transform);
+		g_free(cc->lut);
 		if (cc->profile_in) cmsCloseProfile(cc->profile_in);
 		if (cc->profile_out) cmsCloseProfile(cc->profile_out);
 
@@ -154,6 +408,7 @@ static ColorManCache *color_man_cache_new(ColorManProfileType in_type, const gch
 					  gboolean has_alpha)
 {
 	ColorManCache *cc;
+	gchar *lut_path;
 
 	color_man_lib_init();
 
@@ -184,13 +439,27 @@ static ColorManCache *color_man_cache_new(ColorManProfileType in_type, const gch
 		return NULL;
 		}
 
-	cc->transform = cmsCreateTransform(cc->profile_in,
-					   (has_alpha) ? TYPE_RGBA_8 : TYPE_RGB_8,
-					   cc->profile_out,
-					   (has_alpha) ? TYPE_RGBA_8 : TYPE_RGB_8,
-					   options->color_profile.render_intent, 0);
+	lut_path = color_man_lut_path(in_type, in_file, in_data, in_data_len,
+				      out_type, out_file, out_data, out_data_len);
+	cc->lut = color_man_lut_load(lut_path);
+	if (!cc->lut)
+		{
+		cc->lut = color_man_lut_build(cc->profile_in, cc->profile_out);
+		if (cc->lut) color_man_lut_save(lut_path, cc->lut);
+		}
+	DEBUG_1("color table %s: %s", cc->lut ? "ready" : "failed", lut_path);
+	g_free(lut_path);
+
+	if (!cc->lut)
+		{
+		cc->transform = cmsCreateTransform(cc->profile_in,
+						   (has_alpha) ? TYPE_RGBA_8 : TYPE_RGB_8,
+						   cc->profile_out,
+						   (has_alpha) ? TYPE_RGBA_8 : TYPE_RGB_8,
+						   options->color_profile.render_intent, 0);
+		}
 
-	if (!cc->transform)
+	if (!cc->lut && !cc->transform)
 		{
 		DEBUG_1("failed to create color profile transform");
 
@@ -299,7 +568,123 @@ static void color_man_done(ColorMan *cm, ColorManReturnType type)
 		}
 }
 
-void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, gint w, gint h)
+typedef struct _ColorManBands ColorManBands;
+struct _ColorManBands {
+	const guint16 *lut;
+	guchar *pix;
+	gint rowstride;
+	gint w;
+	gint h;
+	gint bpp;
+
+	gint band_height;
+	gint bands;
+	gint next_band;	/* atomic */
+
+	gint workers;
+	GMutex lock;
+	GCond cond;
+};
+
+static void color_man_bands_run(ColorManBands *cb)
+{
+	gint band;
+
+	while ((band = g_atomic_int_add(&cb->next_band, 1)) < cb->bands)
+		{
+		gint y = band * cb->band_height;
+		gint end = MIN(y + cb->band_height, cb->h);
+
+		for (; y < end; y++)
+			{
+			color_man_lut_apply(cb->lut, cb->pix + y * cb->rowstride, cb->w, cb->bpp);
+			}
+		}
+}
+
+#ifdef HAVE_GTHREAD
+static GThreadPool *color_man_thread_pool = NULL;
+
+static void color_man_bands_thread_cb(gpointer data, gpointer user_data)
+{
+	ColorManBands *cb = data;
+
+	color_man_bands_run(cb);
+
+	g_mutex_lock(&cb->lock);
+	cb->workers--;
+	g_cond_signal(&cb->cond);
+	g_mutex_unlock(&cb->lock);
+}
+#endif
+
+/**
+ * \brief Split the region into bands of rows and correct them on all cores
+ *
+ * Returns once every band is done, so callers see a fully corrected region
+ * just as with a single threaded pass.
+ */
+static void color_man_correct_bands(const guint16 *lut, guchar *pix, gint rowstride, gint w, gint h, gint bpp)
+{
+	ColorManBands cb;
+	gint threads = 1;
+
+	cb.lut = lut;
+	cb.pix = pix;
+	cb.rowstride = rowstride;
+	cb.w = w;
+	cb.h = h;
+	cb.bpp = bpp;
+	cb.next_band = 0;
+	cb.workers = 0;
+
+#ifdef HAVE_GTHREAD
+	if ((gint64)w * h >= 2 * COLOR_MAN_CHUNK_SIZE)
+		{
+		threads = MIN(g_get_num_processors(), (gint64)w * h / COLOR_MAN_CHUNK_SIZE);
+		}
+#endif
+
+	/* a few bands per thread even out rows that cost more than others */
+	cb.bands = (threads > 1) ? MIN(threads * 4, h) : 1;
+	cb.band_height = (h + cb.bands - 1) / cb.bands;
+
+#ifdef HAVE_GTHREAD
+	if (threads > 1)
+		{
+		gint i;
+
+		if (!color_man_thread_pool)
+			{
+			color_man_thread_pool = g_thread_pool_new(color_man_bands_thread_cb, NULL,
+								  MAX(g_get_num_processors() - 1, 1), FALSE, NULL);
+			}
+
+		g_mutex_init(&cb.lock);
+		g_cond_init(&cb.cond);
+
+		cb.workers = threads - 1;
+		for (i = 0; i < threads - 1; i++)
+			{
+			g_thread_pool_push(color_man_thread_pool, &cb, NULL);
+			}
+
+		color_man_bands_run(&cb);
+
+		g_mutex_lock(&cb.lock);
+		while (cb.workers > 0) g_cond_wait(&cb.cond, &cb.lock);
+		g_mutex_unlock(&cb.lock);
+
+		g_mutex_clear(&cb.lock);
+		g_cond_clear(&cb.cond);
+		return;
+		}
+#endif
+
+	color_man_bands_run(&cb);
+}
+
+static void color_man_correct_region_real(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, gint w, gint h)
 {
 	ColorManCache *cc;
 	guchar *pix;
@@ -318,8 +703,16 @@ void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, g
 
 	w = MIN(w, pixbuf_width - x);
 	h = MIN(h, pixbuf_height - y);
+	if (w <= 0 || h <= 0) return;
 
 	pix += x * ((cc->has_alpha) ? 4 : 3);
+
+	if (cc->lut)
+		{
+		color_man_correct_bands(cc->lut, pix + y * rs, rs, w, h, (cc->has_alpha) ? 4 : 3);
+		return;
+		}
+
 	for (i = 0; i < h; i++)
 		{
 		guchar *pbuf;
@@ -331,6 +724,24 @@ void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, g
 
 }
 
+void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, gint w, gint h)
+{
+	gint64 t = TRACE_BEGIN();
+
+	color_man_correct_region_real(cm, pixbuf, x, y, w, h);
+	TRACE_END(t, TRACE_COLOR, "color_man_correct_region");
+}
+
+gboolean color_man_is_fast(ColorMan *cm)
+{
+	ColorManCache *cc;
+
+	if (!cm) return FALSE;
+
+	cc = cm->profile;
+	return (cc->lut != NULL);
+}
+
 static gboolean color_man_idle_cb(gpointer data)
 {
 	ColorMan *cm = data;
@@ -362,7 +773,8 @@ static gboolean color_man_idle_cb(gpointer data)
 		return FALSE;
 		}
 
-	rh = COLOR_MAN_CHUNK_SIZE / width + 1;
+	/* with the table the rest of the image is one threaded pass and one redraw */
+	rh = color_man_is_fast(cm) ? height - cm->row + 1 : COLOR_MAN_CHUNK_SIZE / width + 1;
 	color_man_correct_region(cm, cm->pixbuf, 0, cm->row, width, rh);
 	if (cm->incremental_sync && cm->imd) image_area_changed(cm->imd, 0, cm->row, width, rh);
 	cm->row += rh;
@@ -534,5 +946,10 @@ gboolean color_man_get_status(ColorMan *cm, gchar **image_profile, gchar **scree
 	return FALSE;
 }
 
+gboolean color_man_is_fast(ColorMan *cm)
+{
+	return FALSE;
+}
+
 #endif /* define HAVE_LCMS */
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
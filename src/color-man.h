@@ -68,6 +68,7 @@ void color_man_free(ColorMan *cm);
 void color_man_update(void);
 
 void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, gint w, gint h);
+gboolean color_man_is_fast(ColorMan *cm);
 
 void color_man_start_bg(ColorMan *cm, ColorManDoneFunc don_func, gpointer done_data);
 
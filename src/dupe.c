@@ -1172,11 +1172,11 @@ static gboolean dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, gdouble
 		}
 	if (mask & DUPE_MATCH_NAME)
 		{
-		if (strcmp(a->fd->collate_key_name, b->fd->collate_key_name) != 0) return FALSE;
+		if (strcmp(file_data_get_collate_key(a->fd, TRUE), file_data_get_collate_key(b->fd, TRUE)) != 0) return FALSE;
 		}
 	if (mask & DUPE_MATCH_NAME_CI)
 		{
-		if (strcmp(a->fd->collate_key_name_nocase, b->fd->collate_key_name_nocase) != 0) return FALSE;
+		if (strcmp(file_data_get_collate_key(a->fd, FALSE), file_data_get_collate_key(b->fd, FALSE)) != 0) return FALSE;
 		}
 	if (mask & DUPE_MATCH_SIZE)
 		{
@@ -1471,6 +1471,7 @@ static GList *dupe_setup_point_step(DupeWindow *dw, GList *p)
 static gboolean dupe_check_cb(gpointer data)
 {
 	DupeWindow *dw = data;
+	gint64 t;
 
 	if (!dw->idle_id) return FALSE;
 
@@ -1499,7 +1500,9 @@ static gboolean dupe_check_cb(gpointer data)
 						if (di->md5sum) return TRUE;
 						}
 
+					t = TRACE_BEGIN();
 					di->md5sum = md5_text_from_file_utf8(di->fd->path, "");
+					TRACE_END(t, TRACE_IO, "md5_text_from_file");
 					if (options->thumbnails.enable_caching)
 						{
 						dupe_item_write_cache(di);
@@ -1623,7 +1626,9 @@ static gboolean dupe_check_cb(gpointer data)
 		return FALSE;
 		}
 
+	t = TRACE_BEGIN();
 	dupe_list_check_match(dw, (DupeItem *)dw->working->data, dw->working);
+	TRACE_END(t, TRACE_COMPARE, "dupe_list_check_match");
 	dupe_window_update_progress(dw, _("Comparing..."), dw->setup_count == 0 ? 0.0 : (gdouble) dw->setup_n / dw->setup_count, FALSE);
 	dw->setup_n++;
 
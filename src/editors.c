@@ -62,6 +62,22 @@ struct _EditorData {
 	gpointer data;
 	const EditorDescription *editor;
 	gchar *working_directory; /* fallback if no files are given (editor_no_param) */
+
+	/* parallel mode, see editor_command_parallel_next() */
+	gboolean parallel;
+	gboolean suspended;
+	GList *jobs; /* EditorJob, in the order of the file list */
+};
+
+typedef struct _EditorJob EditorJob;
+struct _EditorJob {
+	EditorData *ed;
+	GList *fd_element;
+	EditorFlags flags;
+	GPid pid;
+	gint status;
+	gint channels; /* open output channels */
+	GString *output;
 };
 
 
@@ -346,6 +362,14 @@ gboolean editor_read_desktop_file(const gchar *path)
 	if (g_key_file_get_boolean(key_file, DESKTOP_GROUP, "X-Geeqie-Filter", NULL)) editor->flags |= EDITOR_DEST;
 	if (g_key_file_get_boolean(key_file, DESKTOP_GROUP, "Terminal", NULL)) editor->flags |= EDITOR_TERMINAL;
 
+	/* 0 means one per processor */
+	editor->jobs = 1;
+	if (g_key_file_has_key(key_file, DESKTOP_GROUP, "X-Geeqie-Jobs", NULL))
+		{
+		editor->jobs = g_key_file_get_integer(key_file, DESKTOP_GROUP, "X-Geeqie-Jobs", NULL);
+		if (editor->jobs <= 0) editor->jobs = g_get_num_processors();
+		}
+
 	editor->flags |= editor_command_parse(editor, NULL, FALSE, NULL);
 
 	if ((editor->flags & EDITOR_NO_PARAM) && !category_geeqie) editor->hidden = TRUE;
@@ -643,36 +667,47 @@ static void editor_verbose_window_progress(EditorData *ed, const gchar *text)
 	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ed->vd->progress), (text) ? text : "");
 }
 
-static gboolean editor_verbose_io_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+/* appends the available output of a child to text, converted to utf8 */
+static void editor_io_read(GIOChannel *source, GString *text)
 {
-	EditorData *ed = data;
 	gchar buf[512];
 	gsize count;
 
-	if (condition & G_IO_IN)
+	while (g_io_channel_read_chars(source, buf, sizeof(buf), &count, NULL) == G_IO_STATUS_NORMAL)
 		{
-		while (g_io_channel_read_chars(source, buf, sizeof(buf), &count, NULL) == G_IO_STATUS_NORMAL)
+		if (!g_utf8_validate(buf, count, NULL))
 			{
-			if (!g_utf8_validate(buf, count, NULL))
-				{
-				gchar *utf8;
+			gchar *utf8;
 
-				utf8 = g_locale_to_utf8(buf, count, NULL, NULL, NULL);
-				if (utf8)
-					{
-					editor_verbose_window_fill(ed->vd, utf8, -1);
-					g_free(utf8);
-					}
-				else
-					{
-					editor_verbose_window_fill(ed->vd, "Error converting text to valid utf8\n", -1);
-					}
+			utf8 = g_locale_to_utf8(buf, count, NULL, NULL, NULL);
+			if (utf8)
+				{
+				g_string_append(text, utf8);
+				g_free(utf8);
 				}
 			else
 				{
-				editor_verbose_window_fill(ed->vd, buf, count);
+				g_string_append(text, "Error converting text to valid utf8\n");
 				}
 			}
+		else
+			{
+			g_string_append_len(text, buf, count);
+			}
+		}
+}
+
+static gboolean editor_verbose_io_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	EditorData *ed = data;
+
+	if (condition & G_IO_IN)
+		{
+		GString *text = g_string_new(NULL);
+
+		editor_io_read(source, text);
+		if (text->len) editor_verbose_window_fill(ed->vd, text->str, text->len);
+		g_string_free(text, TRUE);
 		}
 
 	if (condition & (G_IO_ERR | G_IO_HUP))
@@ -1025,20 +1060,24 @@ static void editor_child_exit_cb(GPid pid, gint status, gpointer data)
 }
 
 
-static EditorFlags editor_command_one(const EditorDescription *editor, GList *list, EditorData *ed)
+/**
+ * \brief Starts the command of editor for list
+ *
+ * The output of the child goes to standard_output and standard_error when
+ * they are not NULL. Returns the flags of the command, errors included.
+ */
+static EditorFlags editor_command_spawn(const EditorDescription *editor, GList *list, EditorData *ed,
+					GPid *pid, gint *standard_output, gint *standard_error)
 {
 	gchar *command;
-	FileData *fd = (ed->flags & EDITOR_NO_PARAM) ? NULL : list->data;;
-	GPid pid;
-	gint standard_output;
-	gint standard_error;
+	FileData *fd = (ed->flags & EDITOR_NO_PARAM) ? NULL : list->data;
+	EditorFlags flags;
 	gboolean ok;
 
-	ed->pid = -1;
-	ed->flags = editor->flags;
-	ed->flags |= editor_command_parse(editor, list, TRUE, &command);
+	flags = editor->flags;
+	flags |= editor_command_parse(editor, list, TRUE, &command);
 
-	ok = !EDITOR_ERRORS(ed->flags);
+	ok = !EDITOR_ERRORS(flags);
 
 	if (ok)
 		{
@@ -1051,7 +1090,7 @@ static EditorFlags editor_command_one(const EditorDescription *editor, GList *li
 			if (!ok) log_printf("ERROR: cannot execute shell command '%s'\n", options->shell.path);
 			}
 
-		if (!ok) ed->flags |= EDITOR_ERROR_CANT_EXEC;
+		if (!ok) flags |= EDITOR_ERROR_CANT_EXEC;
 		}
 
 	if (ok)
@@ -1067,7 +1106,7 @@ static EditorFlags editor_command_one(const EditorDescription *editor, GList *li
 		args[n++] = command;
 		args[n] = NULL;
 
-		if ((ed->flags & EDITOR_DEST) && fd && fd->change && fd->change->dest) /* FIXME: error handling */
+		if ((flags & EDITOR_DEST) && fd && fd->change && fd->change->dest) /* FIXME: error handling */
 			{
 			g_setenv("GEEQIE_DESTINATION", fd->change->dest, TRUE);
 			}
@@ -1079,17 +1118,35 @@ static EditorFlags editor_command_one(const EditorDescription *editor, GList *li
 		ok = g_spawn_async_with_pipes(working_directory, args, NULL,
 				      G_SPAWN_DO_NOT_REAP_CHILD, /* GSpawnFlags */
 				      NULL, NULL,
-				      &pid,
+				      pid,
 				      NULL,
-				      ed->vd ? &standard_output : NULL,
-				      ed->vd ? &standard_error : NULL,
+				      standard_output,
+				      standard_error,
 				      NULL);
 
 		g_free(working_directory);
 
-		if (!ok) ed->flags |= EDITOR_ERROR_CANT_EXEC;
+		if (!ok) flags |= EDITOR_ERROR_CANT_EXEC;
 		}
 
+	g_free(command);
+
+	return flags;
+}
+
+static EditorFlags editor_command_one(const EditorDescription *editor, GList *list, EditorData *ed)
+{
+	GPid pid;
+	gint standard_output;
+	gint standard_error;
+	gboolean ok;
+
+	ed->pid = -1;
+	ed->flags = editor_command_spawn(editor, list, ed, &pid,
+					 ed->vd ? &standard_output : NULL,
+					 ed->vd ? &standard_error : NULL);
+	ok = !EDITOR_ERRORS(ed->flags);
+
 	if (ok)
 		{
 		g_child_watch_add(pid, editor_child_exit_cb, ed);
@@ -1130,13 +1187,199 @@ static EditorFlags editor_command_one(const EditorDescription *editor, GList *li
 			}
 		}
 
-	g_free(command);
-
 	return EDITOR_ERRORS(ed->flags);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * parallel execution of %f commands
+ *-----------------------------------------------------------------------------
+ */
+
+static EditorFlags editor_command_parallel_next(EditorData *ed);
+
+static gboolean editor_job_finished(EditorJob *job)
+{
+	return (job->pid == -1 && job->channels == 0);
+}
+
+static gint editor_jobs_running(EditorData *ed)
+{
+	GList *work;
+	gint n = 0;
+
+	for (work = ed->jobs; work; work = work->next)
+		{
+		if (!editor_job_finished(work->data)) n++;
+		}
+
+	return n;
+}
+
+static void editor_job_free(EditorJob *job)
+{
+	filelist_free(job->fd_element);
+	if (job->output) g_string_free(job->output, TRUE);
+	g_free(job);
+}
+
+static void editor_job_exit_cb(GPid pid, gint status, gpointer data)
+{
+	EditorJob *job = data;
+
+	g_spawn_close_pid(pid);
+	job->pid = -1;
+	job->status = status;
+
+	if (editor_job_finished(job)) editor_command_parallel_next(job->ed);
+}
+
+static gboolean editor_job_io_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	EditorJob *job = data;
+
+	/* buffered, the output of each file is shown in one piece and in order */
+	if (condition & G_IO_IN) editor_io_read(source, job->output);
+
+	if (condition & (G_IO_ERR | G_IO_HUP))
+		{
+		g_io_channel_shutdown(source, TRUE, NULL);
+		job->channels--;
+		if (editor_job_finished(job)) editor_command_parallel_next(job->ed);
+		return FALSE;
+		}
+
+	return TRUE;
+}
+
+static void editor_job_watch(EditorJob *job, gint fd)
+{
+	GIOChannel *channel;
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_flags(channel, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+
+	g_io_add_watch_full(channel, G_PRIORITY_HIGH, G_IO_IN | G_IO_ERR | G_IO_HUP,
+			    editor_job_io_cb, job, NULL);
+	g_io_channel_unref(channel);
+	job->channels++;
+}
+
+static void editor_job_start(EditorData *ed)
+{
+	EditorJob *job;
+	GPid pid;
+	gint standard_output;
+	gint standard_error;
+
+	job = g_new0(EditorJob, 1);
+	job->ed = ed;
+	job->pid = -1;
+	job->fd_element = ed->list;
+	ed->list = g_list_remove_link(ed->list, job->fd_element);
+	if (ed->vd) job->output = g_string_new(NULL);
+
+	job->flags = editor_command_spawn(ed->editor, job->fd_element, ed, &pid,
+					  ed->vd ? &standard_output : NULL,
+					  ed->vd ? &standard_error : NULL);
+
+	if (!EDITOR_ERRORS(job->flags))
+		{
+		job->pid = pid;
+		g_child_watch_add(pid, editor_job_exit_cb, job);
+		if (ed->vd)
+			{
+			editor_job_watch(job, standard_output);
+			editor_job_watch(job, standard_error);
+			}
+		}
+	else if (ed->vd)
+		{
+		g_string_append_printf(job->output, _("Failed to run command:\n%s\n"), ed->editor->file);
+		}
+
+	ed->jobs = g_list_append(ed->jobs, job);
+}
+
+/**
+ * \brief Runs the next step of an editor in parallel mode
+ *
+ * Up to editor->jobs children run at the same time, one file each. The
+ * results are handed to the callback and the verbose window in the order
+ * of the file list, a finished file waits for the ones before it.
+ * Called when a child finishes, and by editor_resume().
+ */
+static EditorFlags editor_command_parallel_next(EditorData *ed)
+{
+	gboolean progress = TRUE;
+
+	if (ed->suspended) return EDITOR_ERRORS(ed->flags);
+
+	while (progress)
+		{
+		progress = FALSE;
+
+		while (ed->jobs && editor_job_finished(ed->jobs->data))
+			{
+			EditorJob *job = ed->jobs->data;
+			FileData *fd = job->fd_element->data;
+			gint cont = EDITOR_CB_CONTINUE;
+
+			ed->jobs = g_list_delete_link(ed->jobs, ed->jobs);
+			ed->flags = job->flags;
+			if (job->status) ed->flags |= EDITOR_ERROR_STATUS;
+			ed->count++;
+
+			if (ed->vd)
+				{
+				editor_verbose_window_fill(ed->vd, "\n", 1);
+				editor_verbose_window_fill(ed->vd, fd->path, strlen(fd->path));
+				editor_verbose_window_fill(ed->vd, "\n", 1);
+				editor_verbose_window_fill(ed->vd, job->output->str, job->output->len);
+				if (!ed->stopping) editor_verbose_window_progress(ed, fd->path);
+				}
+
+			if (ed->callback)
+				{
+				cont = ed->callback((ed->list || ed->jobs) ? ed : NULL, ed->flags, job->fd_element, ed->data);
+				}
+			editor_job_free(job);
+
+			if (cont == EDITOR_CB_SUSPEND)
+				{
+				/* running children go on, their results wait for editor_resume() */
+				ed->suspended = TRUE;
+				return EDITOR_ERRORS(ed->flags);
+				}
+			if (cont == EDITOR_CB_SKIP) ed->stopping = TRUE;
+			}
+
+		/* finished files waiting for a slow one before them are limited too */
+		while (!ed->stopping && ed->list &&
+		       editor_jobs_running(ed) < ed->editor->jobs &&
+		       g_list_length(ed->jobs) < (guint)ed->editor->jobs * 4)
+			{
+			editor_job_start(ed);
+			progress = TRUE;
+			}
+		if (ed->vd) gtk_widget_set_sensitive(ed->vd->button_stop, (ed->list != NULL) && !ed->stopping);
+		}
+
+	if (ed->jobs) return 0;
+
+	/* everything is done, or stopped and the running children are done */
+	return editor_command_done(ed);
+}
+
 static EditorFlags editor_command_next_start(EditorData *ed)
 {
+	if (ed->parallel)
+		{
+		ed->suspended = FALSE;
+		return editor_command_parallel_next(ed);
+		}
+
 	if (ed->vd) editor_verbose_window_fill(ed->vd, "\n", 1);
 
 	if ((ed->list || (ed->flags & EDITOR_NO_PARAM)) && ed->count < ed->total)
@@ -1221,6 +1464,15 @@ static EditorFlags editor_command_done(EditorData *ed)
 {
 	EditorFlags flags;
 
+	if (ed->jobs)
+		{
+		/* editor_skip() in parallel mode, finish when the running children are done */
+		ed->stopping = TRUE;
+		ed->suspended = FALSE;
+		editor_command_parallel_next(ed);
+		return EDITOR_ERRORS(ed->flags);
+		}
+
 	if (ed->vd)
 		{
 		if (ed->count == ed->total)
@@ -1277,6 +1529,8 @@ static EditorFlags editor_command_start(const EditorDescription *editor, const g
 	ed->callback = cb;
 	ed->data = data;
 	ed->working_directory = g_strdup(working_directory);
+	ed->pid = -1;
+	ed->parallel = (editor->jobs > 1 && (flags & EDITOR_FOR_EACH) && !(flags & EDITOR_NO_PARAM) && ed->total > 1);
 
 	if ((flags & EDITOR_VERBOSE_MULTI) && list && list->next)
 		flags |= EDITOR_VERBOSE;
@@ -56,6 +56,7 @@ struct _EditorDescription {
 	gchar *file;
 	gchar *comment;		/* .desktop Comment key, used to show a tooltip */
 	EditorFlags flags;
+	gint jobs;		/* X-Geeqie-Jobs, %f commands run at the same time */
 	gboolean hidden;	/* explicitly hidden, shown in configuration dialog */
 	gboolean ignored;	/* not interesting, do not show at all */
 	gboolean disabled;	/* display disabled by user */
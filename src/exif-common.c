@@ -660,6 +660,171 @@ static void zd_tz(ZoneDetectResult *results, gchar **timezone, gchar **countryna
 	g_free(timezone_id);
 }
 
+/*
+ *-------------------------------------------------------------------
+ * timezone lookup
+ *-------------------------------------------------------------------
+ */
+
+/* results are cached per grid cell of 1/TZ_CACHE_GRID degree, about 100 m */
+#define TZ_CACHE_GRID 1000
+#define TZ_CACHE_SIZE 1024
+
+typedef struct _TZCacheEntry TZCacheEntry;
+struct _TZCacheEntry {
+	gint64 cell;
+	GList *link; /* in tz_cache_lru */
+
+	/* interned, NULL when the position has no zone */
+	const gchar *timezone;
+	const gchar *countryname;
+	const gchar *countryalpha2;
+};
+
+static GMutex tz_lock;
+static ZoneDetect *tz_database = NULL;
+static gboolean tz_database_tried = FALSE;
+static GHashTable *tz_cache = NULL; /* cell -> TZCacheEntry */
+static GQueue tz_cache_lru = G_QUEUE_INIT; /* most recent first */
+
+/* opened on first use and kept for the life of the process */
+static ZoneDetect *tz_database_get(void)
+{
+	gchar *path;
+	gchar *basename;
+	gchar *timezone_path;
+
+	if (tz_database_tried) return tz_database;
+	tz_database_tried = TRUE;
+
+	path = path_from_utf8(TIMEZONE_DATABASE);
+	basename = g_path_get_basename(path);
+	timezone_path = g_build_filename(get_rc_dir(), basename, NULL);
+	if (g_file_test(timezone_path, G_FILE_TEST_EXISTS))
+		{
+		tz_database = ZDOpenDatabase(timezone_path);
+		if (!tz_database)
+			{
+			log_printf("Error: Init of timezone database %s failed\n", timezone_path);
+			}
+		}
+	g_free(path);
+	g_free(timezone_path);
+	g_free(basename);
+
+	return tz_database;
+}
+
+static gint64 tz_cache_cell(gdouble latitude, gdouble longitude)
+{
+	gint64 lat = (gint64)floor(latitude * TZ_CACHE_GRID);
+	gint64 lon = (gint64)floor(longitude * TZ_CACHE_GRID);
+
+	return (lat + 90 * TZ_CACHE_GRID) * (360 * TZ_CACHE_GRID + 1) + (lon + 180 * TZ_CACHE_GRID);
+}
+
+static TZCacheEntry *tz_cache_lookup(ZoneDetect *database, gdouble latitude, gdouble longitude)
+{
+	TZCacheEntry *entry;
+	gint64 cell;
+
+	if (!tz_cache) tz_cache = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+
+	cell = tz_cache_cell(latitude, longitude);
+	entry = g_hash_table_lookup(tz_cache, &cell);
+	if (entry)
+		{
+		g_queue_unlink(&tz_cache_lru, entry->link);
+		g_queue_push_head_link(&tz_cache_lru, entry->link);
+		return entry;
+		}
+
+	if (g_queue_get_length(&tz_cache_lru) >= TZ_CACHE_SIZE)
+		{
+		TZCacheEntry *old = g_queue_pop_tail(&tz_cache_lru);
+
+		g_hash_table_remove(tz_cache, &old->cell);
+		}
+
+	entry = g_new0(TZCacheEntry, 1);
+	entry->cell = cell;
+
+	if (database)
+		{
+		ZoneDetectResult *results;
+
+		results = ZDLookup(database, latitude, longitude, NULL);
+		if (results)
+			{
+			gchar *timezone = NULL;
+			gchar *countryname = NULL;
+			gchar *countryalpha2 = NULL;
+
+			zd_tz(results, &timezone, &countryname, &countryalpha2);
+			entry->timezone = g_intern_string(timezone);
+			entry->countryname = g_intern_string(countryname);
+			entry->countryalpha2 = g_intern_string(countryalpha2);
+			g_free(timezone);
+			g_free(countryname);
+			g_free(countryalpha2);
+			ZDFreeResults(results);
+			}
+		}
+
+	g_hash_table_insert(tz_cache, &entry->cell, entry);
+	g_queue_push_head(&tz_cache_lru, entry);
+	entry->link = tz_cache_lru.head;
+
+	return entry;
+}
+
+/**
+ * @brief Looks up the timezone of a position
+ * @returns TRUE if the position was found in the timezone database
+ *
+ * The database is opened once for the process and recent results are
+ * cached, positions close to each other cost one lookup.
+ */
+static gboolean exif_timezone_lookup(gdouble latitude, gdouble longitude, gchar **timezone, gchar **countryname, gchar **countryalpha2)
+{
+	TZCacheEntry *entry;
+	gboolean found;
+
+	g_mutex_lock(&tz_lock);
+
+	entry = tz_cache_lookup(tz_database_get(), latitude, longitude);
+	found = (entry->timezone != NULL);
+	if (found)
+		{
+		*timezone = g_strdup(entry->timezone);
+		*countryname = g_strdup(entry->countryname);
+		*countryalpha2 = g_strdup(entry->countryalpha2);
+		}
+
+	g_mutex_unlock(&tz_lock);
+
+	return found;
+}
+
+/**
+ * @brief Drops the timezone database and the cached results
+ *
+ * Called when the database file is replaced, the next lookup opens it again.
+ */
+void exif_timezone_database_reset(void)
+{
+	g_mutex_lock(&tz_lock);
+
+	if (tz_database) ZDCloseDatabase(tz_database);
+	tz_database = NULL;
+	tz_database_tried = FALSE;
+
+	g_queue_clear(&tz_cache_lru);
+	if (tz_cache) g_hash_table_remove_all(tz_cache);
+
+	g_mutex_unlock(&tz_lock);
+}
+
 /**
  * @brief Gets timezone data from an exif structure
  * @param[in] exif
@@ -685,12 +850,7 @@ static gboolean exif_build_tz_data(ExifData *exif, gchar **exif_date_time, gchar
 	gchar *lat_min;
 	gchar *lon_deg;
 	gchar *lon_min;
-	gchar *timezone_path;
-	ZoneDetect *cd;
-	ZoneDetectResult *results;
 	gboolean ret = FALSE;
-	gchar *basename;
-	gchar *path;
 
 	text_latitude = exif_get_data_as_text(exif, "Exif.GPSInfo.GPSLatitude");
 	text_longitude = exif_get_data_as_text(exif, "Exif.GPSInfo.GPSLongitude");
@@ -724,30 +884,7 @@ static gboolean exif_build_tz_data(ExifData *exif, gchar **exif_date_time, gchar
 			longitude = -longitude;
 			}
 
-		path = path_from_utf8(TIMEZONE_DATABASE);
-		basename = g_path_get_basename(path);
-		timezone_path = g_build_filename(get_rc_dir(), basename, NULL);
-		if (g_file_test(timezone_path, G_FILE_TEST_EXISTS))
-			{
-			cd = ZDOpenDatabase(timezone_path);
-			if (cd)
-				{
-				results = ZDLookup(cd, latitude, longitude, NULL);
-				if (results)
-					{
-					zd_tz(results, timezone, countryname, countryalpha2);
-					ret = TRUE;
-					}
-				}
-			else
-				{
-				log_printf("Error: Init of timezone database %s failed\n", timezone_path);
-				}
-			ZDCloseDatabase(cd);
-			}
-		g_free(path);
-		g_free(timezone_path);
-		g_free(basename);
+		ret = exif_timezone_lookup(latitude, longitude, timezone, countryname, countryalpha2);
 		}
 
 	if (ret && text_date && text_time)
@@ -1017,6 +1154,8 @@ gchar *exif_get_data_as_text(ExifData *exif, const gchar *key)
 }
 
 
+#define EXIF_CACHE_ENTRY_BYTES (64 * 1024)
+
 static FileCacheData *exif_cache;
 
 void exif_release_cb(FileData *fd)
@@ -1029,6 +1168,8 @@ void exif_init_cache(void)
 {
 	g_assert(!exif_cache);
 	exif_cache = file_cache_new(exif_release_cb, 4);
+	/* the size of parsed metadata is not known, count an estimate per file */
+	file_cache_set_memory(exif_cache, "exif", MEMORY_COST_LOW, EXIF_CACHE_ENTRY_BYTES);
 }
 
 ExifData *exif_read_fd(FileData *fd)
@@ -1217,15 +1358,15 @@ gchar *metadata_file_info(FileData *fd, const gchar *key, MetadataFormat format)
 		}
 	if (strcmp(key, "file.owner") == 0)
 		{
-		return g_strdup(fd->owner);
+		return g_strdup(file_data_get_owner(fd));
 		}
 	if (strcmp(key, "file.group") == 0)
 		{
-		return g_strdup(fd->group);
+		return g_strdup(file_data_get_group(fd));
 		}
 	if (strcmp(key, "file.link") == 0)
 		{
-		return g_strdup(fd->sym_link);
+		return g_strdup(file_data_get_sym_link(fd));
 		}
 	if (strcmp(key, "file.page_no") == 0)
 		{
@@ -146,6 +146,8 @@ gchar *exif_get_tag_description_by_key(const gchar *key);
 
 gchar *exif_get_formatted_by_key(ExifData *exif, const gchar *key, gboolean *key_valid);
 
+void exif_timezone_database_reset(void);
+
 gint exif_update_metadata(ExifData *exif, const gchar *key, const GList *values);
 GList *exif_get_metadata(ExifData *exif, const gchar *key, MetadataFormat format);
 
@@ -46,6 +46,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <sys/mman.h>
 
 #if EXIV2_TEST_VERSION(0,27,0)
@@ -378,14 +379,47 @@ public:
 		else
 			{
 #if EXIV2_TEST_VERSION(0,17,0)
-			gchar *pathl = path_from_utf8(path);;
+			gchar *pathl = path_from_utf8(path);
+			/* write to a temporary file and rename it over the sidecar,
+			   readers never see a partially written file */
+			gchar *tmpl = g_strconcat(pathl, ".tmp_XXXXXX", NULL);
+			struct stat st;
+			gint tmp_fd = g_mkstemp_full(tmpl, O_RDWR, 0666);
 
-			Exiv2::Image::AutoPtr sidecar = Exiv2::ImageFactory::create(Exiv2::ImageType::xmp, pathl);
+			if (tmp_fd >= 0) close(tmp_fd);
 
-			g_free(pathl);
+			try
+				{
+				Exiv2::Image::AutoPtr sidecar = Exiv2::ImageFactory::create(Exiv2::ImageType::xmp, (tmp_fd >= 0) ? tmpl : pathl);
+
+				sidecar->setXmpData(xmpData_);
+				sidecar->writeMetadata();
+				}
+			catch (Exiv2::AnyError& e)
+				{
+				if (tmp_fd >= 0) unlink(tmpl);
+				g_free(tmpl);
+				g_free(pathl);
+				throw;
+				}
+
+			/* keep the permissions of the replaced sidecar */
+			if (tmp_fd >= 0 && stat(pathl, &st) == 0) chmod(tmpl, st.st_mode & 07777);
+
+			if (tmp_fd >= 0 && rename(tmpl, pathl) != 0)
+				{
+				unlink(tmpl);
+				g_free(tmpl);
+				g_free(pathl);
+#ifdef HAVE_EXIV2_ERROR_CODE
+				throw Exiv2::Error(Exiv2::kerFileRenameFailed, path, "", strerror(errno));
+#else
+				throw Exiv2::Error(17, path, "", strerror(errno));
+#endif
+				}
 
-			sidecar->setXmpData(xmpData_);
-			sidecar->writeMetadata();
+			g_free(tmpl);
+			g_free(pathl);
 #else
 #ifdef HAVE_EXIV2_ERROR_CODE
 			throw Exiv2::Error(Exiv2::kerNotAnImage, "xmp");
@@ -445,11 +479,27 @@ public:
 extern "C" {
 
 
+#if EXIV2_TEST_VERSION(0,21,0)
+static GMutex exif_xmp_mutex;
+
+static void exif_xmp_lock_func(void *data, bool lock)
+{
+	if (lock)
+		g_mutex_lock((GMutex *)data);
+	else
+		g_mutex_unlock((GMutex *)data);
+}
+#endif
+
 void exif_init(void)
 {
 #ifdef EXV_ENABLE_NLS
 	bind_textdomain_codeset (EXV_PACKAGE, "UTF-8");
 #endif
+#if EXIV2_TEST_VERSION(0,21,0)
+	/* metadata are written from worker threads, see metadata_write_perform_async() */
+	Exiv2::XmpParser::initialize(exif_xmp_lock_func, &exif_xmp_mutex);
+#endif
 }
 
 
@@ -20,6 +20,7 @@
 
 #include "main.h"
 #include "filecache.h"
+#include "memory-budget.h"
 
 /* Set to TRUE to add file cache dumps to the debug output */
 const gboolean debug_file_cache = FALSE;
@@ -31,12 +32,15 @@ struct _FileCacheData {
 	GList *list;
 	gulong max_size;
 	gulong size;
+	MemoryCache *memory;
+	gulong unit_size; /* bytes of one unit of size, for the memory budget */
 };
 
 typedef struct _FileCacheEntry FileCacheEntry;
 struct _FileCacheEntry {
 	FileData *fd;
 	gulong size;
+	gint64 last_used;
 };
 
 static void file_cache_notify_cb(FileData *fd, NotifyType type, gpointer data);
@@ -50,6 +54,8 @@ FileCacheData *file_cache_new(FileCacheReleaseFunc release, gulong max_size)
 	fc->list = NULL;
 	fc->max_size = max_size;
 	fc->size = 0;
+	fc->memory = NULL;
+	fc->unit_size = 1;
 
 	file_data_register_notify_func(file_cache_notify_cb, fc, NOTIFY_PRIORITY_HIGH);
 
@@ -70,6 +76,7 @@ gboolean file_cache_get(FileCacheData *fc, FileData *fd)
 			{
 			/* entry exists */
 			DEBUG_2("cache hit: fc=%p %s", fc, fd->path);
+			fce->last_used = g_get_monotonic_time();
 			if (work == fc->list) return TRUE; /* already at the beginning */
 			/* move it to the beginning */
 			DEBUG_2("cache move to front: fc=%p %s", fc, fd->path);
@@ -124,10 +131,12 @@ void file_cache_put(FileCacheData *fc, FileData *fd, gulong size)
 	fe = g_new(FileCacheEntry, 1);
 	fe->fd = file_data_ref(fd);
 	fe->size = size;
+	fe->last_used = g_get_monotonic_time();
 	fc->list = g_list_prepend(fc->list, fe);
 	fc->size += size;
 
 	file_cache_set_size(fc, fc->max_size);
+	if (fc->memory) memory_cache_changed();
 }
 
 gulong file_cache_get_max_size(FileCacheData *fc)
@@ -146,6 +155,51 @@ void file_cache_set_max_size(FileCacheData *fc, gulong size)
 	file_cache_set_size(fc, fc->max_size);
 }
 
+static gsize file_cache_memory_size(gpointer data)
+{
+	FileCacheData *fc = data;
+
+	return (gsize)fc->size * fc->unit_size;
+}
+
+static gint64 file_cache_memory_oldest(gpointer data)
+{
+	FileCacheData *fc = data;
+	GList *work = g_list_last(fc->list);
+
+	if (!work) return 0;
+
+	return ((FileCacheEntry *)work->data)->last_used;
+}
+
+static gsize file_cache_memory_evict(gpointer data)
+{
+	FileCacheData *fc = data;
+	gulong size;
+
+	if (!fc->list) return 0;
+
+	size = fc->size;
+	file_cache_set_size(fc, fc->size - ((FileCacheEntry *)g_list_last(fc->list)->data)->size);
+
+	return (gsize)(size - fc->size) * fc->unit_size;
+}
+
+/**
+ * \brief Adds the cache to the memory budget
+ * \param unit_size The bytes of one unit of the sizes given to file_cache_put()
+ *
+ * The cache keeps its own max_size, the budget may only evict more.
+ */
+void file_cache_set_memory(FileCacheData *fc, const gchar *name, MemoryCost cost, gulong unit_size)
+{
+	if (fc->memory) return;
+
+	fc->unit_size = unit_size;
+	fc->memory = memory_cache_register(name, cost, file_cache_memory_size,
+					   file_cache_memory_oldest, file_cache_memory_evict, fc);
+}
+
 static void file_cache_remove_fd(FileCacheData *fc, FileData *fd)
 {
 	GList *work;
@@ -23,6 +23,7 @@
 
 #include "main.h"
 #include "filedata.h"
+#include "memory-budget.h"
 
 typedef struct _FileCacheData FileCacheData;
 typedef void (*FileCacheReleaseFunc)(FileData *fd);
@@ -36,6 +37,7 @@ void file_cache_set_size(FileCacheData *fc, gulong size);
 gulong file_cache_get_max_size(FileCacheData *fc);
 gulong file_cache_get_size(FileCacheData *fc);
 void file_cache_set_max_size(FileCacheData *fc, gulong size);
+void file_cache_set_memory(FileCacheData *fc, const gchar *name, MemoryCost cost, gulong unit_size);
 
 
 #endif
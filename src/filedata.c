@@ -29,6 +29,7 @@
 #include "metadata.h"
 #include "trash.h"
 #include "histogram.h"
+#include "memory-budget.h"
 #include "secure_save.h"
 
 #include "exif.h"
@@ -39,6 +40,26 @@
 
 #ifdef DEBUG_FILEDATA
 gint global_file_data_count = 0;
+
+/* heap used by one FileData, without pixbufs and metadata */
+static gsize file_data_footprint(FileData *fd)
+{
+	gsize size = sizeof(FileData);
+
+	if (fd->original_path) size += strlen(fd->original_path) + 1;
+	if (fd->path && fd->path != fd->original_path) size += strlen(fd->path) + 1;
+
+	if (fd->cold)
+		{
+		size += sizeof(FileDataCold);
+		if (fd->cold->extended_extension) size += strlen(fd->cold->extended_extension) + 1;
+		if (fd->cold->collate_key_name) size += strlen(fd->cold->collate_key_name) + 1;
+		if (fd->cold->collate_key_name_nocase) size += strlen(fd->cold->collate_key_name_nocase) + 1;
+		if (fd->cold->sym_link) size += strlen(fd->cold->sym_link) + 1;
+		}
+
+	return size;
+}
 #endif
 
 static GHashTable *file_data_pool = NULL;
@@ -152,6 +173,139 @@ const gchar *text_from_time(time_t t)
 	return ret;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * thumbnail pixbufs
+ *-----------------------------------------------------------------------------
+ */
+
+/* the thumbnails are kept in a LRU, the most recently used first */
+typedef struct _ThumbPixbufEntry ThumbPixbufEntry;
+struct _ThumbPixbufEntry {
+	FileData *fd;
+	gint64 last_used;
+};
+
+static GQueue thumb_pixbuf_lru = G_QUEUE_INIT;
+static gsize thumb_pixbuf_bytes = 0;
+static MemoryCache *thumb_pixbuf_cache = NULL;
+
+static gsize thumb_pixbuf_size(GdkPixbuf *pixbuf)
+{
+	if (!pixbuf) return 0;
+	return (gsize)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+}
+
+static gsize thumb_pixbuf_cache_size(gpointer data)
+{
+	return thumb_pixbuf_bytes;
+}
+
+static gint64 thumb_pixbuf_cache_oldest(gpointer data)
+{
+	ThumbPixbufEntry *te = g_queue_peek_tail(&thumb_pixbuf_lru);
+
+	return te ? te->last_used : 0;
+}
+
+static gsize thumb_pixbuf_cache_evict(gpointer data)
+{
+	ThumbPixbufEntry *te = g_queue_peek_tail(&thumb_pixbuf_lru);
+	FileData *fd;
+	gsize size;
+
+	if (!te) return 0;
+
+	size = thumb_pixbuf_size(te->fd->thumb_pixbuf);
+	DEBUG_2("thumbnail evicted: %s", te->fd->path);
+	fd = file_data_ref(te->fd);
+	file_data_set_thumb_pixbuf(fd, NULL);
+
+	/* the views load it again if the row is visible */
+	file_data_send_notification(fd, NOTIFY_THUMBNAIL);
+	file_data_unref(fd);
+
+	return size;
+}
+
+/**
+ * \brief Marks the thumbnail of fd as used, call when it is drawn
+ *
+ * The views load thumbnails again when they draw a row without one,
+ * so the thumbnails of rows not drawn for the longest time are the
+ * first to go when the memory budget is exceeded.
+ */
+void file_data_touch_thumb_pixbuf(FileData *fd)
+{
+	ThumbPixbufEntry *te;
+
+	if (!fd->thumb_link) return;
+
+	te = fd->thumb_link->data;
+	te->last_used = g_get_monotonic_time();
+
+	if (fd->thumb_link == thumb_pixbuf_lru.head) return;
+
+	g_queue_unlink(&thumb_pixbuf_lru, fd->thumb_link);
+	g_queue_push_head_link(&thumb_pixbuf_lru, fd->thumb_link);
+}
+
+/**
+ * \brief Replaces the thumbnail of fd, takes the reference of pixbuf
+ *
+ * The thumbnails are kept in the memory budget and may be dropped
+ * again, see file_data_touch_thumb_pixbuf().
+ */
+void file_data_set_thumb_pixbuf(FileData *fd, GdkPixbuf *pixbuf)
+{
+	if (fd->thumb_pixbuf == pixbuf)
+		{
+		if (pixbuf) g_object_unref(pixbuf);
+		file_data_touch_thumb_pixbuf(fd);
+		return;
+		}
+
+	if (fd->thumb_pixbuf)
+		{
+		thumb_pixbuf_bytes -= MIN(thumb_pixbuf_size(fd->thumb_pixbuf), thumb_pixbuf_bytes);
+		g_object_unref(fd->thumb_pixbuf);
+		}
+
+	fd->thumb_pixbuf = pixbuf;
+
+	if (!pixbuf)
+		{
+		if (fd->thumb_link)
+			{
+			g_free(fd->thumb_link->data);
+			g_queue_delete_link(&thumb_pixbuf_lru, fd->thumb_link);
+			fd->thumb_link = NULL;
+			}
+		return;
+		}
+
+	if (!thumb_pixbuf_cache)
+		{
+		thumb_pixbuf_cache = memory_cache_register("thumbnails", MEMORY_COST_LOW,
+							   thumb_pixbuf_cache_size,
+							   thumb_pixbuf_cache_oldest,
+							   thumb_pixbuf_cache_evict, NULL);
+		}
+
+	if (!fd->thumb_link)
+		{
+		ThumbPixbufEntry *te = g_new(ThumbPixbufEntry, 1);
+
+		te->fd = fd;
+		g_queue_push_head(&thumb_pixbuf_lru, te);
+		fd->thumb_link = thumb_pixbuf_lru.head;
+		}
+	file_data_touch_thumb_pixbuf(fd);
+
+	thumb_pixbuf_bytes += thumb_pixbuf_size(pixbuf);
+	memory_cache_changed();
+}
+
 /*
  *-----------------------------------------------------------------------------
  * changed files detection and notification
@@ -178,8 +332,9 @@ static gboolean file_data_check_changed_single_file(FileData *fd, struct stat *s
 		fd->date = st->st_mtime;
 		fd->cdate = st->st_ctime;
 		fd->mode = st->st_mode;
-		if (fd->thumb_pixbuf) g_object_unref(fd->thumb_pixbuf);
-		fd->thumb_pixbuf = NULL;
+		fd->uid = st->st_uid;
+		fd->gid = st->st_gid;
+		file_data_set_thumb_pixbuf(fd, NULL);
 		file_data_increment_version(fd);
 		file_data_send_notification(fd, NOTIFY_REREAD);
 		return TRUE;
@@ -271,43 +426,109 @@ gboolean file_data_check_changed_files(FileData *fd)
  *-----------------------------------------------------------------------------
  */
 
+/**
+ * \brief Returns the rarely used fields of \a fd, allocated on first use
+ */
+FileDataCold *file_data_cold(FileData *fd)
+{
+	if (!fd->cold) fd->cold = g_new0(FileDataCold, 1);
+
+	return fd->cold;
+}
+
+static void file_data_cold_free(FileData *fd)
+{
+	FileDataCold *cold = fd->cold;
+
+	if (!cold) return;
+
+	g_free(cold->extended_extension);
+	g_free(cold->collate_key_name);
+	g_free(cold->collate_key_name_nocase);
+	g_free(cold->sym_link);
+	histmap_free(cold->histmap);
+	g_assert(cold->cached_metadata == NULL); /* freed by metadata_cache_free() */
+	g_free(cold);
+	fd->cold = NULL;
+}
+
 static void file_data_set_collate_keys(FileData *fd)
 {
+	FileDataCold *cold;
 	gchar *caseless_name;
 	gchar *valid_name;
 
 	valid_name = g_filename_display_name(fd->name);
 	caseless_name = g_utf8_casefold(valid_name, -1);
 
-	g_free(fd->collate_key_name);
-	g_free(fd->collate_key_name_nocase);
+	cold = file_data_cold(fd);
+	g_free(cold->collate_key_name);
+	g_free(cold->collate_key_name_nocase);
 
 #if GTK_CHECK_VERSION(2, 8, 0)
 	if (options->file_sort.natural)
 		{
-	 	fd->collate_key_name = g_utf8_collate_key_for_filename(fd->name, -1);
-	 	fd->collate_key_name_nocase = g_utf8_collate_key_for_filename(caseless_name, -1);
+	 	cold->collate_key_name = g_utf8_collate_key_for_filename(fd->name, -1);
+	 	cold->collate_key_name_nocase = g_utf8_collate_key_for_filename(caseless_name, -1);
 		}
 	else
 		{
-		fd->collate_key_name = g_utf8_collate_key(valid_name, -1);
-		fd->collate_key_name_nocase = g_utf8_collate_key(caseless_name, -1);
+		cold->collate_key_name = g_utf8_collate_key(valid_name, -1);
+		cold->collate_key_name_nocase = g_utf8_collate_key(caseless_name, -1);
 		}
 #else
-	fd->collate_key_name = g_utf8_collate_key(valid_name, -1);
-	fd->collate_key_name_nocase = g_utf8_collate_key(caseless_name, -1);
+	cold->collate_key_name = g_utf8_collate_key(valid_name, -1);
+	cold->collate_key_name_nocase = g_utf8_collate_key(caseless_name, -1);
 #endif
 
 	g_free(valid_name);
 	g_free(caseless_name);
 }
 
+static void file_data_reset_collate_keys(FileData *fd)
+{
+	if (!fd->cold) return;
+
+	g_free(fd->cold->collate_key_name);
+	g_free(fd->cold->collate_key_name_nocase);
+	fd->cold->collate_key_name = NULL;
+	fd->cold->collate_key_name_nocase = NULL;
+}
+
+/**
+ * \brief Returns the key for sorting by name, built on first use
+ *
+ * Most files are never sorted by name, a scan does not build the keys.
+ */
+const gchar *file_data_get_collate_key(FileData *fd, gboolean case_sensitive)
+{
+	if (!fd->cold || !fd->cold->collate_key_name) file_data_set_collate_keys(fd);
+
+	return case_sensitive ? fd->cold->collate_key_name : fd->cold->collate_key_name_nocase;
+}
+
+/* one lookup gives both, the class follows the name on rename */
+static void file_data_set_format(FileData *fd)
+{
+	FilterMatch match;
+
+	filter_name_match(fd->path, &match);
+	fd->format_class = filter_match_get_class(&match);
+	fd->extension = match.extension;
+	if (fd->extension == NULL)
+		{
+		fd->extension = fd->name + strlen(fd->name);
+		}
+
+	fd->sidecar_priority = sidecar_file_priority(fd->extension);
+}
+
 static void file_data_set_path(FileData *fd, const gchar *path)
 {
 	g_assert(path /* && *path*/); /* view_dir_tree uses FileData with zero length path */
 	g_assert(file_data_pool);
 
-	g_free(fd->path);
+	if (fd->path != fd->original_path) g_free(fd->path);
 
 	if (fd->original_path)
 		{
@@ -317,50 +538,158 @@ static void file_data_set_path(FileData *fd, const gchar *path)
 
 	g_assert(!g_hash_table_lookup(file_data_pool, path));
 
+	if (fd->cold)
+		{
+		g_free(fd->cold->sym_link);
+		fd->cold->sym_link = NULL;
+		}
+
 	fd->original_path = g_strdup(path);
 	g_hash_table_insert(file_data_pool, fd->original_path, fd);
 
+	/* the path is only different from original_path for "." and ".." */
+	fd->path = fd->original_path;
+	fd->format_class = FORMAT_CLASS_UNKNOWN;
+
 	if (strcmp(path, G_DIR_SEPARATOR_S) == 0)
 		{
-		fd->path = g_strdup(path);
 		fd->name = fd->path;
 		fd->extension = fd->name + 1;
-		file_data_set_collate_keys(fd);
+		file_data_reset_collate_keys(fd);
 		return;
 		}
 
-	fd->path = g_strdup(path);
 	fd->name = filename_from_path(fd->path);
 
 	if (strcmp(fd->name, "..") == 0)
 		{
 		gchar *dir = remove_level_from_path(path);
-		g_free(fd->path);
 		fd->path = remove_level_from_path(dir);
 		g_free(dir);
 		fd->name = "..";
 		fd->extension = fd->name + 2;
-		file_data_set_collate_keys(fd);
+		file_data_reset_collate_keys(fd);
 		return;
 		}
 	else if (strcmp(fd->name, ".") == 0)
 		{
-		g_free(fd->path);
 		fd->path = remove_level_from_path(path);
 		fd->name = ".";
 		fd->extension = fd->name + 1;
-		file_data_set_collate_keys(fd);
+		file_data_reset_collate_keys(fd);
 		return;
 		}
 
-	fd->extension = registered_extension_from_path(fd->path);
-	if (fd->extension == NULL)
+	file_data_set_format(fd);
+	file_data_reset_collate_keys(fd);
+}
+
+static void file_data_filter_changed_cb(gpointer key, gpointer value, gpointer user_data)
+{
+	FileData *fd = value;
+
+	/* the root folder, "." and ".." have no format */
+	if (fd->path != fd->original_path || strcmp(fd->path, G_DIR_SEPARATOR_S) == 0) return;
+
+	file_data_set_format(fd);
+	file_data_reset_collate_keys(fd);
+}
+
+/**
+ * \brief Classifies the existing FileData again by the changed file types
+ *
+ * Called by filter_rebuild().
+ */
+void file_data_filter_changed(void)
+{
+	if (!file_data_pool) return;
+
+	g_hash_table_foreach(file_data_pool, file_data_filter_changed_cb, NULL);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * owner, group and link, read on demand
+ *-----------------------------------------------------------------------------
+ */
+
+/* uid and gid to interned names, the passwd and group databases may be remote */
+static GHashTable *file_data_owner_names = NULL;
+static GHashTable *file_data_group_names = NULL;
+static GMutex file_data_names_lock;
+
+const gchar *file_data_get_owner(FileData *fd)
+{
+	const gchar *name;
+
+	g_mutex_lock(&file_data_names_lock);
+	if (!file_data_owner_names) file_data_owner_names = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	name = g_hash_table_lookup(file_data_owner_names, GUINT_TO_POINTER(fd->uid));
+	if (!name)
 		{
-		fd->extension = fd->name + strlen(fd->name);
+		struct passwd *user;
+
+		user = getpwuid(fd->uid);
+		if (user)
+			{
+			name = g_intern_string(user->pw_name);
+			}
+		else
+			{
+			gchar *buf = g_strdup_printf("%u", (guint)fd->uid);
+
+			name = g_intern_string(buf);
+			g_free(buf);
+			}
+		g_hash_table_insert(file_data_owner_names, GUINT_TO_POINTER(fd->uid), (gpointer)name);
 		}
+	g_mutex_unlock(&file_data_names_lock);
 
-	fd->sidecar_priority = sidecar_file_priority(fd->extension);
-	file_data_set_collate_keys(fd);
+	return name;
+}
+
+const gchar *file_data_get_group(FileData *fd)
+{
+	const gchar *name;
+
+	g_mutex_lock(&file_data_names_lock);
+	if (!file_data_group_names) file_data_group_names = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	name = g_hash_table_lookup(file_data_group_names, GUINT_TO_POINTER(fd->gid));
+	if (!name)
+		{
+		struct group *group;
+
+		group = getgrgid(fd->gid);
+		if (group)
+			{
+			name = g_intern_string(group->gr_name);
+			}
+		else
+			{
+			gchar *buf = g_strdup_printf("%u", (guint)fd->gid);
+
+			name = g_intern_string(buf);
+			g_free(buf);
+			}
+		g_hash_table_insert(file_data_group_names, GUINT_TO_POINTER(fd->gid), (gpointer)name);
+		}
+	g_mutex_unlock(&file_data_names_lock);
+
+	return name;
+}
+
+/**
+ * \brief Returns the target of a symbolic link, an empty string for other files
+ */
+const gchar *file_data_get_sym_link(FileData *fd)
+{
+	FileDataCold *cold = file_data_cold(fd);
+
+	if (!cold->sym_link) cold->sym_link = get_symbolic_link(fd->path);
+
+	return cold->sym_link;
 }
 
 /*
@@ -372,8 +701,6 @@ static void file_data_set_path(FileData *fd, const gchar *path)
 static FileData *file_data_new(const gchar *path_utf8, struct stat *st, gboolean disable_sidecars)
 {
 	FileData *fd;
-	struct passwd *user;
-	struct group *group;
 
 	DEBUG_2("file_data_new: '%s' %d", path_utf8, disable_sidecars);
 
@@ -434,35 +761,19 @@ static FileData *file_data_new(const gchar *path_utf8, struct stat *st, gboolean
 	fd->magick = FD_MAGICK;
 	fd->exifdate = 0;
 	fd->rating = STAR_RATING_NOT_READ;
-	fd->format_class = filter_file_get_class(path_utf8);
 	fd->page_num = 0;
 	fd->page_total = 0;
 
-	user = getpwuid(st->st_uid);
-	if (!user)
-		{
-		fd->owner = g_strdup_printf("%u", st->st_uid);
-		}
-	else
-		{
-		fd->owner = g_strdup(user->pw_name);
-		}
-
-	group = getgrgid(st->st_gid);
-	if (!group)
-		{
-		fd->group = g_strdup_printf("%u", st->st_gid);
-		}
-	else
-		{
-		fd->group = g_strdup(group->gr_name);
-		}
-
-	fd->sym_link = get_symbolic_link(path_utf8);
+	fd->uid = st->st_uid;
+	fd->gid = st->st_gid;
 
 	if (disable_sidecars) fd->disable_grouping = TRUE;
 
-	file_data_set_path(fd, path_utf8); /* set path, name, collate_key_*, original_path */
+	file_data_set_path(fd, path_utf8); /* set path, name, extension, format_class, original_path */
+
+#ifdef DEBUG_FILEDATA
+	DEBUG_3("file data %s: %" G_GSIZE_FORMAT " bytes", fd->path, file_data_footprint(fd));
+#endif
 
 	return fd;
 }
@@ -658,6 +969,15 @@ FileData *file_data_new_dir(const gchar *path_utf8)
 	return file_data_new(path_utf8, &st, TRUE);
 }
 
+/**
+ * \brief Creates the FileData of a folder with a stat the caller already has
+ * \param path Locale encoded
+ */
+FileData *file_data_new_dir_local(const gchar *path, struct stat *st)
+{
+	return file_data_new_local(path, st, TRUE);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * reference counting
@@ -696,22 +1016,16 @@ static void file_data_free(FileData *fd)
 
 #ifdef DEBUG_FILEDATA
 	global_file_data_count--;
-	DEBUG_2("file data count--: %d", global_file_data_count);
+	DEBUG_2("file data count--: %d, %" G_GSIZE_FORMAT " bytes freed", global_file_data_count, file_data_footprint(fd));
 #endif
 
 	metadata_cache_free(fd);
 	g_hash_table_remove(file_data_pool, fd->original_path);
 
-	g_free(fd->path);
+	if (fd->path != fd->original_path) g_free(fd->path);
 	g_free(fd->original_path);
-	g_free(fd->collate_key_name);
-	g_free(fd->collate_key_name_nocase);
-	g_free(fd->extended_extension);
-	if (fd->thumb_pixbuf) g_object_unref(fd->thumb_pixbuf);
-	histmap_free(fd->histmap);
-	g_free(fd->owner);
-	g_free(fd->group);
-	g_free(fd->sym_link);
+	file_data_set_thumb_pixbuf(fd, NULL);
+	file_data_cold_free(fd);
 	g_assert(fd->sidecar_files == NULL); /* sidecar files must be freed before calling this */
 
 	file_data_change_info_free(NULL, fd);
@@ -1036,8 +1350,11 @@ static void file_data_disconnect_sidecar_file(FileData *target, FileData *sfd)
 
 	target->sidecar_files = g_list_remove(target->sidecar_files, sfd);
 	sfd->parent = NULL;
-	g_free(sfd->extended_extension);
-	sfd->extended_extension = NULL;
+	if (sfd->cold)
+		{
+		g_free(sfd->cold->extended_extension);
+		sfd->cold->extended_extension = NULL;
+		}
 
 	file_data_unref(target);
 	file_data_unref(sfd);
@@ -1168,10 +1485,8 @@ gint filelist_sort_compare_filedata(FileData *fa, FileData *fb)
 			break;
 		}
 
-	if (options->file_sort.case_sensitive)
-		ret = strcmp(fa->collate_key_name, fb->collate_key_name);
-	else
-		ret = strcmp(fa->collate_key_name_nocase, fb->collate_key_name_nocase);
+	ret = strcmp(file_data_get_collate_key(fa, options->file_sort.case_sensitive),
+		     file_data_get_collate_key(fb, options->file_sort.case_sensitive));
 
 	if (ret != 0) return ret;
 
@@ -1259,9 +1574,12 @@ static GList * file_data_basename_hash_insert(GHashTable *basename_hash, FileDat
 					}
 				else
 					{
+					FileDataCold *cold = file_data_cold(fd);
+
 					g_free(basename);
 					basename = parent_basename;
-					fd->extended_extension = g_strconcat(parent_extension, fd->extension, NULL);
+					g_free(cold->extended_extension);
+					cold->extended_extension = g_strconcat(parent_extension, fd->extension, NULL);
 					}
 				}
 			}
@@ -1341,7 +1659,7 @@ static gboolean is_hidden_file(const gchar *name)
  *-----------------------------------------------------------------------------
  */
 
-static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList **dirs, gboolean follow_symlinks)
+static gboolean filelist_read_real_untraced(const gchar *dir_path, GList **files, GList **dirs, gboolean follow_symlinks)
 {
 	DIR *dp;
 	struct dirent *dir;
@@ -1383,6 +1701,12 @@ static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList *
 		if (!options->file_filter.show_hidden_files && is_hidden_file(name))
 			continue;
 
+#ifdef _DIRENT_HAVE_D_TYPE
+		/* only folders are wanted, do not stat the files */
+		if (!files && dir->d_type != DT_UNKNOWN && dir->d_type != DT_DIR && dir->d_type != DT_LNK)
+			continue;
+#endif
+
 		filepath = g_build_filename(pathl, name, NULL);
 		if (stat_func(filepath, &ent_sbuf) >= 0)
 			{
@@ -1447,6 +1771,17 @@ static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList *
 	return TRUE;
 }
 
+static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList **dirs, gboolean follow_symlinks)
+{
+	gint64 t = TRACE_BEGIN();
+	gboolean ret;
+
+	ret = filelist_read_real_untraced(dir_path, files, dirs, follow_symlinks);
+	TRACE_END(t, TRACE_SCAN, "filelist_read");
+
+	return ret;
+}
+
 gboolean filelist_read(FileData *dir_fd, GList **files, GList **dirs)
 {
 	return filelist_read_real(dir_fd->path, files, dirs, TRUE);
@@ -1898,7 +2233,7 @@ static gboolean file_data_filter_class(FileData *fd, guint filter)
 		{
 		if (filter & (1 << i))
 			{
-			if ((FileFormatClass)i == filter_file_get_class(fd->path))
+			if ((FileFormatClass)i == fd->format_class)
 				{
 				return TRUE;
 				}
@@ -2377,7 +2712,7 @@ static void file_data_update_ci_dest_preserve_ext(FileData *fd, const gchar *des
 	gchar *base = remove_extension_from_path(dest_path);
 	gchar *old_path = fd->change->dest;
 
-	fd->change->dest = g_strconcat(base, fd->extended_extension ? fd->extended_extension : extension, NULL);
+	fd->change->dest = g_strconcat(base, (fd->cold && fd->cold->extended_extension) ? fd->cold->extended_extension : extension, NULL);
 	file_data_update_planned_change_hash(fd, old_path, fd->change->dest);
 
 	g_free(old_path);
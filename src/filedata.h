@@ -40,6 +40,7 @@ FileData *file_data_new_no_grouping(const gchar *path_utf8);
 
 /* should be used on dirs */
 FileData *file_data_new_dir(const gchar *path_utf8);
+FileData *file_data_new_dir_local(const gchar *path, struct stat *st);
 
 FileData *file_data_new_simple(const gchar *path_utf8);
 
@@ -61,6 +62,9 @@ void file_data_unlock_list(GList *list);
 gboolean file_data_check_changed_files(FileData *fd);
 
 void file_data_increment_version(FileData *fd);
+void file_data_filter_changed(void);
+void file_data_set_thumb_pixbuf(FileData *fd, GdkPixbuf *pixbuf);
+void file_data_touch_thumb_pixbuf(FileData *fd);
 
 gboolean file_data_add_change_info(FileData *fd, FileDataChangeType type, const gchar *src, const gchar *dest);
 void file_data_change_info_free(FileDataChangeInfo *fdci, FileData *fd);
@@ -105,6 +109,12 @@ GList *file_data_filter_file_filter_list(GList *list, GRegex *filter);
 
 GList *file_data_filter_class_list(GList *list, guint filter);
 
+FileDataCold *file_data_cold(FileData *fd);
+const gchar *file_data_get_collate_key(FileData *fd, gboolean case_sensitive);
+const gchar *file_data_get_owner(FileData *fd);
+const gchar *file_data_get_group(FileData *fd);
+const gchar *file_data_get_sym_link(FileData *fd);
+
 gint file_data_get_user_orientation(FileData *fd);
 void file_data_set_user_orientation(FileData *fd, gint value);
 
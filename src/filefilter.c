@@ -23,6 +23,7 @@
 #include "filefilter.h"
 
 #include "cache.h"
+#include "filedata.h"
 #include "misc.h"
 #include "secure_save.h"
 #include "thumb_standard.h"
@@ -36,13 +37,29 @@
  */
 
 static GList *filter_list = NULL;
-static GList *extension_list = NULL;
 static GList *sidecar_ext_list = NULL;
 
 static GList *file_class_extension_list[FILE_FORMAT_CLASSES];
 
-static GList *file_writable_list = NULL; /* writable files */
-static GList *file_sidecar_list = NULL; /* files with allowed sidecar */
+/*
+ * The enabled extensions are compiled by filter_rebuild() into a trie of
+ * reversed extensions, so one walk from the end of a name finds every
+ * extension the name ends with.
+ */
+typedef struct _FilterNode FilterNode;
+struct _FilterNode
+{
+	gchar c;		/* lower case, the root has none */
+	gboolean terminal;	/* an extension ends here */
+	guint classes;		/* bit per FileFormatClass of the extensions ending here */
+	gboolean writable;
+	gboolean allow_sidecar;
+	gint child;		/* index of the first child, -1 for none */
+	gint next;		/* index of the next sibling, -1 for none */
+};
+
+static GArray *filter_trie = NULL; /* FilterNode, the root is index 0 */
+static guint filter_trie_extensions = 0;
 
 
 static FilterEntry *filter_entry_new(const gchar *key, const gchar *description,
@@ -354,33 +371,71 @@ GList *filter_to_list(const gchar *extensions)
 	return list;
 }
 
-static gint filter_sort_ext_len_cb(gconstpointer a, gconstpointer b)
+static gint filter_trie_child(GArray *trie, gint node, gchar c, gboolean create)
 {
-	gchar *sa = (gchar *)a;
-	gchar *sb = (gchar *)b;
+	gint child = g_array_index(trie, FilterNode, node).child;
+	FilterNode new_node;
+
+	while (child >= 0)
+		{
+		FilterNode *fn = &g_array_index(trie, FilterNode, child);
+
+		if (fn->c == c) return child;
+		child = fn->next;
+		}
+
+	if (!create) return -1;
 
-	gint len_a = strlen(sa);
-	gint len_b = strlen(sb);
+	memset(&new_node, 0, sizeof(new_node));
+	new_node.c = c;
+	new_node.child = -1;
+	new_node.next = g_array_index(trie, FilterNode, node).child;
+	g_array_append_val(trie, new_node);
 
-	if (len_a > len_b) return -1;
-	if (len_a < len_b) return 1;
-	return 0;
+	child = trie->len - 1;
+	g_array_index(trie, FilterNode, node).child = child;
+
+	return child;
 }
 
+static void filter_trie_add(const gchar *ext, FileFormatClass file_class, gboolean writable, gboolean allow_sidecar)
+{
+	FilterNode *fn;
+	gint node = 0;
+	gint i;
 
-void filter_rebuild(void)
+	for (i = strlen(ext) - 1; i >= 0; i--)
+		{
+		node = filter_trie_child(filter_trie, node, g_ascii_tolower(ext[i]), TRUE);
+		}
+
+	fn = &g_array_index(filter_trie, FilterNode, node);
+	if (!fn->terminal) filter_trie_extensions++;
+	fn->terminal = TRUE;
+	if (file_class < FILE_FORMAT_CLASSES) fn->classes |= 1 << file_class;
+	if (writable) fn->writable = TRUE;
+	if (allow_sidecar) fn->allow_sidecar = TRUE;
+}
+
+static void filter_trie_reset(void)
 {
-	GList *work;
-	guint i;
+	FilterNode root;
 
-	string_list_free(extension_list);
-	extension_list = NULL;
+	/* threads may still hold a reference, see filter_trie_ref() */
+	if (filter_trie) g_array_unref(filter_trie);
+	filter_trie = g_array_new(FALSE, FALSE, sizeof(FilterNode));
+	filter_trie_extensions = 0;
 
-	string_list_free(file_writable_list);
-	file_writable_list = NULL;
+	memset(&root, 0, sizeof(root));
+	root.child = -1;
+	root.next = -1;
+	g_array_append_val(filter_trie, root);
+}
 
-	string_list_free(file_sidecar_list);
-	file_sidecar_list = NULL;
+void filter_rebuild(void)
+{
+	GList *work;
+	guint i;
 
 	for (i = 0; i < FILE_FORMAT_CLASSES; i++)
 		{
@@ -388,6 +443,8 @@ void filter_rebuild(void)
 		file_class_extension_list[i] = NULL;
 		}
 
+	filter_trie_reset();
+
 	work = filter_list;
 	while (work)
 		{
@@ -399,105 +456,158 @@ void filter_rebuild(void)
 		if (fe->enabled)
 			{
 			GList *ext;
+			GList *ext_work;
 
 			ext = filter_to_list(fe->extensions);
-			if (ext) extension_list = g_list_concat(extension_list, ext);
+			for (ext_work = ext; ext_work; ext_work = ext_work->next)
+				{
+				filter_trie_add(ext_work->data, fe->file_class, fe->writable, fe->allow_sidecar);
+				}
 
 			if (fe->file_class < FILE_FORMAT_CLASSES)
 				{
-				ext = filter_to_list(fe->extensions);
 				if (ext) file_class_extension_list[fe->file_class] = g_list_concat(file_class_extension_list[fe->file_class], ext);
 				}
 			else
 				{
 				log_printf("WARNING: invalid file class %d\n", fe->file_class);
+				string_list_free(ext);
 				}
-
-			if (fe->writable)
-				{
-				ext = filter_to_list(fe->extensions);
-				if (ext) file_writable_list = g_list_concat(file_writable_list, ext);
-				}
-
-			if (fe->allow_sidecar)
-				{
-				ext = filter_to_list(fe->extensions);
-				if (ext) file_sidecar_list = g_list_concat(file_sidecar_list, ext);
-				}
-
 			}
 		}
 
-	/* make sure registered_extension_from_path finds the longer match first */
-	extension_list = g_list_sort(extension_list, filter_sort_ext_len_cb);
 	sidecar_ext_parse(options->sidecar.ext); /* this must be updated after changed file extensions */
+	file_data_filter_changed();
 }
 
-/* return the extension part of the name or NULL */
-static const gchar *filter_name_find(GList *filter, const gchar *name)
+/**
+ * \brief Classifies a name by all the enabled extensions it ends with
+ * \returns FALSE if no extension matches
+ *
+ * match->extension is the longest matching extension, pointing into \a name.
+ * \a trie is from filter_trie_ref(), this can be called from any thread.
+ */
+gboolean filter_trie_match(GArray *trie, const gchar *name, FilterMatch *match)
 {
-	GList *work;
-	guint ln;
+	const FilterNode *fn;
+	gint node = 0;
+	gint i;
 
-	ln = strlen(name);
-	work = filter;
-	while (work)
-		{
-		gchar *filter = work->data;
-		guint lf = strlen(filter);
+	memset(match, 0, sizeof(*match));
+	if (!trie) return FALSE;
 
-		if (ln >= lf)
+	i = strlen(name);
+	while (TRUE)
+		{
+		fn = &g_array_index(trie, FilterNode, node);
+		if (fn->terminal)
 			{
 			/* FIXME: utf8 */
-			if (g_ascii_strncasecmp(name + ln - lf, filter, lf) == 0) return name + ln - lf;
+			match->extension = name + i;
+			match->classes |= fn->classes;
+			if (fn->writable) match->writable = TRUE;
+			if (fn->allow_sidecar) match->allow_sidecar = TRUE;
 			}
-		work = work->next;
+
+		if (i == 0) break;
+		i--;
+		node = filter_trie_child(trie, node, g_ascii_tolower(name[i]), FALSE);
+		if (node < 0) break;
 		}
 
-	return NULL;
+	return (match->extension != NULL);
+}
+
+gboolean filter_name_match(const gchar *name, FilterMatch *match)
+{
+	return filter_trie_match(filter_trie, name, match);
+}
+
+/**
+ * \brief The enabled extensions, unchanged by a later filter_rebuild()
+ * \returns Free with g_array_unref(), NULL before the filter is built
+ */
+GArray *filter_trie_ref(void)
+{
+	return filter_trie ? g_array_ref(filter_trie) : NULL;
+}
+
+/**
+ * \brief The class of a match, in the order image, raw, meta, video, collection, document
+ */
+FileFormatClass filter_match_get_class(const FilterMatch *match)
+{
+	static const FileFormatClass order[] = {
+		FORMAT_CLASS_IMAGE,
+		FORMAT_CLASS_RAWIMAGE,
+		FORMAT_CLASS_META,
+		FORMAT_CLASS_VIDEO,
+		FORMAT_CLASS_COLLECTION,
+		FORMAT_CLASS_DOCUMENT
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(order); i++)
+		{
+		if (match->classes & (1 << order[i])) return order[i];
+		}
+
+	return FORMAT_CLASS_UNKNOWN;
 }
+
 const gchar *registered_extension_from_path(const gchar *name)
 {
-	return filter_name_find(extension_list, name);
+	FilterMatch match;
+
+	filter_name_match(name, &match);
+	return match.extension;
 }
 
 gboolean filter_name_exists(const gchar *name)
 {
-	if (!extension_list || options->file_filter.disable) return TRUE;
+	FilterMatch match;
 
-	return !!filter_name_find(extension_list, name);
+	if (!filter_trie_extensions || options->file_filter.disable) return TRUE;
+
+	return filter_name_match(name, &match);
 }
 
 gboolean filter_file_class(const gchar *name, FileFormatClass file_class)
 {
+	FilterMatch match;
+
 	if (file_class >= FILE_FORMAT_CLASSES)
 		{
 		log_printf("WARNING: invalid file class %d\n", file_class);
 		return FALSE;
 		}
 
-	return !!filter_name_find(file_class_extension_list[file_class], name);
+	filter_name_match(name, &match);
+	return !!(match.classes & (1 << file_class));
 }
 
 FileFormatClass filter_file_get_class(const gchar *name)
 {
-	if (filter_file_class(name, FORMAT_CLASS_IMAGE)) return FORMAT_CLASS_IMAGE;
-	if (filter_file_class(name, FORMAT_CLASS_RAWIMAGE)) return FORMAT_CLASS_RAWIMAGE;
-	if (filter_file_class(name, FORMAT_CLASS_META)) return FORMAT_CLASS_META;
-	if (filter_file_class(name, FORMAT_CLASS_VIDEO)) return FORMAT_CLASS_VIDEO;
-	if (filter_file_class(name, FORMAT_CLASS_COLLECTION)) return FORMAT_CLASS_COLLECTION;
-	if (filter_file_class(name, FORMAT_CLASS_DOCUMENT)) return FORMAT_CLASS_DOCUMENT;
-	return FORMAT_CLASS_UNKNOWN;
+	FilterMatch match;
+
+	filter_name_match(name, &match);
+	return filter_match_get_class(&match);
 }
 
 gboolean filter_name_is_writable(const gchar *name)
 {
-	return !!filter_name_find(file_writable_list, name);
+	FilterMatch match;
+
+	filter_name_match(name, &match);
+	return match.writable;
 }
 
 gboolean filter_name_allow_sidecar(const gchar *name)
 {
-	return !!filter_name_find(file_sidecar_list, name);
+	FilterMatch match;
+
+	filter_name_match(name, &match);
+	return match.allow_sidecar;
 }
 
 void filter_write_list(GString *outstr, gint indent)
@@ -34,6 +34,15 @@ struct _FilterEntry {
 	gboolean allow_sidecar;
 };
 
+/* the enabled extensions a name ends with, see filter_name_match() */
+typedef struct _FilterMatch FilterMatch;
+struct _FilterMatch {
+	const gchar *extension; /* longest match, points into the name */
+	guint classes; /* bit per FileFormatClass */
+	gboolean writable;
+	gboolean allow_sidecar;
+};
+
 /* you can change, but not add or remove entries from the returned list */
 GList *filter_get_list(void);
 void filter_remove_entry(FilterEntry *fe);
@@ -45,6 +54,11 @@ void filter_reset(void);
 void filter_rebuild(void);
 GList *filter_to_list(const gchar *extensions);
 
+gboolean filter_name_match(const gchar *name, FilterMatch *match);
+GArray *filter_trie_ref(void);
+gboolean filter_trie_match(GArray *trie, const gchar *name, FilterMatch *match);
+FileFormatClass filter_match_get_class(const FilterMatch *match);
+
 const gchar *registered_extension_from_path(const gchar *name);
 gboolean filter_name_exists(const gchar *name);
 gboolean filter_file_class(const gchar *name, FileFormatClass file_class);
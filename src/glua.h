@@ -29,6 +29,7 @@
 void lua_init(void);
 
 gchar *lua_callvalue(FileData *fd, const gchar *file, const gchar *function);
+GList *lua_callvalue_list(GList *list, const gchar *file, const gchar *function);
 
 #endif
 #endif
@@ -34,6 +34,14 @@
 
 #define HISTMAP_SIZE 256
 
+/* pixels read for the approximate map shown while the exact one is counted */
+#define HISTMAP_SAMPLE_PIXELS 262144
+
+/* smallest band of pixels worth handing to a thread */
+#define HISTMAP_BAND_PIXELS 1048576
+
+typedef struct _HistMapJob HistMapJob;
+
 struct _HistMap {
 	gulong r[HISTMAP_SIZE];
 	gulong g[HISTMAP_SIZE];
@@ -43,6 +51,19 @@ struct _HistMap {
 	guint idle_id; /* event source id */
 	GdkPixbuf *pixbuf;
 	gint y;
+
+	gboolean sampled; /* counts are from every Nth pixel, exact ones are on the way */
+	HistMapJob *job;
+};
+
+/* per band counts, two sets so that neighbouring pixels of the same
+ * colour do not wait for each other's increment */
+typedef struct _HistMapCount HistMapCount;
+struct _HistMapCount {
+	guint32 r[HISTMAP_SIZE];
+	guint32 g[HISTMAP_SIZE];
+	guint32 b[HISTMAP_SIZE];
+	guint32 max[HISTMAP_SIZE];
 };
 
 
@@ -142,25 +163,61 @@ static HistMap *histmap_new(void)
 	return histmap;
 }
 
-void histmap_free(HistMap *histmap)
+static void histmap_count_rows(HistMapCount count[2], GdkPixbuf *pixbuf, gint y1, gint y2, gint sample)
 {
-	if (!histmap) return;
-	if (histmap->idle_id) g_source_remove(histmap->idle_id);
-	if (histmap->pixbuf) g_object_unref(histmap->pixbuf);
-	g_free(histmap);
+	gint w, srs, step, i, j;
+	guchar *s_pix;
+
+	w = gdk_pixbuf_get_width(pixbuf);
+	srs = gdk_pixbuf_get_rowstride(pixbuf);
+	s_pix = gdk_pixbuf_get_pixels(pixbuf);
+	step = (3 + !!gdk_pixbuf_get_has_alpha(pixbuf)) * sample;
+
+	for (i = y1; i < y2; i += sample)
+		{
+		guchar *sp = s_pix + (i * srs); /* 8bit */
+		gint set = 0;
+
+		for (j = 0; j < w; j += sample)
+			{
+			HistMapCount *c = &count[set];
+			guint max;
+
+			max = MAX(sp[0], sp[1]);
+			max = MAX(max, sp[2]);
+
+			c->r[sp[0]]++;
+			c->g[sp[1]]++;
+			c->b[sp[2]]++;
+			c->max[max]++;
+
+			set ^= 1;
+			sp += step;
+			}
+		}
+}
+
+static void histmap_add_count(HistMap *histmap, HistMapCount count[2], gulong weight)
+{
+	gint i;
+
+	for (i = 0; i < HISTMAP_SIZE; i++)
+		{
+		histmap->r[i] += (count[0].r[i] + count[1].r[i]) * weight;
+		histmap->g[i] += (count[0].g[i] + count[1].g[i]) * weight;
+		histmap->b[i] += (count[0].b[i] + count[1].b[i]) * weight;
+		histmap->max[i] += (count[0].max[i] + count[1].max[i]) * weight;
+		}
 }
 
 static gboolean histmap_read(HistMap *histmap, gboolean whole)
 {
-	gint w, h, i, j, srs, has_alpha, step, end_line;
-	guchar *s_pix;
+	HistMapCount *count;
+	gint w, h, end_line;
 	GdkPixbuf *imgpixbuf = histmap->pixbuf;
 
 	w = gdk_pixbuf_get_width(imgpixbuf);
 	h = gdk_pixbuf_get_height(imgpixbuf);
-	srs = gdk_pixbuf_get_rowstride(imgpixbuf);
-	s_pix = gdk_pixbuf_get_pixels(imgpixbuf);
-	has_alpha = gdk_pixbuf_get_has_alpha(imgpixbuf);
 
 	if (whole)
 		{
@@ -173,63 +230,252 @@ static gboolean histmap_read(HistMap *histmap, gboolean whole)
 		if (end_line > h) end_line = h;
 		}
 
-	step = 3 + !!(has_alpha);
-	for (i = histmap->y; i < end_line; i++)
+	count = g_new0(HistMapCount, 2);
+	histmap_count_rows(count, imgpixbuf, histmap->y, end_line, 1);
+	histmap_add_count(histmap, count, 1);
+	g_free(count);
+
+	histmap->y = end_line;
+	return end_line >= h;
+}
+
+#ifdef HAVE_GTHREAD
+/*
+ *----------------------------------------------------------------------------
+ * sampled and threaded count
+ *----------------------------------------------------------------------------
+ */
+
+struct _HistMapJob {
+	FileData *fd;
+	HistMap *histmap; /* NULL once the map is freed, main thread only */
+	GdkPixbuf *pixbuf;
+
+	gint bands;
+	gint band_height;
+	gint next_band; /* atomic */
+	gint pending; /* atomic */
+	gint abort; /* atomic */
+
+	HistMapCount *counts; /* two per band */
+};
+
+static GThreadPool *histmap_thread_pool = NULL;
+
+static void histmap_clear(HistMap *histmap)
+{
+	memset(histmap->r, 0, sizeof(histmap->r));
+	memset(histmap->g, 0, sizeof(histmap->g));
+	memset(histmap->b, 0, sizeof(histmap->b));
+	memset(histmap->max, 0, sizeof(histmap->max));
+}
+
+/**
+ * \brief Fill the map from a grid of every Nth pixel in both directions
+ *
+ * Returns FALSE when the image is small enough to be counted exactly
+ * right away.
+ */
+static gboolean histmap_read_sampled(HistMap *histmap, GdkPixbuf *pixbuf)
+{
+	HistMapCount *count;
+	gint64 pixels;
+	gint sample;
+
+	pixels = (gint64)gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+	sample = (gint)ceil(sqrt((gdouble)pixels / HISTMAP_SAMPLE_PIXELS));
+	if (sample < 2) return FALSE;
+
+	count = g_new0(HistMapCount, 2);
+	histmap_count_rows(count, pixbuf, 0, gdk_pixbuf_get_height(pixbuf), sample);
+	histmap_add_count(histmap, count, (gulong)sample * sample);
+	g_free(count);
+
+	histmap->sampled = TRUE;
+	return TRUE;
+}
+
+static gboolean histmap_job_done_cb(gpointer data)
+{
+	HistMapJob *job = data;
+	HistMap *histmap = job->histmap;
+
+	if (histmap)
 		{
-		guchar *sp = s_pix + (i * srs); /* 8bit */
-		for (j = 0; j < w; j++)
+		gint i;
+
+		histmap_clear(histmap);
+		for (i = 0; i < job->bands; i++)
 			{
-			guint max = sp[0];
-			if (sp[1] > max) max = sp[1];
-			if (sp[2] > max) max = sp[2];
+			histmap_add_count(histmap, job->counts + i * 2, 1);
+			}
+		histmap->sampled = FALSE;
+		histmap->job = NULL;
 
-			histmap->r[sp[0]]++;
-			histmap->g[sp[1]]++;
-			histmap->b[sp[2]]++;
-			histmap->max[max]++;
+		DEBUG_1("histogram counted in %d bands: %s", job->bands, job->fd->path);
+		file_data_send_notification(job->fd, NOTIFY_HISTMAP);
+		}
 
-			sp += step;
-			}
+	file_data_unref(job->fd);
+	g_object_unref(job->pixbuf);
+	g_free(job->counts);
+	g_free(job);
+
+	return FALSE;
+}
+
+static void histmap_job_band_cb(gpointer data, gpointer user_data)
+{
+	HistMapJob *job = data;
+	gint band;
+
+	band = g_atomic_int_add(&job->next_band, 1);
+
+	if (!g_atomic_int_get(&job->abort))
+		{
+		gint y = band * job->band_height;
+
+		histmap_count_rows(job->counts + band * 2, job->pixbuf,
+				   y, MIN(y + job->band_height, gdk_pixbuf_get_height(job->pixbuf)), 1);
+		}
+
+	if (g_atomic_int_dec_and_test(&job->pending))
+		{
+		g_idle_add(histmap_job_done_cb, job);
 		}
-	histmap->y = end_line;
-	return end_line >= h;
+}
+
+static gboolean histmap_notify_idle_cb(gpointer data)
+{
+	FileData *fd = data;
+
+	file_data_send_notification(fd, NOTIFY_HISTMAP);
+	file_data_unref(fd);
+
+	return FALSE;
+}
+
+/* the callers of histmap_start_idle() are drawing, notify them later */
+static void histmap_notify_idle(FileData *fd)
+{
+	g_idle_add(histmap_notify_idle_cb, file_data_ref(fd));
+}
+
+static void histmap_job_start(FileData *fd, HistMap *histmap)
+{
+	HistMapJob *job;
+	gint64 pixels;
+	gint h;
+	gint i;
+
+	h = gdk_pixbuf_get_height(fd->pixbuf);
+	pixels = (gint64)gdk_pixbuf_get_width(fd->pixbuf) * h;
+
+	job = g_new0(HistMapJob, 1);
+	job->fd = file_data_ref(fd);
+	job->histmap = histmap;
+	job->pixbuf = g_object_ref(fd->pixbuf);
+
+	job->bands = CLAMP(pixels / HISTMAP_BAND_PIXELS, 1, g_get_num_processors() * 2);
+	job->bands = MIN(job->bands, h);
+	job->band_height = (h + job->bands - 1) / job->bands;
+	job->bands = (h + job->band_height - 1) / job->band_height;
+	job->pending = job->bands;
+	job->counts = g_new0(HistMapCount, job->bands * 2);
+
+	histmap->job = job;
+
+	if (!histmap_thread_pool)
+		{
+		histmap_thread_pool = g_thread_pool_new(histmap_job_band_cb, NULL, g_get_num_processors(), FALSE, NULL);
+		}
+
+	for (i = 0; i < job->bands; i++)
+		{
+		g_thread_pool_push(histmap_thread_pool, job, NULL);
+		}
+}
+#endif /* HAVE_GTHREAD */
+
+void histmap_free(HistMap *histmap)
+{
+	if (!histmap) return;
+	if (histmap->idle_id) g_source_remove(histmap->idle_id);
+	if (histmap->pixbuf) g_object_unref(histmap->pixbuf);
+#ifdef HAVE_GTHREAD
+	if (histmap->job)
+		{
+		/* the job frees itself when the bands return */
+		g_atomic_int_set(&histmap->job->abort, TRUE);
+		histmap->job->histmap = NULL;
+		}
+#endif
+	g_free(histmap);
 }
 
 const HistMap *histmap_get(FileData *fd)
 {
-	if (fd->histmap && !fd->histmap->idle_id) return fd->histmap; /* histmap exists and is finished */
+	HistMap *histmap = fd->cold ? fd->cold->histmap : NULL;
+
+	/* histmap exists and is finished, or a sampled map stands in for it */
+	if (histmap && (histmap->sampled || !histmap->idle_id)) return histmap;
 
 	return NULL;
 }
 
+#ifndef HAVE_GTHREAD
 static gboolean histmap_idle_cb(gpointer data)
 {
 	FileData *fd = data;
-	if (histmap_read(fd->histmap, FALSE))
+	HistMap *histmap = fd->cold->histmap;
+
+	if (histmap_read(histmap, FALSE))
 		{
 		/* finished */
-		g_object_unref(fd->histmap->pixbuf); /*pixbuf is no longer needed */
-		fd->histmap->pixbuf = NULL;
-		fd->histmap->idle_id = 0;
+		g_object_unref(histmap->pixbuf); /*pixbuf is no longer needed */
+		histmap->pixbuf = NULL;
+		histmap->idle_id = 0;
 		file_data_send_notification(fd, NOTIFY_HISTMAP);
 		return FALSE;
 		}
 	return TRUE;
 }
+#endif
 
 gboolean histmap_start_idle(FileData *fd)
 {
-	if (fd->histmap || !fd->pixbuf) return FALSE;
+	HistMap *histmap;
+
+	if ((fd->cold && fd->cold->histmap) || !fd->pixbuf) return FALSE;
 
-	fd->histmap = histmap_new();
-	fd->histmap->pixbuf = fd->pixbuf;
-	g_object_ref(fd->histmap->pixbuf);
+	histmap = histmap_new();
+	file_data_cold(fd)->histmap = histmap;
 
-	fd->histmap->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, histmap_idle_cb, fd, NULL);
+#ifdef HAVE_GTHREAD
+	if (!histmap_read_sampled(histmap, fd->pixbuf))
+		{
+		/* small image, count it right now */
+		histmap->pixbuf = fd->pixbuf;
+		histmap_read(histmap, TRUE);
+		histmap->pixbuf = NULL;
+		histmap_notify_idle(fd);
+		return TRUE;
+		}
+
+	/* show the sampled map until the bands are counted */
+	histmap_notify_idle(fd);
+	histmap_job_start(fd, histmap);
+#else
+	histmap->pixbuf = fd->pixbuf;
+	g_object_ref(histmap->pixbuf);
+
+	histmap->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, histmap_idle_cb, fd, NULL);
+#endif
 	return TRUE;
 }
 
 
+
 static void histogram_vgrid(Histogram *histogram, GdkPixbuf *pixbuf, gint x, gint y, gint width, gint height)
 {
 	guint i;
@@ -388,11 +634,11 @@ gboolean histogram_draw(Histogram *histogram, const HistMap *histmap, GdkPixbuf
 
 void histogram_notify_cb(FileData *fd, NotifyType type, gpointer data)
 {
-	if ((type & NOTIFY_REREAD) && fd->histmap)
+	if ((type & NOTIFY_REREAD) && fd->cold && fd->cold->histmap)
 		{
 		DEBUG_1("Notify histogram: %s %04x", fd->path, type);
-		histmap_free(fd->histmap);
-		fd->histmap = NULL;
+		histmap_free(fd->cold->histmap);
+		fd->cold->histmap = NULL;
 		}
 }
 
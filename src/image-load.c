@@ -443,6 +443,7 @@ static gboolean image_loader_get_stopping(ImageLoader *il)
 static void image_loader_sync_pixbuf(ImageLoader *il)
 {
 	GdkPixbuf *pb;
+	gboolean resized = FALSE;
 
 	g_mutex_lock(il->data_mutex);
 
@@ -470,7 +471,20 @@ static void image_loader_sync_pixbuf(ImageLoader *il)
 	il->pixbuf = pb;
 	if (il->pixbuf) g_object_ref(il->pixbuf);
 
+	/* a backend decoding at a reduced size picks the nearest size it can do,
+	 * which may not be the one passed to set_size */
+	if (il->pixbuf && il->shrunk && !g_object_get_data(G_OBJECT(il->pixbuf), "stereo_data") &&
+	    (gdk_pixbuf_get_width(il->pixbuf) != il->actual_width ||
+	     gdk_pixbuf_get_height(il->pixbuf) != il->actual_height))
+		{
+		il->actual_width = gdk_pixbuf_get_width(il->pixbuf);
+		il->actual_height = gdk_pixbuf_get_height(il->pixbuf);
+		resized = TRUE;
+		}
+
 	g_mutex_unlock(il->data_mutex);
+
+	if (resized) image_loader_emit_size(il);
 }
 
 static void image_loader_area_updated_cb(gpointer loader,
@@ -530,6 +544,9 @@ static void image_loader_area_prepared_cb(gpointer loader, gpointer data)
 
 }
 
+/* backends which honour set_size and decode directly at a reduced size */
+static const gchar *image_loader_scaled_mime_types[] = {"jpeg", "webp", "heic", "pdf", "djvu", "jp2", "dds", NULL};
+
 static void image_loader_size_cb(gpointer loader,
 				 gint width, gint height, gpointer data)
 {
@@ -557,7 +574,12 @@ static void image_loader_size_cb(gpointer loader,
 	n = 0;
 	while (mime_types[n] && !scale)
 		{
-		if (strstr(mime_types[n], "jpeg")) scale = TRUE;
+		gint i;
+
+		for (i = 0; image_loader_scaled_mime_types[i] && !scale; i++)
+			{
+			if (strstr(mime_types[n], image_loader_scaled_mime_types[i])) scale = TRUE;
+			}
 		n++;
 		}
 	g_strfreev(mime_types);
@@ -619,6 +641,8 @@ static void image_loader_setup_loader(ImageLoader *il)
 	gchar *format;
 
 	g_mutex_lock(il->data_mutex);
+	/* the optional functions of a backend used before must not stay set */
+	memset(&il->backend, 0, sizeof(il->backend));
 #ifdef HAVE_FFMPEGTHUMBNAILER
 	if (il->fd->format_class == FORMAT_CLASS_VIDEO)
 		{
@@ -725,6 +749,9 @@ static void image_loader_setup_loader(ImageLoader *il)
 
 	il->loader = il->backend.loader_new(image_loader_area_updated_cb, image_loader_size_cb, image_loader_area_prepared_cb, il);
 
+	/* read ahead loads are not displayed until done, a coarse pass would only slow them down */
+	if (il->backend.set_coarse) il->backend.set_coarse(il->loader, !il->delay_area_ready);
+
 #ifdef HAVE_TIFF
 	format = il->backend.get_format_name(il->loader);
 	if (g_strcmp0(format, "tiff") == 0)
@@ -781,7 +808,7 @@ static void image_loader_error(ImageLoader *il)
 	image_loader_emit_error(il);
 }
 
-static gboolean image_loader_continue(ImageLoader *il)
+static gboolean image_loader_continue_real(ImageLoader *il)
 {
 	gint b;
 	gint c;
@@ -818,7 +845,18 @@ static gboolean image_loader_continue(ImageLoader *il)
 	return TRUE;
 }
 
-static gboolean image_loader_begin(ImageLoader *il)
+static gboolean image_loader_continue(ImageLoader *il)
+{
+	gint64 t = TRACE_BEGIN();
+	gboolean ret;
+
+	ret = image_loader_continue_real(il);
+	TRACE_END(t, TRACE_DECODE, "image_loader_continue");
+
+	return ret;
+}
+
+static gboolean image_loader_begin_real(ImageLoader *il)
 {
 	gssize b;
 	gchar *format;
@@ -917,11 +955,22 @@ static gboolean image_loader_begin(ImageLoader *il)
 	return TRUE;
 }
 
+static gboolean image_loader_begin(ImageLoader *il)
+{
+	gint64 t = TRACE_BEGIN();
+	gboolean ret;
+
+	ret = image_loader_begin_real(il);
+	TRACE_END(t, TRACE_DECODE, "image_loader_begin");
+
+	return ret;
+}
+
 /**************************************************************************************/
 /* the following functions are always executed in the main thread */
 
 
-static gboolean image_loader_setup_source(ImageLoader *il)
+static gboolean image_loader_setup_source_real(ImageLoader *il)
 {
 	struct stat st;
 	gchar *pathl;
@@ -981,6 +1030,17 @@ static gboolean image_loader_setup_source(ImageLoader *il)
 	return TRUE;
 }
 
+static gboolean image_loader_setup_source(ImageLoader *il)
+{
+	gint64 t = TRACE_BEGIN();
+	gboolean ret;
+
+	ret = image_loader_setup_source_real(il);
+	TRACE_END(t, TRACE_IO, "image_loader_setup_source");
+
+	return ret;
+}
+
 static void image_loader_stop_source(ImageLoader *il)
 {
 	if (!il) return;
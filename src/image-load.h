@@ -40,6 +40,7 @@ typedef gchar* (*ImageLoaderBackendFuncGetFormatName)(gpointer loader);
 typedef gchar** (*ImageLoaderBackendFuncGetFormatMimeTypes)(gpointer loader);
 typedef void (*ImageLoaderBackendFuncSetPageNum)(gpointer loader, gint page_num);
 typedef gint (*ImageLoaderBackendFuncGetPageTotal)(gpointer loader);
+typedef void (*ImageLoaderBackendFuncSetCoarse)(gpointer loader, gboolean coarse); /* optional, show a coarse pass of a large image first */
 
 typedef struct _ImageLoaderBackend ImageLoaderBackend;
 struct _ImageLoaderBackend
@@ -56,6 +57,7 @@ struct _ImageLoaderBackend
 	ImageLoaderBackendFuncGetFormatMimeTypes get_format_mime_types;
 	ImageLoaderBackendFuncSetPageNum set_page_num;
 	ImageLoaderBackendFuncGetPageTotal get_page_total;
+	ImageLoaderBackendFuncSetCoarse set_coarse;
 };
 
 
@@ -0,0 +1,664 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ * \brief Region on demand decoding of huge images
+ *
+ * Images whose decoded pixbuf would not fit the image cache are not
+ * loaded as a whole. Instead the PixbufRenderer source tiles are decoded
+ * one by one when they become visible, and a reduced copy of the whole
+ * image is built in the background for the zoomed out views.
+ */
+
+#include "main.h"
+#include "image-region.h"
+
+#include "metadata.h"
+#include "ui_fileops.h"
+
+#ifdef HAVE_JPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <jerror.h>
+#endif
+
+#ifdef HAVE_TIFF
+#include <tiffio.h>
+#endif
+
+/* images smaller than this (decoded) are always loaded as a whole */
+#define IMAGE_REGION_MIN_SIZE (256 * 1024 * 1024)
+
+/* maximum width or height of the reduced copy of the whole image */
+#define IMAGE_REGION_PREVIEW_SIZE 4096
+
+/* largest tiff tile or strip accepted, a whole tile or strip is decoded for any pixel of it */
+#define IMAGE_REGION_MAX_TIFF_BLOCK (64 * 1024 * 1024)
+
+typedef enum {
+	IMAGE_REGION_JPEG,
+	IMAGE_REGION_TIFF
+} ImageRegionType;
+
+struct _ImageRegion
+{
+	gint ref;
+	ImageRegionType type;
+
+	gchar *pathl;
+	gint page_num;
+
+	gint width;
+	gint height;
+
+	GMappedFile *mapped;		/* jpeg */
+
+	gpointer tiff;			/* TIFF, used from the main thread only */
+	guint32 block_width;		/* tiff tile or strip size */
+	guint32 block_height;
+	gboolean tiled;
+	guint32 *raster;
+
+	gint preview_denom;		/* jpeg DCT scaling used for the preview */
+	gint preview_step;		/* subsampling used for the preview */
+	gint preview_width;
+	gint preview_height;
+	GdkPixbuf *preview;
+
+	ImageRegionPreviewFunc preview_func;
+	gint abort;
+};
+
+static void image_region_unref(ImageRegion *ir);
+
+static void image_region_pixel_set(guchar *p, gint n_channels, guchar r, guchar g, guchar b, guchar a)
+{
+	p[0] = r;
+	p[1] = g;
+	p[2] = b;
+	if (n_channels == 4) p[3] = a;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * jpeg
+ *-------------------------------------------------------------------
+ */
+
+/* jpeg_crop_scanline() and jpeg_skip_scanlines() are libjpeg-turbo extensions */
+#if defined(HAVE_JPEG) && defined(LIBJPEG_TURBO_VERSION_NUMBER)
+#define IMAGE_REGION_JPEG_SUPPORTED
+
+typedef struct _ImageRegionJpegError ImageRegionJpegError;
+struct _ImageRegionJpegError
+{
+	struct jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+};
+
+static void image_region_jpeg_error_exit(j_common_ptr cinfo)
+{
+	ImageRegionJpegError *err = (ImageRegionJpegError *)cinfo->err;
+	gchar buffer[JMSG_LENGTH_MAX];
+
+	(*cinfo->err->format_message)(cinfo, buffer);
+	DEBUG_1("image region jpeg error: %s", buffer);
+
+	longjmp(err->setjmp_buffer, 1);
+}
+
+static void image_region_jpeg_output_message(j_common_ptr cinfo)
+{
+	/* keep libjpeg quiet */
+}
+
+static void image_region_jpeg_setup(ImageRegion *ir, struct jpeg_decompress_struct *cinfo, ImageRegionJpegError *err)
+{
+	cinfo->err = jpeg_std_error(&err->pub);
+	err->pub.error_exit = image_region_jpeg_error_exit;
+	err->pub.output_message = image_region_jpeg_output_message;
+
+	jpeg_create_decompress(cinfo);
+	jpeg_mem_src(cinfo, (guchar *)g_mapped_file_get_contents(ir->mapped), g_mapped_file_get_length(ir->mapped));
+	jpeg_read_header(cinfo, TRUE);
+	cinfo->out_color_space = JCS_RGB;
+}
+
+static gboolean image_region_jpeg_open(ImageRegion *ir)
+{
+	struct jpeg_decompress_struct cinfo;
+	ImageRegionJpegError err;
+	const guchar *data;
+
+	ir->mapped = g_mapped_file_new(ir->pathl, FALSE, NULL);
+	if (!ir->mapped) return FALSE;
+
+	data = (const guchar *)g_mapped_file_get_contents(ir->mapped);
+	if (g_mapped_file_get_length(ir->mapped) < 4 || data[0] != 0xff || data[1] != 0xd8)
+		{
+		g_mapped_file_unref(ir->mapped);
+		ir->mapped = NULL;
+		return FALSE;
+		}
+
+	if (setjmp(err.setjmp_buffer))
+		{
+		jpeg_destroy_decompress(&cinfo);
+		return FALSE;
+		}
+
+	image_region_jpeg_setup(ir, &cinfo, &err);
+
+	/* cmyk can not be converted by libjpeg */
+	if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+		{
+		jpeg_destroy_decompress(&cinfo);
+		return FALSE;
+		}
+
+	ir->width = cinfo.image_width;
+	ir->height = cinfo.image_height;
+
+	for (ir->preview_denom = 1; ir->preview_denom < 8; ir->preview_denom *= 2)
+		{
+		if ((ir->width + ir->preview_denom - 1) / ir->preview_denom <= IMAGE_REGION_PREVIEW_SIZE &&
+		    (ir->height + ir->preview_denom - 1) / ir->preview_denom <= IMAGE_REGION_PREVIEW_SIZE) break;
+		}
+
+	jpeg_destroy_decompress(&cinfo);
+	return TRUE;
+}
+
+static gboolean image_region_jpeg_read(ImageRegion *ir, gint x, gint y, gint width, gint height, GdkPixbuf *pixbuf)
+{
+	struct jpeg_decompress_struct cinfo;
+	ImageRegionJpegError err;
+	JDIMENSION xoffset = x;
+	JDIMENSION crop_width = width;
+	guchar *line;
+	guchar *pixels;
+	gint rowstride;
+	gint n_channels;
+	gint i, j;
+
+	line = g_malloc(ir->width * 3);
+	pixels = gdk_pixbuf_get_pixels(pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+
+	if (setjmp(err.setjmp_buffer))
+		{
+		jpeg_destroy_decompress(&cinfo);
+		g_free(line);
+		return FALSE;
+		}
+
+	image_region_jpeg_setup(ir, &cinfo, &err);
+	jpeg_start_decompress(&cinfo);
+
+	/* the crop is widened to iMCU boundaries, only the scanlines below y are entropy decoded while skipping */
+	jpeg_crop_scanline(&cinfo, &xoffset, &crop_width);
+	if (y > 0) jpeg_skip_scanlines(&cinfo, y);
+
+	for (i = 0; i < height; i++)
+		{
+		guchar *src;
+		guchar *dest;
+
+		jpeg_read_scanlines(&cinfo, &line, 1);
+
+		src = line + (x - xoffset) * 3;
+		dest = pixels + i * rowstride;
+		for (j = 0; j < width; j++)
+			{
+			image_region_pixel_set(dest, n_channels, src[0], src[1], src[2], 0xff);
+			src += 3;
+			dest += n_channels;
+			}
+		}
+
+	jpeg_destroy_decompress(&cinfo);
+	g_free(line);
+
+	return TRUE;
+}
+
+static GdkPixbuf *image_region_jpeg_preview(ImageRegion *ir)
+{
+	struct jpeg_decompress_struct cinfo;
+	ImageRegionJpegError err;
+	GdkPixbuf *preview;
+	guchar *line;
+	guchar *pixels;
+	gint rowstride;
+	gint i, j;
+
+	preview = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, ir->preview_width, ir->preview_height);
+	if (!preview) return NULL;
+
+	line = g_malloc(ir->width * 3);
+
+	pixels = gdk_pixbuf_get_pixels(preview);
+	rowstride = gdk_pixbuf_get_rowstride(preview);
+
+	if (setjmp(err.setjmp_buffer))
+		{
+		jpeg_destroy_decompress(&cinfo);
+		g_free(line);
+		g_object_unref(preview);
+		return NULL;
+		}
+
+	image_region_jpeg_setup(ir, &cinfo, &err);
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = ir->preview_denom;
+	cinfo.dct_method = JDCT_IFAST;
+	jpeg_start_decompress(&cinfo);
+
+	for (i = 0; i < (gint)cinfo.output_height && !g_atomic_int_get(&ir->abort); i++)
+		{
+		guchar *dest;
+
+		jpeg_read_scanlines(&cinfo, &line, 1);
+		if (i % ir->preview_step || i / ir->preview_step >= ir->preview_height) continue;
+
+		dest = pixels + (i / ir->preview_step) * rowstride;
+		for (j = 0; j < ir->preview_width; j++)
+			{
+			memcpy(dest + j * 3, line + j * ir->preview_step * 3, 3);
+			}
+		}
+
+	jpeg_abort_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	g_free(line);
+
+	return preview;
+}
+#endif
+
+/*
+ *-------------------------------------------------------------------
+ * tiff
+ *-------------------------------------------------------------------
+ */
+
+#ifdef HAVE_TIFF
+static TIFF *image_region_tiff_open_real(ImageRegion *ir)
+{
+	TIFF *tiff;
+
+	tiff = TIFFOpen(ir->pathl, "r");
+	if (!tiff) return NULL;
+
+	if (ir->page_num > 0 && !TIFFSetDirectory(tiff, ir->page_num))
+		{
+		TIFFClose(tiff);
+		return NULL;
+		}
+
+	return tiff;
+}
+
+static gboolean image_region_tiff_open(ImageRegion *ir)
+{
+	TIFF *tiff;
+	guint32 width, height;
+	guint16 orientation;
+	gchar emsg[1024];
+	guchar magic[4];
+	FILE *f;
+	gboolean is_tiff = FALSE;
+
+	f = fopen(ir->pathl, "rb");
+	if (f)
+		{
+		is_tiff = (fread(magic, 1, 4, f) == 4 &&
+			   ((magic[0] == 'I' && magic[1] == 'I' && magic[2] == 42 && magic[3] == 0) ||
+			    (magic[0] == 'M' && magic[1] == 'M' && magic[2] == 0 && magic[3] == 42)));
+		fclose(f);
+		}
+	if (!is_tiff) return FALSE;
+
+	tiff = image_region_tiff_open_real(ir);
+	if (!tiff) return FALSE;
+	ir->tiff = tiff;
+
+	if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) ||
+	    !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height) ||
+	    !TIFFRGBAImageOK(tiff, emsg)) return FALSE;
+
+	/* source tiles are not rotated, leave those to the normal loader */
+	if (TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation) && orientation != ORIENTATION_TOPLEFT) return FALSE;
+
+	ir->width = width;
+	ir->height = height;
+	ir->tiled = TIFFIsTiled(tiff);
+
+	if (ir->tiled)
+		{
+		if (!TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &ir->block_width) ||
+		    !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &ir->block_height)) return FALSE;
+		}
+	else
+		{
+		ir->block_width = width;
+		if (!TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &ir->block_height)) return FALSE;
+		ir->block_height = MIN(ir->block_height, height);
+		}
+
+	if (ir->block_width < 1 || ir->block_height < 1 ||
+	    (gint64)ir->block_width * ir->block_height * 4 > IMAGE_REGION_MAX_TIFF_BLOCK) return FALSE;
+
+	ir->raster = g_try_malloc((gsize)ir->block_width * ir->block_height * 4);
+
+	return (ir->raster != NULL);
+}
+
+/* copies every step-th pixel of the area x, y, width, height to the pixbuf */
+static gboolean image_region_tiff_read_real(ImageRegion *ir, TIFF *tiff, guint32 *raster,
+					    gint x, gint y, gint width, gint height, gint step,
+					    GdkPixbuf *pixbuf)
+{
+	guchar *pixels;
+	gint rowstride;
+	gint n_channels;
+	gint bx, by;
+
+	pixels = gdk_pixbuf_get_pixels(pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+
+	for (by = y - y % ir->block_height; by < y + height; by += ir->block_height)
+		{
+		gint rows;
+
+		if (g_atomic_int_get(&ir->abort)) return FALSE;
+
+		rows = MIN((gint)ir->block_height, ir->height - by);
+
+		for (bx = x - x % ir->block_width; bx < x + width; bx += ir->block_width)
+			{
+			gint x1, x2, y1, y2;
+			gint i, j;
+
+			if (ir->tiled)
+				{
+				if (!TIFFReadRGBATile(tiff, bx, by, raster)) return FALSE;
+				}
+			else
+				{
+				if (!TIFFReadRGBAStrip(tiff, by, raster)) return FALSE;
+				}
+
+			x1 = MAX(x, bx);
+			x2 = MIN(x + width, bx + (gint)ir->block_width);
+			y1 = MAX(y, by);
+			y2 = MIN(y + height, by + rows);
+
+			/* align to the sampling grid */
+			x1 += (step - (x1 - x) % step) % step;
+			y1 += (step - (y1 - y) % step) % step;
+
+			for (i = y1; i < y2; i += step)
+				{
+				guint32 *src;
+				guchar *dest;
+
+				/* the raster is bottom-up, an edge tile is aligned to its bottom */
+				src = raster + (gsize)((ir->tiled ? (gint)ir->block_height : rows) - 1 - (i - by)) * ir->block_width;
+				dest = pixels + ((i - y) / step) * rowstride;
+
+				for (j = x1; j < x2; j += step)
+					{
+					guint32 p = src[j - bx];
+
+					image_region_pixel_set(dest + ((j - x) / step) * n_channels, n_channels,
+							       TIFFGetR(p), TIFFGetG(p), TIFFGetB(p), TIFFGetA(p));
+					}
+				}
+			}
+		}
+
+	return TRUE;
+}
+
+static GdkPixbuf *image_region_tiff_preview(ImageRegion *ir)
+{
+	GdkPixbuf *preview;
+	TIFF *tiff;
+	guint32 *raster;
+	gboolean success;
+
+	tiff = image_region_tiff_open_real(ir);
+	if (!tiff) return NULL;
+
+	raster = g_try_malloc((gsize)ir->block_width * ir->block_height * 4);
+	preview = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, ir->preview_width, ir->preview_height);
+
+	success = (raster && preview &&
+		   image_region_tiff_read_real(ir, tiff, raster, 0, 0, ir->width, ir->height, ir->preview_step, preview));
+
+	g_free(raster);
+	TIFFClose(tiff);
+
+	if (!success && preview)
+		{
+		g_object_unref(preview);
+		preview = NULL;
+		}
+
+	return preview;
+}
+#endif
+
+/*
+ *-------------------------------------------------------------------
+ * preview
+ *-------------------------------------------------------------------
+ */
+
+static gboolean image_region_preview_done_cb(gpointer data)
+{
+	ImageRegion *ir = data;
+
+	if (!g_atomic_int_get(&ir->abort) && ir->preview_func)
+		{
+		ir->preview_func(ir, ir->preview);
+		}
+
+	image_region_unref(ir);
+	return FALSE;
+}
+
+static void image_region_preview_run(gpointer data, gpointer user_data)
+{
+	ImageRegion *ir = data;
+	GdkPixbuf *preview = NULL;
+
+	switch (ir->type)
+		{
+#ifdef IMAGE_REGION_JPEG_SUPPORTED
+		case IMAGE_REGION_JPEG:
+			preview = image_region_jpeg_preview(ir);
+			break;
+#endif
+#ifdef HAVE_TIFF
+		case IMAGE_REGION_TIFF:
+			preview = image_region_tiff_preview(ir);
+			break;
+#endif
+		default:
+			break;
+		}
+
+	DEBUG_1("image region preview %dx%d %s: %s", ir->preview_width, ir->preview_height,
+		preview ? "done" : "failed", ir->pathl);
+
+	ir->preview = preview;
+	g_idle_add(image_region_preview_done_cb, ir);
+}
+
+#ifdef HAVE_GTHREAD
+static GThreadPool *image_region_thread_pool = NULL;
+#endif
+
+void image_region_preview_start(ImageRegion *ir, ImageRegionPreviewFunc func)
+{
+	if (!ir || ir->preview_func) return;
+
+	ir->preview_func = func;
+	ir->ref++;
+
+#ifdef HAVE_GTHREAD
+	if (!image_region_thread_pool)
+		{
+		image_region_thread_pool = g_thread_pool_new(image_region_preview_run, NULL, 2, FALSE, NULL);
+		}
+	g_thread_pool_push(image_region_thread_pool, ir, NULL);
+#else
+	image_region_preview_run(ir, NULL);
+#endif
+}
+
+gdouble image_region_get_preview_scale(ImageRegion *ir)
+{
+	if (!ir || ir->width < 1) return 0.0;
+
+	return (gdouble)ir->preview_width / ir->width;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * public
+ *-------------------------------------------------------------------
+ */
+
+static void image_region_unref(ImageRegion *ir)
+{
+	ir->ref--;
+	if (ir->ref > 0) return;
+
+#ifdef HAVE_TIFF
+	if (ir->tiff) TIFFClose(ir->tiff);
+#endif
+	if (ir->mapped) g_mapped_file_unref(ir->mapped);
+	if (ir->preview) g_object_unref(ir->preview);
+	g_free(ir->raster);
+	g_free(ir->pathl);
+	g_free(ir);
+}
+
+void image_region_free(ImageRegion *ir)
+{
+	if (!ir) return;
+
+	/* a running preview holds a reference */
+	g_atomic_int_set(&ir->abort, TRUE);
+	image_region_unref(ir);
+}
+
+ImageRegion *image_region_new(FileData *fd)
+{
+	ImageRegion *ir;
+	gboolean success = FALSE;
+	gint orientation;
+	gint base_width, base_height;
+
+	if (!fd || fd->format_class != FORMAT_CLASS_IMAGE) return NULL;
+	if (g_ascii_strcasecmp(fd->extension, ".jps") == 0) return NULL;
+	if ((gint64)fd->size < IMAGE_REGION_MIN_SIZE / 256) return NULL;
+
+	orientation = fd->user_orientation;
+	if (!orientation && options->image.exif_rotate_enable)
+		{
+		orientation = metadata_read_int(fd, ORIENTATION_KEY, EXIF_ORIENTATION_TOP_LEFT);
+		}
+	if (orientation && orientation != EXIF_ORIENTATION_TOP_LEFT) return NULL;
+
+	ir = g_new0(ImageRegion, 1);
+	ir->ref = 1;
+	ir->pathl = path_from_utf8(fd->path);
+	ir->page_num = fd->page_num;
+	ir->preview_denom = 1;
+
+#ifdef IMAGE_REGION_JPEG_SUPPORTED
+	if (!success)
+		{
+		ir->type = IMAGE_REGION_JPEG;
+		success = image_region_jpeg_open(ir);
+		}
+#endif
+#ifdef HAVE_TIFF
+	if (!success && !ir->mapped)
+		{
+		ir->type = IMAGE_REGION_TIFF;
+		success = image_region_tiff_open(ir);
+		}
+#endif
+
+	if (!success || (gint64)ir->width * ir->height * 3 <= MAX((gint64)options->image.image_cache_max * 1048576, IMAGE_REGION_MIN_SIZE))
+		{
+		image_region_unref(ir);
+		return NULL;
+		}
+
+	base_width = (ir->width + ir->preview_denom - 1) / ir->preview_denom;
+	base_height = (ir->height + ir->preview_denom - 1) / ir->preview_denom;
+	ir->preview_step = MAX((base_width + IMAGE_REGION_PREVIEW_SIZE - 1) / IMAGE_REGION_PREVIEW_SIZE,
+			       (base_height + IMAGE_REGION_PREVIEW_SIZE - 1) / IMAGE_REGION_PREVIEW_SIZE);
+	ir->preview_step = MAX(ir->preview_step, 1);
+	ir->preview_width = MAX((base_width + ir->preview_step - 1) / ir->preview_step, 1);
+	ir->preview_height = MAX((base_height + ir->preview_step - 1) / ir->preview_step, 1);
+
+	DEBUG_1("image region %dx%d: %s", ir->width, ir->height, fd->path);
+
+	return ir;
+}
+
+void image_region_get_size(ImageRegion *ir, gint *width, gint *height)
+{
+	if (width) *width = ir ? ir->width : 0;
+	if (height) *height = ir ? ir->height : 0;
+}
+
+gboolean image_region_read(ImageRegion *ir, gint x, gint y, gint width, gint height, GdkPixbuf *pixbuf)
+{
+	if (!ir || !pixbuf) return FALSE;
+
+	width = MIN(width, MIN(ir->width - x, gdk_pixbuf_get_width(pixbuf)));
+	height = MIN(height, MIN(ir->height - y, gdk_pixbuf_get_height(pixbuf)));
+	if (x < 0 || y < 0 || width < 1 || height < 1) return FALSE;
+
+	switch (ir->type)
+		{
+#ifdef IMAGE_REGION_JPEG_SUPPORTED
+		case IMAGE_REGION_JPEG:
+			return image_region_jpeg_read(ir, x, y, width, height, pixbuf);
+#endif
+#ifdef HAVE_TIFF
+		case IMAGE_REGION_TIFF:
+			return image_region_tiff_read_real(ir, ir->tiff, ir->raster, x, y, width, height, 1, pixbuf);
+#endif
+		default:
+			break;
+		}
+
+	return FALSE;
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef IMAGE_REGION_H
+#define IMAGE_REGION_H
+
+/* size of the source tiles requested from an ImageRegion */
+#define IMAGE_REGION_TILE_SIZE 512
+
+typedef struct _ImageRegion ImageRegion;
+
+typedef void (*ImageRegionPreviewFunc)(ImageRegion *ir, GdkPixbuf *preview);
+
+ImageRegion *image_region_new(FileData *fd);
+void image_region_free(ImageRegion *ir);
+
+void image_region_get_size(ImageRegion *ir, gint *width, gint *height);
+gboolean image_region_read(ImageRegion *ir, gint x, gint y, gint width, gint height, GdkPixbuf *pixbuf);
+
+gdouble image_region_get_preview_scale(ImageRegion *ir);
+void image_region_preview_start(ImageRegion *ir, ImageRegionPreviewFunc func);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
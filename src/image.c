@@ -32,6 +32,7 @@
 #include "history_list.h"
 #include "image-load.h"
 #include "image-overlay.h"
+#include "image-region.h"
 #include "layout.h"
 #include "layout_image.h"
 #include "pixbuf-renderer.h"
@@ -568,6 +569,12 @@ static void image_post_process_tile_color_cb(PixbufRenderer *pr, GdkPixbuf **pix
 	if (imd->overunderexposed) pixbuf_highlight_overunderexposed(*pixbuf, x, y, w, h);
 }
 
+/* table based colour correction is cheap enough for the fast render pass too */
+static gboolean image_post_process_slow(ImageWindow *imd)
+{
+	return (imd->cm != NULL && !color_man_is_fast(imd->cm));
+}
+
 void image_alter_orientation(ImageWindow *imd, FileData *fd_n, AlterType type)
 {
 	static const gint rotate_90[]    = {1,   6, 7, 8, 5, 2, 3, 4, 1};
@@ -660,7 +667,7 @@ void image_set_desaturate(ImageWindow *imd, gboolean desaturate)
 {
 	imd->desaturate = desaturate;
 	if (imd->cm || imd->desaturate || imd->overunderexposed)
-		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
+		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, image_post_process_slow(imd));
 	else
 		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, NULL, NULL, TRUE);
 	pixbuf_renderer_set_orientation((PixbufRenderer *)imd->pr, imd->orientation);
@@ -675,7 +682,7 @@ void image_set_overunderexposed(ImageWindow *imd, gboolean overunderexposed)
 {
 	imd->overunderexposed = overunderexposed;
 	if (imd->cm || imd->desaturate || imd->overunderexposed)
-		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
+		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, image_post_process_slow(imd));
 	else
 		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, NULL, NULL, TRUE);
 	pixbuf_renderer_set_orientation((PixbufRenderer *)imd->pr, imd->orientation);
@@ -734,12 +741,23 @@ static void image_read_ahead_error_cb(ImageLoader *il, gpointer data)
 
 static void image_read_ahead_start(ImageWindow *imd)
 {
+	ImageRegion *ir;
+
 	/* already started ? */
 	if (!imd->read_ahead_fd || imd->read_ahead_il || imd->read_ahead_fd->pixbuf) return;
 
 	/* still loading ?, do later */
 	if (imd->il /*|| imd->cm*/) return;
 
+	/* an image shown by regions is never decoded whole, it is not read ahead either */
+	ir = image_region_new(imd->read_ahead_fd);
+	if (ir)
+		{
+		DEBUG_1("read ahead skipped, region on demand: %s", imd->read_ahead_fd->path);
+		image_region_free(ir);
+		return;
+		}
+
 	DEBUG_1("%s read ahead started for :%s", get_exec_time(), imd->read_ahead_fd->path);
 
 	imd->read_ahead_il = image_loader_new(imd->read_ahead_fd);
@@ -784,7 +802,11 @@ static void image_cache_release_cb(FileData *fd)
 static FileCacheData *image_get_cache(void)
 {
 	static FileCacheData *cache = NULL;
-	if (!cache) cache = file_cache_new(image_cache_release_cb, 1);
+	if (!cache)
+		{
+		cache = file_cache_new(image_cache_release_cb, 1);
+		file_cache_set_memory(cache, "images", MEMORY_COST_HIGH, 1);
+		}
 	file_cache_set_max_size(cache, (gulong)options->image.image_cache_max * 1048576); /* update from options */
 	return cache;
 }
@@ -984,6 +1006,73 @@ static gboolean image_read_ahead_check(ImageWindow *imd)
 	return FALSE;
 }
 
+static gint image_region_tile_request_cb(PixbufRenderer *pr, gint x, gint y,
+					 gint width, gint height, GdkPixbuf *pixbuf, gpointer data)
+{
+	ImageWindow *imd = data;
+
+	return image_region_read((ImageRegion *)imd->region, x, y, width, height, pixbuf);
+}
+
+static void image_region_preview_cb(ImageRegion *ir, GdkPixbuf *preview)
+{
+	GList *work;
+
+	for (work = image_list; work; work = work->next)
+		{
+		ImageWindow *imd = work->data;
+
+		if (imd->region != ir) continue;
+
+		pixbuf_renderer_set_tiles_preview((PixbufRenderer *)imd->pr, preview, image_region_get_preview_scale(ir));
+		}
+}
+
+static gboolean image_load_region_begin(ImageWindow *imd, FileData *fd)
+{
+	ImageRegion *ir;
+	PixbufRenderer *pr;
+	gint width, height;
+	gint cache_size;
+
+	ir = image_region_new(fd);
+	if (!ir) return FALSE;
+
+	imd->region = ir;
+	image_region_get_size(ir, &width, &height);
+
+	/* the source tile cache is the only copy of the image data, let it use the image cache budget */
+	cache_size = (gint64)options->image.image_cache_max * 1048576 / (IMAGE_REGION_TILE_SIZE * IMAGE_REGION_TILE_SIZE * 3);
+
+	imd->orientation = EXIF_ORIENTATION_TOP_LEFT;
+	pr = (PixbufRenderer *)imd->pr;
+	pixbuf_renderer_set_post_process_func(pr, NULL, NULL, FALSE);
+	if (imd->cm)
+		{
+		color_man_free(imd->cm);
+		imd->cm = NULL;
+		}
+
+	pixbuf_renderer_set_tiles(pr, width, height, IMAGE_REGION_TILE_SIZE, IMAGE_REGION_TILE_SIZE, cache_size,
+				  image_region_tile_request_cb, NULL, imd, image_zoom_get(imd));
+	pixbuf_renderer_set_orientation(pr, imd->orientation);
+	pixbuf_renderer_set_tiles_preview(pr, NULL, image_region_get_preview_scale(ir));
+
+	if (imd->color_profile_enable)
+		{
+		image_post_process_color(imd, 0, FALSE);
+		}
+
+	if (imd->cm || imd->desaturate || imd->overunderexposed)
+		pixbuf_renderer_set_post_process_func(pr, image_post_process_tile_color_cb, (gpointer) imd, image_post_process_slow(imd));
+
+	image_region_preview_start(ir, image_region_preview_cb);
+
+	image_state_set(imd, IMAGE_STATE_IMAGE);
+
+	return TRUE;
+}
+
 static gboolean image_load_begin(ImageWindow *imd, FileData *fd)
 {
 	DEBUG_1("%s image begin", get_exec_time());
@@ -1005,6 +1094,12 @@ static gboolean image_load_begin(ImageWindow *imd, FileData *fd)
 		return TRUE;
 		}
 
+	if (image_load_region_begin(imd, fd))
+		{
+		DEBUG_1("region on demand: %s", imd->image_fd->path);
+		return TRUE;
+		}
+
 	if (!imd->delay_flip && image_get_pixbuf(imd))
 		{
 		PixbufRenderer *pr;
@@ -1056,6 +1151,9 @@ static void image_reset(ImageWindow *imd)
 	image_loader_free(imd->il);
 	imd->il = NULL;
 
+	image_region_free((ImageRegion *)imd->region);
+	imd->region = NULL;
+
 	color_man_free((ColorMan *)imd->cm);
 	imd->cm = NULL;
 
@@ -1366,7 +1464,7 @@ void image_change_pixbuf(ImageWindow *imd, GdkPixbuf *pixbuf, gdouble zoom, gboo
 		}
 
 	if (imd->cm || imd->desaturate || imd->overunderexposed)
-		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
+		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, image_post_process_slow(imd));
 
 	image_state_set(imd, IMAGE_STATE_IMAGE);
 }
@@ -1481,15 +1579,20 @@ void image_move_from_image(ImageWindow *imd, ImageWindow *source)
 	file_data_unref(imd->read_ahead_fd);
 	source->read_ahead_fd = NULL;
 
+	image_region_free((ImageRegion *)imd->region);
+	imd->region = source->region;
+	source->region = NULL;
+
 	imd->orientation = source->orientation;
 	imd->desaturate = source->desaturate;
 
 	imd->user_stereo = source->user_stereo;
 
 	pixbuf_renderer_move(PIXBUF_RENDERER(imd->pr), PIXBUF_RENDERER(source->pr));
+	if (imd->region) PIXBUF_RENDERER(imd->pr)->func_tile_data = imd;
 
 	if (imd->cm || imd->desaturate || imd->overunderexposed)
-		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
+		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, image_post_process_slow(imd));
 	else
 		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, NULL, NULL, TRUE);
 
@@ -1551,7 +1654,7 @@ void image_copy_from_image(ImageWindow *imd, ImageWindow *source)
 	pixbuf_renderer_copy(PIXBUF_RENDERER(imd->pr), PIXBUF_RENDERER(source->pr));
 
 	if (imd->cm || imd->desaturate || imd->overunderexposed)
-		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
+		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, image_post_process_slow(imd));
 	else
 		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, NULL, NULL, TRUE);
 
@@ -23,9 +23,11 @@
 #include "image_load_collection.h"
 
 #include "cache.h"
-#include "misc.h"
+#include "pixbuf_util.h"
 #include "ui_fileops.h"
 
+#include <math.h>
+
 typedef struct _ImageLoaderCOLLECTION ImageLoaderCOLLECTION;
 struct _ImageLoaderCOLLECTION {
 	ImageLoaderBackendCbAreaUpdated area_updated_cb;
@@ -38,80 +40,133 @@ struct _ImageLoaderCOLLECTION {
 	gboolean abort;
 };
 
-static gboolean image_loader_collection_load(gpointer loader, const guchar *buf, gsize count, GError **error)
+#define COLLECTION_PREVIEW_BORDER 1
+
+/* returns the paths of the cached thumbnails of the first files in the collection */
+static GList *image_loader_collection_thumbs(const guchar *buf, gsize count, gint max)
 {
-	ImageLoaderCOLLECTION *ld = (ImageLoaderCOLLECTION *) loader;
-	ImageLoader *il = ld->data;
-
-	#define LINE_LENGTH 1000
-
-	gboolean ret = FALSE;
-	gchar *randname;
-	gchar *cmd_line;
-	FILE *fp = NULL;
-	gint line_count = 0;
-	GString *file_names = g_string_new(NULL);
-	gchar line[LINE_LENGTH];
-	gchar **split_line = NULL;
-	gchar *cache_found;
-	gchar *pathl;
-
-	if (runcmd("which montage >/dev/null 2>&1") == 0)
+	GList *list = NULL;
+	const gchar *ptr = (const gchar *)buf;
+	const gchar *end = ptr + count;
+	gint n = 0;
+
+	while (ptr < end && n < max)
 		{
-		pathl = path_from_utf8(il->fd->path);
-		fp = fopen(pathl, "r");
-		g_free(pathl);
-		if (fp)
+		const gchar *line_end = memchr(ptr, '\n', end - ptr);
+		const gchar *name_start;
+		const gchar *name_end;
+
+		if (!line_end) line_end = end;
+
+		if (*ptr != '#' && (name_start = memchr(ptr, '"', line_end - ptr)) &&
+		    (name_end = memchr(name_start + 1, '"', line_end - name_start - 1)))
 			{
-			while(fgets(line, LINE_LENGTH, fp) && line_count < options->thumbnails.collection_preview)
+			gchar *path = g_strndup(name_start + 1, name_end - name_start - 1);
+			gchar *cache_found = cache_find_location(CACHE_TYPE_THUMB, path);
+
+			if (cache_found)
 				{
-				if (line[0] && line[0] != '#')
-					{
-					split_line = g_strsplit(line, "\"", 4);
-					cache_found = cache_find_location(CACHE_TYPE_THUMB, split_line[1]);
-					if (cache_found)
-						{
-						file_names = g_string_append(file_names, g_strconcat("\"", cache_found,"\" ", NULL));
-						line_count++;
-						}
-					g_free(cache_found);
-					}
-					if (split_line)
-						{
-						g_strfreev(split_line);
-						}
-					split_line = NULL;
+				list = g_list_prepend(list, cache_found);
+				n++;
 				}
-			fclose(fp);
+			g_free(path);
+			}
 
-			if (file_names->len > 0)
-				{
-				randname = g_strdup("/tmp/geeqie_collection_XXXXXX.png");
-				g_mkstemp(randname);
+		ptr = line_end + 1;
+		}
+
+	return g_list_reverse(list);
+}
+
+static gboolean image_loader_collection_load(gpointer loader, const guchar *buf, gsize count, GError **error)
+{
+	ImageLoaderCOLLECTION *ld = (ImageLoaderCOLLECTION *) loader;
+	GList *thumbs;
+	GList *work;
+	gint n;
+	gint cols;
+	gint rows;
+	gint tile_w;
+	gint tile_h;
+	gint border;
+	gint width;
+	gint height;
+	gint i;
+
+	thumbs = image_loader_collection_thumbs(buf, count, options->thumbnails.collection_preview);
+	n = g_list_length(thumbs);
+	if (n == 0) return FALSE;
+
+	/* the same layout as a montage of the thumbnails, a grid close to a square */
+	cols = (gint)ceil(sqrt(n));
+	rows = (n + cols - 1) / cols;
+	tile_w = options->thumbnails.max_width;
+	tile_h = options->thumbnails.max_height;
+	border = COLLECTION_PREVIEW_BORDER;
+
+	width = cols * (tile_w + 2 * border);
+	height = rows * (tile_h + 2 * border);
+
+	/* scale the tiles directly to the requested size, each thumbnail is resampled only once */
+	if (ld->requested_width > 0 && ld->requested_height > 0 &&
+	    (width > (gint)ld->requested_width || height > (gint)ld->requested_height))
+		{
+		gdouble scale = MIN((gdouble)ld->requested_width / width, (gdouble)ld->requested_height / height);
 
-				cmd_line = g_strdup_printf("montage %s -geometry %dx%d+1+1 %s >/dev/null 2>&1", file_names->str, options->thumbnails.max_width, options->thumbnails.max_height, randname);
+		tile_w = MAX(1, (gint)(tile_w * scale));
+		tile_h = MAX(1, (gint)(tile_h * scale));
+		border = 0;
+		width = cols * tile_w;
+		height = rows * tile_h;
+		}
 
-				runcmd(cmd_line);
-				ld->pixbuf = gdk_pixbuf_new_from_file(randname, NULL);
-				if (ld->pixbuf)
-					{
-					ld->area_updated_cb(loader, 0, 0, gdk_pixbuf_get_width(ld->pixbuf), gdk_pixbuf_get_height(ld->pixbuf), ld->data);
-					}
+	ld->pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	if (!ld->pixbuf)
+		{
+		string_list_free(thumbs);
+		return FALSE;
+		}
+	gdk_pixbuf_fill(ld->pixbuf, 0xffffffff);
 
-				unlink(randname);
-				g_free(randname);
-				g_string_free(file_names, TRUE);
-				g_free(cmd_line);
+	i = 0;
+	work = thumbs;
+	while (work && !ld->abort)
+		{
+		const gchar *thumb_path = work->data;
+		gchar *pathl = path_from_utf8(thumb_path);
+		GdkPixbuf *thumb = gdk_pixbuf_new_from_file(pathl, NULL);
 
-				ret = TRUE;
-				}
-			else
-				{
-				g_string_free(file_names, TRUE);
-				}
+		g_free(pathl);
+
+		if (thumb)
+			{
+			gint w = gdk_pixbuf_get_width(thumb);
+			gint h = gdk_pixbuf_get_height(thumb);
+			gint nw = w;
+			gint nh = h;
+			gint x;
+			gint y;
+
+			if (w > tile_w || h > tile_h) pixbuf_scale_aspect(tile_w, tile_h, w, h, &nw, &nh);
+
+			x = (i % cols) * (tile_w + 2 * border) + border + (tile_w - nw) / 2;
+			y = (i / cols) * (tile_h + 2 * border) + border + (tile_h - nh) / 2;
+
+			gdk_pixbuf_composite(thumb, ld->pixbuf, x, y, nw, nh,
+					     (gdouble)x, (gdouble)y, (gdouble)nw / w, (gdouble)nh / h,
+					     GDK_INTERP_BILINEAR, 255);
+			g_object_unref(thumb);
+			i++;
 			}
+
+		work = work->next;
 		}
-	return ret;
+
+	string_list_free(thumbs);
+
+	ld->area_updated_cb(loader, 0, 0, width, height, ld->data);
+
+	return TRUE;
 }
 
 static gpointer image_loader_collection_new(ImageLoaderBackendCbAreaUpdated area_updated_cb, ImageLoaderBackendCbSize size_cb, ImageLoaderBackendCbAreaPrepared area_prepared_cb, gpointer data)
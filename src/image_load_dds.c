@@ -512,6 +512,17 @@ guchar *ddsReadX8R8G8B8(int width, int height, const unsigned char *buffer) {
 	return (guchar *) pixels;
 }
 
+static gsize ddsGetLevelSize(int type, int width, int height) {
+	switch (type) {
+	case DXT1: return (gsize)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	case DXT2:
+	case DXT3:
+	case DXT4:
+	case DXT5: return (gsize)((width + 3) / 4) * ((height + 3) / 4) * 16;
+	default: return (gsize)width * height * (type & 0xFFFF);
+	}
+}
+
 static gboolean image_loader_dds_load (gpointer loader, const guchar *buf, gsize count, GError **error)
 {
 	ImageLoaderDDS *ld = (ImageLoaderDDS *) loader;
@@ -521,23 +532,52 @@ static gboolean image_loader_dds_load (gpointer loader, const guchar *buf, gsize
 	if (type == 0) return FALSE;
 	{
 		guchar *pixels = NULL;
-		gint rowstride = width * 4;
+		const guchar *level = buf;
+		gint rowstride;
+
+		/* may call set_size with a reduced size */
+		ld->size_cb(loader, width, height, ld->data);
+
+		if (ld->requested_width > 0 && ld->requested_height > 0) {
+			/* pick the smallest mipmap still covering the requested size */
+			int mipmaps = ddsGetMipmap(buf);
+			gsize offset = 128;
+			int i;
+
+			for (i = 1; i < mipmaps; i++) {
+				int w = MAX(1, width / 2);
+				int h = MAX(1, height / 2);
+				gsize size = ddsGetLevelSize(type, width, height);
+
+				if ((guint)w < ld->requested_width || (guint)h < ld->requested_height) break;
+				if (offset + size + ddsGetLevelSize(type, w, h) > count) break;
+
+				offset += size;
+				width = w;
+				height = h;
+			}
+
+			/* the decoders below expect the pixel data at offset 128 */
+			level = buf + offset - 128;
+		}
+
+		rowstride = width * 4;
 		switch (type) {
-		case DXT1: pixels = ddsDecodeDXT1(width, height, buf); break;
-		case DXT2: pixels = ddsDecodeDXT2(width, height, buf); break;
-		case DXT3: pixels = ddsDecodeDXT3(width, height, buf); break;
-		case DXT4: pixels = ddsDecodeDXT4(width, height, buf); break;
-		case DXT5: pixels = ddsDecodeDXT5(width, height, buf); break;
-		case A1R5G5B5: pixels = ddsReadA1R5G5B5(width, height, buf); break;
-		case X1R5G5B5: pixels = ddsReadX1R5G5B5(width, height, buf); break;
-		case A4R4G4B4: pixels = ddsReadA4R4G4B4(width, height, buf); break;
-		case X4R4G4B4: pixels = ddsReadX4R4G4B4(width, height, buf); break;
-		case R5G6B5: pixels = ddsReadR5G6B5(width, height, buf); break;
-		case R8G8B8: pixels = ddsReadR8G8B8(width, height, buf); break;
-		case A8B8G8R8: pixels = ddsReadA8B8G8R8(width, height, buf); break;
-		case X8B8G8R8: pixels = ddsReadX8B8G8R8(width, height, buf); break;
-		case A8R8G8B8: pixels = ddsReadA8R8G8B8(width, height, buf); break;
-		case X8R8G8B8: pixels = ddsReadX8R8G8B8(width, height, buf); break;
+		case DXT1: pixels = ddsDecodeDXT1(width, height, level); break;
+		case DXT2: pixels = ddsDecodeDXT2(width, height, level); break;
+		case DXT3: pixels = ddsDecodeDXT3(width, height, level); break;
+		case DXT4: pixels = ddsDecodeDXT4(width, height, level); break;
+		case DXT5: pixels = ddsDecodeDXT5(width, height, level); break;
+		case A1R5G5B5: pixels = ddsReadA1R5G5B5(width, height, level); break;
+		case X1R5G5B5: pixels = ddsReadX1R5G5B5(width, height, level); break;
+		case A4R4G4B4: pixels = ddsReadA4R4G4B4(width, height, level); break;
+		case X4R4G4B4: pixels = ddsReadX4R4G4B4(width, height, level); break;
+		case R5G6B5: pixels = ddsReadR5G6B5(width, height, level); break;
+		case R8G8B8: pixels = ddsReadR8G8B8(width, height, level); break;
+		case A8B8G8R8: pixels = ddsReadA8B8G8R8(width, height, level); break;
+		case X8B8G8R8: pixels = ddsReadX8B8G8R8(width, height, level); break;
+		case A8R8G8B8: pixels = ddsReadA8R8G8B8(width, height, level); break;
+		case X8R8G8B8: pixels = ddsReadX8R8G8B8(width, height, level); break;
 		}
 		ld->pixbuf = gdk_pixbuf_new_from_data (pixels, GDK_COLORSPACE_RGB, TRUE, 8, width, height, rowstride, free_buffer, NULL);
 		ld->area_updated_cb(loader, 0, 0, width, height, ld->data);
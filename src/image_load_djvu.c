@@ -78,6 +78,17 @@ static gboolean image_loader_djvu_load(gpointer loader, const guchar *buf, gsize
 
 	width = ddjvu_page_get_width(page);
 	height = ddjvu_page_get_height(page);
+
+	/* may call set_size with a reduced size, the page is then rendered at that scale */
+	ld->size_cb(loader, width, height, ld->data);
+
+	if (ld->requested_width > 0 && ld->requested_height > 0 &&
+	    ld->requested_width < (guint)width && ld->requested_height < (guint)height)
+		{
+		width = ld->requested_width;
+		height = ld->requested_height;
+		}
+
 	stride = width * 4;
 
 	pixels = (guchar *)g_malloc(height * stride);
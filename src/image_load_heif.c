@@ -45,6 +45,40 @@ static void free_buffer(guchar *pixels, gpointer data)
 	g_free (pixels);
 }
 
+/* returns the smallest embedded thumbnail still covering the requested size, or NULL */
+static struct heif_image_handle *image_loader_heif_get_thumbnail(struct heif_image_handle *handle, guint width, guint height)
+{
+	struct heif_image_handle *best = NULL;
+	gint thumb_total;
+	gint i;
+
+	thumb_total = heif_image_handle_get_number_of_thumbnails(handle);
+	if (thumb_total < 1) return NULL;
+
+	heif_item_id IDs[thumb_total];
+	thumb_total = heif_image_handle_get_list_of_thumbnail_IDs(handle, IDs, thumb_total);
+
+	for (i = 0; i < thumb_total; i++)
+		{
+		struct heif_image_handle *thumb;
+
+		if (heif_image_handle_get_thumbnail(handle, IDs[i], &thumb).code) continue;
+
+		if ((guint)heif_image_handle_get_width(thumb) < width ||
+		    (guint)heif_image_handle_get_height(thumb) < height ||
+		    (best && heif_image_handle_get_width(thumb) >= heif_image_handle_get_width(best)))
+			{
+			heif_image_handle_release(thumb);
+			continue;
+			}
+
+		if (best) heif_image_handle_release(best);
+		best = thumb;
+		}
+
+	return best;
+}
+
 static gboolean image_loader_heif_load(gpointer loader, const guchar *buf, gsize count, GError **error)
 {
 	ImageLoaderHEIF *ld = (ImageLoaderHEIF *) loader;
@@ -85,11 +119,27 @@ static gboolean image_loader_heif_load(gpointer loader, const guchar *buf, gsize
 			return FALSE;
 			}
 
+		/* may call set_size with a reduced size */
+		ld->size_cb(loader, heif_image_handle_get_width(handle), heif_image_handle_get_height(handle), ld->data);
+
+		if (ld->requested_width > 0 && ld->requested_height > 0)
+			{
+			struct heif_image_handle* thumb_handle;
+
+			thumb_handle = image_loader_heif_get_thumbnail(handle, ld->requested_width, ld->requested_height);
+			if (thumb_handle)
+				{
+				heif_image_handle_release(handle);
+				handle = thumb_handle;
+				}
+			}
+
 		// decode the image and convert colorspace to RGB, saved as 24bit interleaved
 		error_code = heif_decode_image(handle, &img, heif_colorspace_RGB, heif_chroma_interleaved_24bit, NULL);
 		if (error_code.code)
 			{
 			log_printf("warning: heif reader error: %s\n", error_code.message);
+			heif_image_handle_release(handle);
 			heif_context_free(ctx);
 			return FALSE;
 			}
@@ -99,6 +149,7 @@ static gboolean image_loader_heif_load(gpointer loader, const guchar *buf, gsize
 		height = heif_image_get_height(img,heif_channel_interleaved);
 		width = heif_image_get_width(img,heif_channel_interleaved);
 		alpha = heif_image_handle_has_alpha_channel(handle);
+		heif_image_handle_release(handle);
 
 		ld->pixbuf = gdk_pixbuf_new_from_data(data, GDK_COLORSPACE_RGB, alpha, 8, width, height, stride, free_buffer, NULL);
 
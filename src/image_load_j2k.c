@@ -229,6 +229,33 @@ static gboolean image_loader_j2k_load(gpointer loader, const guchar *buf, gsize
 		return FALSE;
 		}
 
+	/* may call set_size with a reduced size */
+	ld->size_cb(loader, image->x1 - image->x0, image->y1 - image->y0, ld->data);
+
+	if (ld->requested_width > 0 && ld->requested_height > 0)
+		{
+		opj_codestream_info_v2_t *info;
+		guint reduce = 0;
+
+		/* decode only the resolution levels needed for the requested size */
+		info = opj_get_cstr_info(codec);
+		if (info)
+			{
+			while (reduce + 1 < info->m_default_tile_info.tccp_info[0].numresolutions &&
+			       ((image->x1 - image->x0) >> (reduce + 1)) >= ld->requested_width &&
+			       ((image->y1 - image->y0) >> (reduce + 1)) >= ld->requested_height)
+				{
+				reduce++;
+				}
+			opj_destroy_cstr_info(&info);
+			}
+
+		if (reduce > 0 && opj_set_decoded_resolution_factor(codec, reduce) != OPJ_TRUE)
+			{
+			DEBUG_1("j2k: could not reduce resolution by %d levels", reduce);
+			}
+		}
+
 	if (opj_decode(codec, stream, image) != OPJ_TRUE)
 		{
 		log_printf(_("Couldn't decode JP2 image in file"));
@@ -50,6 +50,7 @@ struct _ImageLoaderJpeg {
 
 	gboolean abort;
 	gboolean stereo;
+	gboolean coarse;	/* a large full size decode shows a coarse pass first */
 
 };
 
@@ -253,6 +254,77 @@ static void set_mem_src (j_decompress_ptr cinfo, void* buffer, long nbytes)
 }
 
 
+/* full size decodes of at least this many pixels show a coarse version first */
+#define JPEG_COARSE_MIN_PIXELS (2048 * 2048)
+
+/* decodes the image at 1/8 size and scales it up into the pixbuf,
+ * so that something is shown while the full size decode runs
+ */
+static void image_loader_jpeg_read_coarse(gpointer loader, const guchar *buf, gsize count)
+{
+	ImageLoaderJpeg *lj = (ImageLoaderJpeg *) loader;
+	struct jpeg_decompress_struct cinfo;
+	struct error_handler_data jerr;
+	GdkPixbuf * volatile coarse = NULL;
+	guchar *dptr;
+	guint rowstride;
+	gint width, height;
+
+	cinfo.err = jpeg_std_error (&jerr.pub);
+	jerr.pub.error_exit = fatal_error_handler;
+	jerr.pub.output_message = output_message_handler;
+	jerr.error = NULL;
+
+	if (setjmp(jerr.setjmp_buffer))
+		{
+		jpeg_destroy_decompress(&cinfo);
+		if (coarse) g_object_unref(coarse);
+		return;
+		}
+
+	jpeg_create_decompress(&cinfo);
+	set_mem_src(&cinfo, (unsigned char *)buf, count);
+	jpeg_read_header(&cinfo, TRUE);
+
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = 8;
+	cinfo.dct_method = JDCT_IFAST;
+	cinfo.do_fancy_upsampling = FALSE;
+	jpeg_start_decompress(&cinfo);
+
+	coarse = gdk_pixbuf_new(GDK_COLORSPACE_RGB, cinfo.out_color_components == 4 ? TRUE : FALSE,
+				8, cinfo.output_width, cinfo.output_height);
+	if (!coarse)
+		{
+		jpeg_destroy_decompress(&cinfo);
+		return;
+		}
+
+	rowstride = gdk_pixbuf_get_rowstride(coarse);
+	dptr = gdk_pixbuf_get_pixels(coarse);
+
+	while (cinfo.output_scanline < cinfo.output_height && !lj->abort)
+		{
+		image_loader_jpeg_read_scanline(&cinfo, &dptr, rowstride);
+		}
+
+	jpeg_destroy_decompress(&cinfo);
+
+	if (!lj->abort)
+		{
+		width = gdk_pixbuf_get_width(lj->pixbuf);
+		height = gdk_pixbuf_get_height(lj->pixbuf);
+
+		gdk_pixbuf_scale(coarse, lj->pixbuf, 0, 0, width, height, 0, 0,
+				 (gdouble)width / gdk_pixbuf_get_width(coarse),
+				 (gdouble)height / gdk_pixbuf_get_height(coarse),
+				 GDK_INTERP_BILINEAR);
+		lj->area_updated_cb(loader, 0, 0, width, height, lj->data);
+		}
+
+	g_object_unref(coarse);
+}
+
 static gboolean image_loader_jpeg_load (gpointer loader, const guchar *buf, gsize count, GError **error)
 {
 	ImageLoaderJpeg *lj = (ImageLoaderJpeg *) loader;
@@ -397,6 +469,12 @@ static gboolean image_loader_jpeg_load (gpointer loader, const guchar *buf, gsiz
 	if (lj->stereo) g_object_set_data(G_OBJECT(lj->pixbuf), "stereo_data", GINT_TO_POINTER(STEREO_PIXBUF_CROSS));
 	lj->area_prepared_cb(loader, lj->data);
 
+	if (lj->coarse && !lj->stereo && cinfo.scale_denom == 1 &&
+	    cinfo.output_width * cinfo.output_height >= JPEG_COARSE_MIN_PIXELS)
+		{
+		image_loader_jpeg_read_coarse(loader, buf, count);
+		}
+
 	rowstride = gdk_pixbuf_get_rowstride(lj->pixbuf);
 	dptr = gdk_pixbuf_get_pixels(lj->pixbuf);
 	dptr2 = gdk_pixbuf_get_pixels(lj->pixbuf) + ((cinfo.out_color_components == 4) ? 4 * cinfo.output_width : 3 * cinfo.output_width);
@@ -433,6 +511,12 @@ static void image_loader_jpeg_set_size(gpointer loader, int width, int height)
 	lj->requested_height = height;
 }
 
+static void image_loader_jpeg_set_coarse(gpointer loader, gboolean coarse)
+{
+	ImageLoaderJpeg *lj = (ImageLoaderJpeg *) loader;
+	lj->coarse = coarse;
+}
+
 static GdkPixbuf* image_loader_jpeg_get_pixbuf(gpointer loader)
 {
 	ImageLoaderJpeg *lj = (ImageLoaderJpeg *) loader;
@@ -481,6 +565,7 @@ void image_loader_backend_set_jpeg(ImageLoaderBackend *funcs)
 
 	funcs->get_format_name = image_loader_jpeg_get_format_name;
 	funcs->get_format_mime_types = image_loader_jpeg_get_format_mime_types;
+	funcs->set_coarse = image_loader_jpeg_set_coarse;
 }
 
 
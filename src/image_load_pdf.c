@@ -47,6 +47,7 @@ static gboolean image_loader_pdf_load(gpointer loader, const guchar *buf, gsize
 	PopplerPage *page;
 	PopplerDocument *document;
 	gdouble width, height;
+	gdouble scale = 1.0;
 	cairo_surface_t *surface;
 	cairo_t *cr;
 	gboolean ret = FALSE;
@@ -70,14 +71,26 @@ static gboolean image_loader_pdf_load(gpointer loader, const guchar *buf, gsize
 		page = poppler_document_get_page(document, ld->page_num);
 		poppler_page_get_size(page, &width, &height);
 
-		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+		/* may call set_size with a reduced size */
+		ld->size_cb(loader, width, height, ld->data);
+
+		if (ld->requested_width > 0 && ld->requested_height > 0 &&
+		    ld->requested_width < width && ld->requested_height < height)
+			{
+			scale = MIN(ld->requested_width / width, ld->requested_height / height);
+			}
+
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width * scale, height * scale);
 		cr = cairo_create(surface);
+		cairo_scale(cr, scale, scale);
 		poppler_page_render(page, cr);
 
 		cairo_set_operator(cr, CAIRO_OPERATOR_DEST_OVER);
 		cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
 		cairo_paint(cr);
 
+		width = cairo_image_surface_get_width(surface);
+		height = cairo_image_surface_get_height(surface);
 		ld->pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, width, height);
 		ld->area_updated_cb(loader, 0, 0, width, height, ld->data);
 
@@ -48,34 +48,67 @@ static gboolean image_loader_webp_load(gpointer loader, const guchar *buf, gsize
 	ImageLoaderWEBP *ld = (ImageLoaderWEBP *) loader;
 	guint8* data;
 	gint width, height;
-	gboolean res_info;
-	WebPBitstreamFeatures features;
+	gint stride;
+	gint bytes_per_pixel;
+	WebPDecoderConfig config;
 	VP8StatusCode status_code;
 
-	res_info = WebPGetInfo(buf, count, &width, &height);
-	if (!res_info)
+	if (!WebPInitDecoderConfig(&config))
 		{
 		log_printf("warning: webp reader error\n");
 		return FALSE;
 		}
 
-	status_code = WebPGetFeatures(buf, count, &features);
+	status_code = WebPGetFeatures(buf, count, &config.input);
 	if (status_code != VP8_STATUS_OK)
 		{
 		log_printf("warning: webp reader error\n");
 		return FALSE;
 		}
 
-	if (features.has_alpha)
+	width = config.input.width;
+	height = config.input.height;
+
+	/* may call set_size with a reduced size */
+	ld->size_cb(loader, width, height, ld->data);
+
+	if (ld->requested_width > 0 && ld->requested_height > 0 &&
+	    ld->requested_width < (guint)width && ld->requested_height < (guint)height)
 		{
-		data = WebPDecodeRGBA(buf, count, &width, &height);
+		width = ld->requested_width;
+		height = ld->requested_height;
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
+		config.options.bypass_filtering = 1;
+		config.options.no_fancy_upsampling = 1;
 		}
-	else
+
+	bytes_per_pixel = config.input.has_alpha ? 4 : 3;
+	stride = width * bytes_per_pixel;
+	data = g_try_malloc((gsize)stride * height);
+	if (!data)
 		{
-		data = WebPDecodeRGB(buf, count, &width, &height);
+		log_printf("warning: webp reader error: out of memory\n");
+		return FALSE;
+		}
+
+	config.output.colorspace = config.input.has_alpha ? MODE_RGBA : MODE_RGB;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = data;
+	config.output.u.RGBA.stride = stride;
+	config.output.u.RGBA.size = (gsize)stride * height;
+
+	status_code = WebPDecode(buf, count, &config);
+	WebPFreeDecBuffer(&config.output);
+	if (status_code != VP8_STATUS_OK)
+		{
+		log_printf("warning: webp reader error\n");
+		g_free(data);
+		return FALSE;
 		}
 
-	ld->pixbuf = gdk_pixbuf_new_from_data(data, GDK_COLORSPACE_RGB, features.has_alpha, 8, width, height, width * (features.has_alpha ? 4 : 3), free_buffer, NULL);
+	ld->pixbuf = gdk_pixbuf_new_from_data(data, GDK_COLORSPACE_RGB, config.input.has_alpha, 8, width, height, stride, free_buffer, NULL);
 
 	ld->area_updated_cb(loader, 0, 0, width, height, ld->data);
 
@@ -3589,6 +3589,31 @@ void layout_util_status_update_write_all(void)
 		}
 }
 
+void layout_util_status_update_write_progress(guint done, guint total, guint failed)
+{
+	GList *work;
+	gchar *buf = NULL;
+
+	if (total > 0)
+		{
+		if (failed > 0)
+			buf = g_strdup_printf(_("Writing metadata %d/%d, %d failed"), done, total, failed);
+		else
+			buf = g_strdup_printf(_("Writing metadata %d/%d"), done, total);
+		}
+
+	work = layout_window_list;
+	while (work)
+		{
+		LayoutWindow *lw = work->data;
+		work = work->next;
+
+		layout_status_update_progress(lw, total ? (gdouble)done / total : 0.0, buf);
+		}
+
+	g_free(buf);
+}
+
 static gchar *layout_color_name_parse(const gchar *name)
 {
 	if (!name || !*name) return g_strdup(_("Empty"));
@@ -35,6 +35,7 @@ void layout_util_sync(LayoutWindow *lw);
 
 void layout_util_status_update_write(LayoutWindow *lw);
 void layout_util_status_update_write_all(void);
+void layout_util_status_update_write_progress(guint done, guint total, guint failed);
 
 //void layout_edit_update_all(void);
 
@@ -50,6 +50,7 @@ struct _LogWindow
 	GtkWidget *wrap;
 	GtkWidget *timer_data;
 	GtkWidget *debug_level;
+	GtkWidget *trace;
 };
 
 #if !GTK_CHECK_VERSION(3,0,0)
@@ -111,6 +112,20 @@ static void log_window_timer_data_cb(GtkWidget *widget, gpointer data)
 	options->log_window.timer_data = !options->log_window.timer_data;
 }
 
+static void log_window_trace_cb(GtkWidget *widget, gpointer data)
+{
+	if (trace_enabled)
+		{
+		trace_finish(NULL);
+		gtk_button_set_label(GTK_BUTTON(widget), _("Trace"));
+		}
+	else
+		{
+		trace_start();
+		gtk_button_set_label(GTK_BUTTON(widget), _("Stop trace"));
+		}
+}
+
 static void log_window_regexp_cb(GtkWidget *text_entry, gpointer data)
 {
 	gchar *new_regexp;
@@ -166,10 +181,13 @@ static LogWindow *log_window_create(LayoutWindow *lw)
 	gtk_box_pack_start(GTK_BOX(win_vbox), scrolledwin, TRUE, TRUE, 0);
 	gtk_widget_show(scrolledwin);
 
-#ifdef DEBUG
 	hbox = pref_box_new(win_vbox, FALSE, GTK_ORIENTATION_HORIZONTAL, PREF_PAD_SPACE);
-
 	gtk_widget_show(hbox);
+
+	logwin->trace = pref_button_new(hbox, NULL, trace_enabled ? _("Stop trace") : _("Trace"), FALSE,
+					G_CALLBACK(log_window_trace_cb), logwin);
+
+#ifdef DEBUG
 	logwin->debug_level = pref_spin_new_mnemonic(hbox, _("Debug level:"), NULL,
 			  0, 4, 1, 1, get_debug_level(),G_CALLBACK(log_window_debug_spin_cb),
 			  logwin->debug_level );
@@ -32,6 +32,7 @@
 #include <glib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include "main.h"
 #include "glua.h"
@@ -258,43 +259,164 @@ void lua_init(void)
 	lua_settable(L, -3);
 	lua_pop(L, 1);
 	lua_pop(L, 1);
+
+	/* Collection Table (Dummy at the moment) */
+	lua_newtable(L);
+	lua_setglobal(L, "Collection");
+}
+
+/*
+ *-------------------------------------------------------------------
+ * script registry
+ *-------------------------------------------------------------------
+ */
+
+typedef struct _LuaScript LuaScript;
+struct _LuaScript {
+	gchar *path;	/**< locale encoded, NULL for inline chunks */
+	time_t mtime;
+	off_t size;
+
+	gint chunk;	/**< registry reference of the compiled chunk */
+	gint state;	/**< registry reference of the table kept between calls */
+};
+
+static GHashTable *lua_scripts = NULL;	/**< script file name -> LuaScript */
+static GHashTable *lua_inline = NULL;	/**< inline chunk text -> LuaScript */
+
+static void lua_script_free(gpointer data)
+{
+	LuaScript *script = data;
+
+	luaL_unref(L, LUA_REGISTRYINDEX, script->chunk);
+	luaL_unref(L, LUA_REGISTRYINDEX, script->state);
+	g_free(script->path);
+	g_free(script);
+}
+
+static LuaScript *lua_script_new(void)
+{
+	LuaScript *script;
+
+	script = g_new0(LuaScript, 1);
+	script->chunk = LUA_NOREF;
+	lua_newtable(L);
+	script->state = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	return script;
+}
+
+static gchar *lua_script_find(const gchar *file)
+{
+	gchar *path;
+
+	path = g_build_filename(get_rc_dir(), "lua", file, NULL);
+	if (access(path, R_OK) == 0) return path;
+	g_free(path);
+
+	/* FIXME: what is the correct way to find the scripts folder? */
+	path = g_build_filename("/usr/local/lib", GQ_APPNAME_LC, file, NULL);
+	if (access(path, R_OK) == 0) return path;
+	g_free(path);
+
+	return NULL;
+}
+
+static void lua_script_unload(LuaScript *script)
+{
+	luaL_unref(L, LUA_REGISTRYINDEX, script->chunk);
+	script->chunk = LUA_NOREF;
 }
 
 /**
- * \brief Call a lua function to get a single value.
+ * \brief Get the compiled chunk of a script file or an inline chunk.
+ *
+ * Scripts are compiled once and reloaded when the file changes on disk.
+ * Returns NULL if the script file does not exist. A chunk that does not
+ * compile is returned without a chunk and the message in \a error.
  */
-gchar *lua_callvalue(FileData *fd, const gchar *file, const gchar *function)
+static LuaScript *lua_script_get(const gchar *file, const gchar *function, gchar **error)
 {
+	LuaScript *script;
+	struct stat st;
 	gint result;
-	gchar *data = NULL;
-	gchar *path;
-	FileData **image_data;
-	gchar *tmp;
-	GError *error = NULL;
-	gboolean ok;
 
-	ok = access(g_build_filename(get_rc_dir(), "lua", file, NULL), R_OK);
-	if (ok == 0)
+	if (!lua_scripts)
 		{
-		path = g_build_filename(get_rc_dir(), "lua", file, NULL);
+		lua_scripts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, lua_script_free);
+		lua_inline = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, lua_script_free);
 		}
-	else
+
+	if (file[0] == '\0')
 		{
-		/* FIXME: what is the correct way to find the scripts folder? */
-		ok = access(g_build_filename("/usr/local/lib", GQ_APPNAME_LC, file, NULL), R_OK);
-		if (ok == 0)
+		script = g_hash_table_lookup(lua_inline, function);
+		if (!script)
 			{
-			path = g_build_filename("/usr/local/lib", GQ_APPNAME_LC, file, NULL);
+			script = lua_script_new();
+			g_hash_table_insert(lua_inline, g_strdup(function), script);
 			}
-		else
+		if (script->chunk == LUA_NOREF)
 			{
-			return g_strdup("");
+			result = luaL_loadstring(L, function);
+			if (result)
+				{
+				*error = g_strdup(lua_tostring(L, -1));
+				lua_pop(L, 1);
+				return script;
+				}
+			script->chunk = luaL_ref(L, LUA_REGISTRYINDEX);
 			}
+		return script;
 		}
 
-	/* Collection Table (Dummy at the moment) */
-	lua_newtable(L);
-	lua_setglobal(L, "Collection");
+	script = g_hash_table_lookup(lua_scripts, file);
+	if (!script)
+		{
+		script = lua_script_new();
+		g_hash_table_insert(lua_scripts, g_strdup(file), script);
+		}
+
+	if (script->path && stat(script->path, &st) == 0)
+		{
+		if (st.st_mtime != script->mtime || st.st_size != script->size)
+			{
+			DEBUG_1("lua: reloading %s", script->path);
+			lua_script_unload(script);
+			}
+		}
+	else
+		{
+		lua_script_unload(script);
+		g_free(script->path);
+		script->path = lua_script_find(file);
+		if (!script->path || stat(script->path, &st) != 0) return NULL;
+		}
+
+	if (script->chunk == LUA_NOREF)
+		{
+		script->mtime = st.st_mtime;
+		script->size = st.st_size;
+
+		result = luaL_loadfile(L, script->path);
+		if (result)
+			{
+			*error = g_strdup(lua_tostring(L, -1));
+			lua_pop(L, 1);
+			return script;
+			}
+		script->chunk = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+
+	return script;
+}
+
+static gchar *lua_script_call(LuaScript *script, FileData *fd)
+{
+	gint result;
+	gchar *data;
+	FileData **image_data;
+	gchar *tmp;
+	GError *error = NULL;
 
 	/* Current Image */
 	image_data = (FileData **)lua_newuserdata(L, sizeof(FileData *));
@@ -303,22 +425,23 @@ gchar *lua_callvalue(FileData *fd, const gchar *file, const gchar *function)
 	lua_setglobal(L, "Image");
 
 	*image_data = fd;
-	if (file[0] == '\0')
-		{
-		result = luaL_dostring(L, function);
-		}
-	else
-		{
-		result = luaL_dofile(L, path);
-		g_free(path);
-		}
 
+	/* Table kept for this script between calls */
+	lua_rawgeti(L, LUA_REGISTRYINDEX, script->state);
+	lua_setglobal(L, "State");
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, script->chunk);
+	result = lua_pcall(L, 0, 1, 0);
 	if (result)
 		{
 		data = g_strdup_printf("Error running lua script: %s", lua_tostring(L, -1));
+		lua_pop(L, 1);
 		return data;
 		}
 	data = g_strdup(lua_tostring(L, -1));
+	lua_pop(L, 1);
+	if (!data) return g_strdup("");
+
 	tmp = g_locale_to_utf8(data, strlen(data), NULL, NULL, &error);
 	if (error)
 		{
@@ -328,10 +451,70 @@ gchar *lua_callvalue(FileData *fd, const gchar *file, const gchar *function)
 	else
 		{
 		g_free(data);
-		data = g_strdup(tmp);
+		data = tmp;
 		} // if (error) { ... } else
 	return data;
 }
 
+/**
+ * \brief Call a lua function to get a single value.
+ */
+gchar *lua_callvalue(FileData *fd, const gchar *file, const gchar *function)
+{
+	LuaScript *script;
+	gchar *error = NULL;
+	gchar *data;
+
+	script = lua_script_get(file, function, &error);
+	if (!script) return g_strdup("");
+	if (error)
+		{
+		data = g_strdup_printf("Error running lua script: %s", error);
+		g_free(error);
+		return data;
+		}
+
+	return lua_script_call(script, fd);
+}
+
+/**
+ * \brief Call a lua function for each FileData of a list.
+ *
+ * The script is looked up and compiled once for the whole list.
+ * Returns a list of strings in the order of \a list.
+ */
+GList *lua_callvalue_list(GList *list, const gchar *file, const gchar *function)
+{
+	LuaScript *script;
+	gchar *error = NULL;
+	GList *work;
+	GList *ret = NULL;
+
+	script = lua_script_get(file, function, &error);
+
+	for (work = list; work; work = work->next)
+		{
+		FileData *fd = work->data;
+		gchar *data;
+
+		if (!script)
+			{
+			data = g_strdup("");
+			}
+		else if (error)
+			{
+			data = g_strdup_printf("Error running lua script: %s", error);
+			}
+		else
+			{
+			data = lua_script_call(script, fd);
+			}
+		ret = g_list_prepend(ret, data);
+		}
+	g_free(error);
+
+	return g_list_reverse(ret);
+}
+
 #endif
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
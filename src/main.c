@@ -32,6 +32,8 @@
 
 #include "main.h"
 
+#include "batch.h"
+#include "bench.h"
 #include "cache.h"
 #include "collect.h"
 #include "collect-io.h"
@@ -63,6 +65,7 @@
 
 
 gboolean thumb_format_changed = FALSE;
+gboolean batch_mode = FALSE;
 static RemoteConnection *remote_connection = NULL;
 
 /*
@@ -384,6 +387,8 @@ static void parse_command_line(gint argc, gchar *argv[])
 				print_term(FALSE, _("  -n, --new-instance               open a new instance of Geeqie\n"));
 				print_term(FALSE, _("  -r, --remote                     send following commands to open window\n"));
 				print_term(FALSE, _("  -rh,--remote-help                print remote command list\n"));
+				print_term(FALSE, _("      --batch [options] <folders>  build caches without a display, as first option\n"));
+				print_term(FALSE, _("      --bench [options]            run the benchmarks, as first option, see --bench --help\n"));
 #ifdef DEBUG
 				print_term(FALSE, _("      --debug[=level]              turn on debug output\n"));
 				print_term(FALSE, _("  -g:<regexp>, --grep:<regexp>     filter debug output\n"));
@@ -886,6 +891,19 @@ gint main(gint argc, gchar *argv[])
 	gtkrc_load();
 
 	parse_command_line_for_debug_option(argc, argv);
+
+	if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+		{
+		/* runs without a display, GTK+ is not initialised */
+		exit(batch_main(argc - 2, argv + 2));
+		}
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		{
+		/* GTK+ is only initialised for the render cases, when there is a display */
+		exit(bench_main(argc - 2, argv + 2));
+		}
+
 	DEBUG_1("%s main: gtk_init", get_exec_time());
 #ifdef HAVE_CLUTTER
 	if (gtk_clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
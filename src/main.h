@@ -122,6 +122,7 @@
 #define GQ_LINK_STR "↗"
 #include "typedefs.h"
 #include "debug.h"
+#include "trace.h"
 #include "options.h"
 
 #define DESKTOP_FILE_TEMPLATE GQ_APP_DIR "/template.desktop"
@@ -145,6 +146,7 @@
  */
 
 extern gboolean thumb_format_changed;
+extern gboolean batch_mode; /* geeqie --batch, no windows */
 
 void keyboard_scroll_calc(gint *x, gint *y, GdkEventKey *event);
 gint key_press_cb(GtkWidget *widget, GdkEventKey *event, gpointer data);
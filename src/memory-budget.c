@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ * \brief One memory budget for all in-memory caches
+ *
+ * The caches keep their own limits and order. They also register here,
+ * and when the bytes of all of them exceed options->image.memory_budget,
+ * entries are evicted from whichever cache has the entry with the
+ * greatest age divided by its MemoryCost.
+ *
+ * Under memory pressure of the system, from /proc/pressure/memory or
+ * else /proc/meminfo, a quarter of the cached bytes is freed at each check
+ * until the pressure is gone.
+ *
+ * All of it runs in the main thread.
+ */
+
+#include "main.h"
+#include "memory-budget.h"
+
+#define MEMORY_BUDGET_MIN (64 * 1024 * 1024)
+#define MEMORY_BUDGET_FALLBACK (1024 * 1024 * 1024)	/* when the RAM size is unknown */
+
+#define MEMORY_PRESSURE_INTERVAL 5	/* seconds */
+#define MEMORY_PRESSURE_PSI 10.0	/* percent of time stalled in the last 10 seconds */
+#define MEMORY_PRESSURE_AVAILABLE 10	/* percent of the RAM still available */
+
+struct _MemoryCache
+{
+	const gchar *name;
+	MemoryCost cost;
+	MemoryCacheSizeFunc size_func;
+	MemoryCacheOldestFunc oldest_func;
+	MemoryCacheEvictFunc evict_func;
+	gpointer data;
+};
+
+static GList *memory_caches = NULL;
+static guint memory_check_id = 0; /* event source id */
+static guint memory_pressure_id = 0; /* event source id */
+static gboolean memory_pressure = FALSE;
+
+/*
+ *-----------------------------------------------------------------------------
+ * system memory
+ *-----------------------------------------------------------------------------
+ */
+
+/* sizes in bytes, FALSE if /proc/meminfo can not be read */
+static gboolean memory_read_meminfo(guint64 *total, guint64 *available)
+{
+	gchar *buf;
+	gchar *p;
+
+	*total = 0;
+	*available = 0;
+
+	if (!g_file_get_contents("/proc/meminfo", &buf, NULL, NULL)) return FALSE;
+
+	p = strstr(buf, "MemTotal:");
+	if (p) *total = g_ascii_strtoull(p + 9, NULL, 10) * 1024;
+	p = strstr(buf, "MemAvailable:");
+	if (p) *available = g_ascii_strtoull(p + 13, NULL, 10) * 1024;
+
+	g_free(buf);
+
+	return *total > 0;
+}
+
+/* the avg10 of "some" in /proc/pressure/memory, -1 if there is none */
+static gdouble memory_read_psi(void)
+{
+	gchar *buf;
+	gchar *p;
+	gdouble ret = -1.0;
+
+	if (!g_file_get_contents("/proc/pressure/memory", &buf, NULL, NULL)) return ret;
+
+	if (g_str_has_prefix(buf, "some") && (p = strstr(buf, "avg10=")))
+		{
+		ret = g_ascii_strtod(p + 6, NULL);
+		}
+
+	g_free(buf);
+
+	return ret;
+}
+
+static gboolean memory_system_pressure(void)
+{
+	guint64 total;
+	guint64 available;
+	gdouble psi;
+
+	psi = memory_read_psi();
+	if (psi >= 0.0) return psi > MEMORY_PRESSURE_PSI;
+
+	if (!memory_read_meminfo(&total, &available) || available == 0) return FALSE;
+
+	return available < total / 100 * MEMORY_PRESSURE_AVAILABLE;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * eviction
+ *-----------------------------------------------------------------------------
+ */
+
+/**
+ * \brief The bytes all caches may use
+ */
+gsize memory_budget_get(void)
+{
+	static guint64 ram = 0;
+	guint64 available;
+
+	if (options->image.memory_budget > 0)
+		{
+		return MAX((gsize)options->image.memory_budget * 1048576, MEMORY_BUDGET_MIN);
+		}
+
+	if (!ram && !memory_read_meminfo(&ram, &available)) return MEMORY_BUDGET_FALLBACK;
+
+	return MAX(ram / 4, MEMORY_BUDGET_MIN);
+}
+
+static gsize memory_caches_size(void)
+{
+	GList *work;
+	gsize size = 0;
+
+	for (work = memory_caches; work; work = work->next)
+		{
+		MemoryCache *mc = work->data;
+
+		size += mc->size_func(mc->data);
+		}
+
+	return size;
+}
+
+static MemoryCache *memory_cache_find_victim(void)
+{
+	GList *work;
+	MemoryCache *victim = NULL;
+	gdouble victim_score = 0.0;
+	gint64 now = g_get_monotonic_time();
+
+	for (work = memory_caches; work; work = work->next)
+		{
+		MemoryCache *mc = work->data;
+		gint64 last_used;
+		gdouble score;
+
+		if (!mc->evict_func) continue;
+
+		last_used = mc->oldest_func(mc->data);
+		if (last_used <= 0) continue;
+
+		score = (gdouble)(now - last_used + 1) / mc->cost;
+		if (score > victim_score)
+			{
+			victim = mc;
+			victim_score = score;
+			}
+		}
+
+	return victim;
+}
+
+static void memory_budget_enforce(void)
+{
+	gsize budget = memory_budget_get();
+	gsize size = memory_caches_size();
+	gsize start_size = size;
+
+	if (memory_pressure) budget = MIN(budget, size / 4 * 3);
+
+	while (size > budget)
+		{
+		MemoryCache *mc = memory_cache_find_victim();
+		gsize freed;
+
+		if (!mc) break;
+
+		freed = mc->evict_func(mc->data);
+		if (!freed) break;
+
+		size -= MIN(freed, size);
+		}
+
+	if (size != start_size)
+		{
+		DEBUG_1("memory budget: %" G_GSIZE_FORMAT " -> %" G_GSIZE_FORMAT " bytes of %" G_GSIZE_FORMAT "%s",
+			start_size, size, memory_budget_get(), memory_pressure ? ", memory pressure" : "");
+		}
+}
+
+static gboolean memory_check_cb(gpointer data)
+{
+	memory_check_id = 0;
+	memory_budget_enforce();
+
+	return FALSE;
+}
+
+static gboolean memory_pressure_cb(gpointer data)
+{
+	gboolean pressure = memory_system_pressure();
+
+	if (pressure != memory_pressure) DEBUG_1("memory pressure: %s", pressure ? "on" : "off");
+	memory_pressure = pressure;
+
+	if (memory_pressure) memory_budget_enforce();
+
+	return TRUE;
+}
+
+/**
+ * \brief Checks the budget once the main loop is idle, call when a cache grew
+ */
+void memory_cache_changed(void)
+{
+	if (!memory_check_id) memory_check_id = g_idle_add(memory_check_cb, NULL);
+}
+
+/**
+ * \brief Adds a cache to the budget
+ * \param name A static string, caches of the same kind share it
+ * \param evict_func NULL if the cache is only counted
+ */
+MemoryCache *memory_cache_register(const gchar *name, MemoryCost cost,
+				   MemoryCacheSizeFunc size_func,
+				   MemoryCacheOldestFunc oldest_func,
+				   MemoryCacheEvictFunc evict_func,
+				   gpointer data)
+{
+	MemoryCache *mc;
+
+	g_return_val_if_fail(size_func != NULL, NULL);
+	g_return_val_if_fail(!evict_func || oldest_func, NULL);
+
+	mc = g_new0(MemoryCache, 1);
+	mc->name = name;
+	mc->cost = cost;
+	mc->size_func = size_func;
+	mc->oldest_func = oldest_func;
+	mc->evict_func = evict_func;
+	mc->data = data;
+
+	memory_caches = g_list_prepend(memory_caches, mc);
+
+	if (!memory_pressure_id)
+		{
+		memory_pressure_id = g_timeout_add_seconds(MEMORY_PRESSURE_INTERVAL, memory_pressure_cb, NULL);
+		}
+
+	return mc;
+}
+
+void memory_cache_unregister(MemoryCache *mc)
+{
+	if (!mc) return;
+
+	memory_caches = g_list_remove(memory_caches, mc);
+	g_free(mc);
+
+	if (!memory_caches && memory_pressure_id)
+		{
+		g_source_remove(memory_pressure_id);
+		memory_pressure_id = 0;
+		memory_pressure = FALSE;
+		}
+}
+
+/**
+ * \brief The bytes used by each kind of cache, and the budget
+ * \returns One line per kind, free with g_free()
+ */
+gchar *memory_budget_get_usage(void)
+{
+	GString *out = g_string_new(NULL);
+	GHashTable *sizes;
+	GHashTable *counts;
+	GList *names = NULL;
+	GList *work;
+	gsize total = 0;
+
+	sizes = g_hash_table_new(g_str_hash, g_str_equal);
+	counts = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (work = memory_caches; work; work = work->next)
+		{
+		MemoryCache *mc = work->data;
+		gsize size = mc->size_func(mc->data);
+		gsize *sum = g_hash_table_lookup(sizes, mc->name);
+
+		if (!sum)
+			{
+			sum = g_new0(gsize, 1);
+			g_hash_table_insert(sizes, (gpointer)mc->name, sum);
+			names = g_list_prepend(names, (gpointer)mc->name);
+			}
+		*sum += size;
+		g_hash_table_insert(counts, (gpointer)mc->name,
+				    GUINT_TO_POINTER(GPOINTER_TO_UINT(g_hash_table_lookup(counts, mc->name)) + 1));
+		total += size;
+		}
+
+	names = g_list_sort(names, (GCompareFunc)strcmp);
+	for (work = names; work; work = work->next)
+		{
+		const gchar *name = work->data;
+		gsize *sum = g_hash_table_lookup(sizes, name);
+
+		g_string_append_printf(out, "%s: %u caches, %" G_GSIZE_FORMAT " bytes\n", name,
+				       GPOINTER_TO_UINT(g_hash_table_lookup(counts, name)), *sum);
+		g_free(sum);
+		}
+	g_string_append_printf(out, "total: %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes%s\n",
+			       total, memory_budget_get(), memory_pressure ? ", memory pressure" : "");
+
+	g_list_free(names);
+	g_hash_table_destroy(counts);
+	g_hash_table_destroy(sizes);
+
+	return g_string_free(out, FALSE);
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
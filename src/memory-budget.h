@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+/* how expensive an evicted entry is to get back, divides its age */
+typedef enum {
+	MEMORY_COST_LOW		= 1,	/* read again from a disk cache */
+	MEMORY_COST_MEDIUM	= 2,	/* drawn again from data in memory */
+	MEMORY_COST_HIGH	= 4	/* decoded again from the file */
+} MemoryCost;
+
+typedef struct _MemoryCache MemoryCache;
+
+/* bytes used */
+typedef gsize (*MemoryCacheSizeFunc)(gpointer data);
+/* g_get_monotonic_time() of the last use of the entry evict would free, 0 if none can be */
+typedef gint64 (*MemoryCacheOldestFunc)(gpointer data);
+/* frees the least recently used entry, returns the bytes freed */
+typedef gsize (*MemoryCacheEvictFunc)(gpointer data);
+
+MemoryCache *memory_cache_register(const gchar *name, MemoryCost cost,
+				   MemoryCacheSizeFunc size_func,
+				   MemoryCacheOldestFunc oldest_func,
+				   MemoryCacheEvictFunc evict_func,
+				   gpointer data);
+void memory_cache_unregister(MemoryCache *mc);
+void memory_cache_changed(void);
+
+gsize memory_budget_get(void);
+gchar *memory_budget_get_usage(void);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -74,105 +74,207 @@ static gboolean metadata_file_read(gchar *path, GList **keywords, gchar **commen
 
 /*
  *-------------------------------------------------------------------
- * long-term cache - keep keywords from whole dir in memory
+ * long-term cache - keep metadata from whole dir in memory
  *-------------------------------------------------------------------
  */
 
-/* fd->cached metadata list of lists
-   each particular list contains key as a first entry, then the values
+/* fd->cold->cached_metadata is an array of MetadataCacheEntry sorted by key,
+   the keys are interned as quarks and the values are stored as
+   NULL-terminated string arrays
 */
 
-static void metadata_cache_update(FileData *fd, const gchar *key, const GList *values)
+typedef struct _MetadataCacheEntry MetadataCacheEntry;
+struct _MetadataCacheEntry {
+	GQuark key;
+	gchar **values;
+};
+
+/* above this total size only keywords are cached */
+#define METADATA_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
+static guint metadata_cache_files = 0; /* number of FileData with cached metadata */
+static guint metadata_cache_entries = 0;
+static gsize metadata_cache_size = 0; /* approximate memory used by all caches, in bytes */
+
+static gsize metadata_cache_entry_size(const MetadataCacheEntry *entry)
 {
-	GList *work;
+	gsize size = sizeof(MetadataCacheEntry) + sizeof(gchar *);
+	gchar **value;
 
-	work = fd->cached_metadata;
-	while (work)
+	for (value = entry->values; *value; value++)
 		{
-		GList *entry = work->data;
-		gchar *entry_key = entry->data;
+		size += sizeof(gchar *) + strlen(*value) + 1;
+		}
+	return size;
+}
 
-		if (strcmp(entry_key, key) == 0)
-			{
-			/* key found - just replace values */
-			GList *old_values = entry->next;
-			entry->next = NULL;
-			old_values->prev = NULL;
-			string_list_free(old_values);
-			work->data = g_list_append(entry, string_list_copy(values));
-			DEBUG_1("updated %s %s\n", key, fd->path);
-			return;
-			}
-		work = work->next;
+static gchar **metadata_cache_values_from_list(const GList *list)
+{
+	gchar **values = g_new(gchar *, g_list_length((GList *)list) + 1);
+	gint i = 0;
+
+	while (list)
+		{
+		values[i++] = g_strdup(list->data);
+		list = list->next;
 		}
+	values[i] = NULL;
+
+	return values;
+}
 
-	/* key not found - prepend new entry */
-	fd->cached_metadata = g_list_prepend(fd->cached_metadata,
-				g_list_prepend(string_list_copy(values), g_strdup(key)));
-	DEBUG_1("added %s %s\n", key, fd->path);
+static GList *metadata_cache_values_to_list(gchar **values)
+{
+	GList *list = NULL;
+
+	while (*values)
+		{
+		list = g_list_prepend(list, g_strdup(*values));
+		values++;
+		}
 
+	return g_list_reverse(list);
 }
 
-static const GList *metadata_cache_get(FileData *fd, const gchar *key)
+/* returns the index of the entry or the position where it should be inserted */
+static guint metadata_cache_find(FileData *fd, GQuark key, gboolean *found)
 {
-	GList *work;
+	GArray *cache = fd->cold ? fd->cold->cached_metadata : NULL;
+	guint lo = 0;
+	guint hi = cache ? cache->len : 0;
 
-	work = fd->cached_metadata;
-	while (work)
+	*found = FALSE;
+	while (lo < hi)
 		{
-		GList *entry = work->data;
-		gchar *entry_key = entry->data;
+		guint mid = (lo + hi) / 2;
+		GQuark mid_key = g_array_index(cache, MetadataCacheEntry, mid).key;
 
-		if (strcmp(entry_key, key) == 0)
+		if (mid_key == key)
 			{
-			/* key found */
-			DEBUG_1("found %s %s\n", key, fd->path);
-			return entry;
+			*found = TRUE;
+			return mid;
 			}
-		work = work->next;
+
+		if (mid_key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
 		}
-	return NULL;
-	DEBUG_1("not found %s %s\n", key, fd->path);
+
+	return lo;
+}
+
+static void metadata_cache_entry_free(MetadataCacheEntry *entry)
+{
+	metadata_cache_size -= metadata_cache_entry_size(entry);
+	metadata_cache_entries--;
+	g_strfreev(entry->values);
 }
 
 static void metadata_cache_remove(FileData *fd, const gchar *key)
 {
-	GList *work;
+	GQuark quark = g_quark_try_string(key);
+	gboolean found;
+	guint i;
 
-	work = fd->cached_metadata;
-	while (work)
+	if (!quark || !fd->cold || !fd->cold->cached_metadata) return;
+
+	i = metadata_cache_find(fd, quark, &found);
+	if (!found) return;
+
+	metadata_cache_entry_free(&g_array_index(fd->cold->cached_metadata, MetadataCacheEntry, i));
+	g_array_remove_index(fd->cold->cached_metadata, i);
+	DEBUG_1("removed %s %s\n", key, fd->path);
+}
+
+static void metadata_cache_update(FileData *fd, const gchar *key, const GList *values)
+{
+	MetadataCacheEntry entry;
+	FileDataCold *cold;
+	gboolean found;
+	guint i;
+
+	if (metadata_cache_size >= METADATA_CACHE_MAX_SIZE && strcmp(key, KEYWORD_KEY) != 0)
 		{
-		GList *entry = work->data;
-		gchar *entry_key = entry->data;
+		metadata_cache_remove(fd, key);
+		return;
+		}
 
-		if (strcmp(entry_key, key) == 0)
-			{
-			/* key found */
-			string_list_free(entry);
-			fd->cached_metadata = g_list_delete_link(fd->cached_metadata, work);
-			DEBUG_1("removed %s %s\n", key, fd->path);
-			return;
-			}
-		work = work->next;
+	cold = file_data_cold(fd);
+	if (!cold->cached_metadata)
+		{
+		cold->cached_metadata = g_array_sized_new(FALSE, FALSE, sizeof(MetadataCacheEntry), 1);
+		metadata_cache_files++;
+		metadata_cache_size += sizeof(GArray);
+		}
+
+	entry.key = g_quark_from_string(key);
+	entry.values = metadata_cache_values_from_list(values);
+
+	metadata_cache_size += metadata_cache_entry_size(&entry);
+	metadata_cache_entries++;
+
+	i = metadata_cache_find(fd, entry.key, &found);
+	if (found)
+		{
+		/* key found - just replace values */
+		metadata_cache_entry_free(&g_array_index(cold->cached_metadata, MetadataCacheEntry, i));
+		g_array_index(cold->cached_metadata, MetadataCacheEntry, i) = entry;
+		DEBUG_1("updated %s %s\n", key, fd->path);
+		}
+	else
+		{
+		g_array_insert_val(cold->cached_metadata, i, entry);
+		DEBUG_1("added %s %s\n", key, fd->path);
 		}
-	DEBUG_1("not removed %s %s\n", key, fd->path);
+}
+
+/* returns a copy of the cached values or NULL with *found set to FALSE */
+static GList *metadata_cache_get(FileData *fd, const gchar *key, gboolean *found)
+{
+	GQuark quark = g_quark_try_string(key);
+	guint i;
+
+	*found = FALSE;
+	if (!quark || !fd->cold || !fd->cold->cached_metadata) return NULL;
+
+	i = metadata_cache_find(fd, quark, found);
+	if (!*found) return NULL;
+
+	return metadata_cache_values_to_list(g_array_index(fd->cold->cached_metadata, MetadataCacheEntry, i).values);
 }
 
 void metadata_cache_free(FileData *fd)
 {
-	GList *work;
-	if (fd->cached_metadata) DEBUG_1("freed %s\n", fd->path);
+	FileDataCold *cold = fd->cold;
+	guint i;
 
-	work = fd->cached_metadata;
-	while (work)
+	if (!cold) return;
+
+	if (cold->cached_metadata)
 		{
-		GList *entry = work->data;
-		string_list_free(entry);
+		DEBUG_1("freed %s\n", fd->path);
 
-		work = work->next;
+		for (i = 0; i < cold->cached_metadata->len; i++)
+			{
+			metadata_cache_entry_free(&g_array_index(cold->cached_metadata, MetadataCacheEntry, i));
+			}
+		g_array_free(cold->cached_metadata, TRUE);
+		cold->cached_metadata = NULL;
+
+		metadata_cache_files--;
+		metadata_cache_size -= sizeof(GArray);
 		}
-	g_list_free(fd->cached_metadata);
-	fd->cached_metadata = NULL;
+
+	g_free(cold->keyword_bits);
+	cold->keyword_bits = NULL;
+}
+
+void metadata_cache_get_usage(guint *files, guint *entries, gsize *size)
+{
+	if (files) *files = metadata_cache_files;
+	if (entries) *entries = metadata_cache_entries;
+	if (size) *size = metadata_cache_size;
 }
 
 
@@ -186,19 +288,12 @@ void metadata_cache_free(FileData *fd)
  *-------------------------------------------------------------------
  */
 
-static GList *metadata_write_queue = NULL;
+static GHashTable *metadata_write_queue = NULL; /* set of FileData with unsaved changes */
 static guint metadata_write_idle_id = 0; /* event source id */
 
-static void metadata_write_queue_add(FileData *fd)
+/* (re)starts the timeout after which the queue is written */
+static void metadata_write_queue_arm(void)
 {
-	if (!g_list_find(metadata_write_queue, fd))
-		{
-		metadata_write_queue = g_list_prepend(metadata_write_queue, fd);
-		file_data_ref(fd);
-
-		layout_util_status_update_write_all();
-		}
-
 	if (metadata_write_idle_id)
 		{
 		g_source_remove(metadata_write_idle_id);
@@ -211,13 +306,50 @@ static void metadata_write_queue_add(FileData *fd)
 		}
 }
 
+static void metadata_write_queue_add(FileData *fd)
+{
+	if (!metadata_write_queue)
+		{
+		metadata_write_queue = g_hash_table_new(g_direct_hash, g_direct_equal);
+		}
+
+	if (!g_hash_table_contains(metadata_write_queue, fd))
+		{
+		g_hash_table_add(metadata_write_queue, fd);
+		file_data_ref(fd);
+
+		layout_util_status_update_write_all();
+		}
+
+	metadata_write_queue_arm();
+}
+
+static gboolean metadata_write_queue_contains(FileData *fd)
+{
+	return metadata_write_queue && g_hash_table_contains(metadata_write_queue, fd);
+}
+
+static gboolean metadata_write_in_flight_unapply(FileData *fd);
 
 gboolean metadata_write_queue_remove(FileData *fd)
 {
+	if (metadata_write_in_flight_unapply(fd))
+		{
+		/* the file was edited again while it was being written,
+		   fd stays in the queue with the newer changes, write them later */
+		if (metadata_write_queue_contains(fd))
+			metadata_write_queue_arm();
+		else
+			metadata_write_queue_add(fd);
+		file_data_increment_version(fd);
+		file_data_send_notification(fd, NOTIFY_REREAD);
+		return TRUE;
+		}
+
 	g_hash_table_destroy(fd->modified_xmp);
 	fd->modified_xmp = NULL;
 
-	metadata_write_queue = g_list_remove(metadata_write_queue, fd);
+	if (metadata_write_queue) g_hash_table_remove(metadata_write_queue, fd);
 
 	file_data_increment_version(fd);
 	file_data_send_notification(fd, NOTIFY_REREAD);
@@ -249,12 +381,12 @@ void metadata_notify_cb(FileData *fd, NotifyType type, gpointer data)
 		{
 		metadata_cache_free(fd);
 
-		if (g_list_find(metadata_write_queue, fd))
+		if (metadata_write_queue_contains(fd))
 			{
 			DEBUG_1("Notify metadata: %s %04x", fd->path, type);
-			if (!isname(fd->path))
+			if (!isname(fd->path) && !fd->change)
 				{
-				/* ignore deleted files */
+				/* ignore deleted files, pending operations finalize the file themselves */
 				metadata_write_queue_remove(fd);
 				}
 			}
@@ -264,9 +396,12 @@ void metadata_notify_cb(FileData *fd, NotifyType type, gpointer data)
 gboolean metadata_write_queue_confirm(gboolean force_dialog, FileUtilDoneFunc done_func, gpointer done_data)
 {
 	GList *work;
+	GList *queue;
 	GList *to_approve = NULL;
 
-	work = metadata_write_queue;
+	queue = metadata_write_queue ? g_hash_table_get_keys(metadata_write_queue) : NULL;
+
+	work = queue;
 	while (work)
 		{
 		FileData *fd = work->data;
@@ -283,16 +418,18 @@ gboolean metadata_write_queue_confirm(gboolean force_dialog, FileUtilDoneFunc do
 
 		to_approve = g_list_prepend(to_approve, file_data_ref(fd));
 		}
+	g_list_free(queue);
 
-	file_util_write_metadata(NULL, to_approve, NULL, force_dialog, done_func, done_data);
+	file_util_write_metadata(NULL, filelist_sort_path(to_approve), NULL, force_dialog, done_func, done_data);
 
-	return (metadata_write_queue != NULL);
+	return (metadata_queue_length() > 0);
 }
 
 static gboolean metadata_write_queue_idle_cb(gpointer data)
 {
-	metadata_write_queue_confirm(FALSE, NULL, NULL);
+	/* files written at once can arm the timeout again */
 	metadata_write_idle_id = 0;
+	metadata_write_queue_confirm(FALSE, NULL, NULL);
 	return FALSE;
 }
 
@@ -336,9 +473,292 @@ gboolean metadata_write_perform(FileData *fd)
 	return success;
 }
 
+/*
+ *-------------------------------------------------------------------
+ * background writer
+ *-------------------------------------------------------------------
+ */
+
+typedef struct _MetadataWriteJob MetadataWriteJob;
+struct _MetadataWriteJob
+{
+	FileData *fd;
+	gchar *path;
+	gchar *sidecar_path;
+	gchar *dest;
+	gchar *target; /* the file actually modified, jobs with the same target are serialized */
+	GHashTable *modified_xmp; /* snapshot of fd->modified_xmp, shared with metadata_write_in_flight */
+	gboolean success;
+
+	MetadataWriteDoneFunc done_func;
+	gpointer done_data;
+};
+
+static GHashTable *metadata_write_in_flight = NULL; /* FileData -> snapshot of the changes being written */
+
+static guint metadata_write_jobs_total = 0;
+static guint metadata_write_jobs_done = 0;
+static guint metadata_write_jobs_failed = 0;
+
+static gboolean metadata_string_list_equal(const GList *a, const GList *b)
+{
+	while (a && b)
+		{
+		if (g_strcmp0(a->data, b->data) != 0) return FALSE;
+		a = a->next;
+		b = b->next;
+		}
+
+	return (a == NULL && b == NULL);
+}
+
+/* removes the changes written by a background job from fd->modified_xmp,
+   returns TRUE if the file was edited meanwhile and newer changes remain unsaved */
+static gboolean metadata_write_in_flight_unapply(FileData *fd)
+{
+	GHashTable *written;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	gboolean remaining;
+
+	if (!metadata_write_in_flight) return FALSE;
+
+	written = g_hash_table_lookup(metadata_write_in_flight, fd);
+	if (!written) return FALSE;
+
+	if (fd->modified_xmp)
+		{
+		g_hash_table_iter_init(&iter, written);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			{
+			gpointer current;
+
+			if (g_hash_table_lookup_extended(fd->modified_xmp, key, NULL, &current) &&
+			    metadata_string_list_equal(current, value))
+				{
+				g_hash_table_remove(fd->modified_xmp, key);
+				}
+			}
+		}
+
+	remaining = (fd->modified_xmp && g_hash_table_size(fd->modified_xmp) > 0);
+
+	g_hash_table_remove(metadata_write_in_flight, fd);
+
+	return remaining;
+}
+
+static void metadata_write_progress_update(void)
+{
+	if (metadata_write_jobs_done >= metadata_write_jobs_total)
+		{
+		metadata_write_jobs_total = 0;
+		metadata_write_jobs_done = 0;
+		metadata_write_jobs_failed = 0;
+		}
+
+	layout_util_status_update_write_progress(metadata_write_jobs_done, metadata_write_jobs_total, metadata_write_jobs_failed);
+}
+
+#ifdef HAVE_GTHREAD
+static GThreadPool *metadata_write_thread_pool = NULL;
+static GHashTable *metadata_write_busy = NULL; /* target path -> GQueue of jobs waiting for the same target */
+
+static GHashTable *metadata_modified_xmp_copy(GHashTable *modified_xmp)
+{
+	GHashTable *copy;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	copy = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)string_list_free);
+	if (!modified_xmp) return copy;
+
+	g_hash_table_iter_init(&iter, modified_xmp);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		{
+		g_hash_table_insert(copy, g_strdup(key), string_list_copy(value));
+		}
+
+	return copy;
+}
+
+static void metadata_write_job_free(MetadataWriteJob *job)
+{
+	if (!job) return;
+
+	file_data_unref(job->fd);
+	g_free(job->path);
+	g_free(job->sidecar_path);
+	g_free(job->dest);
+	g_free(job->target);
+	if (job->modified_xmp) g_hash_table_unref(job->modified_xmp);
+	g_free(job);
+}
+
+static gboolean metadata_write_busy_acquire(MetadataWriteJob *job)
+{
+	GQueue *waiting;
+
+	if (!metadata_write_busy)
+		{
+		metadata_write_busy = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_queue_free);
+		}
+
+	waiting = g_hash_table_lookup(metadata_write_busy, job->target);
+	if (waiting)
+		{
+		g_queue_push_tail(waiting, job);
+		return FALSE;
+		}
+
+	g_hash_table_insert(metadata_write_busy, g_strdup(job->target), g_queue_new());
+	return TRUE;
+}
+
+/* returns the next job waiting for the target, the target stays busy in that case */
+static MetadataWriteJob *metadata_write_busy_release(const gchar *target)
+{
+	GQueue *waiting;
+
+	waiting = g_hash_table_lookup(metadata_write_busy, target);
+	if (!waiting) return NULL;
+
+	if (g_queue_is_empty(waiting))
+		{
+		g_hash_table_remove(metadata_write_busy, target);
+		return NULL;
+		}
+
+	return g_queue_pop_head(waiting);
+}
+
+static gboolean metadata_write_job_done_cb(gpointer data)
+{
+	MetadataWriteJob *job = data;
+	MetadataWriteJob *next;
+
+	if (job->dest)
+		{
+		/* see metadata_write_perform() */
+		file_data_unref(file_data_new_group(job->dest));
+		}
+
+	if (job->success)
+		{
+		metadata_legacy_delete(job->fd, job->dest);
+		}
+	else
+		{
+		log_printf(_("Error: unable to write metadata: %s\n"), job->target);
+		metadata_write_jobs_failed++;
+		}
+
+	next = metadata_write_busy_release(job->target);
+	if (next) g_thread_pool_push(metadata_write_thread_pool, next, NULL);
+
+	metadata_write_jobs_done++;
+	metadata_write_progress_update();
+
+	if (job->done_func) job->done_func(job->fd, job->success, job->done_data);
+
+	metadata_write_job_free(job);
+	return FALSE;
+}
+
+static void metadata_write_thread_run(gpointer data, gpointer user_data)
+{
+	MetadataWriteJob *job = data;
+	ExifData *exif;
+
+	/* read the current metadata from the file, not from the cache,
+	   the file could be modified meanwhile */
+	exif = exif_read(job->path, job->sidecar_path, job->modified_xmp);
+	if (exif)
+		{
+		job->success = (job->dest) ? exif_write_sidecar(exif, job->dest) : exif_write(exif);
+		exif_free(exif);
+		}
+
+	g_idle_add(metadata_write_job_done_cb, job);
+}
+#endif /* HAVE_GTHREAD */
+
+/**
+ * \brief Writes the changed metadata of fd in a worker thread
+ *
+ * This is the threaded equivalent of metadata_write_perform(). Files are
+ * written concurrently, writes to the same target file are serialized.
+ * The changes made to fd while the write is in progress are kept in the
+ * queue by metadata_write_queue_remove().
+ *
+ * \param done_func Called in the main thread when the file is written,
+ *    it can be called before this function returns
+ */
+void metadata_write_perform_async(FileData *fd, MetadataWriteDoneFunc done_func, gpointer done_data)
+{
+#ifdef HAVE_GTHREAD
+	MetadataWriteJob *job;
+	guint lf;
+#endif
+	gboolean success;
+
+	g_assert(fd->change);
+
+	metadata_write_jobs_total++;
+
+#ifdef HAVE_GTHREAD
+	lf = strlen(GQ_CACHE_EXT_METADATA);
+	if (!fd->change->dest ||
+	    g_ascii_strncasecmp(fd->change->dest + strlen(fd->change->dest) - lf, GQ_CACHE_EXT_METADATA, lf) != 0)
+		{
+		job = g_new0(MetadataWriteJob, 1);
+		job->fd = file_data_ref(fd);
+		job->path = g_strdup(fd->path);
+		job->dest = g_strdup(fd->change->dest);
+		job->target = g_strdup(job->dest ? job->dest : job->path);
+		job->modified_xmp = metadata_modified_xmp_copy(fd->modified_xmp);
+		job->done_func = done_func;
+		job->done_data = done_data;
+
+#ifdef HAVE_EXIV2
+		/* the same sidecar lookup as in exif_read_fd() */
+		job->sidecar_path = cache_find_location(CACHE_TYPE_XMP_METADATA, fd->path);
+		if (!job->sidecar_path) job->sidecar_path = file_data_get_sidecar_path(fd, TRUE);
+#endif
+
+		if (!metadata_write_in_flight)
+			{
+			metadata_write_in_flight = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_unref);
+			}
+		g_hash_table_insert(metadata_write_in_flight, fd, g_hash_table_ref(job->modified_xmp));
+
+		if (!metadata_write_thread_pool)
+			{
+			metadata_write_thread_pool = g_thread_pool_new(metadata_write_thread_run, NULL, g_get_num_processors(), FALSE, NULL);
+			}
+
+		metadata_write_progress_update();
+
+		if (metadata_write_busy_acquire(job)) g_thread_pool_push(metadata_write_thread_pool, job, NULL);
+		return;
+		}
+#endif
+
+	/* legacy metadata files are small and secure_save is not thread safe, write them directly */
+	success = metadata_write_perform(fd);
+
+	metadata_write_jobs_done++;
+	if (!success) metadata_write_jobs_failed++;
+	metadata_write_progress_update();
+
+	if (done_func) done_func(fd, success, done_data);
+}
+
 gint metadata_queue_length(void)
 {
-	return g_list_length(metadata_write_queue);
+	return metadata_write_queue ? g_hash_table_size(metadata_write_queue) : 0;
 }
 
 static gboolean metadata_check_key(const gchar *keys[], const gchar *key)
@@ -380,7 +800,8 @@ gboolean metadata_write_list(FileData *fd, const gchar *key, const GList *values
 		}
 	g_hash_table_insert(fd->modified_xmp, g_strdup(key), string_list_copy((GList *)values));
 
-	metadata_cache_remove(fd, key);
+	/* the key can be mapped to other keys (Xmp to Exif/Iptc), drop all of them */
+	metadata_cache_free(fd);
 
 	if (fd->exif)
 		{
@@ -667,7 +1088,7 @@ GList *metadata_read_list(FileData *fd, const gchar *key, MetadataFormat format)
 {
 	ExifData *exif;
 	GList *list = NULL;
-	const GList *cache_entry;
+	gboolean cached;
 	if (!fd) return NULL;
 
 	/* unwritten data overide everything */
@@ -678,10 +1099,10 @@ GList *metadata_read_list(FileData *fd, const gchar *key, MetadataFormat format)
 		}
 
 
-	if (format == METADATA_PLAIN && strcmp(key, KEYWORD_KEY) == 0
-	    && (cache_entry = metadata_cache_get(fd, key)))
+	if (format == METADATA_PLAIN)
 		{
-		return string_list_copy(cache_entry->next);
+		list = metadata_cache_get(fd, key, &cached);
+		if (cached) return list;
 		}
 
 	/*
@@ -723,7 +1144,7 @@ GList *metadata_read_list(FileData *fd, const gchar *key, MetadataFormat format)
 	list = exif_get_metadata(exif, key, format);
 	exif_free_fd(fd, exif);
 
-	if (format == METADATA_PLAIN && strcmp(key, KEYWORD_KEY) == 0)
+	if (format == METADATA_PLAIN)
 		{
 		metadata_cache_update(fd, key, list);
 		}
@@ -1039,26 +1460,238 @@ GList *string_to_keywords_list(const gchar *text)
 }
 
 /*
- * keywords to marks
+ * compiled keyword dictionary
+ *
+ * Keywords from keyword_tree get small integer ids, the keywords of each file
+ * are kept as a bitset of these ids in fd->cold->keyword_bits. A keyword connected
+ * to a mark is compiled into a list of bitsets (the keyword and its ancestors,
+ * for helpers one bitset per child keyword), so that meta_data_get_keyword_mark()
+ * does not have to read the keyword list and walk the tree for every file.
  */
 
+static GHashTable *keyword_dict = NULL; /* keyword (casefolded if not case sensitive) -> id + 1 */
+static guint keyword_dict_words = 1; /* size of the bitsets in 32-bit words */
+static GList *keyword_dict_marks[FILEDATA_MARKS_SIZE]; /* the mark is set if all bits of any of the bitsets are set */
+static gint keyword_dict_generation = 1; /* increased when the ids change, invalidates fd->cold->keyword_bits */
+static gboolean keyword_dict_dirty = TRUE;
+static gboolean keyword_dict_case_sensitive = FALSE;
 
-gboolean meta_data_get_keyword_mark(FileData *fd, gint n, gpointer data)
+static void keyword_dict_invalidate(void)
 {
-	/* FIXME: do not use global keyword_tree */
-	GList *path = data;
+	keyword_dict_dirty = TRUE;
+}
+
+static void keyword_dict_tree_changed_cb(gpointer data)
+{
+	keyword_dict_invalidate();
+}
+
+static gchar *keyword_dict_key(GtkTreeModel *keyword_tree, GtkTreeIter *iter)
+{
+	if (keyword_dict_case_sensitive) return keyword_get_name(keyword_tree, iter);
+	return keyword_get_casefold(keyword_tree, iter);
+}
+
+static gint keyword_dict_lookup(const gchar *key)
+{
+	return GPOINTER_TO_INT(g_hash_table_lookup(keyword_dict, key)) - 1;
+}
+
+static void keyword_dict_add_recursive(GHashTable *dict, GtkTreeModel *keyword_tree, GtkTreeIter *parent)
+{
+	GtkTreeIter iter;
+
+	if (!gtk_tree_model_iter_children(keyword_tree, &iter, parent)) return;
+
+	do
+		{
+		if (keyword_get_is_keyword(keyword_tree, &iter))
+			{
+			gchar *key = keyword_dict_key(keyword_tree, &iter);
+
+			if (!g_hash_table_contains(dict, key))
+				{
+				g_hash_table_insert(dict, key, GINT_TO_POINTER(g_hash_table_size(dict) + 1));
+				}
+			else
+				{
+				g_free(key);
+				}
+			}
+		keyword_dict_add_recursive(dict, keyword_tree, &iter);
+		}
+	while (gtk_tree_model_iter_next(keyword_tree, &iter));
+}
+
+static gboolean keyword_dict_equal(GHashTable *a, GHashTable *b)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	if (!a || !b) return FALSE;
+	if (g_hash_table_size(a) != g_hash_table_size(b)) return FALSE;
+
+	g_hash_table_iter_init(&iter, a);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		{
+		if (g_hash_table_lookup(b, key) != value) return FALSE;
+		}
+	return TRUE;
+}
+
+/* bitset of the keyword and all its parent keywords, see keyword_tree_is_set() */
+static guint32 *keyword_dict_node_bits(GtkTreeModel *keyword_tree, GtkTreeIter *iter_ptr)
+{
+	GtkTreeIter iter = *iter_ptr;
+	guint32 *bits = g_new0(guint32, keyword_dict_words);
+
+	while (TRUE)
+		{
+		GtkTreeIter parent;
+
+		if (keyword_get_is_keyword(keyword_tree, &iter))
+			{
+			gchar *key = keyword_dict_key(keyword_tree, &iter);
+			gint id = keyword_dict_lookup(key);
+
+			if (id >= 0) bits[id / 32] |= 1u << (id % 32);
+			g_free(key);
+			}
+
+		if (!gtk_tree_model_iter_parent(keyword_tree, &parent, &iter)) return bits;
+		iter = parent;
+		}
+}
+
+static GList *keyword_dict_node_alternatives(GtkTreeModel *keyword_tree, GtkTreeIter *iter, GList *list)
+{
+	GtkTreeIter child;
+
+	if (keyword_get_is_keyword(keyword_tree, iter))
+		{
+		return g_list_prepend(list, keyword_dict_node_bits(keyword_tree, iter));
+		}
+
+	/* a helper is set if it has any children set */
+	if (!gtk_tree_model_iter_children(keyword_tree, &child, iter)) return list;
+
+	do
+		{
+		list = keyword_dict_node_alternatives(keyword_tree, &child, list);
+		}
+	while (gtk_tree_model_iter_next(keyword_tree, &child));
+
+	return list;
+}
+
+static void keyword_dict_update(void)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(keyword_tree);
+	GHashTable *dict;
+	gint i;
+
+	if (!keyword_dict_dirty && keyword_dict_case_sensitive == options->metadata.keywords_case_sensitive) return;
+
+	keyword_dict_case_sensitive = options->metadata.keywords_case_sensitive;
+
+	dict = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if (keyword_tree) keyword_dict_add_recursive(dict, model, NULL);
+
+	/* the tree changes often just in the mark or hide_in columns,
+	   keep the bitsets of the files if the ids are the same */
+	if (!keyword_dict_equal(keyword_dict, dict)) keyword_dict_generation++;
+
+	if (keyword_dict) g_hash_table_destroy(keyword_dict);
+	keyword_dict = dict;
+	keyword_dict_words = MAX(1, (g_hash_table_size(dict) + 31) / 32);
+
+	for (i = 0; i < FILEDATA_MARKS_SIZE; i++)
+		{
+		FileDataGetMarkFunc get_mark_func;
+		gpointer mark_func_data;
+		GtkTreeIter iter;
+
+		g_list_free_full(keyword_dict_marks[i], g_free);
+		keyword_dict_marks[i] = NULL;
+
+		file_data_get_registered_mark_func(i, &get_mark_func, NULL, &mark_func_data);
+		if (get_mark_func != meta_data_get_keyword_mark) continue;
+
+		if (keyword_tree && keyword_tree_get_iter(model, &iter, mark_func_data))
+			{
+			keyword_dict_marks[i] = keyword_dict_node_alternatives(model, &iter, NULL);
+			}
+		}
+
+	keyword_dict_dirty = FALSE;
+}
+
+static const guint32 *keyword_dict_file_bits(FileData *fd)
+{
+	FileDataCold *cold = file_data_cold(fd);
 	GList *keywords;
-	gboolean found = FALSE;
+	GList *work;
+
+	if (cold->keyword_bits &&
+	    cold->keyword_bits_version == fd->version &&
+	    cold->keyword_bits_generation == keyword_dict_generation) return cold->keyword_bits;
+
+	g_free(cold->keyword_bits);
+	cold->keyword_bits = g_new0(guint32, keyword_dict_words);
+
 	keywords = metadata_read_list(fd, KEYWORD_KEY, METADATA_PLAIN);
-	if (keywords)
+	work = keywords;
+	while (work)
 		{
-		GtkTreeIter iter;
-		if (keyword_tree_get_iter(GTK_TREE_MODEL(keyword_tree), &iter, path) &&
-		    keyword_tree_is_set(GTK_TREE_MODEL(keyword_tree), &iter, keywords))
-			found = TRUE;
+		const gchar *kw = work->data;
+		gchar *key = keyword_dict_case_sensitive ? g_strdup(kw) : g_utf8_casefold(kw, -1);
+		gint id = keyword_dict_lookup(key);
 
+		if (id >= 0) cold->keyword_bits[id / 32] |= 1u << (id % 32);
+		g_free(key);
+		work = work->next;
 		}
-	return found;
+	string_list_free(keywords);
+
+	cold->keyword_bits_version = fd->version;
+	cold->keyword_bits_generation = keyword_dict_generation;
+
+	return cold->keyword_bits;
+}
+
+static gboolean keyword_dict_bits_contain(const guint32 *bits, const guint32 *required)
+{
+	guint i;
+
+	for (i = 0; i < keyword_dict_words; i++)
+		{
+		if ((bits[i] & required[i]) != required[i]) return FALSE;
+		}
+	return TRUE;
+}
+
+/*
+ * keywords to marks
+ */
+
+
+gboolean meta_data_get_keyword_mark(FileData *fd, gint n, gpointer data)
+{
+	/* FIXME: do not use global keyword_tree */
+	const guint32 *bits;
+	GList *work;
+
+	keyword_dict_update();
+	bits = keyword_dict_file_bits(fd);
+
+	work = keyword_dict_marks[n];
+	while (work)
+		{
+		if (keyword_dict_bits_contain(bits, work->data)) return TRUE;
+		work = work->next;
+		}
+	return FALSE;
 }
 
 gboolean meta_data_set_keyword_mark(FileData *fd, gint n, gboolean value, gpointer data)
@@ -1129,6 +1762,7 @@ void meta_data_connect_mark_with_keyword(GtkTreeModel *keyword_tree, GtkTreeIter
 		gtk_tree_store_set(GTK_TREE_STORE(keyword_tree), kw_iter, KEYWORD_COLUMN_MARK, mark_str, -1);
 		g_free(mark_str);
 		}
+	keyword_dict_invalidate();
 }
 
 
@@ -1714,6 +2348,11 @@ void keyword_tree_new(void)
 	if (keyword_tree) return;
 
 	keyword_tree = gtk_tree_store_new(KEYWORD_COLUMN_COUNT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_POINTER);
+
+	g_signal_connect_swapped(G_OBJECT(keyword_tree), "row-changed", G_CALLBACK(keyword_dict_tree_changed_cb), NULL);
+	g_signal_connect_swapped(G_OBJECT(keyword_tree), "row-inserted", G_CALLBACK(keyword_dict_tree_changed_cb), NULL);
+	g_signal_connect_swapped(G_OBJECT(keyword_tree), "row-deleted", G_CALLBACK(keyword_dict_tree_changed_cb), NULL);
+	g_signal_connect_swapped(G_OBJECT(keyword_tree), "rows-reordered", G_CALLBACK(keyword_dict_tree_changed_cb), NULL);
 }
 
 static GtkTreeIter keyword_tree_default_append(GtkTreeStore *keyword_tree, GtkTreeIter *parent, const gchar *name, gboolean is_keyword)
@@ -1870,6 +2509,7 @@ void keyword_tree_disconnect_marks()
 		{
 		keyword_tree_node_disconnect_marks(GTK_TREE_MODEL(keyword_tree), &iter);
 		}
+	keyword_dict_invalidate();
 }
 
 GtkTreeIter *keyword_add_from_config(GtkTreeStore *keyword_tree, GtkTreeIter *parent, const gchar **attribute_names, const gchar **attribute_values)
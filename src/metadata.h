@@ -28,10 +28,13 @@
 #define RATING_KEY "Xmp.xmp.Rating"
 
 void metadata_cache_free(FileData *fd);
+void metadata_cache_get_usage(guint *files, guint *entries, gsize *size);
 
 gboolean metadata_write_queue_remove(FileData *fd);
 gboolean metadata_write_queue_remove_list(GList *list);
 gboolean metadata_write_perform(FileData *fd);
+typedef void (*MetadataWriteDoneFunc)(FileData *fd, gboolean success, gpointer data);
+void metadata_write_perform_async(FileData *fd, MetadataWriteDoneFunc done_func, gpointer done_data);
 gboolean metadata_write_queue_confirm(gboolean force_dialog, FileUtilDoneFunc done_func, gpointer done_data);
 void metadata_notify_cb(FileData *fd, NotifyType type, gpointer data);
 
@@ -114,6 +114,7 @@ ConfOptions *init_options(ConfOptions *options)
 	options->image.scroll_reset_method = SCROLL_RESET_NOCHANGE;
 	options->image.tile_cache_max = 10;
 	options->image.image_cache_max = 128; /* 4 x 10MPix */
+	options->image.memory_budget = 0;
 	options->image.use_custom_border_color = FALSE;
 	options->image.use_custom_border_color_in_fullscreen = TRUE;
 	options->image.zoom_2pass = TRUE;
@@ -175,6 +176,7 @@ ConfOptions *init_options(ConfOptions *options)
 	options->thumbnails.max_width = DEFAULT_THUMB_WIDTH;
 	options->thumbnails.quality = GDK_INTERP_TILES;
 	options->thumbnails.spec_standard = TRUE;
+	options->thumbnails.use_pack = FALSE;
 	options->thumbnails.use_xvpics = TRUE;
 	options->thumbnails.use_exif = FALSE;
 	options->thumbnails.use_ft_metadata = TRUE;
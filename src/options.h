@@ -120,6 +120,7 @@ struct _ConfOptions
 
 		gint tile_cache_max;	/* in megabytes */
 		gint image_cache_max;   /* in megabytes */
+		gint memory_budget;	/* in megabytes for all caches, 0 for a quarter of the RAM */
 		gboolean enable_read_ahead;
 
 		ZoomMode zoom_mode;
@@ -144,6 +145,7 @@ struct _ConfOptions
 		gboolean cache_into_dirs;
 		gboolean use_xvpics;
 		gboolean spec_standard;
+		gboolean use_pack;
 		guint quality;
 		gboolean use_exif;
 		gboolean use_ft_metadata;
@@ -44,6 +44,7 @@
 #include "main.h"
 #include "pixbuf_util.h"
 #include "exif.h"
+#include "memory-budget.h"
 #else
 typedef enum {
 	EXIF_ORIENTATION_UNKNOWN	= 0,
@@ -438,6 +439,7 @@ static void pixbuf_renderer_init(PixbufRenderer *pr)
 
 	pr->source_tiles_enabled = FALSE;
 	pr->source_tiles = NULL;
+	pr->source_tiles_memory = NULL;
 
 	pr->orientation = 1;
 
@@ -476,7 +478,7 @@ static void pixbuf_renderer_finalize(GObject *object)
 
 	pr_scroller_timer_set(pr, FALSE);
 
-	pr_source_tile_free_all(pr);
+	pr_source_tile_unset(pr);
 }
 
 PixbufRenderer *pixbuf_renderer_new(void)
@@ -976,6 +978,71 @@ static void pr_source_tile_unset(PixbufRenderer *pr)
 {
 	pr_source_tile_free_all(pr);
 	pr->source_tiles_enabled = FALSE;
+
+	memory_cache_unregister(pr->source_tiles_memory);
+	pr->source_tiles_memory = NULL;
+
+	if (pr->source_tiles_preview) g_object_unref(pr->source_tiles_preview);
+	pr->source_tiles_preview = NULL;
+	pr->source_tiles_preview_scale = 0.0;
+}
+
+static gboolean pr_source_tile_visible(PixbufRenderer *pr, SourceTile *st);
+
+static GList *pr_source_tile_find_evictable(PixbufRenderer *pr)
+{
+	GList *work;
+
+	for (work = g_list_last(pr->source_tiles); work; work = work->prev)
+		{
+		if (!pr_source_tile_visible(pr, work->data)) return work;
+		}
+
+	return NULL;
+}
+
+static gsize pr_source_tile_memory_size(gpointer data)
+{
+	PixbufRenderer *pr = data;
+	SourceTile *st;
+
+	if (!pr->source_tiles) return 0;
+
+	st = pr->source_tiles->data;
+	return (gsize)g_list_length(pr->source_tiles) *
+	       gdk_pixbuf_get_rowstride(st->pixbuf) * gdk_pixbuf_get_height(st->pixbuf);
+}
+
+static gint64 pr_source_tile_memory_oldest(gpointer data)
+{
+	GList *work = pr_source_tile_find_evictable((PixbufRenderer *)data);
+
+	return work ? ((SourceTile *)work->data)->last_used : 0;
+}
+
+static gsize pr_source_tile_memory_evict(gpointer data)
+{
+	PixbufRenderer *pr = data;
+	GList *work = pr_source_tile_find_evictable(pr);
+	SourceTile *st;
+	gsize size;
+
+	if (!work) return 0;
+
+	st = work->data;
+	pr->source_tiles = g_list_delete_link(pr->source_tiles, work);
+
+	if (pr->func_tile_dispose)
+		{
+		pr->func_tile_dispose(pr, st->x, st->y,
+				      pr->source_tile_width, pr->source_tile_height,
+				      st->pixbuf, pr->func_tile_data);
+		}
+
+	size = (gsize)gdk_pixbuf_get_rowstride(st->pixbuf) * gdk_pixbuf_get_height(st->pixbuf);
+	pr_source_tile_free(st);
+
+	return size;
 }
 
 static gboolean pr_source_tile_visible(PixbufRenderer *pr, SourceTile *st)
@@ -1056,9 +1123,19 @@ static SourceTile *pr_source_tile_new(PixbufRenderer *pr, gint x, gint y)
 	st->x = ROUND_DOWN(x, pr->source_tile_width);
 	st->y = ROUND_DOWN(y, pr->source_tile_height);
 	st->blank = TRUE;
+	st->last_used = g_get_monotonic_time();
 
 	pr->source_tiles = g_list_prepend(pr->source_tiles, st);
 
+	if (!pr->source_tiles_memory)
+		{
+		pr->source_tiles_memory = memory_cache_register("source tiles", MEMORY_COST_HIGH,
+								pr_source_tile_memory_size,
+								pr_source_tile_memory_oldest,
+								pr_source_tile_memory_evict, pr);
+		}
+	memory_cache_changed();
+
 	return st;
 }
 
@@ -1100,6 +1177,7 @@ static SourceTile *pr_source_tile_find(PixbufRenderer *pr, gint x, gint y)
 				pr->source_tiles = g_list_remove_link(pr->source_tiles, work);
 				pr->source_tiles = g_list_concat(work, pr->source_tiles);
 				}
+			st->last_used = g_get_monotonic_time();
 			return st;
 			}
 
@@ -1223,6 +1301,21 @@ void pixbuf_renderer_set_tiles_size(PixbufRenderer *pr, gint width, gint height)
 	pr_zoom_sync(pr, pr->zoom, PR_ZOOM_FORCE, 0, 0);
 }
 
+void pixbuf_renderer_set_tiles_preview(PixbufRenderer *pr, GdkPixbuf *pixbuf, gdouble max_scale)
+{
+	g_return_if_fail(IS_PIXBUF_RENDERER(pr));
+
+	if (!pr->source_tiles_enabled) return;
+
+	if (pixbuf) g_object_ref(pixbuf);
+	if (pr->source_tiles_preview) g_object_unref(pr->source_tiles_preview);
+	pr->source_tiles_preview = pixbuf;
+	pr->source_tiles_preview_scale = max_scale;
+
+	pr->renderer->area_changed(pr->renderer, 0, 0, pr->image_width, pr->image_height);
+	if (pr->renderer2) pr->renderer2->area_changed(pr->renderer2, 0, 0, pr->image_width, pr->image_height);
+}
+
 gint pixbuf_renderer_get_tiles(PixbufRenderer *pr)
 {
 	g_return_val_if_fail(IS_PIXBUF_RENDERER(pr), FALSE);
@@ -2598,6 +2691,10 @@ void pixbuf_renderer_move(PixbufRenderer *pr, PixbufRenderer *source)
 		pr->source_tiles = source->source_tiles;
 		source->source_tiles = NULL;
 
+		pr->source_tiles_preview = source->source_tiles_preview;
+		pr->source_tiles_preview_scale = source->source_tiles_preview_scale;
+		source->source_tiles_preview = NULL;
+
 		pr_zoom_sync(pr, source->zoom, PR_ZOOM_FORCE | PR_ZOOM_NEW, 0, 0);
 		}
 	else
@@ -2655,6 +2752,11 @@ void pixbuf_renderer_copy(PixbufRenderer *pr, PixbufRenderer *source)
 		pr->source_tiles = source->source_tiles;
 		source->source_tiles = NULL;
 
+		if (source->source_tiles_preview) g_object_ref(source->source_tiles_preview);
+		if (pr->source_tiles_preview) g_object_unref(pr->source_tiles_preview);
+		pr->source_tiles_preview = source->source_tiles_preview;
+		pr->source_tiles_preview_scale = source->source_tiles_preview_scale;
+
 		pr_zoom_sync(pr, source->zoom, PR_ZOOM_FORCE | PR_ZOOM_NEW, 0, 0);
 		}
 	else
@@ -174,6 +174,9 @@ struct _PixbufRenderer
 	GList *source_tiles;	/* list of active source tiles */
 	gint source_tile_width;
 	gint source_tile_height;
+	GdkPixbuf *source_tiles_preview;	/* reduced copy of the whole image, see pixbuf_renderer_set_tiles_preview */
+	gdouble source_tiles_preview_scale;
+	struct _MemoryCache *source_tiles_memory;	/* the source tiles in the memory budget */
 
 	PixbufRendererTileRequestFunc func_tile_request;
 	PixbufRendererTileDisposeFunc func_tile_dispose;
@@ -265,6 +268,8 @@ void pixbuf_renderer_set_tiles(PixbufRenderer *pr, gint width, gint height,
 			       gpointer user_data,
 			       gdouble zoom);
 void pixbuf_renderer_set_tiles_size(PixbufRenderer *pr, gint width, gint height);
+/* below max_scale the tiles are not requested, the preview (if any yet) is scaled instead */
+void pixbuf_renderer_set_tiles_preview(PixbufRenderer *pr, GdkPixbuf *pixbuf, gdouble max_scale);
 gint pixbuf_renderer_get_tiles(PixbufRenderer *pr);
 
 /* move image data from source to pr, source is then set to NULL image */
@@ -340,6 +345,7 @@ struct _SourceTile
 	gint y;
 	GdkPixbuf *pixbuf;
 	gboolean blank;
+	gint64 last_used;	/* g_get_monotonic_time() of the last find */
 };
 
 
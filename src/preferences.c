@@ -299,6 +299,7 @@ static void config_window_apply(void)
 	options->thumbnails.use_ft_metadata = c_options->thumbnails.use_ft_metadata;
 // 	options->thumbnails.use_ft_metadata_small = c_options->thumbnails.use_ft_metadata_small;
 	options->thumbnails.spec_standard = c_options->thumbnails.spec_standard;
+	options->thumbnails.use_pack = c_options->thumbnails.use_pack;
 	options->metadata.enable_metadata_dirs = c_options->metadata.enable_metadata_dirs;
 	options->file_filter.show_hidden_files = c_options->file_filter.show_hidden_files;
 	options->file_filter.show_parent_directory = c_options->file_filter.show_parent_directory;
@@ -325,6 +326,7 @@ static void config_window_apply(void)
 
 	options->image.tile_cache_max = c_options->image.tile_cache_max;
 	options->image.image_cache_max = c_options->image.image_cache_max;
+	options->image.memory_budget = c_options->image.memory_budget;
 
 	options->image.zoom_quality = c_options->image.zoom_quality;
 
@@ -1942,6 +1944,9 @@ static void config_tab_general(GtkWidget *notebook)
 	pref_radiobutton_new(group_frame, button, get_thumbnails_standard_cache_dir(),
 							options->thumbnails.spec_standard && !options->thumbnails.cache_into_dirs,
 							G_CALLBACK(cache_standard_cb), NULL);
+	button = pref_checkbox_new_int(group_frame, _("Pack thumbnails into a single file"),
+				       options->thumbnails.use_pack, &c_options->thumbnails.use_pack);
+	gtk_widget_set_tooltip_text(button, _("Faster for large collections. The thumbnails are not shared with other applications, use Cache Maintenance to export them."));
 
 	pref_checkbox_new_int(group, _("Use EXIF thumbnails when available (EXIF thumbnails may be outdated)"),
 			      options->thumbnails.use_exif, &c_options->thumbnails.use_exif);
@@ -2068,6 +2073,8 @@ static void config_tab_general(GtkWidget *notebook)
 
 	pref_spin_new_int(group, _("Decoded image cache size (Mb):"), NULL,
 			  0, 99999, 1, options->image.image_cache_max, &c_options->image.image_cache_max);
+	pref_spin_new_int(group, _("Memory for all caches (Mb, 0 for a quarter of the RAM):"), NULL,
+			  0, 999999, 64, options->image.memory_budget, &c_options->image.memory_budget);
 	pref_checkbox_new_int(group, _("Preload next image"),
 			      options->image.enable_read_ahead, &c_options->image.enable_read_ahead);
 
@@ -3801,6 +3808,7 @@ static void timezone_async_ready_cb(GObject *source_object, GAsyncResult *res, g
 		tmp_filename = g_file_get_parse_name(tz->tmp_g_file);
 		move_file(tmp_filename, tz->timezone_database_user);
 		g_free(tmp_filename);
+		exif_timezone_database_reset();
 		}
 	else
 		{
@@ -22,6 +22,7 @@
 #include "main.h"
 #include "remote.h"
 
+#include "cache.h"
 #include "cache_maint.h"
 #include "collect.h"
 #include "collect-io.h"
@@ -33,9 +34,12 @@
 #include "layout.h"
 #include "layout_image.h"
 #include "layout_util.h"
+#include "memory-budget.h"
+#include "metadata.h"
 #include "misc.h"
 #include "pixbuf-renderer.h"
 #include "slideshow.h"
+#include "thumb_standard.h"
 #include "ui_fileops.h"
 #include "rcfile.h"
 
@@ -62,13 +66,27 @@ static void gr_raise(const gchar *text, GIOChannel *channel, gpointer data);
 
 static LayoutWindow *lw_id = NULL; /* points to the window set by the --id option */
 
+typedef struct _RemoteStream RemoteStream;
+
 typedef struct _RemoteClient RemoteClient;
 struct _RemoteClient {
 	gint fd;
 	guint channel_id; /* event source id */
 	RemoteConnection *rc;
+	RemoteStream *stream; /* file list being sent, the command is not finished */
 };
 
+static void remote_stream_start(RemoteStream *rs, RemoteClient *client);
+static void remote_stream_cancel(RemoteStream *rs);
+
+/* set by a command that answers with a stream, see remote_server_client_cb() */
+static RemoteStream *remote_stream_pending = NULL;
+
+/* set by --filelist-range and --filelist-dimensions for the following lists */
+static guint filelist_range_start = 0;
+static guint filelist_range_count = 0; /* 0 for all */
+static gboolean filelist_dimensions = FALSE;
+
 typedef struct _RemoteData RemoteData;
 struct _RemoteData {
 	CollectionData *command_collection;
@@ -122,6 +140,14 @@ static gboolean remote_server_client_cb(GIOChannel *source, GIOCondition conditi
 	lw_id = NULL;
 	rc = client->rc;
 
+	if (client->stream)
+		{
+		/* a client waits for the end of a list, anything else cancels it */
+		DEBUG_1("client input during a file list, closing client.");
+		remote_stream_cancel(client->stream);
+		condition = G_IO_HUP;
+		}
+
 	if (condition & G_IO_IN)
 		{
 		gchar *buffer = NULL;
@@ -138,6 +164,17 @@ static gboolean remote_server_client_cb(GIOChannel *source, GIOCondition conditi
 				if (strlen(buffer) > 0)
 					{
 					if (rc->read_func) rc->read_func(rc, buffer, source, rc->read_data);
+
+					if (remote_stream_pending)
+						{
+						/* the stream finishes the command, the next one is read when it is done */
+						g_io_channel_flush(source, NULL);
+						remote_stream_start(remote_stream_pending, client);
+						remote_stream_pending = NULL;
+						g_free(buffer);
+						break;
+						}
+
 					g_io_channel_write_chars(source, "<gq_end_of_command>", -1, NULL, NULL); /* empty line finishes the command */
 					g_io_channel_flush(source, NULL);
 					}
@@ -161,6 +198,7 @@ static gboolean remote_server_client_cb(GIOChannel *source, GIOCondition conditi
 		DEBUG_1("HUP detected, closing client.");
 		DEBUG_1("client count %d", g_list_length(rc->clients));
 
+		if (client->stream) remote_stream_cancel(client->stream);
 		g_source_remove(client->channel_id);
 		close(client->fd);
 		g_free(client);
@@ -185,6 +223,11 @@ static void remote_server_client_add(RemoteConnection *rc, gint fd)
 	client->rc = rc;
 	client->fd = fd;
 
+	/* the file list options start again with each client */
+	filelist_range_start = 0;
+	filelist_range_count = 0;
+	filelist_dimensions = FALSE;
+
 	channel = g_io_channel_unix_new(fd);
 	client->channel_id = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT, G_IO_IN | G_IO_HUP,
 						 remote_server_client_cb, client, NULL);
@@ -202,6 +245,7 @@ static void remote_server_clients_close(RemoteConnection *rc)
 
 		rc->clients = g_list_remove(rc->clients, client);
 
+		if (client->stream) remote_stream_cancel(client->stream);
 		g_source_remove(client->channel_id);
 		close(client->fd);
 		g_free(client);
@@ -440,6 +484,347 @@ void remote_close(RemoteConnection *rc)
 	g_free(rc);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * streamed file lists
+ *-----------------------------------------------------------------------------
+ */
+
+/* bytes of records sent at a time */
+#define REMOTE_STREAM_CHUNK 65536
+
+/* file lists built at the same time */
+#define REMOTE_STREAM_THREADS 2
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct _RemoteStream {
+	RemoteClient *client; /* NULL once the client is gone */
+	gint fd; /* own copy of the client socket, written by the thread */
+
+	/* taken on the main thread when the command is read */
+	gchar *pathl;
+	gboolean recurse;
+	gboolean show_hidden;
+	gboolean filter_disable;
+	GArray *trie; /* from filter_trie_ref() */
+	gboolean dimensions;
+	guint start;
+	guint count;
+
+	gint abort; /* atomic, set when the client is gone */
+	gboolean full; /* count reached */
+	guint index; /* of the next matching file */
+	GString *chunk;
+	GHashTable *visited; /* "dev:inode" of folders, for links to a parent */
+};
+
+#ifdef HAVE_GTHREAD
+static GThreadPool *remote_stream_pool = NULL;
+#endif
+
+static gboolean remote_stream_write(RemoteStream *rs, const gchar *data, gsize len)
+{
+	while (len > 0)
+		{
+		gssize n = send(rs->fd, data, len, MSG_NOSIGNAL);
+
+		if (n < 0)
+			{
+			if (errno == EINTR) continue;
+			g_atomic_int_set(&rs->abort, TRUE);
+			return FALSE;
+			}
+		data += n;
+		len -= n;
+		}
+
+	return TRUE;
+}
+
+/* each chunk is read as one reply line by the client, which adds the last newline */
+static void remote_stream_flush(RemoteStream *rs)
+{
+	if (rs->chunk->len == 0) return;
+
+	g_string_append(rs->chunk, "<gq_end_of_command>");
+	remote_stream_write(rs, rs->chunk->str, rs->chunk->len);
+	g_string_truncate(rs->chunk, 0);
+}
+
+static void remote_stream_append_json_string(GString *out, const gchar *text)
+{
+	const gchar *p;
+
+	g_string_append_c(out, '"');
+	for (p = text; *p; p++)
+		{
+		switch (*p)
+			{
+			case '"':
+				g_string_append(out, "\\\"");
+				break;
+			case '\\':
+				g_string_append(out, "\\\\");
+				break;
+			case '\n':
+				g_string_append(out, "\\n");
+				break;
+			case '\t':
+				g_string_append(out, "\\t");
+				break;
+			default:
+				if ((guchar)*p < 0x20)
+					{
+					g_string_append_printf(out, "\\u%04x", (guchar)*p);
+					}
+				else
+					{
+					g_string_append_c(out, *p);
+					}
+				break;
+			}
+		}
+	g_string_append_c(out, '"');
+}
+
+static void remote_stream_record_start(RemoteStream *rs)
+{
+	if (rs->chunk->len > 0) g_string_append_c(rs->chunk, '\n');
+}
+
+static void remote_stream_file(RemoteStream *rs, const gchar *pathl, const gchar *name, struct stat *st)
+{
+	FilterMatch match;
+	FileFormatClass class;
+	gchar *path;
+
+	if (!filter_trie_match(rs->trie, name, &match) &&
+	    !rs->filter_disable && rs->trie && rs->trie->len > 1) return;
+
+	if (rs->index++ < rs->start) return;
+
+	if (rs->count && rs->index > rs->start + rs->count)
+		{
+		/* tells the script where the next page starts */
+		remote_stream_record_start(rs);
+		g_string_append_printf(rs->chunk, "{\"next\":%u}", rs->index - 1);
+		rs->full = TRUE;
+		return;
+		}
+
+	class = filter_match_get_class(&match);
+
+	path = g_filename_to_utf8(pathl, -1, NULL, NULL, NULL);
+	if (!path) path = g_filename_display_name(pathl);
+
+	remote_stream_record_start(rs);
+	g_string_append(rs->chunk, "{\"path\":");
+	remote_stream_append_json_string(rs->chunk, path);
+	g_string_append_printf(rs->chunk, ",\"size\":%" G_GINT64_FORMAT ",\"mtime\":%" G_GINT64_FORMAT ",\"class\":\"%s\"",
+			       (gint64)st->st_size, (gint64)st->st_mtime, format_class_list[class]);
+
+	if (rs->dimensions && class == FORMAT_CLASS_IMAGE)
+		{
+		gint width;
+		gint height;
+
+		if (gdk_pixbuf_get_file_info(pathl, &width, &height))
+			{
+			g_string_append_printf(rs->chunk, ",\"width\":%d,\"height\":%d", width, height);
+			}
+		}
+	g_string_append_c(rs->chunk, '}');
+	g_free(path);
+
+	if (rs->chunk->len >= REMOTE_STREAM_CHUNK) remote_stream_flush(rs);
+}
+
+static gboolean remote_stream_stopped(RemoteStream *rs)
+{
+	return rs->full || g_atomic_int_get(&rs->abort);
+}
+
+static gint remote_stream_name_cmp(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const gchar **)a, *(const gchar **)b);
+}
+
+static void remote_stream_dir(RemoteStream *rs, const gchar *pathl)
+{
+	GPtrArray *names;
+	GPtrArray *dirs;
+	struct dirent *dir;
+	struct stat st;
+	gchar *key;
+	DIR *dp;
+	guint i;
+
+	if (stat(pathl, &st) != 0) return;
+	key = g_strdup_printf("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT, (guint64)st.st_dev, (guint64)st.st_ino);
+	if (g_hash_table_lookup(rs->visited, key))
+		{
+		g_free(key);
+		return;
+		}
+	g_hash_table_insert(rs->visited, key, GINT_TO_POINTER(1));
+
+	dp = opendir(pathl);
+	if (!dp) return;
+
+	names = g_ptr_array_new_with_free_func(g_free);
+	while ((dir = readdir(dp)) != NULL)
+		{
+		const gchar *name = dir->d_name;
+
+		if (name[0] == '.')
+			{
+			if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) continue;
+			if (!rs->show_hidden) continue;
+			}
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (!rs->recurse && dir->d_type == DT_DIR) continue;
+#endif
+		g_ptr_array_add(names, g_strdup(name));
+		}
+	closedir(dp);
+
+	/* a stable order, so that a list can be fetched in pages */
+	g_ptr_array_sort(names, remote_stream_name_cmp);
+
+	dirs = g_ptr_array_new_with_free_func(g_free);
+	for (i = 0; i < names->len && !remote_stream_stopped(rs); i++)
+		{
+		const gchar *name = g_ptr_array_index(names, i);
+		gchar *filepath = g_build_filename(pathl, name, NULL);
+
+		if (stat(filepath, &st) != 0)
+			{
+			g_free(filepath);
+			}
+		else if (S_ISDIR(st.st_mode))
+			{
+			if (rs->recurse &&
+			    strcmp(name, GQ_CACHE_LOCAL_THUMB) != 0 &&
+			    strcmp(name, GQ_CACHE_LOCAL_METADATA) != 0 &&
+			    strcmp(name, THUMB_FOLDER_LOCAL) != 0)
+				{
+				g_ptr_array_add(dirs, filepath);
+				}
+			else
+				{
+				g_free(filepath);
+				}
+			}
+		else
+			{
+			if (S_ISREG(st.st_mode)) remote_stream_file(rs, filepath, name, &st);
+			g_free(filepath);
+			}
+		}
+	g_ptr_array_free(names, TRUE);
+
+	/* as filelist_recursive(), the files of a folder come before its subfolders */
+	for (i = 0; i < dirs->len && !remote_stream_stopped(rs); i++)
+		{
+		remote_stream_dir(rs, g_ptr_array_index(dirs, i));
+		}
+	g_ptr_array_free(dirs, TRUE);
+}
+
+static void remote_stream_free(RemoteStream *rs)
+{
+	if (rs->fd >= 0) close(rs->fd);
+	if (rs->trie) g_array_unref(rs->trie);
+	if (rs->visited) g_hash_table_destroy(rs->visited);
+	if (rs->chunk) g_string_free(rs->chunk, TRUE);
+	g_free(rs->pathl);
+	g_free(rs);
+}
+
+static gboolean remote_stream_done_cb(gpointer data)
+{
+	RemoteStream *rs = data;
+
+	if (rs->client)
+		{
+		/* the empty reply finishes the command */
+		if (!g_atomic_int_get(&rs->abort))
+			{
+			remote_stream_write(rs, "<gq_end_of_command>", strlen("<gq_end_of_command>"));
+			}
+		rs->client->stream = NULL;
+		}
+
+	DEBUG_1("file list of %s done, %u files", rs->pathl, rs->index);
+	remote_stream_free(rs);
+
+	return FALSE;
+}
+
+static void remote_stream_run(gpointer data, gpointer user_data)
+{
+	RemoteStream *rs = data;
+
+	rs->chunk = g_string_sized_new(REMOTE_STREAM_CHUNK + 1024);
+	rs->visited = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	remote_stream_dir(rs, rs->pathl);
+	if (!g_atomic_int_get(&rs->abort)) remote_stream_flush(rs);
+
+	g_idle_add(remote_stream_done_cb, rs);
+}
+
+static void remote_stream_start(RemoteStream *rs, RemoteClient *client)
+{
+	rs->client = client;
+	rs->fd = dup(client->fd);
+	client->stream = rs;
+
+	if (rs->fd < 0)
+		{
+		log_printf("error sending file list: %s\n", strerror(errno));
+		g_atomic_int_set(&rs->abort, TRUE);
+		}
+
+#ifdef HAVE_GTHREAD
+	if (!remote_stream_pool)
+		{
+		remote_stream_pool = g_thread_pool_new(remote_stream_run, NULL, REMOTE_STREAM_THREADS, FALSE, NULL);
+		}
+	g_thread_pool_push(remote_stream_pool, rs, NULL);
+#else
+	remote_stream_run(rs, NULL);
+#endif
+}
+
+static void remote_stream_cancel(RemoteStream *rs)
+{
+	g_atomic_int_set(&rs->abort, TRUE);
+	if (rs->client) rs->client->stream = NULL;
+	rs->client = NULL;
+}
+
+static RemoteStream *remote_stream_new(const gchar *path, gboolean recurse)
+{
+	RemoteStream *rs;
+
+	rs = g_new0(RemoteStream, 1);
+	rs->fd = -1;
+	rs->pathl = path_from_utf8(path);
+	rs->recurse = recurse;
+	rs->show_hidden = options->file_filter.show_hidden_files;
+	rs->filter_disable = options->file_filter.disable;
+	rs->trie = filter_trie_ref();
+	rs->dimensions = filelist_dimensions;
+	rs->start = filelist_range_start;
+	rs->count = filelist_range_count;
+
+	return rs;
+}
+
 /*
  *-----------------------------------------------------------------------------
  * remote functions
@@ -860,7 +1245,7 @@ static void get_filelist(const gchar *text, GIOChannel *channel, gboolean recurs
 		{
 		fd = work->data;
 		g_string_append_printf(out_string, "%s", fd->path);
-		class = filter_file_get_class(fd->path);
+		class = fd->format_class;
 
 		switch (class)
 			{
@@ -947,6 +1332,53 @@ static void gr_collection_list(const gchar *text, GIOChannel *channel, gpointer
 }
 
 
+/* answered by a stream of JSON lines, see remote_stream_run() */
+static void get_filelist_json(const gchar *text, gboolean recurse)
+{
+	gchar *path;
+
+	if (strcmp(text, "") == 0)
+		{
+		if (!layout_valid(&lw_id)) return;
+		path = g_strdup(lw_id->dir_fd->path);
+		}
+	else
+		{
+		path = pwd ? set_pwd((gchar *)text) : g_strdup(text);
+		}
+
+	if (isdir(path))
+		{
+		remote_stream_pending = remote_stream_new(path, recurse);
+		}
+	g_free(path);
+}
+
+static void gr_filelist_json(const gchar *text, GIOChannel *channel, gpointer data)
+{
+	get_filelist_json(text, FALSE);
+}
+
+static void gr_filelist_json_recurse(const gchar *text, GIOChannel *channel, gpointer data)
+{
+	get_filelist_json(text, TRUE);
+}
+
+static void gr_filelist_range(const gchar *text, GIOChannel *channel, gpointer data)
+{
+	gchar **numbers;
+
+	numbers = g_strsplit(text, ",", 2);
+	filelist_range_start = numbers[0] ? (guint)strtoul(numbers[0], NULL, 10) : 0;
+	filelist_range_count = (numbers[0] && numbers[1]) ? (guint)strtoul(numbers[1], NULL, 10) : 0;
+	g_strfreev(numbers);
+}
+
+static void gr_filelist_dimensions(const gchar *text, GIOChannel *channel, gpointer data)
+{
+	filelist_dimensions = TRUE;
+}
+
 static void gr_filelist(const gchar *text, GIOChannel *channel, gpointer data)
 {
 	get_filelist(text, channel, FALSE);
@@ -988,6 +1420,63 @@ static void gr_file_tell(const gchar *text, GIOChannel *channel, gpointer data)
 	g_free(out_string);
 }
 
+static void gr_cache_usage(const gchar *text, GIOChannel *channel, gpointer data)
+{
+	GString *out_string = g_string_new(NULL);
+	guint files;
+	guint entries;
+	gsize size;
+	gchar *usage;
+
+	metadata_cache_get_usage(&files, &entries, &size);
+	g_string_append_printf(out_string, "metadata: %u files, %u entries, %" G_GSIZE_FORMAT " bytes\n", files, entries, size);
+
+	usage = memory_budget_get_usage();
+	g_string_append(out_string, usage);
+	g_free(usage);
+
+	g_io_channel_write_chars(channel, out_string->str, -1, NULL, NULL);
+	g_io_channel_write_chars(channel, "<gq_end_of_command>", -1, NULL, NULL);
+
+	g_string_free(out_string, TRUE);
+}
+
+static void gr_trace(const gchar *text, GIOChannel *channel, gpointer data)
+{
+	if (strcmp(text, "on") == 0)
+		{
+		trace_start();
+		}
+	else if (strcmp(text, "summary") == 0)
+		{
+		gchar *summary = trace_get_summary();
+
+		if (channel)
+			{
+			g_io_channel_write_chars(channel, summary, -1, NULL, NULL);
+			g_io_channel_write_chars(channel, "<gq_end_of_command>", -1, NULL, NULL);
+			}
+		else
+			{
+			printf_term(FALSE, "%s", summary);
+			}
+		g_free(summary);
+		}
+	else if (strcmp(text, "off") == 0)
+		{
+		trace_finish(NULL);
+		}
+	else
+		{
+		gchar *tilde_filename = expand_tilde(text);
+		gchar *filename = set_pwd(tilde_filename);
+
+		trace_finish(filename);
+		g_free(filename);
+		g_free(tilde_filename);
+		}
+}
+
 static void gr_file_info(const gchar *text, GIOChannel *channel, gpointer data)
 {
 	gchar *filename;
@@ -1246,10 +1735,40 @@ static void gr_lua(const gchar *text, GIOChannel *channel, gpointer data)
 
 	lua_command = g_strsplit(text, ",", 2);
 
-	if (lua_command[0] && lua_command[1])
+	if (lua_command[0] && lua_command[1] && isdir(lua_command[0]))
+		{
+		FileData *dir_fd = file_data_new_dir(lua_command[0]);
+		GList *list = NULL;
+		GList *results;
+		GList *work;
+		GList *work_result;
+		GString *out_string = g_string_new(NULL);
+
+		filelist_read(dir_fd, &list, NULL);
+		results = lua_callvalue_list(list, lua_command[1], NULL);
+
+		work = list;
+		work_result = results;
+		while (work && work_result)
+			{
+			FileData *fd = work->data;
+
+			g_string_append_printf(out_string, "%s: %s\n", fd->path, (gchar *)work_result->data);
+			work = work->next;
+			work_result = work_result->next;
+			}
+
+		g_io_channel_write_chars(channel, out_string->str, -1, NULL, NULL);
+
+		g_string_free(out_string, TRUE);
+		string_list_free(results);
+		filelist_free(list);
+		file_data_unref(dir_fd);
+		}
+	else if (lua_command[0] && lua_command[1])
 		{
 		FileData *fd = file_data_new_group(lua_command[0]);
-		result = g_strdup(lua_callvalue(fd, lua_command[1], NULL));
+		result = lua_callvalue(fd, lua_command[1], NULL);
 		if (result)
 			{
 			g_io_channel_write_chars(channel, result, -1, NULL, NULL);
@@ -1258,6 +1777,7 @@ static void gr_lua(const gchar *text, GIOChannel *channel, gpointer data)
 			{
 			g_io_channel_write_chars(channel, N_("lua error: no data"), -1, NULL, NULL);
 			}
+		file_data_unref(fd);
 		}
 	else
 		{
@@ -1280,6 +1800,7 @@ struct _RemoteCommandEntry {
 	gboolean prefer_command_line;
 	gchar *parameter;
 	gchar *description;
+	gboolean headless; /* run without starting Geeqie when it is not running */
 };
 
 static RemoteCommandEntry remote_commands[] = {
@@ -1312,9 +1833,15 @@ static RemoteCommandEntry remote_commands[] = {
 	{ NULL, "--get-render-intent",  gr_render_intent,       FALSE, FALSE, NULL, N_("get render intent") },
 	{ NULL, "--get-filelist:",      gr_filelist,            TRUE,  FALSE, N_("[<FOLDER>]"), N_("get list of files and class") },
 	{ NULL, "--get-filelist-recurse:", gr_filelist_recurse, TRUE,  FALSE, N_("[<FOLDER>]"), N_("get list of files and class recursive") },
+	{ NULL, "--get-filelist-json:", gr_filelist_json,       TRUE,  FALSE, N_("[<FOLDER>]"), N_("get list of files with size, date and class as JSON lines, sent while the folder is read") },
+	{ NULL, "--get-filelist-json-recurse:", gr_filelist_json_recurse, TRUE, FALSE, N_("[<FOLDER>]"), N_("get list of files as JSON lines recursive") },
+	{ NULL, "--filelist-range:",    gr_filelist_range,      TRUE,  FALSE, N_("<START>,<COUNT>"), N_("limit following JSON file lists to COUNT files from START") },
+	{ NULL, "--filelist-dimensions", gr_filelist_dimensions, FALSE, FALSE, NULL, N_("add image dimensions to following JSON file lists") },
 	{ NULL, "--get-collection:",    gr_collection,          TRUE,  FALSE, N_("<COLLECTION>"), N_("get collection content") },
 	{ NULL, "--get-collection-list", gr_collection_list,    FALSE, FALSE, NULL, N_("get collection list") },
 	{ NULL, "--get-file-info",      gr_file_info,           FALSE, FALSE, NULL, N_("get file info") },
+	{ NULL, "--get-cache-usage",    gr_cache_usage,         FALSE, FALSE, NULL, N_("get memory used by in-memory caches") },
+	{ NULL, "--trace:",             gr_trace,               TRUE,  FALSE, N_("on|off|summary|<FILE>"), N_("start tracing, stop and save it to trace.json or FILE, or get the summary") },
 	{ NULL, "view:",                gr_file_view,           TRUE,  FALSE, N_("<FILE>"), N_("open FILE in new window") },
 	{ NULL, "--view:",              gr_file_view,           TRUE,  FALSE, N_("<FILE>"), N_("open FILE in new window") },
 	{ NULL, "--list-clear",         gr_list_clear,          FALSE, FALSE, NULL, N_("clear command line collection list") },
@@ -1324,15 +1851,15 @@ static RemoteCommandEntry remote_commands[] = {
 	{ NULL, "--id:",                gr_lw_id,               TRUE, FALSE, N_("<ID>"), N_("window id for following commands") },
 	{ NULL, "--new-window",         gr_new_window,          FALSE, FALSE, NULL, N_("new window") },
 	{ NULL, "--close-window",       gr_close_window,        FALSE, FALSE, NULL, N_("close window") },
-	{ "-ct:", "--cache-thumbs:",    gr_cache_thumb,         TRUE, FALSE, N_("clear|clean"), N_("clear or clean thumbnail cache") },
-	{ "-cs:", "--cache-shared:",    gr_cache_shared,        TRUE, FALSE, N_("clear|clean"), N_("clear or clean shared thumbnail cache") },
-	{ "-cm","--cache-metadata",      gr_cache_metadata,               FALSE, FALSE, NULL, N_("    clean the metadata cache") },
+	{ "-ct:", "--cache-thumbs:",    gr_cache_thumb,         TRUE, FALSE, N_("clear|clean"), N_("clear or clean thumbnail cache"), TRUE },
+	{ "-cs:", "--cache-shared:",    gr_cache_shared,        TRUE, FALSE, N_("clear|clean"), N_("clear or clean shared thumbnail cache"), TRUE },
+	{ "-cm","--cache-metadata",      gr_cache_metadata,               FALSE, FALSE, NULL, N_("    clean the metadata cache"), TRUE },
 	{ "-cr:", "--cache-render:",    gr_cache_render,        TRUE, FALSE, N_("<folder>  "), N_(" render thumbnails") },
 	{ "-crr:", "--cache-render-recurse:", gr_cache_render_recurse, TRUE, FALSE, N_("<folder> "), N_("render thumbnails recursively") },
 	{ "-crs:", "--cache-render-shared:", gr_cache_render_standard, TRUE, FALSE, N_("<folder> "), N_(" render thumbnails (see Help)") },
 	{ "-crsr:", "--cache-render-shared-recurse:", gr_cache_render_standard_recurse, TRUE, FALSE, N_("<folder>"), N_(" render thumbnails recursively (see Help)") },
 #ifdef HAVE_LUA
-	{ NULL, "--lua:",               gr_lua,                 TRUE, FALSE, N_("<FILE>,<lua script>"), N_("run lua script on FILE") },
+	{ NULL, "--lua:",               gr_lua,                 TRUE, FALSE, N_("<FILE>|<FOLDER>,<lua script>"), N_("run lua script on FILE, or on each file in FOLDER") },
 #endif
 	{ NULL, "--PWD:",               gr_pwd,                 TRUE, FALSE, N_("<PWD>"), N_("use PWD as working directory for following commands") },
 	{ NULL, "--print0",             gr_print0,              TRUE, FALSE, NULL, N_("terminate returned data with null character instead of newline") },
@@ -1378,6 +1905,42 @@ static RemoteCommandEntry *remote_command_find(const gchar *text, const gchar **
 	return NULL;
 }
 
+/**
+ * \brief Runs the commands without a window if they all support it
+ * \returns FALSE if some command needs a running Geeqie
+ */
+static gboolean remote_control_headless(GList *remote_list, GList *cmd_list, GList *collection_list)
+{
+	GList *work;
+
+	if (!remote_list || cmd_list || collection_list) return FALSE;
+
+	for (work = remote_list; work; work = work->next)
+		{
+		RemoteCommandEntry *entry;
+
+		entry = remote_command_find(work->data, NULL);
+		if (!entry) return FALSE;
+		if (entry->func != gr_pwd && !entry->headless) return FALSE;
+		}
+
+	for (work = remote_list; work; work = work->next)
+		{
+		RemoteCommandEntry *entry;
+		const gchar *offset;
+
+		entry = remote_command_find(work->data, &offset);
+		entry->func(offset, NULL, NULL);
+		}
+
+	while (cache_maintain_remote_busy())
+		{
+		g_main_context_iteration(NULL, TRUE);
+		}
+
+	return TRUE;
+}
+
 static void remote_cb(RemoteConnection *rc, const gchar *text, GIOChannel *channel, gpointer data)
 {
 	RemoteCommandEntry *entry;
@@ -1469,6 +2032,12 @@ void remote_control(const gchar *arg_exec, GList *remote_list, const gchar *path
 		gint retry_count = 12;
 		gboolean blank = FALSE;
 
+		if (!path && remote_control_headless(remote_list, cmd_list, collection_list))
+			{
+			g_free(buf);
+			exit(0);
+			}
+
 		printf_term(FALSE, _("Remote %s not running, starting..."), GQ_APPNAME);
 
 		command = g_string_new(arg_exec);
@@ -44,6 +44,7 @@
 #include "main.h"
 #include "pixbuf_util.h"
 #include "exif.h"
+#include "memory-budget.h"
 #else
 typedef enum {
 	EXIF_ORIENTATION_UNKNOWN	= 0,
@@ -90,6 +91,7 @@ struct _ImageTile
 	QueueData *qd2;
 
 	guint size;		/* est. memory used by pixmap and pixbuf */
+	gint64 last_used;	/* g_get_monotonic_time() of the last rt_tile_get() */
 };
 
 struct _QueueData
@@ -130,6 +132,7 @@ struct _RendererTiles
 	gint tile_cols;		/* count of tile columns */
 	GList *tiles;		/* list of buffer tiles */
 	gint tile_cache_size;	/* allocated size of pixmaps/pixbufs */
+	MemoryCache *memory;	/* the tiles in the memory budget */
 	GList *draw_queue;	/* list of areas to redraw */
 	GList *draw_queue_2pass;/* list when 2 pass is enabled */
 
@@ -159,6 +162,7 @@ static void rt_overlay_draw(RendererTiles *rt, gint x, gint y, gint w, gint h, I
 static void rt_tile_free_all(RendererTiles *rt);
 static void rt_tile_invalidate_region(RendererTiles *rt, gint x, gint y, gint w, gint h);
 static gboolean rt_tile_is_visible(RendererTiles *rt, ImageTile *it);
+static gboolean rt_tile_is_evictable(RendererTiles *rt, ImageTile *it);
 static void rt_queue_clear(RendererTiles *rt);
 static void rt_queue_merge(QueueData *parent, QueueData *qd);
 static void rt_queue(RendererTiles *rt, gint x, gint y, gint w, gint h,
@@ -351,6 +355,7 @@ static ImageTile *rt_tile_add(RendererTiles *rt, gint x, gint y)
 	if (it->x + it->w > pr->width) it->w = pr->width - it->x;
 	if (it->y + it->h > pr->height) it->h = pr->height - it->y;
 
+	it->last_used = g_get_monotonic_time();
 	rt->tiles = g_list_prepend(rt->tiles, it);
 	rt->tile_cache_size += it->size;
 
@@ -410,11 +415,57 @@ static void rt_tile_free_space(RendererTiles *rt, guint space, ImageTile *it)
 
 		needle = work->data;
 		work = work->prev;
-		if (needle != it &&
-		    ((!needle->qd && !needle->qd2) || !rt_tile_is_visible(rt, needle))) rt_tile_remove(rt, needle);
+		if (needle != it && rt_tile_is_evictable(rt, needle)) rt_tile_remove(rt, needle);
 		}
 }
 
+static gboolean rt_tile_is_evictable(RendererTiles *rt, ImageTile *it)
+{
+	return (!it->qd && !it->qd2) || !rt_tile_is_visible(rt, it);
+}
+
+static ImageTile *rt_tile_find_evictable(RendererTiles *rt)
+{
+	GList *work;
+
+	for (work = g_list_last(rt->tiles); work; work = work->prev)
+		{
+		ImageTile *it = work->data;
+
+		if (rt_tile_is_evictable(rt, it)) return it;
+		}
+
+	return NULL;
+}
+
+static gsize rt_memory_size(gpointer data)
+{
+	RendererTiles *rt = data;
+
+	return rt->tile_cache_size;
+}
+
+static gint64 rt_memory_oldest(gpointer data)
+{
+	ImageTile *it = rt_tile_find_evictable((RendererTiles *)data);
+
+	return it ? it->last_used : 0;
+}
+
+static gsize rt_memory_evict(gpointer data)
+{
+	RendererTiles *rt = data;
+	ImageTile *it = rt_tile_find_evictable(rt);
+	gsize size;
+
+	if (!it) return 0;
+
+	size = it->size;
+	rt_tile_remove(rt, it);
+
+	return size;
+}
+
 static void rt_tile_invalidate_all(RendererTiles *rt)
 {
 	PixbufRenderer *pr = rt->pr;
@@ -480,6 +531,7 @@ static ImageTile *rt_tile_get(RendererTiles *rt, gint x, gint y, gboolean only_e
 			{
 			rt->tiles = g_list_delete_link(rt->tiles, work);
 			rt->tiles = g_list_prepend(rt->tiles, it);
+			it->last_used = g_get_monotonic_time();
 			return it;
 			}
 
@@ -537,6 +589,7 @@ static void rt_tile_prepare(RendererTiles *rt, ImageTile *it)
 		it->surface = surface;
 		it->size += size;
 		rt->tile_cache_size += size;
+		memory_cache_changed();
 		}
 
 	if (!it->pixbuf)
@@ -551,6 +604,7 @@ static void rt_tile_prepare(RendererTiles *rt, ImageTile *it)
 		it->pixbuf = pixbuf;
 		it->size += size;
 		rt->tile_cache_size += size;
+		memory_cache_changed();
 		}
 }
 
@@ -1196,6 +1250,19 @@ static gboolean rt_source_tile_render(RendererTiles *rt, ImageTile *it,
 
 		if (pr->width < PR_MIN_SCALE_SIZE || pr->height < PR_MIN_SCALE_SIZE) fast = TRUE;
 
+		if (pr->source_tiles_preview_scale > 0.0 && pr->scale <= pr->source_tiles_preview_scale)
+			{
+			/* zoomed out far enough, use the reduced copy of the whole image */
+			if (!pr->source_tiles_preview) return FALSE;
+
+			gdk_pixbuf_scale(pr->source_tiles_preview, it->pixbuf, x, y, w, h,
+					 (gdouble) -it->x, (gdouble) -it->y,
+					 (gdouble)pr->width / gdk_pixbuf_get_width(pr->source_tiles_preview),
+					 (gdouble)pr->height / gdk_pixbuf_get_height(pr->source_tiles_preview),
+					 (fast) ? GDK_INTERP_NEAREST : pr->zoom_quality);
+			return TRUE;
+			}
+
 #if 0
 		/* draws red over draw region, to check for leaks (regions not filled) */
 		pixbuf_set_rect_fill(it->pixbuf, x, y, w, h, 255, 0, 0, 255);
@@ -1263,6 +1330,8 @@ static void rt_tile_get_region(gboolean has_alpha,
                                GdkInterpType interp_type,
                                int check_x, int check_y)
 {
+	gint64 t = TRACE_BEGIN();
+
 	if (!has_alpha)
 		{
 		if (scale_x == 1.0 && scale_y == 1.0)
@@ -1300,6 +1369,8 @@ static void rt_tile_get_region(gboolean has_alpha,
 					 (options->image.alpha_color_2.green & 0x00FF00) +
 					 (options->image.alpha_color_2.blue >> 8 & 0x00FF)));
 		}
+
+	TRACE_END(t, TRACE_SCALE, "rt_tile_get_region");
 }
 
 
@@ -1317,9 +1388,9 @@ static gint rt_get_orientation(RendererTiles *rt)
 }
 
 
-static void rt_tile_render(RendererTiles *rt, ImageTile *it,
-			   gint x, gint y, gint w, gint h,
-			   gboolean new_data, gboolean fast)
+static void rt_tile_render_real(RendererTiles *rt, ImageTile *it,
+				gint x, gint y, gint w, gint h,
+				gboolean new_data, gboolean fast)
 {
 	PixbufRenderer *pr = rt->pr;
 	gboolean has_alpha;
@@ -1456,6 +1527,16 @@ static void rt_tile_render(RendererTiles *rt, ImageTile *it,
 		}
 }
 
+static void rt_tile_render(RendererTiles *rt, ImageTile *it,
+			   gint x, gint y, gint w, gint h,
+			   gboolean new_data, gboolean fast)
+{
+	gint64 t = TRACE_BEGIN();
+
+	rt_tile_render_real(rt, it, x, y, w, h, new_data, fast);
+	TRACE_END(t, TRACE_RENDER, "rt_tile_render");
+}
+
 
 static void rt_tile_expose(RendererTiles *rt, ImageTile *it,
 			   gint x, gint y, gint w, gint h,
@@ -2089,6 +2170,7 @@ static void renderer_stereo_set(void *renderer, gint stereo_mode)
 static void renderer_free(void *renderer)
 {
 	RendererTiles *rt = (RendererTiles *)renderer;
+	memory_cache_unregister(rt->memory);
 	rt_queue_clear(rt);
 	rt_tile_free_all(rt);
 	if (rt->spare_tile) g_object_unref(rt->spare_tile);
@@ -2183,6 +2265,8 @@ RendererFuncs *renderer_tiles_new(PixbufRenderer *pr)
 	rt->tile_cache_size = 0;
 
 	rt->tile_cache_max = PR_CACHE_SIZE_DEFAULT;
+	rt->memory = memory_cache_register("tiles", MEMORY_COST_MEDIUM,
+					   rt_memory_size, rt_memory_oldest, rt_memory_evict, rt);
 
 	rt->draw_idle_id = 0;
 
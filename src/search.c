@@ -2379,7 +2379,13 @@ static gboolean search_step_cb(gpointer data)
 
 	if (sd->search_file_list)
 		{
-		if (search_file_next(sd))
+		gint64 t = TRACE_BEGIN();
+		gboolean done;
+
+		done = search_file_next(sd);
+		TRACE_END(t, TRACE_COMPARE, "search_file_next");
+
+		if (done)
 			{
 			sd->search_idle_id = 0;
 			return FALSE;
@@ -2767,10 +2773,8 @@ static gint search_result_sort_cb(GtkTreeModel *model, GtkTreeIter *a, GtkTreeIt
 			return 0;
 			break;
 		case SEARCH_COLUMN_NAME:
-			if (options->file_sort.case_sensitive)
-				return strcmp(fda->fd->collate_key_name, fdb->fd->collate_key_name);
-			else
-				return strcmp(fda->fd->collate_key_name_nocase, fdb->fd->collate_key_name_nocase);
+			return strcmp(file_data_get_collate_key(fda->fd, options->file_sort.case_sensitive),
+				      file_data_get_collate_key(fdb->fd, options->file_sort.case_sensitive));
 			break;
 		case SEARCH_COLUMN_SIZE:
 			if (fda->fd->size > fdb->fd->size) return 1;
@@ -123,8 +123,7 @@ static void thumb_loader_percent_cb(ImageLoader *il, gdouble percent, gpointer d
 
 static void thumb_loader_set_fallback(ThumbLoader *tl)
 {
-	if (tl->fd->thumb_pixbuf) g_object_unref(tl->fd->thumb_pixbuf);
-	tl->fd->thumb_pixbuf = pixbuf_fallback(tl->fd, tl->max_w, tl->max_h);
+	file_data_set_thumb_pixbuf(tl->fd, pixbuf_fallback(tl->fd, tl->max_w, tl->max_h));
 }
 
 static void thumb_loader_done_cb(ImageLoader *il, gpointer data)
@@ -205,8 +204,7 @@ static void thumb_loader_done_cb(ImageLoader *il, gpointer data)
 
 		if (tl->fd)
 			{
-			if (tl->fd->thumb_pixbuf) g_object_unref(tl->fd->thumb_pixbuf);
-			tl->fd->thumb_pixbuf = gdk_pixbuf_scale_simple(pixbuf, w, h, (GdkInterpType)options->thumbnails.quality);
+			file_data_set_thumb_pixbuf(tl->fd, gdk_pixbuf_scale_simple(pixbuf, w, h, (GdkInterpType)options->thumbnails.quality));
 			}
 		save = TRUE;
 		}
@@ -214,10 +212,8 @@ static void thumb_loader_done_cb(ImageLoader *il, gpointer data)
 		{
 		if (tl->fd)
 			{
-			if (tl->fd->thumb_pixbuf) g_object_unref(tl->fd->thumb_pixbuf);
-			tl->fd->thumb_pixbuf = pixbuf;
-
-			g_object_ref(tl->fd->thumb_pixbuf);
+			g_object_ref(pixbuf);
+			file_data_set_thumb_pixbuf(tl->fd, pixbuf);
 			}
 		save = image_loader_get_shrunk(il);
 		}
@@ -357,6 +353,7 @@ gboolean thumb_loader_start(ThumbLoader *tl, FileData *fd)
 					{
 					DEBUG_1("Broken image mark found:%s", cache_path);
 					g_free(cache_path);
+					tl->cache_hit = TRUE;
 					thumb_loader_set_fallback(tl);
 					return FALSE;
 					}
@@ -373,8 +370,7 @@ gboolean thumb_loader_start(ThumbLoader *tl, FileData *fd)
 
 	if (!cache_path && options->thumbnails.use_xvpics)
 		{
-		if (tl->fd->thumb_pixbuf) g_object_unref(tl->fd->thumb_pixbuf);
-		tl->fd->thumb_pixbuf = get_xv_thumbnail(tl->fd->path, tl->max_w, tl->max_h);
+		file_data_set_thumb_pixbuf(tl->fd, get_xv_thumbnail(tl->fd->path, tl->max_w, tl->max_h));
 		if (tl->fd->thumb_pixbuf)
 			{
 			thumb_loader_delay_done(tl);
@@ -423,6 +419,19 @@ gboolean thumb_loader_start(ThumbLoader *tl, FileData *fd)
 	return TRUE;
 }
 
+/* the thumbnail, or the mark that it fails, was read from a cache, nothing was generated */
+gboolean thumb_loader_cache_hit(ThumbLoader *tl)
+{
+	if (!tl) return FALSE;
+
+	if (tl->standard_loader)
+		{
+		return ((ThumbLoaderStd *)tl)->cache_hit;
+		}
+
+	return tl->cache_hit;
+}
+
 GdkPixbuf *thumb_loader_get_pixbuf(ThumbLoader *tl)
 {
 	GdkPixbuf *pixbuf;
@@ -492,8 +501,7 @@ void thumb_notify_cb(FileData *fd, NotifyType type, gpointer data)
 	if ((type & (NOTIFY_REREAD | NOTIFY_CHANGE)) && fd->thumb_pixbuf)
 		{
 		DEBUG_1("Notify thumb: %s %04x", fd->path, type);
-		g_object_unref(fd->thumb_pixbuf);
-		fd->thumb_pixbuf = NULL;
+		file_data_set_thumb_pixbuf(fd, NULL);
 		}
 }
 
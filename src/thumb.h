@@ -34,6 +34,7 @@ void thumb_loader_set_cache(ThumbLoader *tl, gboolean enable_cache, gboolean loc
 gboolean thumb_loader_start(ThumbLoader *tl, FileData *fd);
 void thumb_loader_free(ThumbLoader *tl);
 
+gboolean thumb_loader_cache_hit(ThumbLoader *tl);
 GdkPixbuf *thumb_loader_get_pixbuf(ThumbLoader *tl);
 
 void thumb_notify_cb(FileData *fd, NotifyType type, gpointer data);
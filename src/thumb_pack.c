@@ -0,0 +1,953 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ * \brief Packed thumbnail store
+ *
+ * All thumbnails are kept in two files instead of one png per image:
+ *
+ * thumbs.pack is append only. Each record is a ThumbPackRecord followed by
+ * the UTF-8 path of the source image and its pixels, deflated at the
+ * lowest level or stored raw when that does not save anything.
+ *
+ * thumbs.idx is a ThumbPackHeader followed by an open addressed table of
+ * ThumbPackSlot, mapped into memory. Slots are keyed by a hash of the
+ * source path and the thumbnail size and hold the mtime of the source, so
+ * a lookup costs one probe in the map and one pread().
+ *
+ * A replaced thumbnail leaves its old record behind, compaction copies
+ * only the records still referenced by a slot whose source is unchanged.
+ * The instance holding the lock on thumbs.pack writes, others only read.
+ */
+
+#include "main.h"
+#include "thumb_pack.h"
+
+#include "cache.h"
+#include "ui_fileops.h"
+
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+
+#define THUMB_PACK_INDEX_MAGIC  "GQTPIDX1"
+#define THUMB_PACK_RECORD_MAGIC 0x50545147 /* "GQTP" */
+
+#define THUMB_PACK_CAPACITY_MIN 4096
+#define THUMB_PACK_COMPACT_STEP 256
+
+#define THUMB_PACK_FLAG_ALPHA   (1 << 0)
+#define THUMB_PACK_FLAG_DEFLATE (1 << 1)
+
+#define THUMB_PACK_PERMS_FOLDER 0700
+#define THUMB_PACK_PERMS_FILE   0600
+
+
+typedef struct _ThumbPackHeader ThumbPackHeader;
+struct _ThumbPackHeader
+{
+	gchar magic[8];
+	guint32 capacity;	/* slots, a power of 2 */
+	guint32 count;		/* used slots */
+	guint64 pack_size;	/* end of the last complete record */
+	guint64 live_size;	/* bytes of the records referenced by a slot */
+};
+
+typedef struct _ThumbPackSlot ThumbPackSlot;
+struct _ThumbPackSlot
+{
+	guint64 key;		/* 0 for an empty slot */
+	gint64 mtime;
+	guint64 offset;
+	guint32 length;
+	guint32 reserved;
+};
+
+typedef struct _ThumbPackRecord ThumbPackRecord;
+struct _ThumbPackRecord
+{
+	guint32 magic;
+	guint32 path_len;
+	gint64 mtime;
+	guint16 width;
+	guint16 height;
+	guint8 size;		/* ThumbPackSize */
+	guint8 flags;
+	guint16 reserved;
+	guint32 data_len;	/* stored pixel bytes */
+	guint32 raw_len;	/* pixel bytes after inflating */
+};
+
+typedef struct _ThumbPack ThumbPack;
+struct _ThumbPack
+{
+	gchar *pack_path;
+	gchar *index_path;
+
+	gint pack_fd;
+	gint index_fd;
+	gboolean writable;
+
+	gpointer map;
+	gsize map_size;
+	ThumbPackHeader *header;
+	ThumbPackSlot *slots;
+};
+
+struct _ThumbPackCompact
+{
+	ThumbPack *dest;
+	ThumbPackSlot *slots;	/* copy of the index when compaction started, a store can grow it */
+	guint32 capacity;
+	guint position;
+};
+
+struct _ThumbPackIter
+{
+	gint pack_fd;		/* the records stay readable when a compaction replaces the pack */
+	ThumbPackSlot *slots;	/* copy of the index, a store can grow it */
+	guint32 capacity;
+	guint position;
+};
+
+static ThumbPack *thumb_pack = NULL;
+static gboolean thumb_pack_tried = FALSE;
+
+
+/*
+ *-------------------------------------------------------------------
+ * files
+ *-------------------------------------------------------------------
+ */
+
+static guint64 thumb_pack_key(const gchar *path, ThumbPackSize size)
+{
+	guint64 hash = 14695981039346656037ULL;
+	const guchar *p;
+
+	for (p = (const guchar *)path; *p; p++)
+		{
+		hash = (hash ^ *p) * 1099511628211ULL;
+		}
+	hash = (hash ^ (guchar)size) * 1099511628211ULL;
+
+	return hash ? hash : 1;
+}
+
+static gboolean thumb_pack_read_at(gint fd, gpointer buf, gsize len, guint64 offset)
+{
+	gchar *p = buf;
+
+	while (len > 0)
+		{
+		ssize_t n = pread(fd, p, len, offset);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return FALSE;
+		p += n;
+		len -= n;
+		offset += n;
+		}
+
+	return TRUE;
+}
+
+static gboolean thumb_pack_write_at(gint fd, gconstpointer buf, gsize len, guint64 offset)
+{
+	const gchar *p = buf;
+
+	while (len > 0)
+		{
+		ssize_t n = pwrite(fd, p, len, offset);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return FALSE;
+		p += n;
+		len -= n;
+		offset += n;
+		}
+
+	return TRUE;
+}
+
+static void thumb_pack_unmap(ThumbPack *tp)
+{
+	if (tp->map) munmap(tp->map, tp->map_size);
+	tp->map = NULL;
+	tp->map_size = 0;
+	tp->header = NULL;
+	tp->slots = NULL;
+}
+
+static gboolean thumb_pack_map(ThumbPack *tp)
+{
+	struct stat st;
+	ThumbPackHeader *header;
+	gpointer map;
+
+	if (fstat(tp->index_fd, &st) != 0 || st.st_size < (off_t)sizeof(ThumbPackHeader)) return FALSE;
+
+	map = mmap(NULL, st.st_size, PROT_READ | (tp->writable ? PROT_WRITE : 0), MAP_SHARED, tp->index_fd, 0);
+	if (map == MAP_FAILED) return FALSE;
+
+	header = map;
+	if (memcmp(header->magic, THUMB_PACK_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+	    (guint64)st.st_size != sizeof(ThumbPackHeader) + (guint64)header->capacity * sizeof(ThumbPackSlot))
+		{
+		munmap(map, st.st_size);
+		return FALSE;
+		}
+
+	tp->map = map;
+	tp->map_size = st.st_size;
+	tp->header = header;
+	tp->slots = (ThumbPackSlot *)(header + 1);
+
+	return TRUE;
+}
+
+static gboolean thumb_pack_index_init(gint fd, guint32 capacity)
+{
+	ThumbPackHeader header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, THUMB_PACK_INDEX_MAGIC, sizeof(header.magic));
+	header.capacity = capacity;
+
+	if (ftruncate(fd, 0) != 0) return FALSE;
+	if (ftruncate(fd, sizeof(header) + (off_t)capacity * sizeof(ThumbPackSlot)) != 0) return FALSE;
+
+	return thumb_pack_write_at(fd, &header, sizeof(header), 0);
+}
+
+static void thumb_pack_free(ThumbPack *tp)
+{
+	if (!tp) return;
+
+	thumb_pack_unmap(tp);
+	if (tp->index_fd >= 0) close(tp->index_fd);
+	if (tp->pack_fd >= 0) close(tp->pack_fd);
+	g_free(tp->pack_path);
+	g_free(tp->index_path);
+	g_free(tp);
+}
+
+/* a capacity other than 0 creates an empty store */
+static ThumbPack *thumb_pack_open(const gchar *pack_path, const gchar *index_path, guint32 capacity)
+{
+	ThumbPack *tp;
+	gchar *pathl;
+	gint flags = O_RDWR | O_CREAT | (capacity ? O_TRUNC : 0);
+
+	tp = g_new0(ThumbPack, 1);
+	tp->pack_path = g_strdup(pack_path);
+	tp->index_path = g_strdup(index_path);
+
+	pathl = path_from_utf8(pack_path);
+	tp->pack_fd = open(pathl, flags, THUMB_PACK_PERMS_FILE);
+	g_free(pathl);
+
+	pathl = path_from_utf8(index_path);
+	tp->index_fd = open(pathl, flags, THUMB_PACK_PERMS_FILE);
+	g_free(pathl);
+
+	if (tp->pack_fd < 0 || tp->index_fd < 0)
+		{
+		thumb_pack_free(tp);
+		return NULL;
+		}
+
+	tp->writable = (flock(tp->pack_fd, LOCK_EX | LOCK_NB) == 0);
+
+	if (capacity || !thumb_pack_map(tp))
+		{
+		if (!tp->writable)
+			{
+			thumb_pack_free(tp);
+			return NULL;
+			}
+
+		if (!capacity) capacity = THUMB_PACK_CAPACITY_MIN;
+
+		DEBUG_1("thumb pack: new index %s", index_path);
+		if (ftruncate(tp->pack_fd, 0) != 0 ||
+		    !thumb_pack_index_init(tp->index_fd, capacity) ||
+		    !thumb_pack_map(tp))
+			{
+			thumb_pack_free(tp);
+			return NULL;
+			}
+		}
+	else if (tp->writable)
+		{
+		/* drop a record left incomplete by a crash */
+		if (ftruncate(tp->pack_fd, tp->header->pack_size) != 0)
+			{
+			log_printf("Unable to truncate thumbnail pack %s\n", pack_path);
+			}
+		}
+
+	return tp;
+}
+
+static ThumbPack *thumb_pack_get(void)
+{
+	gchar *pack_path;
+	gchar *index_path;
+
+	if (thumb_pack_tried) return thumb_pack;
+	thumb_pack_tried = TRUE;
+
+	if (!recursive_mkdir_if_not_exists(get_thumbnails_pack_dir(), THUMB_PACK_PERMS_FOLDER)) return NULL;
+
+	pack_path = g_build_filename(get_thumbnails_pack_dir(), THUMB_PACK_NAME, NULL);
+	index_path = g_build_filename(get_thumbnails_pack_dir(), THUMB_PACK_INDEX_NAME, NULL);
+
+	thumb_pack = thumb_pack_open(pack_path, index_path, 0);
+	if (!thumb_pack)
+		{
+		log_printf("Unable to open thumbnail pack %s\n", pack_path);
+		}
+	else if (!thumb_pack->writable)
+		{
+		DEBUG_1("thumb pack: %s is locked, read only", pack_path);
+		}
+
+	g_free(pack_path);
+	g_free(index_path);
+
+	return thumb_pack;
+}
+
+static gboolean thumb_pack_same_file(gint fd, const gchar *path)
+{
+	struct stat st_fd;
+	struct stat st_path;
+
+	return (fstat(fd, &st_fd) == 0 && stat_utf8(path, &st_path) &&
+		st_fd.st_dev == st_path.st_dev && st_fd.st_ino == st_path.st_ino);
+}
+
+/* the writer renames new files in place when it grows the index or compacts
+ * the store, a reader keeps the old ones open until it checks */
+static ThumbPack *thumb_pack_get_current(void)
+{
+	ThumbPack *tp = thumb_pack_get();
+
+	if (!tp || tp->writable) return tp;
+
+	if (thumb_pack_same_file(tp->index_fd, tp->index_path) &&
+	    thumb_pack_same_file(tp->pack_fd, tp->pack_path)) return tp;
+
+	DEBUG_1("thumb pack: %s was replaced, opened again", tp->index_path);
+	thumb_pack_close();
+
+	return thumb_pack_get();
+}
+
+/*
+ *-------------------------------------------------------------------
+ * index
+ *-------------------------------------------------------------------
+ */
+
+static ThumbPackSlot *thumb_pack_find_slot(ThumbPackSlot *slots, guint32 capacity, guint64 key)
+{
+	guint32 mask = capacity - 1;
+	guint32 i = key & mask;
+
+	while (slots[i].key && slots[i].key != key) i = (i + 1) & mask;
+
+	return &slots[i];
+}
+
+static gboolean thumb_pack_grow(ThumbPack *tp)
+{
+	ThumbPackHeader header;
+	ThumbPackSlot *slots;
+	gchar *tmp_path;
+	gchar *tmp_pathl;
+	gchar *index_pathl;
+	gpointer old_map;
+	gsize old_map_size;
+	gint old_fd;
+	gint fd;
+	guint32 i;
+	gboolean success;
+
+	header = *tp->header;
+	header.capacity *= 2;
+
+	slots = g_new0(ThumbPackSlot, header.capacity);
+	for (i = 0; i < tp->header->capacity; i++)
+		{
+		if (!tp->slots[i].key) continue;
+		*thumb_pack_find_slot(slots, header.capacity, tp->slots[i].key) = tp->slots[i];
+		}
+
+	tmp_path = g_strconcat(tp->index_path, ".tmp", NULL);
+	tmp_pathl = path_from_utf8(tmp_path);
+	index_pathl = path_from_utf8(tp->index_path);
+
+	fd = open(tmp_pathl, O_RDWR | O_CREAT | O_TRUNC, THUMB_PACK_PERMS_FILE);
+	success = (fd >= 0 &&
+		   thumb_pack_write_at(fd, &header, sizeof(header), 0) &&
+		   thumb_pack_write_at(fd, slots, (gsize)header.capacity * sizeof(ThumbPackSlot), sizeof(header)) &&
+		   rename(tmp_pathl, index_pathl) == 0);
+
+	g_free(slots);
+	g_free(index_pathl);
+	g_free(tmp_pathl);
+	g_free(tmp_path);
+
+	if (!success)
+		{
+		if (fd >= 0) close(fd);
+		log_printf("Unable to grow thumbnail pack index %s\n", tp->index_path);
+		return FALSE;
+		}
+
+	/* the old map stays in use when the new index can not be mapped */
+	old_map = tp->map;
+	old_map_size = tp->map_size;
+	old_fd = tp->index_fd;
+
+	tp->index_fd = fd;
+	if (!thumb_pack_map(tp))
+		{
+		tp->index_fd = old_fd;
+		close(fd);
+		log_printf("Unable to map thumbnail pack index %s\n", tp->index_path);
+		return FALSE;
+		}
+
+	munmap(old_map, old_map_size);
+	close(old_fd);
+
+	DEBUG_1("thumb pack: index grown to %u slots", header.capacity);
+
+	return TRUE;
+}
+
+static gboolean thumb_pack_insert(ThumbPack *tp, guint64 key, gint64 mtime, guint64 offset, guint32 length)
+{
+	ThumbPackSlot *slot;
+
+	if (((guint64)tp->header->count + 1) * 10 > (guint64)tp->header->capacity * 7 &&
+	    !thumb_pack_grow(tp)) return FALSE;
+
+	slot = thumb_pack_find_slot(tp->slots, tp->header->capacity, key);
+	if (slot->key)
+		{
+		tp->header->live_size -= slot->length;
+		}
+	else
+		{
+		tp->header->count++;
+		}
+
+	slot->key = key;
+	slot->mtime = mtime;
+	slot->offset = offset;
+	slot->length = length;
+
+	tp->header->live_size += length;
+	if (offset + length > tp->header->pack_size) tp->header->pack_size = offset + length;
+
+	return TRUE;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * records
+ *-------------------------------------------------------------------
+ */
+
+static guchar *thumb_pack_encode(const gchar *path, ThumbPackSize size, time_t mtime, GdkPixbuf *pixbuf, gsize *length)
+{
+	ThumbPackRecord record;
+	GConverter *conv;
+	const guchar *pixels;
+	guchar *raw;
+	guchar *buf;
+	guchar *data;
+	gsize bytes_read;
+	gsize bytes_written;
+	gsize row;
+	gsize bound;
+	gint w, h, rs, channels;
+	gint y;
+
+	w = gdk_pixbuf_get_width(pixbuf);
+	h = gdk_pixbuf_get_height(pixbuf);
+	rs = gdk_pixbuf_get_rowstride(pixbuf);
+	channels = gdk_pixbuf_get_n_channels(pixbuf);
+	pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+	if (w > G_MAXUINT16 || h > G_MAXUINT16 || gdk_pixbuf_get_bits_per_sample(pixbuf) != 8) return NULL;
+
+	memset(&record, 0, sizeof(record));
+	record.magic = THUMB_PACK_RECORD_MAGIC;
+	record.path_len = strlen(path);
+	record.mtime = mtime;
+	record.width = w;
+	record.height = h;
+	record.size = size;
+	record.flags = gdk_pixbuf_get_has_alpha(pixbuf) ? THUMB_PACK_FLAG_ALPHA : 0;
+
+	row = (gsize)w * channels;
+	record.raw_len = row * h;
+
+	raw = g_malloc(record.raw_len);
+	for (y = 0; y < h; y++)
+		{
+		memcpy(raw + y * row, pixels + y * rs, row);
+		}
+
+	bound = record.raw_len + record.raw_len / 8 + 64;
+	buf = g_malloc(sizeof(record) + record.path_len + bound);
+	data = buf + sizeof(record) + record.path_len;
+
+	conv = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+	if (g_converter_convert(conv, raw, record.raw_len, data, bound, G_CONVERTER_INPUT_AT_END,
+				&bytes_read, &bytes_written, NULL) == G_CONVERTER_FINISHED &&
+	    bytes_written < record.raw_len)
+		{
+		record.flags |= THUMB_PACK_FLAG_DEFLATE;
+		record.data_len = bytes_written;
+		}
+	else
+		{
+		memcpy(data, raw, record.raw_len);
+		record.data_len = record.raw_len;
+		}
+	g_object_unref(conv);
+	g_free(raw);
+
+	memcpy(buf, &record, sizeof(record));
+	memcpy(buf + sizeof(record), path, record.path_len);
+
+	*length = sizeof(record) + record.path_len + record.data_len;
+	return buf;
+}
+
+static void thumb_pack_pixels_free(guchar *pixels, gpointer data)
+{
+	g_free(pixels);
+}
+
+/* path, if not NULL, must match the path stored in the record */
+static GdkPixbuf *thumb_pack_decode(const guchar *buf, gsize length, const gchar *path,
+				    gchar **path_out, ThumbPackSize *size_out, time_t *mtime_out)
+{
+	ThumbPackRecord record;
+	const gchar *record_path;
+	const guchar *data;
+	guchar *pixels;
+	gint channels;
+
+	if (length < sizeof(record)) return NULL;
+	memcpy(&record, buf, sizeof(record));
+
+	if (record.magic != THUMB_PACK_RECORD_MAGIC ||
+	    sizeof(record) + (gsize)record.path_len + record.data_len != length) return NULL;
+
+	record_path = (const gchar *)buf + sizeof(record);
+	if (path && (strlen(path) != record.path_len || memcmp(path, record_path, record.path_len) != 0)) return NULL;
+
+	channels = (record.flags & THUMB_PACK_FLAG_ALPHA) ? 4 : 3;
+	if (record.width == 0 || record.height == 0 ||
+	    (gsize)record.width * record.height * channels != record.raw_len) return NULL;
+
+	data = buf + sizeof(record) + record.path_len;
+	pixels = g_malloc(record.raw_len);
+
+	if (record.flags & THUMB_PACK_FLAG_DEFLATE)
+		{
+		GConverter *conv;
+		GConverterResult result;
+		gsize bytes_read;
+		gsize bytes_written;
+
+		conv = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+		result = g_converter_convert(conv, data, record.data_len, pixels, record.raw_len,
+					     G_CONVERTER_INPUT_AT_END, &bytes_read, &bytes_written, NULL);
+		g_object_unref(conv);
+
+		if (result != G_CONVERTER_FINISHED || bytes_written != record.raw_len)
+			{
+			g_free(pixels);
+			return NULL;
+			}
+		}
+	else
+		{
+		if (record.data_len != record.raw_len)
+			{
+			g_free(pixels);
+			return NULL;
+			}
+		memcpy(pixels, data, record.raw_len);
+		}
+
+	if (path_out) *path_out = g_strndup(record_path, record.path_len);
+	if (size_out) *size_out = record.size;
+	if (mtime_out) *mtime_out = record.mtime;
+
+	return gdk_pixbuf_new_from_data(pixels, GDK_COLORSPACE_RGB, (record.flags & THUMB_PACK_FLAG_ALPHA), 8,
+					record.width, record.height, record.width * channels,
+					thumb_pack_pixels_free, NULL);
+}
+
+static guchar *thumb_pack_read_record(ThumbPack *tp, const ThumbPackSlot *slot)
+{
+	guchar *buf;
+
+	if (slot->length < sizeof(ThumbPackRecord)) return NULL;
+
+	buf = g_malloc(slot->length);
+	if (!thumb_pack_read_at(tp->pack_fd, buf, slot->length, slot->offset))
+		{
+		g_free(buf);
+		return NULL;
+		}
+
+	return buf;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * public
+ *-------------------------------------------------------------------
+ */
+
+/**
+ * \brief Returns the packed thumbnail of \a path, NULL if there is none
+ * or if it was made from a different version of the file.
+ */
+GdkPixbuf *thumb_pack_lookup(const gchar *path, ThumbPackSize size, time_t mtime)
+{
+	ThumbPack *tp;
+	ThumbPackSlot slot;
+	GdkPixbuf *pixbuf;
+	guchar *buf;
+
+	tp = thumb_pack_get_current();
+	if (!tp || !path) return NULL;
+
+	slot = *thumb_pack_find_slot(tp->slots, tp->header->capacity, thumb_pack_key(path, size));
+	if (!slot.key || slot.mtime != (gint64)mtime) return NULL;
+
+	buf = thumb_pack_read_record(tp, &slot);
+	if (!buf) return NULL;
+
+	pixbuf = thumb_pack_decode(buf, slot.length, path, NULL, NULL, NULL);
+	g_free(buf);
+
+	return pixbuf;
+}
+
+/**
+ * \brief Appends a thumbnail, replacing the previous one of \a path.
+ */
+gboolean thumb_pack_store(const gchar *path, ThumbPackSize size, time_t mtime, GdkPixbuf *pixbuf)
+{
+	ThumbPack *tp;
+	guchar *buf;
+	gsize length;
+	guint64 offset;
+
+	tp = thumb_pack_get();
+	if (!tp || !tp->writable || !path || !pixbuf) return FALSE;
+
+	buf = thumb_pack_encode(path, size, mtime, pixbuf, &length);
+	if (!buf) return FALSE;
+
+	offset = tp->header->pack_size;
+	if (!thumb_pack_write_at(tp->pack_fd, buf, length, offset))
+		{
+		log_printf("Unable to write thumbnail pack %s\n", tp->pack_path);
+		g_free(buf);
+		return FALSE;
+		}
+	g_free(buf);
+
+	DEBUG_1("thumb pack: stored %s", path);
+
+	return thumb_pack_insert(tp, thumb_pack_key(path, size), mtime, offset, length);
+}
+
+void thumb_pack_get_usage(guint *count, guint64 *size, guint64 *live_size)
+{
+	ThumbPack *tp = NULL;
+	gchar *path;
+
+	/* do not create the store just to report that it is empty */
+	path = g_build_filename(get_thumbnails_pack_dir(), THUMB_PACK_INDEX_NAME, NULL);
+	if (thumb_pack_tried || isfile(path)) tp = thumb_pack_get();
+	g_free(path);
+
+	if (count) *count = tp ? tp->header->count : 0;
+	if (size) *size = tp ? tp->header->pack_size : 0;
+	if (live_size) *live_size = tp ? tp->header->live_size : 0;
+}
+
+void thumb_pack_close(void)
+{
+	thumb_pack_free(thumb_pack);
+	thumb_pack = NULL;
+	thumb_pack_tried = FALSE;
+}
+
+void thumb_pack_clear(void)
+{
+	gchar *path;
+
+	thumb_pack_close();
+
+	path = g_build_filename(get_thumbnails_pack_dir(), THUMB_PACK_INDEX_NAME, NULL);
+	if (isfile(path)) unlink_file(path);
+	g_free(path);
+
+	path = g_build_filename(get_thumbnails_pack_dir(), THUMB_PACK_NAME, NULL);
+	if (isfile(path)) unlink_file(path);
+	g_free(path);
+}
+
+ThumbPackIter *thumb_pack_iter_new(void)
+{
+	ThumbPack *tp;
+	ThumbPackIter *pi;
+
+	tp = thumb_pack_get_current();
+	if (!tp) return NULL;
+
+	pi = g_new0(ThumbPackIter, 1);
+	pi->pack_fd = dup(tp->pack_fd);
+	pi->capacity = tp->header->capacity;
+	pi->slots = g_memdup(tp->slots, (guint)pi->capacity * sizeof(ThumbPackSlot));
+
+	if (pi->pack_fd < 0)
+		{
+		thumb_pack_iter_free(pi);
+		return NULL;
+		}
+
+	return pi;
+}
+
+/**
+ * \brief Returns the next thumbnail, FALSE when all entries are done.
+ *
+ * \a path and \a pixbuf must be freed by the caller. Thumbnails stored
+ * after thumb_pack_iter_new() are not returned.
+ */
+gboolean thumb_pack_iter_next(ThumbPackIter *pi, gchar **path, ThumbPackSize *size, time_t *mtime, GdkPixbuf **pixbuf)
+{
+	while (pi->position < pi->capacity)
+		{
+		ThumbPackSlot slot = pi->slots[pi->position];
+		guchar *buf;
+
+		pi->position++;
+		if (!slot.key || slot.length < sizeof(ThumbPackRecord)) continue;
+
+		buf = g_malloc(slot.length);
+		if (thumb_pack_read_at(pi->pack_fd, buf, slot.length, slot.offset))
+			{
+			*pixbuf = thumb_pack_decode(buf, slot.length, NULL, path, size, mtime);
+			}
+		else
+			{
+			*pixbuf = NULL;
+			}
+		g_free(buf);
+
+		if (*pixbuf) return TRUE;
+		}
+
+	return FALSE;
+}
+
+gdouble thumb_pack_iter_get_progress(ThumbPackIter *pi)
+{
+	return pi->capacity ? (gdouble)pi->position / pi->capacity : 1.0;
+}
+
+void thumb_pack_iter_free(ThumbPackIter *pi)
+{
+	if (!pi) return;
+
+	if (pi->pack_fd >= 0) close(pi->pack_fd);
+	g_free(pi->slots);
+	g_free(pi);
+}
+
+/*
+ *-------------------------------------------------------------------
+ * compaction
+ *-------------------------------------------------------------------
+ */
+
+static gboolean thumb_pack_compact_keep(const guchar *buf, gsize length, gint64 mtime)
+{
+	ThumbPackRecord record;
+	struct stat st;
+	gchar *path;
+	gboolean keep;
+
+	if (length < sizeof(record)) return FALSE;
+	memcpy(&record, buf, sizeof(record));
+	if (record.magic != THUMB_PACK_RECORD_MAGIC ||
+	    sizeof(record) + (gsize)record.path_len + record.data_len != length) return FALSE;
+
+	path = g_strndup((const gchar *)buf + sizeof(record), record.path_len);
+	keep = (stat_utf8(path, &st) && st.st_mtime == mtime);
+	if (!keep) DEBUG_1("thumb pack: dropping %s", path);
+	g_free(path);
+
+	return keep;
+}
+
+ThumbPackCompact *thumb_pack_compact_new(void)
+{
+	ThumbPack *tp;
+	ThumbPackCompact *pc;
+	gchar *pack_tmp;
+	gchar *index_tmp;
+	guint32 capacity = THUMB_PACK_CAPACITY_MIN;
+
+	tp = thumb_pack_get();
+	if (!tp || !tp->writable) return NULL;
+
+	while ((guint64)capacity < (guint64)tp->header->count * 2) capacity *= 2;
+
+	pack_tmp = g_strconcat(tp->pack_path, ".tmp", NULL);
+	index_tmp = g_strconcat(tp->index_path, ".tmp", NULL);
+
+	pc = g_new0(ThumbPackCompact, 1);
+	pc->dest = thumb_pack_open(pack_tmp, index_tmp, capacity);
+
+	g_free(pack_tmp);
+	g_free(index_tmp);
+
+	if (!pc->dest || !pc->dest->writable)
+		{
+		thumb_pack_compact_free(pc);
+		return NULL;
+		}
+
+	pc->capacity = tp->header->capacity;
+	pc->slots = g_memdup(tp->slots, (guint)pc->capacity * sizeof(ThumbPackSlot));
+
+	return pc;
+}
+
+/**
+ * \brief Copies the next entries to the new store.
+ *
+ * Returns FALSE when all entries are done. Thumbnails stored while the
+ * compaction runs are not copied and will be created again.
+ */
+gboolean thumb_pack_compact_step(ThumbPackCompact *pc, gdouble *progress)
+{
+	ThumbPack *tp = thumb_pack;
+	guint end;
+
+	if (!tp) return FALSE;
+
+	end = MIN(pc->position + THUMB_PACK_COMPACT_STEP, pc->capacity);
+	for (; pc->position < end; pc->position++)
+		{
+		ThumbPackSlot slot = pc->slots[pc->position];
+		ThumbPackHeader *header = pc->dest->header;
+		guchar *buf;
+
+		if (!slot.key) continue;
+
+		buf = thumb_pack_read_record(tp, &slot);
+		if (!buf) continue;
+
+		if (thumb_pack_compact_keep(buf, slot.length, slot.mtime) &&
+		    thumb_pack_write_at(pc->dest->pack_fd, buf, slot.length, header->pack_size))
+			{
+			thumb_pack_insert(pc->dest, slot.key, slot.mtime, header->pack_size, slot.length);
+			}
+		g_free(buf);
+		}
+
+	if (progress) *progress = (gdouble)pc->position / pc->capacity;
+
+	return (pc->position < pc->capacity);
+}
+
+/**
+ * \brief Replaces the store with the compacted one, after the last step.
+ */
+gboolean thumb_pack_compact_finish(ThumbPackCompact *pc)
+{
+	ThumbPack *tp = thumb_pack;
+	gchar *pack_path;
+	gchar *index_path;
+	gboolean success;
+
+	if (!tp || pc->position < pc->capacity) return FALSE;
+
+	pack_path = g_strdup(tp->pack_path);
+	index_path = g_strdup(tp->index_path);
+
+	DEBUG_1("thumb pack: compacted %" G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT " bytes",
+		tp->header->pack_size, pc->dest->header->pack_size);
+
+	success = rename_file(pc->dest->index_path, index_path) &&
+		  rename_file(pc->dest->pack_path, pack_path);
+
+	/* release the lock on the new pack before it is opened again */
+	thumb_pack_free(pc->dest);
+	pc->dest = NULL;
+	thumb_pack_close();
+
+	if (!success) log_printf("Unable to replace thumbnail pack %s\n", pack_path);
+
+	g_free(pack_path);
+	g_free(index_path);
+
+	return success;
+}
+
+void thumb_pack_compact_free(ThumbPackCompact *pc)
+{
+	if (!pc) return;
+
+	if (pc->dest)
+		{
+		gchar *pack_path = g_strdup(pc->dest->pack_path);
+		gchar *index_path = g_strdup(pc->dest->index_path);
+
+		thumb_pack_free(pc->dest);
+		unlink_file(pack_path);
+		unlink_file(index_path);
+		g_free(pack_path);
+		g_free(index_path);
+		}
+	g_free(pc->slots);
+	g_free(pc);
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef THUMB_PACK_H
+#define THUMB_PACK_H
+
+#define THUMB_PACK_NAME       "thumbs.pack"
+#define THUMB_PACK_INDEX_NAME "thumbs.idx"
+
+typedef enum {
+	THUMB_PACK_NORMAL,
+	THUMB_PACK_LARGE,
+	THUMB_PACK_FAIL
+} ThumbPackSize;
+
+typedef struct _ThumbPackCompact ThumbPackCompact;
+typedef struct _ThumbPackIter ThumbPackIter;
+
+GdkPixbuf *thumb_pack_lookup(const gchar *path, ThumbPackSize size, time_t mtime);
+gboolean thumb_pack_store(const gchar *path, ThumbPackSize size, time_t mtime, GdkPixbuf *pixbuf);
+
+void thumb_pack_get_usage(guint *count, guint64 *size, guint64 *live_size);
+void thumb_pack_close(void);
+void thumb_pack_clear(void);
+
+/* walks the entries present when the iterator was made */
+ThumbPackIter *thumb_pack_iter_new(void);
+gboolean thumb_pack_iter_next(ThumbPackIter *pi, gchar **path, ThumbPackSize *size, time_t *mtime, GdkPixbuf **pixbuf);
+gdouble thumb_pack_iter_get_progress(ThumbPackIter *pi);
+void thumb_pack_iter_free(ThumbPackIter *pi);
+
+/* rewrites the store without replaced, outdated or orphaned entries */
+ThumbPackCompact *thumb_pack_compact_new(void);
+gboolean thumb_pack_compact_step(ThumbPackCompact *pc, gdouble *progress);
+gboolean thumb_pack_compact_finish(ThumbPackCompact *pc);
+void thumb_pack_compact_free(ThumbPackCompact *pc);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -30,6 +30,7 @@
 #include "filedata.h"
 #include "exif.h"
 #include "metadata.h"
+#include "thumb_pack.h"
 
 
 /*
@@ -107,6 +108,12 @@ void thumb_loader_std_set_callbacks(ThumbLoaderStd *tl,
 
 static void thumb_loader_std_reset(ThumbLoaderStd *tl)
 {
+	if (tl->idle_id)
+		{
+		g_source_remove(tl->idle_id);
+		tl->idle_id = 0;
+		}
+
 	image_loader_free(tl->il);
 	tl->il = NULL;
 
@@ -123,6 +130,7 @@ static void thumb_loader_std_reset(ThumbLoaderStd *tl)
 	tl->thumb_path_local = FALSE;
 
 	tl->cache_hit = FALSE;
+	tl->trace_start = 0;
 
 	tl->source_mtime = 0;
 	tl->source_size = 0;
@@ -278,10 +286,51 @@ static gboolean thumb_loader_std_validate(ThumbLoaderStd *tl, GdkPixbuf *pixbuf)
 	return TRUE;
 }
 
-static void thumb_loader_std_save(ThumbLoaderStd *tl, GdkPixbuf *pixbuf)
+/* save thumb, using a temp file then renaming into place */
+static gboolean thumb_std_save_png(GdkPixbuf *pixbuf, const gchar *thumb_path, const gchar *uri,
+				   time_t mtime, mode_t mode)
 {
-	gchar *base_path;
 	gchar *tmp_path;
+	gchar *mark_app;
+	gchar *mark_mtime;
+	gchar *pathl;
+	gboolean success;
+
+	tmp_path = unique_filename(thumb_path, ".tmp", "_", 2);
+	if (!tmp_path) return FALSE;
+
+	mark_app = g_strdup_printf("%s %s", GQ_APPNAME, VERSION);
+	mark_mtime = g_strdup_printf("%llu", (unsigned long long)mtime);
+	pathl = path_from_utf8(tmp_path);
+	success = gdk_pixbuf_save(pixbuf, pathl, "png", NULL,
+				  THUMB_MARKER_URI, uri,
+				  THUMB_MARKER_MTIME, mark_mtime,
+				  THUMB_MARKER_APP, mark_app,
+				  NULL);
+	if (success)
+		{
+		chmod(pathl, mode);
+		success = rename_file(tmp_path, thumb_path);
+		}
+
+	g_free(pathl);
+
+	g_free(mark_mtime);
+	g_free(mark_app);
+
+	g_free(tmp_path);
+
+	return success;
+}
+
+static ThumbPackSize thumb_std_pack_size(gint w, gint h)
+{
+	return (w > THUMB_SIZE_NORMAL || h > THUMB_SIZE_NORMAL) ? THUMB_PACK_LARGE : THUMB_PACK_NORMAL;
+}
+
+static void thumb_loader_std_save_real(ThumbLoaderStd *tl, GdkPixbuf *pixbuf)
+{
+	gchar *base_path;
 	gboolean fail;
 
 	if (!tl->cache_enable || tl->cache_hit) return;
@@ -301,6 +350,15 @@ static void thumb_loader_std_save(ThumbLoaderStd *tl, GdkPixbuf *pixbuf)
 		fail = FALSE;
 		}
 
+	if (!tl->cache_local && options->thumbnails.use_pack &&
+	    thumb_pack_store(tl->fd->path,
+			     fail ? THUMB_PACK_FAIL : thumb_std_pack_size(gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf)),
+			     tl->source_mtime, pixbuf))
+		{
+		g_object_unref(G_OBJECT(pixbuf));
+		return;
+		}
+
 	tl->thumb_path = thumb_loader_std_cache_path(tl, tl->cache_local, pixbuf, fail);
 	if (!tl->thumb_path)
 		{
@@ -335,56 +393,38 @@ static void thumb_loader_std_save(ThumbLoaderStd *tl, GdkPixbuf *pixbuf)
 	DEBUG_1("thumb saving: %s", tl->fd->path);
 	DEBUG_1("       saved: %s", tl->thumb_path);
 
-	/* save thumb, using a temp file then renaming into place */
-	tmp_path = unique_filename(tl->thumb_path, ".tmp", "_", 2);
-	if (tmp_path)
+	if (!thumb_std_save_png(pixbuf, tl->thumb_path,
+				(tl->cache_local) ? tl->local_uri : tl->thumb_uri, tl->source_mtime,
+				(tl->cache_local) ? tl->source_mode : THUMB_PERMS_THUMB))
 		{
-		const gchar *mark_uri;
-		gchar *mark_app;
-		gchar *mark_mtime;
-		gchar *pathl;
-		gboolean success;
-
-		mark_uri = (tl->cache_local) ? tl->local_uri :tl->thumb_uri;
-
-		mark_app = g_strdup_printf("%s %s", GQ_APPNAME, VERSION);
-		mark_mtime = g_strdup_printf("%llu", (unsigned long long)tl->source_mtime);
-		pathl = path_from_utf8(tmp_path);
-		success = gdk_pixbuf_save(pixbuf, pathl, "png", NULL,
-					  THUMB_MARKER_URI, mark_uri,
-					  THUMB_MARKER_MTIME, mark_mtime,
-					  THUMB_MARKER_APP, mark_app,
-					  NULL);
-		if (success)
-			{
-			chmod(pathl, (tl->cache_local) ? tl->source_mode : THUMB_PERMS_THUMB);
-			success = rename_file(tmp_path, tl->thumb_path);
-			}
-
-		g_free(pathl);
+		DEBUG_1("thumb save failed: %s", tl->fd->path);
+		DEBUG_1("            thumb: %s", tl->thumb_path);
+		}
 
-		g_free(mark_mtime);
-		g_free(mark_app);
+	g_object_unref(G_OBJECT(pixbuf));
+}
 
-		g_free(tmp_path);
-		if (!success)
-			{
-			DEBUG_1("thumb save failed: %s", tl->fd->path);
-			DEBUG_1("            thumb: %s", tl->thumb_path);
-			}
+static void thumb_loader_std_save(ThumbLoaderStd *tl, GdkPixbuf *pixbuf)
+{
+	gint64 t = TRACE_BEGIN();
 
-		}
+	thumb_loader_std_save_real(tl, pixbuf);
+	TRACE_END(t, TRACE_THUMB, "thumb_loader_std_save");
+}
 
-	g_object_unref(G_OBJECT(pixbuf));
+/* ends the span from thumb_loader_std_start() to the result */
+static void thumb_loader_std_trace_end(ThumbLoaderStd *tl)
+{
+	TRACE_END(tl->trace_start, TRACE_THUMB, "thumb_loader_std");
+	tl->trace_start = 0;
 }
 
 static void thumb_loader_std_set_fallback(ThumbLoaderStd *tl)
 {
-	if (tl->fd->thumb_pixbuf) g_object_unref(tl->fd->thumb_pixbuf);
-	tl->fd->thumb_pixbuf = pixbuf_fallback(tl->fd, tl->requested_width, tl->requested_height);
+	file_data_set_thumb_pixbuf(tl->fd, pixbuf_fallback(tl->fd, tl->requested_width, tl->requested_height));
 }
 
-static GdkPixbuf *thumb_loader_std_finish(ThumbLoaderStd *tl, GdkPixbuf *pixbuf, gboolean shrunk)
+static GdkPixbuf *thumb_loader_std_finish_real(ThumbLoaderStd *tl, GdkPixbuf *pixbuf, gboolean shrunk)
 {
 	GdkPixbuf *pixbuf_thumb = NULL;
 	GdkPixbuf *result;
@@ -503,6 +543,17 @@ static GdkPixbuf *thumb_loader_std_finish(ThumbLoaderStd *tl, GdkPixbuf *pixbuf,
 	return result;
 }
 
+static GdkPixbuf *thumb_loader_std_finish(ThumbLoaderStd *tl, GdkPixbuf *pixbuf, gboolean shrunk)
+{
+	gint64 t = TRACE_BEGIN();
+	GdkPixbuf *result;
+
+	result = thumb_loader_std_finish_real(tl, pixbuf, shrunk);
+	TRACE_END(t, TRACE_SCALE, "thumb_loader_std_finish");
+
+	return result;
+}
+
 static gboolean thumb_loader_std_next_source(ThumbLoaderStd *tl, gboolean remove_broken)
 {
 	image_loader_free(tl->il);
@@ -571,12 +622,21 @@ static void thumb_loader_std_done_cb(ImageLoader *il, gpointer data)
 
 	tl->cache_hit = (tl->thumb_path != NULL);
 
+	/* copy thumbnails of the shared cache into the packed store as they are used,
+	   the pngs stay for the other programs using the shared cache */
+	if (tl->cache_hit && !tl->thumb_path_local && options->thumbnails.use_pack)
+		{
+		thumb_pack_store(tl->fd->path,
+				 thumb_std_pack_size(gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf)),
+				 tl->source_mtime, pixbuf);
+		}
+
 	if (tl->fd)
 		{
-		if (tl->fd->thumb_pixbuf) g_object_unref(tl->fd->thumb_pixbuf);
-		tl->fd->thumb_pixbuf = thumb_loader_std_finish(tl, pixbuf, image_loader_get_shrunk(il));
+		file_data_set_thumb_pixbuf(tl->fd, thumb_loader_std_finish(tl, pixbuf, image_loader_get_shrunk(il)));
 		}
 
+	thumb_loader_std_trace_end(tl);
 	if (tl->func_done) tl->func_done(tl, tl->data);
 }
 
@@ -598,6 +658,7 @@ static void thumb_loader_std_error_cb(ImageLoader *il, gpointer data)
 
 	thumb_loader_std_set_fallback(tl);
 
+	thumb_loader_std_trace_end(tl);
 	if (tl->func_error) tl->func_error(tl, tl->data);
 }
 
@@ -656,6 +717,17 @@ void thumb_loader_std_set_cache(ThumbLoaderStd *tl, gboolean enable_cache, gbool
 	tl->cache_retry = retry_failed;
 }
 
+static gboolean thumb_loader_std_pack_done_cb(gpointer data)
+{
+	ThumbLoaderStd *tl = data;
+
+	tl->idle_id = 0;
+	thumb_loader_std_trace_end(tl);
+	if (tl->func_done) tl->func_done(tl, tl->data);
+
+	return FALSE;
+}
+
 gboolean thumb_loader_std_start(ThumbLoaderStd *tl, FileData *fd)
 {
 	static gchar *thumb_cache = NULL;
@@ -664,7 +736,7 @@ gboolean thumb_loader_std_start(ThumbLoaderStd *tl, FileData *fd)
 	if (!tl || !fd) return FALSE;
 
 	thumb_loader_std_reset(tl);
-
+	tl->trace_start = TRACE_BEGIN();
 
 	tl->fd = file_data_ref(fd);
 	if (!stat_utf8(fd->path, &st) || (tl->fd->format_class != FORMAT_CLASS_IMAGE && tl->fd->format_class != FORMAT_CLASS_RAWIMAGE && tl->fd->format_class != FORMAT_CLASS_VIDEO && tl->fd->format_class != FORMAT_CLASS_COLLECTION && tl->fd->format_class != FORMAT_CLASS_DOCUMENT && !options->file_filter.disable))
@@ -691,6 +763,40 @@ gboolean thumb_loader_std_start(ThumbLoaderStd *tl, FileData *fd)
 		g_free(pathl);
 		}
 
+	if (tl->cache_enable && !tl->cache_local && options->thumbnails.use_pack)
+		{
+		GdkPixbuf *pixbuf;
+
+		pixbuf = thumb_pack_lookup(tl->fd->path,
+					   thumb_std_pack_size(tl->requested_width, tl->requested_height),
+					   tl->source_mtime);
+		if (pixbuf)
+			{
+			DEBUG_1("thumb packed: %s", tl->fd->path);
+
+			tl->cache_hit = TRUE;
+			file_data_set_thumb_pixbuf(tl->fd, thumb_loader_std_finish(tl, pixbuf, FALSE));
+			g_object_unref(pixbuf);
+
+			/* keep the asynchronous behaviour of the loader */
+			tl->idle_id = g_idle_add(thumb_loader_std_pack_done_cb, tl);
+			return TRUE;
+			}
+
+		if (!tl->cache_retry)
+			{
+			pixbuf = thumb_pack_lookup(tl->fd->path, THUMB_PACK_FAIL, tl->source_mtime);
+			if (pixbuf)
+				{
+				DEBUG_1("thumb pack fail valid: %s", tl->fd->path);
+				g_object_unref(pixbuf);
+				tl->cache_hit = TRUE;
+				thumb_loader_std_set_fallback(tl);
+				return FALSE;
+				}
+			}
+		}
+
 	if (tl->cache_enable)
 		{
 		gint found;
@@ -710,8 +816,15 @@ gboolean thumb_loader_std_start(ThumbLoaderStd *tl, FileData *fd)
 			file_data_unref(fd);
 			}
 
-		if (thumb_loader_std_fail_check(tl) ||
-		    !thumb_loader_std_next_source(tl, found))
+		if (thumb_loader_std_fail_check(tl))
+			{
+			/* the fail mark is a hit too, nothing is tried */
+			tl->cache_hit = TRUE;
+			thumb_loader_std_set_fallback(tl);
+			return FALSE;
+			}
+
+		if (!thumb_loader_std_next_source(tl, found))
 			{
 			thumb_loader_std_set_fallback(tl);
 			return FALSE;
@@ -909,6 +1022,92 @@ ThumbLoaderStd *thumb_loader_std_thumb_file_validate(const gchar *thumb_path, gi
 	return tv->tl;
 }
 
+/* text chunks larger than this are not thumbnail markers */
+#define THUMB_TEXT_CHUNK_MAX 4096
+
+/**
+ * \brief Validates a non local thumbnail file from its png text chunks
+ *
+ * Unlike thumb_loader_std_thumb_file_validate() the image data is not
+ * read. \a pathl is in the locale encoding, safe to call from any thread.
+ */
+gboolean thumb_std_thumb_file_check(const gchar *pathl, gint allowed_days)
+{
+	static const guchar png_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+	const gchar *key_uri = THUMB_MARKER_URI + strlen("tEXt::");
+	const gchar *key_mtime = THUMB_MARKER_MTIME + strlen("tEXt::");
+	gchar *uri = NULL;
+	gchar *mtime_str = NULL;
+	gboolean valid = FALSE;
+	guchar buf[8];
+	FILE *f;
+
+	f = fopen(pathl, "rb");
+	if (!f) return FALSE;
+
+	if (fread(buf, 1, sizeof(buf), f) == sizeof(buf) && memcmp(buf, png_signature, sizeof(buf)) == 0)
+		{
+		while ((!uri || !mtime_str) && fread(buf, 1, sizeof(buf), f) == sizeof(buf))
+			{
+			guint32 length = ((guint32)buf[0] << 24) | ((guint32)buf[1] << 16) | ((guint32)buf[2] << 8) | buf[3];
+
+			if (memcmp(buf + 4, "IDAT", 4) == 0 || memcmp(buf + 4, "IEND", 4) == 0) break;
+
+			if (memcmp(buf + 4, "tEXt", 4) == 0 && length < THUMB_TEXT_CHUNK_MAX)
+				{
+				gchar text[THUMB_TEXT_CHUNK_MAX + 1];
+				gsize key_len;
+
+				if (fread(text, 1, length, f) != length) break;
+				text[length] = '\0';
+
+				key_len = strlen(text);
+				if (key_len < length)
+					{
+					if (!uri && strcmp(text, key_uri) == 0) uri = g_strdup(text + key_len + 1);
+					if (!mtime_str && strcmp(text, key_mtime) == 0) mtime_str = g_strdup(text + key_len + 1);
+					}
+
+				/* skip the crc */
+				length = 0;
+				}
+
+			if (fseek(f, (glong)length + 4, SEEK_CUR) != 0) break;
+			}
+		}
+	fclose(f);
+
+	if (uri && mtime_str)
+		{
+		struct stat st;
+
+		if (strncmp(uri, "file:", strlen("file:")) == 0)
+			{
+			gchar *target;
+
+			target = g_filename_from_uri(uri, NULL, NULL);
+			if (target && stat(target, &st) == 0 &&
+			    st.st_mtime == strtol(mtime_str, NULL, 10))
+				{
+				valid = TRUE;
+				}
+			g_free(target);
+			}
+		else if (stat(pathl, &st) == 0)
+			{
+			if (st.st_atime >= time(NULL) - (time_t)allowed_days * 24 * 60 * 60)
+				{
+				valid = TRUE;
+				}
+			}
+		}
+
+	g_free(uri);
+	g_free(mtime_str);
+
+	return valid;
+}
+
 static void thumb_std_maint_remove_one(const gchar *source, const gchar *uri, gboolean local,
 				       const gchar *subfolder)
 {
@@ -1108,4 +1307,51 @@ void thumb_std_maint_moved(const gchar *source, const gchar *dest)
 		thumb_std_maint_move_tail = thumb_std_maint_move_list;
 		}
 }
+
+/**
+ * \brief Writes a thumbnail of the packed store to the shared cache
+ */
+gboolean thumb_std_pack_export(const gchar *source, ThumbPackSize size, time_t mtime, GdkPixbuf *pixbuf)
+{
+	const gchar *folder;
+	gchar *sourcel;
+	gchar *uri;
+	gchar *thumb_path;
+	gchar *base_path;
+	gboolean success = FALSE;
+
+	switch (size)
+		{
+		case THUMB_PACK_LARGE:
+			folder = THUMB_FOLDER_LARGE;
+			break;
+		case THUMB_PACK_FAIL:
+			folder = THUMB_FOLDER_FAIL;
+			break;
+		case THUMB_PACK_NORMAL:
+		default:
+			folder = THUMB_FOLDER_NORMAL;
+			break;
+		}
+
+	sourcel = path_from_utf8(source);
+	uri = g_filename_to_uri(sourcel, NULL, NULL);
+	g_free(sourcel);
+
+	thumb_path = thumb_std_cache_path(source, uri, FALSE, folder);
+	if (thumb_path)
+		{
+		base_path = remove_level_from_path(thumb_path);
+		recursive_mkdir_if_not_exists(base_path, THUMB_PERMS_FOLDER);
+		g_free(base_path);
+
+		DEBUG_1("thumb exported: %s", source);
+		success = thumb_std_save_png(pixbuf, thumb_path, uri, mtime, THUMB_PERMS_THUMB);
+		}
+
+	g_free(thumb_path);
+	g_free(uri);
+
+	return success;
+}
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
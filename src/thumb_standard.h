@@ -22,6 +22,8 @@
 #ifndef THUMB_STANDARD_H
 #define THUMB_STANDARD_H
 
+#include "thumb_pack.h"
+
 
 #if GLIB_CHECK_VERSION (2, 34, 0)
 #define THUMB_FOLDER_GLOBAL "thumbnails"
@@ -70,6 +72,10 @@ struct _ThumbLoaderStd
 	ThumbLoaderStdFunc func_progress;
 
 	gpointer data;
+
+	guint idle_id; /* event source id, result from the packed store */
+
+	gint64 trace_start;
 };
 
 
@@ -95,10 +101,14 @@ ThumbLoaderStd *thumb_loader_std_thumb_file_validate(const gchar *thumb_path, gi
 						     gpointer data);
 void thumb_loader_std_thumb_file_validate_cancel(ThumbLoaderStd *tl);
 
+gboolean thumb_std_thumb_file_check(const gchar *pathl, gint allowed_days);
+
 
 void thumb_std_maint_removed(const gchar *source);
 void thumb_std_maint_moved(const gchar *source, const gchar *dest);
 
+gboolean thumb_std_pack_export(const gchar *source, ThumbPackSize size, time_t mtime, GdkPixbuf *pixbuf);
+
 
 #endif
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ * \brief Timing of spans of work, for finding where time goes
+ *
+ * While tracing, each span ending with TRACE_END() is kept in a ring of
+ * the last TRACE_EVENTS_MAX spans and counted in a histogram per name.
+ * The ring is saved in the Chrome trace event format, which chrome://tracing
+ * and Perfetto show as a timeline per thread. The histograms give the
+ * summary, percentiles are the upper bound of their bucket.
+ *
+ * Spans may end in any thread.
+ */
+
+#include "main.h"
+#include "trace.h"
+
+#include "ui_fileops.h"
+
+#include <unistd.h>
+
+#define TRACE_EVENTS_MAX 65536
+
+/* bucket n holds durations of less than 2^n microseconds */
+#define TRACE_BUCKETS 32
+
+typedef struct _TraceEvent TraceEvent;
+struct _TraceEvent
+{
+	const gchar *category;
+	const gchar *name;
+	gint64 start;
+	gint64 duration;
+	guint tid;
+};
+
+typedef struct _TraceStat TraceStat;
+struct _TraceStat
+{
+	const gchar *category;
+	const gchar *name;
+	guint count;
+	gint64 total;
+	gint64 max;
+	guint buckets[TRACE_BUCKETS];
+};
+
+gint trace_enabled = FALSE;
+
+static GMutex trace_lock;
+static TraceEvent *trace_events = NULL;
+static guint64 trace_event_count = 0; /* since the start, the ring keeps the last ones */
+static gint64 trace_start_time = 0;
+static gint64 trace_stop_time = 0;
+static GHashTable *trace_stats = NULL; /* name -> TraceStat */
+static GHashTable *trace_threads = NULL; /* GThread -> tid */
+
+void trace_add(const gchar *category, const gchar *name, gint64 start)
+{
+	gint64 duration = g_get_monotonic_time() - start;
+	TraceEvent *event;
+	TraceStat *stat;
+	guint tid;
+	gint bucket;
+
+	g_mutex_lock(&trace_lock);
+
+	/* the span started before tracing was stopped */
+	if (!trace_enabled)
+		{
+		g_mutex_unlock(&trace_lock);
+		return;
+		}
+
+	tid = GPOINTER_TO_UINT(g_hash_table_lookup(trace_threads, g_thread_self()));
+	if (!tid)
+		{
+		tid = g_hash_table_size(trace_threads) + 1;
+		g_hash_table_insert(trace_threads, g_thread_self(), GUINT_TO_POINTER(tid));
+		}
+
+	event = &trace_events[trace_event_count % TRACE_EVENTS_MAX];
+	event->category = category;
+	event->name = name;
+	event->start = start;
+	event->duration = duration;
+	event->tid = tid;
+	trace_event_count++;
+
+	stat = g_hash_table_lookup(trace_stats, name);
+	if (!stat)
+		{
+		stat = g_new0(TraceStat, 1);
+		stat->category = category;
+		stat->name = name;
+		g_hash_table_insert(trace_stats, (gpointer)name, stat);
+		}
+
+	bucket = MIN(g_bit_storage(MAX(duration, 0)), TRACE_BUCKETS - 1);
+	stat->buckets[bucket]++;
+	stat->count++;
+	stat->total += duration;
+	if (duration > stat->max) stat->max = duration;
+
+	g_mutex_unlock(&trace_lock);
+}
+
+/**
+ * \brief Clears the data of the last trace and starts a new one
+ */
+void trace_start(void)
+{
+	g_mutex_lock(&trace_lock);
+
+	if (!trace_events) trace_events = g_new(TraceEvent, TRACE_EVENTS_MAX);
+	trace_event_count = 0;
+
+	if (trace_stats) g_hash_table_destroy(trace_stats);
+	trace_stats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+	if (trace_threads) g_hash_table_destroy(trace_threads);
+	trace_threads = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	trace_start_time = g_get_monotonic_time();
+	g_atomic_int_set(&trace_enabled, TRUE);
+
+	g_mutex_unlock(&trace_lock);
+
+	log_printf(_("Tracing started\n"));
+}
+
+/**
+ * \brief Stops tracing, the data is kept for trace_save() and trace_get_summary()
+ */
+void trace_stop(void)
+{
+	g_mutex_lock(&trace_lock);
+	if (trace_enabled) trace_stop_time = g_get_monotonic_time();
+	g_atomic_int_set(&trace_enabled, FALSE);
+	g_mutex_unlock(&trace_lock);
+}
+
+/**
+ * \brief Writes the spans in the Chrome trace event format
+ */
+gboolean trace_save(const gchar *path)
+{
+	GString *out;
+	GError *error = NULL;
+	gchar *pathl;
+	guint64 i;
+	guint64 first;
+	gint pid = getpid();
+	gboolean ret;
+
+	out = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	g_mutex_lock(&trace_lock);
+	first = (trace_event_count > TRACE_EVENTS_MAX) ? trace_event_count - TRACE_EVENTS_MAX : 0;
+	for (i = first; i < trace_event_count; i++)
+		{
+		TraceEvent *event = &trace_events[i % TRACE_EVENTS_MAX];
+
+		g_string_append_printf(out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%u}",
+				       (i == first) ? "" : ",\n", event->name, event->category,
+				       event->start - trace_start_time, event->duration, pid, event->tid);
+		}
+	g_mutex_unlock(&trace_lock);
+
+	g_string_append(out, "\n]}\n");
+
+	pathl = path_from_utf8(path);
+	ret = g_file_set_contents(pathl, out->str, out->len, &error);
+	if (!ret)
+		{
+		log_printf(_("Error writing trace to %s: %s\n"), path, error->message);
+		g_error_free(error);
+		}
+	g_free(pathl);
+	g_string_free(out, TRUE);
+
+	return ret;
+}
+
+static gdouble trace_stat_percentile(TraceStat *stat, gdouble fraction)
+{
+	guint want = (guint)(stat->count * fraction);
+	guint seen = 0;
+	gint i;
+
+	for (i = 0; i < TRACE_BUCKETS; i++)
+		{
+		seen += stat->buckets[i];
+		if (seen > want) break;
+		}
+
+	return MIN((gdouble)((gint64)1 << MIN(i, TRACE_BUCKETS - 1)), (gdouble)stat->max) / 1000.0;
+}
+
+static gint trace_stat_sort_cb(gconstpointer a, gconstpointer b)
+{
+	const TraceStat *sa = a;
+	const TraceStat *sb = b;
+
+	if (sa->total == sb->total) return 0;
+	return (sa->total > sb->total) ? -1 : 1;
+}
+
+/**
+ * \brief The count, time and duration histogram of each span, slowest first
+ * \returns Free with g_free()
+ */
+gchar *trace_get_summary(void)
+{
+	GString *out;
+	GList *stats;
+	GList *work;
+
+	out = g_string_new(NULL);
+
+	g_mutex_lock(&trace_lock);
+
+	if (!trace_stats)
+		{
+		g_mutex_unlock(&trace_lock);
+		return g_string_free(out, FALSE);
+		}
+
+	g_string_append_printf(out, "%" G_GUINT64_FORMAT " spans in %.1f s%s\n", trace_event_count,
+			       ((trace_enabled ? g_get_monotonic_time() : trace_stop_time) - trace_start_time) / 1000000.0,
+			       trace_event_count > TRACE_EVENTS_MAX ? ", the oldest are not saved" : "");
+	g_string_append_printf(out, "%-34s %8s %10s %8s %8s %8s %8s %8s\n",
+			       "span", "count", "total ms", "mean", "p50", "p90", "p99", "max");
+
+	stats = g_list_sort(g_hash_table_get_values(trace_stats), trace_stat_sort_cb);
+	for (work = stats; work; work = work->next)
+		{
+		TraceStat *stat = work->data;
+		gchar *label;
+		gint i;
+
+		label = g_strdup_printf("%s/%s", stat->category, stat->name);
+		g_string_append_printf(out, "%-34s %8u %10.1f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+				       label, stat->count, stat->total / 1000.0,
+				       stat->total / 1000.0 / stat->count,
+				       trace_stat_percentile(stat, 0.5),
+				       trace_stat_percentile(stat, 0.9),
+				       trace_stat_percentile(stat, 0.99),
+				       stat->max / 1000.0);
+		g_free(label);
+
+		/* the histogram, by the upper bound of each bucket */
+		g_string_append(out, "   ");
+		for (i = 0; i < TRACE_BUCKETS; i++)
+			{
+			if (!stat->buckets[i]) continue;
+			g_string_append_printf(out, " <%gms:%u", ((gint64)1 << i) / 1000.0, stat->buckets[i]);
+			}
+		g_string_append_c(out, '\n');
+		}
+	g_list_free(stats);
+
+	g_mutex_unlock(&trace_lock);
+
+	return g_string_free(out, FALSE);
+}
+
+/**
+ * \brief Stops tracing, saves the trace and logs the summary
+ * \param path NULL for trace.json in the configuration folder
+ */
+void trace_finish(const gchar *path)
+{
+	gchar *default_path = NULL;
+	gchar *summary;
+
+	trace_stop();
+
+	if (!path) path = default_path = g_build_filename(get_rc_dir(), "trace.json", NULL);
+
+	summary = trace_get_summary();
+	log_printf("%s", summary);
+	if (trace_save(path)) log_printf(_("Trace saved to %s\n"), path);
+
+	g_free(summary);
+	g_free(default_path);
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+/* categories of spans */
+#define TRACE_IO	"io"
+#define TRACE_DECODE	"decode"
+#define TRACE_COLOR	"color"
+#define TRACE_SCALE	"scale"
+#define TRACE_RENDER	"render"
+#define TRACE_THUMB	"thumb"
+#define TRACE_SCAN	"scan"
+#define TRACE_COMPARE	"compare"
+
+extern gint trace_enabled;
+
+/*
+ * A span, costs one load and a branch when tracing is off:
+ *
+ *	gint64 t = TRACE_BEGIN();
+ *	...
+ *	TRACE_END(t, TRACE_DECODE, "image_loader_begin");
+ *
+ * The category and name must be static strings.
+ */
+#define TRACE_BEGIN() (trace_enabled ? g_get_monotonic_time() : 0)
+#define TRACE_END(start, category, name) \
+	G_STMT_START { if (start) trace_add((category), (name), (start)); } G_STMT_END
+
+void trace_add(const gchar *category, const gchar *name, gint64 start);
+
+void trace_start(void);
+void trace_stop(void);
+gboolean trace_save(const gchar *path);
+gchar *trace_get_summary(void);
+void trace_finish(const gchar *path);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
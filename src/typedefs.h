@@ -187,7 +187,8 @@ typedef enum {
 	NOTIFY_METADATA		= 1 << 5, /* changed image metadata, not yet written */
 	NOTIFY_GROUPING		= 1 << 6, /* change in fd->sidecar_files or fd->parent */
 	NOTIFY_REREAD		= 1 << 7, /* changed file size, date, etc., file name remains unchanged */
-	NOTIFY_CHANGE		= 1 << 8  /* generic change described by fd->change */
+	NOTIFY_CHANGE		= 1 << 8, /* generic change described by fd->change */
+	NOTIFY_THUMBNAIL	= 1 << 9  /* fd->thumb_pixbuf was dropped for the memory budget */
 } NotifyType;
 
 typedef enum {
@@ -313,6 +314,7 @@ typedef struct _CollectWindow CollectWindow;
 typedef struct _ImageWindow ImageWindow;
 
 typedef struct _FileData FileData;
+typedef struct _FileDataCold FileDataCold;
 typedef struct _FileDataChangeInfo FileDataChangeInfo;
 
 typedef struct _LayoutWindow LayoutWindow;
@@ -562,6 +564,8 @@ struct _ImageWindow
 	FileData *read_ahead_fd;
 	ImageLoader *read_ahead_il;
 
+	gpointer region;	/* ImageRegion, huge images are decoded on demand by source tiles */
+
 	gint prev_color_row;
 
 	gboolean auto_refresh;
@@ -585,36 +589,56 @@ struct _FileDataChangeInfo {
 	gboolean regroup_when_finished;
 };
 
-struct _FileData {
-	guint magick;
-	gint type;
-	gchar *original_path; /* key to file_data_pool hash table */
-	gchar *path;
-	const gchar *name;
-	const gchar *extension;
+/* FileData fields that most files never use, allocated by file_data_cold() */
+struct _FileDataCold {
 	gchar *extended_extension;
-	FileFormatClass format_class;
-	gchar *collate_key_name;
+	gchar *collate_key_name; /* NULL until needed, see file_data_get_collate_key() */
 	gchar *collate_key_name_nocase;
+	gchar *sym_link; /* NULL until read by file_data_get_sym_link() */
+
+	HistMap *histmap;
+
+	GArray *cached_metadata; /* MetadataCacheEntry sorted by key, see metadata.c */
+	guint32 *keyword_bits; /* keywords as a bitset of keyword dictionary ids, see metadata.c */
+	gint keyword_bits_version; /* fd->version for which keyword_bits are valid */
+	gint keyword_bits_generation; /* keyword dictionary generation for which keyword_bits are valid */
+};
+
+/* pointer and 64 bit fields first, then the 32 bit ones, to avoid padding */
+struct _FileData {
+	gchar *original_path; /* key to file_data_pool hash table */
+	gchar *path; /* usually the same string as original_path */
+	const gchar *name; /* points into path */
+	const gchar *extension; /* points into path */
 	gint64 size;
 	time_t date;
 	time_t cdate;
-	mode_t mode; /* this is needed at least for notification in view_dir because it is preserved after the file/directory is deleted */
-	gint sidecar_priority;
-
-	guint marks; /* each bit represents one mark */
-	guint valid_marks; /* zero bit means that the corresponding mark needs to be reread */
-
 
 	GList *sidecar_files;
 	FileData *parent; /* parent file if this is a sidecar file, NULL otherwise */
 	FileDataChangeInfo *change; /* for rename, move ... */
+	FileDataCold *cold; /* NULL until one of its fields is needed */
 	GdkPixbuf *thumb_pixbuf;
+	GList *thumb_link; /* in the thumbnail LRU of filedata.c, NULL without thumb_pixbuf */
 
 	GdkPixbuf *pixbuf; /* full-size image, only complete images, NULL during loading
 			      all FileData with non-NULL pixbuf are referenced by image_cache */
 
-	HistMap *histmap;
+	ExifData *exif;
+	time_t exifdate;
+	time_t exifdate_digitized;
+	GHashTable *modified_xmp; // hash table which contains unwritten xmp metadata in format: key->list of string values
+
+	guint magick;
+	gint type;
+	FileFormatClass format_class;
+	mode_t mode; /* this is needed at least for notification in view_dir because it is preserved after the file/directory is deleted */
+	uid_t uid; /* owner and group names are looked up on demand */
+	gid_t gid;
+	gint sidecar_priority;
+
+	guint marks; /* each bit represents one mark */
+	guint valid_marks; /* zero bit means that the corresponding mark needs to be reread */
 
 	gboolean locked;
 	gint ref;
@@ -624,18 +648,9 @@ struct _FileData {
 	gint user_orientation;
 	gint exif_orientation;
 
-	ExifData *exif;
-	time_t exifdate;
-	time_t exifdate_digitized;
-	GHashTable *modified_xmp; // hash table which contains unwritten xmp metadata in format: key->list of string values
-	GList *cached_metadata;
 	gint rating;
 	gboolean metadata_in_idle_loaded;
 
-	gchar *owner;
-	gchar *group;
-	gchar *sym_link;
-
 	SelectionType selected;  // Used by view_file_icon.
 
 	gint page_num;
@@ -892,6 +907,7 @@ struct _ViewDirInfoTree
 {
 	guint drop_expand_id; /* event source id */
 	gint busy_ref;
+	GList *read_jobs; /* folders being read in a thread */
 };
 
 
@@ -936,6 +952,7 @@ struct _ViewFile
 	gboolean thumbs_running;
 	ThumbLoader *thumbs_loader;
 	FileData *thumbs_filedata;
+	guint thumbs_idle_id; /* event source id */
 
 	/* marks */
 	gboolean marks_enabled;
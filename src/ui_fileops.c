@@ -23,6 +23,10 @@
 #  include "config.h"
 #endif
 
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE /* for copy_file_range() */
+#endif
+
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,7 +34,15 @@
 #include <unistd.h>
 #include <sys/param.h>
 #include <dirent.h>
+#include <errno.h>
 #include <utime.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#if defined(HAVE_SENDFILE) && defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 #include <glib.h>
 #include <gtk/gtk.h>	/* for locale warning dialog */
@@ -545,15 +557,121 @@ static gboolean hard_linked(const gchar *a, const gchar *b)
 		sta.st_ino == stb.st_ino);
 }
 
-gboolean copy_file(const gchar *s, const gchar *t)
+/* bytes per kernel copy call, also how often progress and cancellation are checked */
+#define COPY_FILE_CHUNK (8 * 1024 * 1024)
+#define COPY_FILE_BUFFER (1024 * 1024)
+
+enum {
+	COPY_METHOD_COPY_FILE_RANGE,
+	COPY_METHOD_SENDFILE,
+	COPY_METHOD_READ_WRITE
+};
+
+/* errors meaning the method is not available for this pair of files */
+static gboolean copy_method_unsupported(gint err)
+{
+	return (err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == EBADF);
+}
+
+/**
+ * \brief Copies the contents of fi to fo
+ *
+ * A reflink is tried first, it shares the blocks on filesystems that
+ * support it. Otherwise the data is copied in the kernel with
+ * copy_file_range() or sendfile(), falling back to read()/write().
+ */
+static gboolean copy_file_data(gint fi, gint fo, GCancellable *cancellable,
+			       CopyFileProgressFunc func, gpointer data)
 {
-	FILE *fi = NULL;
-	FILE *fo = NULL;
+	guchar *buf = NULL;
+	gint64 total = 0;
+	gint method = COPY_METHOD_COPY_FILE_RANGE;
+	gboolean ret = FALSE;
+
+#ifdef FICLONE
+	if (ioctl(fo, FICLONE, fi) == 0)
+		{
+		struct stat st;
+
+		if (func && fstat(fi, &st) == 0) func(st.st_size, data);
+		return TRUE;
+		}
+#endif
+
+	while (TRUE)
+		{
+		gssize b = -1;
+
+		if (cancellable && g_cancellable_is_cancelled(cancellable)) goto end;
+
+		switch (method)
+			{
+			case COPY_METHOD_COPY_FILE_RANGE:
+#ifdef HAVE_COPY_FILE_RANGE
+				b = copy_file_range(fi, NULL, fo, NULL, COPY_FILE_CHUNK, 0);
+#else
+				errno = ENOSYS;
+#endif
+				break;
+			case COPY_METHOD_SENDFILE:
+#if defined(HAVE_SENDFILE) && defined(__linux__)
+				b = sendfile(fo, fi, NULL, COPY_FILE_CHUNK);
+#else
+				errno = ENOSYS;
+#endif
+				break;
+			default:
+				if (!buf) buf = g_malloc(COPY_FILE_BUFFER);
+				b = read(fi, buf, COPY_FILE_BUFFER);
+				if (b > 0)
+					{
+					gssize w = 0;
+
+					while (w < b)
+						{
+						gssize n = write(fo, buf + w, b - w);
+
+						if (n < 0)
+							{
+							if (errno == EINTR) continue;
+							goto end;
+							}
+						w += n;
+						}
+					}
+				break;
+			}
+
+		if (b < 0)
+			{
+			if (errno == EINTR) continue;
+			if (total == 0 && method != COPY_METHOD_READ_WRITE && copy_method_unsupported(errno))
+				{
+				method++;
+				continue;
+				}
+			goto end;
+			}
+		if (b == 0) break;
+
+		total += b;
+		if (func) func(b, data);
+		}
+
+	ret = TRUE;
+
+end:
+	g_free(buf);
+	return ret;
+}
+
+gboolean copy_file_full(const gchar *s, const gchar *t, GCancellable *cancellable,
+			CopyFileProgressFunc func, gpointer data)
+{
+	gint fi = -1;
 	gchar *sl = NULL;
 	gchar *tl = NULL;
 	gchar *randname = NULL;
-	gchar buf[16384];
-	size_t b;
 	gint ret = FALSE;
 	gint fd = -1;
 
@@ -628,8 +746,8 @@ gboolean copy_file(const gchar *s, const gchar *t)
 		} // if symlink did not succeed, continue on to try a copy procedure
 	orig_copy:
 
-	fi = fopen(sl, "rb");
-	if (!fi) goto end;
+	fi = open(sl, O_RDONLY);
+	if (fi == -1) goto end;
 
 	/* First we write to a temporary file, then we rename it on success,
 	   and attributes from original file are copied */
@@ -639,23 +757,20 @@ gboolean copy_file(const gchar *s, const gchar *t)
 	fd = g_mkstemp(randname);
 	if (fd == -1) goto end;
 
-	fo = fdopen(fd, "wb");
-	if (!fo) {
-		close(fd);
+	if (!copy_file_data(fi, fd, cancellable, func, data))
+		{
+		unlink(randname);
 		goto end;
-	}
+		}
 
-	while ((b = fread(buf, sizeof(gchar), sizeof(buf), fi)) && b != 0)
+	close(fi); fi = -1;
+	if (close(fd) < 0)
 		{
-		if (fwrite(buf, sizeof(gchar), b, fo) != b)
-			{
-			unlink(randname);
-			goto end;
-			}
+		fd = -1;
+		unlink(randname);
+		goto end;
 		}
-
-	fclose(fi); fi = NULL;
-	fclose(fo); fo = NULL;
+	fd = -1;
 
 	if (rename(randname, tl) < 0) {
 		unlink(randname);
@@ -665,15 +780,21 @@ gboolean copy_file(const gchar *s, const gchar *t)
 	ret = copy_file_attributes(s, t, TRUE, TRUE);
 
 end:
-	if (fi) fclose(fi);
-	if (fo) fclose(fo);
+	if (fi != -1) close(fi);
+	if (fd != -1) close(fd);
 	if (sl) g_free(sl);
 	if (tl) g_free(tl);
 	if (randname) g_free(randname);
 	return ret;
 }
 
-gboolean move_file(const gchar *s, const gchar *t)
+gboolean copy_file(const gchar *s, const gchar *t)
+{
+	return copy_file_full(s, t, NULL, NULL, NULL);
+}
+
+gboolean move_file_full(const gchar *s, const gchar *t, GCancellable *cancellable,
+			CopyFileProgressFunc func, gpointer data)
 {
 	gchar *sl, *tl;
 	gboolean ret = TRUE;
@@ -686,7 +807,7 @@ gboolean move_file(const gchar *s, const gchar *t)
 		{
 		/* this may have failed because moving a file across filesystems
 		was attempted, so try copy and delete instead */
-		if (copy_file(s, t))
+		if (copy_file_full(s, t, cancellable, func, data))
 			{
 			if (unlink(sl) < 0)
 				{
@@ -705,6 +826,11 @@ gboolean move_file(const gchar *s, const gchar *t)
 	return ret;
 }
 
+gboolean move_file(const gchar *s, const gchar *t)
+{
+	return move_file_full(s, t, NULL, NULL, NULL);
+}
+
 gboolean rename_file(const gchar *s, const gchar *t)
 {
 	gchar *sl, *tl;
@@ -77,6 +77,15 @@ gboolean rmdir_utf8(const gchar *s);
 gboolean copy_file_attributes(const gchar *s, const gchar *t, gint perms, gint mtime);
 gboolean copy_file(const gchar *s, const gchar *t);
 gboolean move_file(const gchar *s, const gchar *t);
+
+/* called with the number of bytes copied since the previous call,
+ * from the thread doing the copy */
+typedef void (* CopyFileProgressFunc)(gint64 bytes, gpointer data);
+
+gboolean copy_file_full(const gchar *s, const gchar *t, GCancellable *cancellable,
+			CopyFileProgressFunc func, gpointer data);
+gboolean move_file_full(const gchar *s, const gchar *t, GCancellable *cancellable,
+			CopyFileProgressFunc func, gpointer data);
 gboolean rename_file(const gchar *s, const gchar *t);
 gchar *get_current_dir(void);
 
@@ -275,6 +275,7 @@ struct _UtilityDataMessages {
 };
 
 typedef struct _UtilityData UtilityData;
+typedef struct _FileUtilCopy FileUtilCopy;
 
 struct _UtilityData {
 	UtilityType type;
@@ -293,6 +294,10 @@ struct _UtilityData {
 	guint update_idle_id; /* event source id */
 	guint perform_idle_id; /* event source id */
 
+	gint perform_pending; /* number of files processed in background threads */
+	GList *perform_failed; /* files which failed in background threads */
+	FileUtilCopy *copy; /* copy or move running in background threads */
+
 	gboolean with_sidecars; /* operate on grouped or single files; TRUE = use file_data_sc_, FALSE = use file_data_ functions */
 
 	/* alternative dialog parts */
@@ -650,10 +655,476 @@ static gint file_util_perform_ci_cb(gpointer resume_data, EditorFlags flags, GLi
  */
 
 
+static void file_util_perform_ci_metadata_done_cb(FileData *fd, gboolean success, gpointer data)
+{
+	UtilityData *ud = data;
+
+	ud->perform_pending--;
+
+	if (success)
+		{
+		GList *single_entry = g_list_append(NULL, fd);
+
+		file_util_perform_ci_cb(GINT_TO_POINTER(1), 0, single_entry, ud);
+		g_list_free(single_entry);
+		}
+	else
+		{
+		ud->perform_failed = g_list_append(ud->perform_failed, fd);
+		}
+
+	if (ud->perform_pending == 0)
+		{
+		/* report all failures in one dialog, the threads can't be suspended */
+		GList *failed = ud->perform_failed;
+
+		ud->perform_failed = NULL;
+		file_util_perform_ci_cb(NULL, failed ? EDITOR_ERROR_STATUS : 0, failed, ud);
+		g_list_free(failed);
+		}
+}
+
+/* metadata of all files are written at once by metadata_write_perform_async */
+static void file_util_perform_ci_metadata(UtilityData *ud)
+{
+	GList *work;
+	GList *list;
+
+	list = g_list_copy(ud->flist);
+	ud->perform_pending = g_list_length(list);
+
+	work = list;
+	while (work)
+		{
+		FileData *fd = work->data;
+		work = work->next;
+
+		/* ud can be freed by the last callback, do not touch it afterwards */
+		metadata_write_perform_async(fd, file_util_perform_ci_metadata_done_cb, ud);
+		}
+	g_list_free(list);
+}
+
+#ifdef HAVE_GTHREAD
+/*
+ *--------------------------------------------------------------------------
+ * copy and move in background threads
+ *--------------------------------------------------------------------------
+ */
+
+/* files copied or moved at the same time to one destination device */
+#define FILE_UTIL_COPY_PER_DEVICE 4
+
+/* the progress dialog is shown only for operations taking longer than this, in ms */
+#define FILE_UTIL_COPY_DIALOG_DELAY 1000
+#define FILE_UTIL_COPY_UPDATE_INTERVAL 500
+
+typedef struct _FileUtilCopyJob FileUtilCopyJob;
+struct _FileUtilCopyJob {
+	UtilityData *ud;
+	FileData *fd;
+
+	/* sidecars first, the same order as file_data_sc_perform_ci() */
+	GList *sources;
+	GList *dests;
+	gboolean move;
+
+	dev_t device;
+	gint64 size;
+	gint64 reported; /* bytes added to the progress so far, worker thread only */
+	gboolean success;
+};
+
+struct _FileUtilCopy {
+	GQueue *queue; /* jobs waiting for a free slot on their device */
+	GList *running;
+	GCancellable *cancellable;
+
+	GMutex lock; /* protects bytes_done */
+	gint64 bytes_done;
+	gint64 bytes_total;
+	gint files_done;
+	gint files_total;
+	gint64 start_time;
+
+	guint timer_id; /* event source id */
+	GenericDialog *gd;
+	GtkWidget *progress;
+	GtkWidget *label;
+
+	GList *skipped;
+};
+
+static GThreadPool *file_util_copy_thread_pool = NULL;
+
+static void file_util_copy_job_free(FileUtilCopyJob *job)
+{
+	string_list_free(job->sources);
+	string_list_free(job->dests);
+	g_free(job);
+}
+
+static void file_util_copy_progress_cb(gint64 bytes, gpointer data)
+{
+	FileUtilCopyJob *job = data;
+	FileUtilCopy *copy = job->ud->copy;
+
+	job->reported += bytes;
+
+	g_mutex_lock(&copy->lock);
+	copy->bytes_done += bytes;
+	g_mutex_unlock(&copy->lock);
+}
+
+static gboolean file_util_copy_job_done_cb(gpointer data);
+
+static void file_util_copy_thread_run(gpointer data, gpointer user_data)
+{
+	FileUtilCopyJob *job = data;
+	FileUtilCopy *copy = job->ud->copy;
+	GList *work_s = job->sources;
+	GList *work_d = job->dests;
+
+	job->success = TRUE;
+	while (work_s && work_d)
+		{
+		const gchar *source = work_s->data;
+		const gchar *dest = work_d->data;
+
+		if (!(job->move ? move_file_full(source, dest, copy->cancellable, file_util_copy_progress_cb, job)
+				: copy_file_full(source, dest, copy->cancellable, file_util_copy_progress_cb, job)))
+			{
+			job->success = FALSE;
+			}
+
+		work_s = work_s->next;
+		work_d = work_d->next;
+		}
+
+	/* renames and reflinks do not report the bytes as they go */
+	if (job->success && job->reported < job->size)
+		{
+		file_util_copy_progress_cb(job->size - job->reported, job);
+		}
+
+	g_idle_add(file_util_copy_job_done_cb, job);
+}
+
+static gint file_util_copy_device_running(FileUtilCopy *copy, dev_t device)
+{
+	GList *work;
+	gint n = 0;
+
+	for (work = copy->running; work; work = work->next)
+		{
+		FileUtilCopyJob *job = work->data;
+
+		if (job->device == device) n++;
+		}
+
+	return n;
+}
+
+static void file_util_copy_schedule(UtilityData *ud)
+{
+	FileUtilCopy *copy = ud->copy;
+	GList *work;
+
+	if (g_cancellable_is_cancelled(copy->cancellable))
+		{
+		FileUtilCopyJob *job;
+
+		while ((job = g_queue_pop_head(copy->queue)))
+			{
+			copy->skipped = g_list_append(copy->skipped, job->fd);
+			file_util_copy_job_free(job);
+			}
+		return;
+		}
+
+	work = copy->queue->head;
+	while (work)
+		{
+		FileUtilCopyJob *job = work->data;
+		GList *next = work->next;
+
+		if (file_util_copy_device_running(copy, job->device) < FILE_UTIL_COPY_PER_DEVICE)
+			{
+			g_queue_delete_link(copy->queue, work);
+			copy->running = g_list_prepend(copy->running, job);
+			g_thread_pool_push(file_util_copy_thread_pool, job, NULL);
+			}
+		work = next;
+		}
+}
+
+static void file_util_copy_cancel_cb(GenericDialog *gd, gpointer data)
+{
+	UtilityData *ud = data;
+
+	/* the dialog closes itself */
+	ud->copy->gd = NULL;
+	g_cancellable_cancel(ud->copy->cancellable);
+	file_util_copy_schedule(ud);
+}
+
+static void file_util_copy_dialog_update(UtilityData *ud)
+{
+	FileUtilCopy *copy = ud->copy;
+	gint64 bytes_done;
+	gint64 elapsed;
+	gchar *done_text;
+	gchar *total_text;
+	gchar *rate_text = NULL;
+	gchar *text;
+	gdouble rate = 0;
+
+	g_mutex_lock(&copy->lock);
+	bytes_done = copy->bytes_done;
+	g_mutex_unlock(&copy->lock);
+
+	elapsed = g_get_monotonic_time() - copy->start_time;
+	if (elapsed > 0) rate = (gdouble)bytes_done * G_USEC_PER_SEC / elapsed;
+
+	done_text = text_from_size_abrev(bytes_done);
+	total_text = text_from_size_abrev(copy->bytes_total);
+
+	if (rate > 0 && bytes_done < copy->bytes_total)
+		{
+		gchar *speed = text_from_size_abrev((gint64)rate);
+		gint64 left = (gint64)((copy->bytes_total - bytes_done) / rate);
+
+		rate_text = g_strdup_printf(_("%s/s, about %d:%02d left"), speed, (gint)(left / 60), (gint)(left % 60));
+		g_free(speed);
+		}
+
+	text = g_strdup_printf(_("%d of %d files\n%s of %s\n%s"), copy->files_done, copy->files_total,
+			       done_text, total_text, rate_text ? rate_text : "");
+	gtk_label_set_text(GTK_LABEL(copy->label), text);
+
+	if (copy->bytes_total > 0)
+		{
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(copy->progress),
+					      CLAMP((gdouble)bytes_done / copy->bytes_total, 0.0, 1.0));
+		}
+
+	g_free(text);
+	g_free(rate_text);
+	g_free(done_text);
+	g_free(total_text);
+}
+
+static gboolean file_util_copy_timer_cb(gpointer data)
+{
+	UtilityData *ud = data;
+	FileUtilCopy *copy = ud->copy;
+
+	if (g_cancellable_is_cancelled(copy->cancellable)) return TRUE;
+
+	if (!copy->gd)
+		{
+		copy->gd = file_util_gen_dlg(ud->messages.title, "dlg_progress",
+					     ud->parent, TRUE, file_util_copy_cancel_cb, ud);
+		copy->label = gtk_label_new("");
+		gtk_label_set_justify(GTK_LABEL(copy->label), GTK_JUSTIFY_LEFT);
+		gtk_misc_set_alignment(GTK_MISC(copy->label), 0.0, 0.5);
+		gtk_box_pack_start(GTK_BOX(copy->gd->vbox), copy->label, FALSE, FALSE, 0);
+		gtk_widget_show(copy->label);
+
+		copy->progress = gtk_progress_bar_new();
+		gtk_box_pack_start(GTK_BOX(copy->gd->vbox), copy->progress, FALSE, FALSE, 0);
+		gtk_widget_show(copy->progress);
+
+		gtk_widget_show(copy->gd->dialog);
+
+		file_util_copy_dialog_update(ud);
+
+		/* from now on update more often */
+		copy->timer_id = g_timeout_add(FILE_UTIL_COPY_UPDATE_INTERVAL, file_util_copy_timer_cb, ud);
+		return FALSE;
+		}
+
+	file_util_copy_dialog_update(ud);
+
+	return TRUE;
+}
+
+static void file_util_copy_finish(UtilityData *ud)
+{
+	FileUtilCopy *copy = ud->copy;
+	GList *failed;
+	GList *skipped;
+
+	DEBUG_1("file operation finished: %d files, %" G_GINT64_FORMAT " bytes in %" G_GINT64_FORMAT " ms",
+		copy->files_done, copy->bytes_done, (g_get_monotonic_time() - copy->start_time) / 1000);
+
+	if (copy->timer_id) g_source_remove(copy->timer_id);
+	if (copy->gd) generic_dialog_close(copy->gd);
+	g_object_unref(copy->cancellable);
+	g_queue_free(copy->queue);
+	g_mutex_clear(&copy->lock);
+	skipped = copy->skipped;
+	g_free(copy);
+	ud->copy = NULL;
+
+	if (skipped)
+		{
+		file_util_perform_ci_cb(GINT_TO_POINTER(1), EDITOR_ERROR_SKIPPED, skipped, ud);
+		g_list_free(skipped);
+		}
+
+	/* report all failures in one dialog, the threads can't be suspended */
+	failed = ud->perform_failed;
+	ud->perform_failed = NULL;
+	file_util_perform_ci_cb(NULL, failed ? EDITOR_ERROR_STATUS : 0, failed, ud);
+	g_list_free(failed);
+}
+
+static gboolean file_util_copy_job_done_cb(gpointer data)
+{
+	FileUtilCopyJob *job = data;
+	UtilityData *ud = job->ud;
+	FileUtilCopy *copy = ud->copy;
+
+	copy->running = g_list_remove(copy->running, job);
+	copy->files_done++;
+
+	if (job->success)
+		{
+		GList *single_entry = g_list_append(NULL, job->fd);
+
+		file_util_perform_ci_cb(GINT_TO_POINTER(1), 0, single_entry, ud);
+		g_list_free(single_entry);
+		}
+	else if (g_cancellable_is_cancelled(copy->cancellable))
+		{
+		copy->skipped = g_list_append(copy->skipped, job->fd);
+		}
+	else
+		{
+		ud->perform_failed = g_list_append(ud->perform_failed, job->fd);
+		}
+
+	file_util_copy_job_free(job);
+
+	file_util_copy_schedule(ud);
+	if (!copy->running && g_queue_is_empty(copy->queue)) file_util_copy_finish(ud);
+
+	return FALSE;
+}
+
+static void file_util_copy_job_add_path(FileUtilCopyJob *job, FileData *fd)
+{
+	job->sources = g_list_append(job->sources, g_strdup(fd->change->source));
+	job->dests = g_list_append(job->dests, g_strdup(fd->change->dest));
+	job->size += fd->size;
+}
+
+/**
+ * \brief Copies or moves the files of ud in a thread pool
+ *
+ * Several files are in flight per destination device, the rest wait in
+ * a queue. The results are passed to file_util_perform_ci_cb() as they
+ * come, failures are collected and reported at the end.
+ */
+static void file_util_perform_ci_copy(UtilityData *ud)
+{
+	FileUtilCopy *copy;
+	GList *work;
+	gchar *last_dir = NULL;
+	dev_t last_device = 0;
+
+	copy = g_new0(FileUtilCopy, 1);
+	copy->queue = g_queue_new();
+	copy->cancellable = g_cancellable_new();
+	g_mutex_init(&copy->lock);
+	copy->start_time = g_get_monotonic_time();
+	ud->copy = copy;
+
+	if (!file_util_copy_thread_pool)
+		{
+		file_util_copy_thread_pool = g_thread_pool_new(file_util_copy_thread_run, NULL,
+							       FILE_UTIL_COPY_PER_DEVICE * 2, FALSE, NULL);
+		}
+
+	work = ud->flist;
+	while (work)
+		{
+		FileData *fd = work->data;
+		FileUtilCopyJob *job;
+		gchar *dir;
+
+		work = work->next;
+
+		if (ud->with_sidecars && !file_data_sc_check_ci(fd, fd->change->type))
+			{
+			ud->perform_failed = g_list_append(ud->perform_failed, fd);
+			continue;
+			}
+
+		job = g_new0(FileUtilCopyJob, 1);
+		job->ud = ud;
+		job->fd = fd;
+		job->move = (fd->change->type == FILEDATA_CHANGE_MOVE);
+
+		if (ud->with_sidecars)
+			{
+			GList *sc;
+
+			for (sc = fd->sidecar_files; sc; sc = sc->next)
+				{
+				file_util_copy_job_add_path(job, sc->data);
+				}
+			}
+		file_util_copy_job_add_path(job, fd);
+
+		dir = remove_level_from_path(fd->change->dest);
+		if (g_strcmp0(dir, last_dir) != 0)
+			{
+			struct stat st;
+
+			last_device = stat_utf8(dir, &st) ? st.st_dev : 0;
+			g_free(last_dir);
+			last_dir = dir;
+			}
+		else
+			{
+			g_free(dir);
+			}
+		job->device = last_device;
+
+		copy->bytes_total += job->size;
+		copy->files_total++;
+		g_queue_push_tail(copy->queue, job);
+		}
+	g_free(last_dir);
+
+	copy->timer_id = g_timeout_add(FILE_UTIL_COPY_DIALOG_DELAY, file_util_copy_timer_cb, ud);
+
+	file_util_copy_schedule(ud);
+	if (!copy->running && g_queue_is_empty(copy->queue)) file_util_copy_finish(ud);
+}
+#endif /* HAVE_GTHREAD */
+
 static gboolean file_util_perform_ci_internal(gpointer data)
 {
 	UtilityData *ud = data;
 
+	if (ud->type == UTILITY_TYPE_WRITE_METADATA && !ud->with_sidecars)
+		{
+		file_util_perform_ci_metadata(ud);
+		return FALSE;
+		}
+
+#ifdef HAVE_GTHREAD
+	if (ud->type == UTILITY_TYPE_COPY || ud->type == UTILITY_TYPE_MOVE)
+		{
+		/* ud can be freed by the last callback, do not touch it afterwards */
+		file_util_perform_ci_copy(ud);
+		return FALSE;
+		}
+#endif
+
 	if (!ud->perform_idle_id)
 		{
 		/* this function was called directly
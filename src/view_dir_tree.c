@@ -23,12 +23,14 @@
 #include "view_dir_tree.h"
 
 
+#include "cache.h"
 #include "dnd.h"
 #include "dupe.h"
 #include "filedata.h"
 #include "layout.h"
 #include "layout_image.h"
 #include "layout_util.h"
+#include "thumb_standard.h"
 #include "utilops.h"
 #include "ui_fileops.h"
 #include "ui_menu.h"
@@ -36,6 +38,9 @@
 #include "view_dir.h"
 
 #include <gdk/gdkkeysyms.h> /* for keyboard values */
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
 
 
 #define VDTREE(_vd_) ((ViewDirInfoTree *)(_vd_->info))
@@ -336,22 +341,6 @@ static GList *parts_list_add_node_points(ViewDir *vd, GList *list)
  *----------------------------------------------------------------------------
  */
 
-static gboolean vdtree_find_iter_by_data(ViewDir *vd, GtkTreeIter *parent, NodeData *nd, GtkTreeIter *iter)
-{
-	GtkTreeModel *store;
-
-	store = gtk_tree_view_get_model(GTK_TREE_VIEW(vd->view));
-	if (!nd || !gtk_tree_model_iter_children(store, iter, parent)) return -1;
-	do	{
-		NodeData *cnd;
-
-		gtk_tree_model_get(store, iter, DIR_COLUMN_POINTER, &cnd, -1);
-		if (cnd == nd) return TRUE;
-		} while (gtk_tree_model_iter_next(store, iter));
-
-	return FALSE;
-}
-
 static NodeData *vdtree_find_iter_by_name(ViewDir *vd, GtkTreeIter *parent, const gchar *name, GtkTreeIter *iter)
 {
 	GtkTreeModel *store;
@@ -368,30 +357,362 @@ static NodeData *vdtree_find_iter_by_name(ViewDir *vd, GtkTreeIter *parent, cons
 	return NULL;
 }
 
-static NodeData *vdtree_find_iter_by_fd(ViewDir *vd, GtkTreeIter *parent, FileData *fd, GtkTreeIter *iter)
+/*
+ *----------------------------------------------------------------------------
+ * folder reading
+ *----------------------------------------------------------------------------
+ */
+
+/* folders whose subfolder list is kept */
+#define VDTREE_LISTING_CACHE_MAX 256
+
+/* folders read at the same time, they are often on network shares */
+#define VDTREE_READ_THREADS 4
+
+/* more subfolders than this are added unsorted and sorted once */
+#define VDTREE_SORT_BATCH 64
+
+#ifdef __linux__
+/* file systems known to count the subfolders of a folder in st_nlink */
+static const long vdtree_nlink_fs_types[] = {
+	0xEF53,		/* ext2/3/4 */
+	0x58465342,	/* xfs */
+	0x01021994,	/* tmpfs */
+	0xF2F52010,	/* f2fs */
+	0x3153464a,	/* jfs */
+	0x52654973,	/* reiserfs */
+	0
+};
+#endif
+
+typedef struct _VdtreeEntry VdtreeEntry;
+struct _VdtreeEntry
 {
-	GtkTreeModel *store;
+	gchar *name; /* locale encoded */
+	struct stat st;
+};
 
-	store = gtk_tree_view_get_model(GTK_TREE_VIEW(vd->view));
-	if (!fd || !gtk_tree_model_iter_children(store, iter, parent)) return NULL;
-	do	{
-		NodeData *nd;
+typedef struct _VdtreeChild VdtreeChild;
+struct _VdtreeChild
+{
+	FileData *fd;
+	gboolean has_children; /* FALSE if known to have no subfolders */
+};
 
-		gtk_tree_model_get(store, iter, DIR_COLUMN_POINTER, &nd, -1);
-		if (nd && nd->fd == fd) return nd;
-		} while (gtk_tree_model_iter_next(store, iter));
+typedef struct _VdtreeListing VdtreeListing;
+struct _VdtreeListing
+{
+	gchar *path; /* key */
+	time_t mtime; /* of the folder when it was read */
+	gboolean show_hidden;
+	GArray *children; /* VdtreeChild */
+};
 
-	return NULL;
+static GHashTable *vdtree_listing_cache = NULL;
+static GQueue vdtree_listing_order = G_QUEUE_INIT; /* oldest first */
+
+static void vdtree_listing_free(VdtreeListing *vl)
+{
+	guint i;
+
+	for (i = 0; i < vl->children->len; i++)
+		{
+		file_data_unref(g_array_index(vl->children, VdtreeChild, i).fd);
+		}
+	g_array_free(vl->children, TRUE);
+	g_free(vl->path);
+	g_free(vl);
+}
+
+static void vdtree_listing_cache_remove(const gchar *path)
+{
+	VdtreeListing *vl;
+
+	if (!vdtree_listing_cache) return;
+
+	vl = g_hash_table_lookup(vdtree_listing_cache, path);
+	if (!vl) return;
+
+	g_hash_table_remove(vdtree_listing_cache, path);
+	g_queue_remove(&vdtree_listing_order, vl);
+	vdtree_listing_free(vl);
+}
+
+static void vdtree_listing_cache_add(VdtreeListing *vl)
+{
+	if (!vdtree_listing_cache) vdtree_listing_cache = g_hash_table_new(g_str_hash, g_str_equal);
+
+	vdtree_listing_cache_remove(vl->path);
+
+	while (g_queue_get_length(&vdtree_listing_order) >= VDTREE_LISTING_CACHE_MAX)
+		{
+		VdtreeListing *old = g_queue_pop_head(&vdtree_listing_order);
+
+		g_hash_table_remove(vdtree_listing_cache, old->path);
+		vdtree_listing_free(old);
+		}
+
+	g_hash_table_insert(vdtree_listing_cache, vl->path, vl);
+	g_queue_push_tail(&vdtree_listing_order, vl);
+}
+
+/* returns the cached listing if the folder did not change since it was read */
+static VdtreeListing *vdtree_listing_cache_get(FileData *dir_fd)
+{
+	VdtreeListing *vl;
+	struct stat st;
+
+	if (!vdtree_listing_cache) return NULL;
+
+	vl = g_hash_table_lookup(vdtree_listing_cache, dir_fd->path);
+	if (!vl) return NULL;
+
+	if (vl->show_hidden != options->file_filter.show_hidden_files ||
+	    !stat_utf8(dir_fd->path, &st) || st.st_mtime != vl->mtime)
+		{
+		vdtree_listing_cache_remove(dir_fd->path);
+		return NULL;
+		}
+
+	return vl;
+}
+
+static void vdtree_entries_free(GArray *entries)
+{
+	guint i;
+
+	if (!entries) return;
+
+	for (i = 0; i < entries->len; i++)
+		{
+		g_free(g_array_index(entries, VdtreeEntry, i).name);
+		}
+	g_array_free(entries, TRUE);
+}
+
+/**
+ * \brief Reads the subfolders of a folder, safe to call from any thread
+ * \param pathl Locale encoded
+ * \param nlink_valid Set if st_nlink of subfolders on the same device tells whether they have subfolders
+ * \returns An array of VdtreeEntry, NULL if the folder can not be read
+ *
+ * Only entries that d_type does not show to be files are stat()ed.
+ */
+static GArray *vdtree_read_dir(const gchar *pathl, gboolean show_hidden, time_t *mtime, dev_t *dev,
+			       gboolean *nlink_valid)
+{
+	GArray *entries;
+	struct dirent *dir;
+	struct stat st;
+	DIR *dp;
+
+	dp = opendir(pathl);
+	if (!dp) return NULL;
+
+	/* taken before reading, a change during the read invalidates the listing */
+	if (fstat(dirfd(dp), &st) != 0)
+		{
+		closedir(dp);
+		return NULL;
+		}
+	*mtime = st.st_mtime;
+	*dev = st.st_dev;
+
+	*nlink_valid = FALSE;
+#ifdef __linux__
+		{
+		struct statfs sfs;
+
+		if (fstatfs(dirfd(dp), &sfs) == 0)
+			{
+			gint i;
+
+			for (i = 0; vdtree_nlink_fs_types[i]; i++)
+				{
+				if ((long)sfs.f_type == vdtree_nlink_fs_types[i]) *nlink_valid = TRUE;
+				}
+			}
+		}
+#endif
+
+	entries = g_array_new(FALSE, FALSE, sizeof(VdtreeEntry));
+
+	while ((dir = readdir(dp)) != NULL)
+		{
+		const gchar *name = dir->d_name;
+		VdtreeEntry entry;
+		gchar *filepath;
+
+		if (name[0] == '.')
+			{
+			if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) continue;
+			if (!show_hidden) continue;
+			}
+
+		/* the local cache folders are not shown, as in filelist_read() */
+		if (strcmp(name, GQ_CACHE_LOCAL_THUMB) == 0 ||
+		    strcmp(name, GQ_CACHE_LOCAL_METADATA) == 0 ||
+		    strcmp(name, THUMB_FOLDER_LOCAL) == 0) continue;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (dir->d_type != DT_UNKNOWN && dir->d_type != DT_DIR && dir->d_type != DT_LNK) continue;
+#endif
+
+		filepath = g_build_filename(pathl, name, NULL);
+		if (stat(filepath, &entry.st) == 0 && S_ISDIR(entry.st.st_mode))
+			{
+			entry.name = g_strdup(name);
+			g_array_append_val(entries, entry);
+			}
+		g_free(filepath);
+		}
+
+	closedir(dp);
+
+	return entries;
+}
+
+/* turns the entries read into a listing and caches it, main thread only */
+static VdtreeListing *vdtree_listing_new(FileData *dir_fd, GArray *entries, gboolean show_hidden,
+					 time_t mtime, dev_t dev, gboolean nlink_valid)
+{
+	VdtreeListing *vl;
+	gchar *pathl;
+	guint i;
+
+	vl = g_new0(VdtreeListing, 1);
+	vl->path = g_strdup(dir_fd->path);
+	/* a change later in the same second would not show in the mtime */
+	vl->mtime = (mtime < time(NULL)) ? mtime : -1;
+	vl->show_hidden = show_hidden;
+	vl->children = g_array_sized_new(FALSE, FALSE, sizeof(VdtreeChild), entries->len);
+
+	pathl = path_from_utf8(dir_fd->path);
+	for (i = 0; i < entries->len; i++)
+		{
+		VdtreeEntry *entry = &g_array_index(entries, VdtreeEntry, i);
+		VdtreeChild child;
+		gchar *filepath;
+
+		filepath = g_build_filename(pathl, entry->name, NULL);
+		child.fd = file_data_new_dir_local(filepath, &entry->st);
+		/* a folder without subfolders has a link count of 2, itself and "." */
+		child.has_children = !(nlink_valid && entry->st.st_dev == dev && entry->st.st_nlink == 2);
+		g_array_append_val(vl->children, child);
+		g_free(filepath);
+		}
+	g_free(pathl);
+
+	vdtree_listing_cache_add(vl);
+
+	return vl;
+}
+
+static VdtreeListing *vdtree_listing_read(FileData *dir_fd)
+{
+	VdtreeListing *vl;
+	GArray *entries;
+	gchar *pathl;
+	time_t mtime;
+	dev_t dev;
+	gboolean nlink_valid;
+	gboolean show_hidden = options->file_filter.show_hidden_files;
+
+	pathl = path_from_utf8(dir_fd->path);
+	entries = vdtree_read_dir(pathl, show_hidden, &mtime, &dev, &nlink_valid);
+	g_free(pathl);
+
+	if (!entries)
+		{
+		entries = g_array_new(FALSE, FALSE, sizeof(VdtreeEntry));
+		mtime = -1;
+		dev = 0;
+		nlink_valid = FALSE;
+		}
+	vl = vdtree_listing_new(dir_fd, entries, show_hidden, mtime, dev, nlink_valid);
+	vdtree_entries_free(entries);
+
+	return vl;
+}
+
+#ifdef HAVE_GTHREAD
+typedef struct _VdtreeReadJob VdtreeReadJob;
+struct _VdtreeReadJob
+{
+	ViewDir *vd; /* NULL once the view is destroyed */
+	FileData *dir_fd;
+	gchar *pathl;
+	gboolean show_hidden;
+
+	/* result */
+	GArray *entries; /* VdtreeEntry, NULL if the folder could not be read */
+	time_t mtime;
+	dev_t dev;
+	gboolean nlink_valid;
+};
+
+static GThreadPool *vdtree_read_pool = NULL;
+
+static void vdtree_read_job_detach(VdtreeReadJob *job)
+{
+	job->vd = NULL;
+}
+
+static void vdtree_read_job_free(VdtreeReadJob *job)
+{
+	vdtree_entries_free(job->entries);
+	file_data_unref(job->dir_fd);
+	g_free(job->pathl);
+	g_free(job);
 }
+#endif
 
-static void vdtree_add_by_data(ViewDir *vd, FileData *fd, GtkTreeIter *parent)
+/*
+ *----------------------------------------------------------------------------
+ * populating
+ *----------------------------------------------------------------------------
+ */
+
+static void vdtree_populate_real(ViewDir *vd, GtkTreeIter *iter, gboolean force, FileData *target_fd,
+				 gboolean async, gboolean *valid);
+
+/* nodes are created with an "empty" node, so that the expander is shown
+ * this is removed when the child is populated */
+static void vdtree_add_empty(GtkTreeStore *store, GtkTreeIter *parent)
+{
+	NodeData *end;
+	GtkTreeIter empty;
+
+	end = g_new0(NodeData, 1);
+	end->fd = NULL;
+	end->expanded = TRUE;
+
+	gtk_tree_store_append(store, &empty, parent);
+	gtk_tree_store_set(store, &empty, DIR_COLUMN_POINTER, end,
+					  DIR_COLUMN_NAME, "empty", -1);
+}
+
+/* a folder listed without subfolders may have got some since, the listing
+ * of its parent does not change for that */
+static gboolean vdtree_has_children_check(FileData *fd)
+{
+	struct stat st;
+	gchar *pathl;
+	gboolean ret;
+
+	pathl = path_from_utf8(fd->path);
+	ret = (stat(pathl, &st) != 0 || st.st_nlink != 2);
+	g_free(pathl);
+
+	return ret;
+}
+
+static void vdtree_add_by_data(ViewDir *vd, FileData *fd, GtkTreeIter *parent, gboolean has_children)
 {
 	GtkTreeStore *store;
 	GtkTreeIter child;
 	NodeData *nd;
 	GdkPixbuf *pixbuf;
-	NodeData *end;
-	GtkTreeIter empty;
 	gchar *link = NULL;
 
 	if (!fd) return;
@@ -435,15 +756,8 @@ static void vdtree_add_by_data(ViewDir *vd, FileData *fd, GtkTreeIter *parent)
 					 DIR_COLUMN_LINK, link,
 					 DIR_COLUMN_COLOR, FALSE, -1);
 
-	/* all nodes are created with an "empty" node, so that the expander is shown
-	 * this is removed when the child is populated */
-	end = g_new0(NodeData, 1);
-	end->fd = NULL;
-	end->expanded = TRUE;
-
-	gtk_tree_store_append(store, &empty, &child);
-	gtk_tree_store_set(store, &empty, DIR_COLUMN_POINTER, end,
-					  DIR_COLUMN_NAME, "empty", -1);
+	/* folders known to have no subfolders get no expander */
+	if (has_children) vdtree_add_empty(store, &child);
 
 	if (parent)
 		{
@@ -464,22 +778,253 @@ static void vdtree_add_by_data(ViewDir *vd, FileData *fd, GtkTreeIter *parent)
 	g_free(link);
 }
 
-gboolean vdtree_populate_path_by_iter(ViewDir *vd, GtkTreeIter *iter, gboolean force, FileData *target_fd)
+typedef struct _VdtreeRow VdtreeRow;
+struct _VdtreeRow
+{
+	NodeData *nd;
+	GtkTreeIter iter; /* the iters of a tree store stay valid while other rows change */
+};
+
+/* merges the subfolders of a listing into the children of iter */
+static void vdtree_populate_apply(ViewDir *vd, GtkTreeIter *iter, NodeData *nd, VdtreeListing *vl,
+				  FileData *target_fd, gboolean add_hidden, time_t current_time)
 {
 	GtkTreeModel *store;
-	GList *list;
+	GtkTreeSortable *sortable = NULL;
+	GHashTable *old;
+	GHashTableIter old_iter;
+	GtkTreeIter child;
+	GArray *children;
+	VdtreeRow *row;
+	gchar *link = NULL;
+	guint i;
+
+	store = gtk_tree_view_get_model(GTK_TREE_VIEW(vd->view));
+
+	/* nested updates may drop vl from the cache */
+	children = g_array_sized_new(FALSE, FALSE, sizeof(VdtreeChild), vl->children->len);
+	g_array_append_vals(children, vl->children->data, vl->children->len);
+	for (i = 0; i < children->len; i++)
+		{
+		file_data_ref(g_array_index(children, VdtreeChild, i).fd);
+		}
+
+	/* the current children by fd, the "empty" node has none */
+	old = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	if (gtk_tree_model_iter_children(store, &child, iter))
+		{
+		do	{
+			row = g_new(VdtreeRow, 1);
+			gtk_tree_model_get(store, &child, DIR_COLUMN_POINTER, &row->nd, -1);
+			row->iter = child;
+			g_hash_table_insert(old, row->nd->fd, row);
+			} while (gtk_tree_model_iter_next(store, &child));
+		}
+
+	/* many rows are added unsorted and sorted once */
+	if (children->len > VDTREE_SORT_BATCH)
+		{
+		sortable = GTK_TREE_SORTABLE(store);
+		gtk_tree_sortable_set_sort_column_id(sortable, GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
+		}
+
+	for (i = 0; i <= children->len; i++)
+		{
+		FileData *fd;
+		gboolean has_children;
+
+		if (i < children->len)
+			{
+			VdtreeChild *vc = &g_array_index(children, VdtreeChild, i);
+
+			fd = vc->fd;
+			has_children = vc->has_children;
+			}
+		else
+			{
+			/* when hidden files are not enabled, and the user enters a hidden path,
+			 * allow the tree to display that path by specifically inserting the hidden entries
+			 */
+			gint n;
+			gchar *name8;
+
+			if (!add_hidden) break;
+
+			n = strlen(nd->fd->path) + 1;
+
+			while (target_fd->path[n] != '\0' && target_fd->path[n] != G_DIR_SEPARATOR) n++;
+			name8 = g_strndup(target_fd->path, n);
+
+			fd = isdir(name8) ? file_data_new_dir(name8) : NULL;
+			has_children = TRUE;
+			g_free(name8);
+
+			if (!fd) break;
+			}
+
+		row = g_hash_table_lookup(old, fd);
+		if (row)
+			{
+			NodeData *cnd = row->nd;
+
+			child = row->iter;
+
+			if (cnd->expanded && cnd->version != fd->version)
+				{
+				vdtree_populate_path_by_iter(vd, &child, FALSE, target_fd);
+				}
+			else if (!cnd->expanded && !gtk_tree_model_iter_has_child(store, &child) &&
+				 (has_children || vdtree_has_children_check(fd)))
+				{
+				vdtree_add_empty(GTK_TREE_STORE(store), &child);
+				}
+
+			gtk_tree_store_set(GTK_TREE_STORE(store), &child, DIR_COLUMN_NAME, fd->name, -1);
+
+			if (islink(fd->path))
+				{
+				link = realpath(fd->path, NULL);
+				}
+			else
+				{
+				link = NULL;
+				}
+
+			gtk_tree_store_set(GTK_TREE_STORE(store), &child, DIR_COLUMN_LINK, link, -1);
+			g_free(link);
+			link = NULL;
+
+			cnd->version = fd->version;
+			g_hash_table_remove(old, fd);
+			file_data_unref(fd);
+			}
+		else
+			{
+			vdtree_add_by_data(vd, fd, iter, has_children);
+			}
+		}
+
+	g_hash_table_iter_init(&old_iter, old);
+	while (g_hash_table_iter_next(&old_iter, NULL, (gpointer *)&row))
+		{
+		NodeData *cnd = row->nd;
+
+		if (vd->click_fd == cnd->fd) vd->click_fd = NULL;
+		if (vd->drop_fd == cnd->fd) vd->drop_fd = NULL;
+
+		gtk_tree_store_remove(GTK_TREE_STORE(store), &row->iter);
+		vdtree_node_free(cnd);
+		}
+	g_hash_table_destroy(old);
+	g_array_free(children, TRUE);
+
+	if (sortable)
+		{
+		gtk_tree_sortable_set_sort_column_id(sortable, GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
+		}
+
+	nd->expanded = TRUE;
+	nd->last_update = current_time;
+}
+
+#ifdef HAVE_GTHREAD
+static gboolean vdtree_read_job_done_cb(gpointer data)
+{
+	VdtreeReadJob *job = data;
+	ViewDir *vd = job->vd;
+	VdtreeListing *vl;
+	GtkTreeIter iter;
+	NodeData *nd;
+
+	if (!vd)
+		{
+		vdtree_read_job_free(job);
+		return FALSE;
+		}
+
+	VDTREE(vd)->read_jobs = g_list_remove(VDTREE(vd)->read_jobs, job);
+	vdtree_busy_pop(vd);
+
+	if (!job->entries)
+		{
+		/* unreadable, shown without subfolders and read again next time */
+		job->entries = g_array_new(FALSE, FALSE, sizeof(VdtreeEntry));
+		job->mtime = -1;
+		job->nlink_valid = FALSE;
+		}
+
+	vl = vdtree_listing_new(job->dir_fd, job->entries, job->show_hidden,
+				job->mtime, job->dev, job->nlink_valid);
+
+	/* the folder may have been removed from the tree meanwhile */
+	if (vd_find_row(vd, job->dir_fd, &iter))
+		{
+		gtk_tree_model_get(gtk_tree_view_get_model(GTK_TREE_VIEW(vd->view)), &iter,
+				   DIR_COLUMN_POINTER, &nd, -1);
+		if (nd) vdtree_populate_apply(vd, &iter, nd, vl, NULL, FALSE, time(NULL));
+		}
+
+	vdtree_read_job_free(job);
+	return FALSE;
+}
+
+static void vdtree_read_job_run(gpointer data, gpointer user_data)
+{
+	VdtreeReadJob *job = data;
+
+	job->entries = vdtree_read_dir(job->pathl, job->show_hidden, &job->mtime, &job->dev, &job->nlink_valid);
+
+	g_idle_add(vdtree_read_job_done_cb, job);
+}
+
+static void vdtree_read_job_start(ViewDir *vd, FileData *dir_fd)
+{
+	VdtreeReadJob *job;
 	GList *work;
-	GList *old;
+
+	for (work = VDTREE(vd)->read_jobs; work; work = work->next)
+		{
+		job = work->data;
+		if (job->dir_fd == dir_fd) return;
+		}
+
+	if (!vdtree_read_pool)
+		{
+		vdtree_read_pool = g_thread_pool_new(vdtree_read_job_run, NULL, VDTREE_READ_THREADS, FALSE, NULL);
+		}
+
+	job = g_new0(VdtreeReadJob, 1);
+	job->vd = vd;
+	job->dir_fd = file_data_ref(dir_fd);
+	job->pathl = path_from_utf8(dir_fd->path);
+	job->show_hidden = options->file_filter.show_hidden_files;
+
+	VDTREE(vd)->read_jobs = g_list_prepend(VDTREE(vd)->read_jobs, job);
+	vdtree_busy_push(vd);
+
+	g_thread_pool_push(vdtree_read_pool, job, NULL);
+}
+#endif
+
+/**
+ * \param async Read the folder in a thread if it is not cached, the rows are added later
+ * \param valid Set to FALSE if the node was removed
+ */
+static void vdtree_populate_real(ViewDir *vd, GtkTreeIter *iter, gboolean force, FileData *target_fd,
+				 gboolean async, gboolean *valid)
+{
+	GtkTreeModel *store;
+	VdtreeListing *vl = NULL;
 	time_t current_time;
-	GtkTreeIter child;
 	NodeData *nd;
 	gboolean add_hidden = FALSE;
-	gchar *link = NULL;
+
+	*valid = FALSE;
 
 	store = gtk_tree_view_get_model(GTK_TREE_VIEW(vd->view));
 	gtk_tree_model_get(store, iter, DIR_COLUMN_POINTER, &nd, -1);
 
-	if (!nd) return FALSE;
+	if (!nd) return;
 
 	current_time = time(NULL);
 
@@ -491,16 +1036,20 @@ gboolean vdtree_populate_path_by_iter(ViewDir *vd, GtkTreeIter *iter, gboolean f
 			if (vd->drop_fd == nd->fd) vd->drop_fd = NULL;
 			gtk_tree_store_remove(GTK_TREE_STORE(store), iter);
 			vdtree_node_free(nd);
-			return FALSE;
+			return;
 			}
+
+		*valid = TRUE;
 		if (!force && current_time - nd->last_update < 2)
 			{
 			DEBUG_1("Too frequent update of %s", nd->fd->path);
-			return TRUE;
+			return;
 			}
 		file_data_check_changed_files(nd->fd); /* make sure we have recent info */
 		}
 
+	*valid = TRUE;
+
 	/* when hidden files are not enabled, and the user enters a hidden path,
 	 * allow the tree to display that path by specifically inserting the hidden entries
 	 */
@@ -516,116 +1065,40 @@ gboolean vdtree_populate_path_by_iter(ViewDir *vd, GtkTreeIter *iter, gboolean f
 		}
 
 	if (nd->expanded && (!force && !add_hidden) && nd->fd->version == nd->version)
-		return TRUE;
+		return;
 
-	vdtree_busy_push(vd);
-
-	filelist_read(nd->fd, NULL, &list);
-
-	if (add_hidden)
+	if (force)
 		{
-		gint n;
-		gchar *name8;
-
-		n = strlen(nd->fd->path) + 1;
-
-		while (target_fd->path[n] != '\0' && target_fd->path[n] != G_DIR_SEPARATOR) n++;
-		name8 = g_strndup(target_fd->path, n);
-
-		if (isdir(name8))
-			{
-			list = g_list_prepend(list, file_data_new_dir(name8));
-			}
-
-		g_free(name8);
+		vdtree_listing_cache_remove(nd->fd->path);
 		}
-
-	old = NULL;
-	if (gtk_tree_model_iter_children(store, &child, iter))
+	else
 		{
-		do	{
-			NodeData *cnd;
-
-			gtk_tree_model_get(store, &child, DIR_COLUMN_POINTER, &cnd, -1);
-			old = g_list_prepend(old, cnd);
-			} while (gtk_tree_model_iter_next(store, &child));
+		vl = vdtree_listing_cache_get(nd->fd);
 		}
 
-	work = list;
-	while (work)
+#ifdef HAVE_GTHREAD
+	if (!vl && async)
 		{
-		FileData *fd;
-
-		fd = work->data;
-		work = work->next;
-
-		if (strcmp(fd->name, ".") == 0 || strcmp(fd->name, "..") == 0)
-			{
-			file_data_unref(fd);
-			}
-		else
-			{
-			NodeData *cnd;
-
-			cnd = vdtree_find_iter_by_fd(vd, iter, fd, &child);
-			if (cnd)
-				{
-				if (cnd->expanded && cnd->version != fd->version)
-					{
-					vdtree_populate_path_by_iter(vd, &child, FALSE, target_fd);
-					}
-
-				gtk_tree_store_set(GTK_TREE_STORE(store), &child, DIR_COLUMN_NAME, fd->name, -1);
-
-				if (islink(fd->path))
-					{
-					link = realpath(fd->path, NULL);
-					}
-				else
-					{
-					link = NULL;
-					}
-
-				gtk_tree_store_set(GTK_TREE_STORE(store), &child, DIR_COLUMN_LINK, link, -1);
-
-				cnd->version = fd->version;
-				old = g_list_remove(old, cnd);
-				file_data_unref(fd);
-				}
-			else
-				{
-				vdtree_add_by_data(vd, fd, iter);
-				}
-			}
+		vdtree_read_job_start(vd, nd->fd);
+		return;
 		}
+#endif
 
-	work = old;
-	while (work)
-		{
-		NodeData *cnd = work->data;
-		work = work->next;
-
-		if (vd->click_fd == cnd->fd) vd->click_fd = NULL;
-		if (vd->drop_fd == cnd->fd) vd->drop_fd = NULL;
-
-		if (vdtree_find_iter_by_data(vd, iter, cnd, &child))
-			{
-			gtk_tree_store_remove(GTK_TREE_STORE(store), &child);
-			vdtree_node_free(cnd);
-			}
-		}
+	vdtree_busy_push(vd);
 
-	g_list_free(old);
-	g_list_free(list);
+	if (!vl) vl = vdtree_listing_read(nd->fd);
+	vdtree_populate_apply(vd, iter, nd, vl, target_fd, add_hidden, current_time);
 
 	vdtree_busy_pop(vd);
+}
 
-	nd->expanded = TRUE;
-	nd->last_update = current_time;
+gboolean vdtree_populate_path_by_iter(ViewDir *vd, GtkTreeIter *iter, gboolean force, FileData *target_fd)
+{
+	gboolean valid;
 
-	g_free(link);
+	vdtree_populate_real(vd, iter, force, target_fd, FALSE, &valid);
 
-	return TRUE;
+	return valid;
 }
 
 FileData *vdtree_populate_path(ViewDir *vd, FileData *target_fd, gboolean expand, gboolean force)
@@ -941,10 +1414,11 @@ static void vdtree_row_expanded(GtkTreeView *treeview, GtkTreeIter *iter, GtkTre
 	GtkTreeModel *store;
 	NodeData *nd = NULL;
 	FileData *fd;
+	gboolean valid;
 
 	gtk_tree_view_set_tooltip_column(treeview, DIR_COLUMN_LINK);
 
-	vdtree_populate_path_by_iter(vd, iter, FALSE, NULL);
+	vdtree_populate_real(vd, iter, FALSE, NULL, TRUE, &valid);
 	store = gtk_tree_view_get_model(GTK_TREE_VIEW(treeview));
 
 	gtk_tree_model_get_iter(store, iter, tpath);
@@ -967,8 +1441,9 @@ static void vdtree_row_collapsed(GtkTreeView *treeview, GtkTreeIter *iter, GtkTr
 	GtkTreeModel *store;
 	NodeData *nd = NULL;
 	FileData *fd;
+	gboolean valid;
 
-	vdtree_populate_path_by_iter(vd, iter, FALSE, NULL);
+	vdtree_populate_real(vd, iter, FALSE, NULL, TRUE, &valid);
 	store = gtk_tree_view_get_model(GTK_TREE_VIEW(treeview));
 
 	gtk_tree_model_get_iter(store, iter, tpath);
@@ -997,10 +1472,8 @@ static gint vdtree_sort_cb(GtkTreeModel *store, GtkTreeIter *a, GtkTreeIter *b,
 	if (!nda->fd) return 1;
 	if (!ndb->fd) return -1;
 
-	if (options->file_sort.case_sensitive)
-		return strcmp(nda->fd->collate_key_name, ndb->fd->collate_key_name);
-	else
-		return strcmp(nda->fd->collate_key_name_nocase, ndb->fd->collate_key_name_nocase);
+	return strcmp(file_data_get_collate_key(nda->fd, options->file_sort.case_sensitive),
+		      file_data_get_collate_key(ndb->fd, options->file_sort.case_sensitive));
 }
 
 /*
@@ -1016,7 +1489,7 @@ static void vdtree_setup_root(ViewDir *vd)
 
 
 	fd = file_data_new_dir(path);
-	vdtree_add_by_data(vd, fd, NULL);
+	vdtree_add_by_data(vd, fd, NULL, TRUE);
 
 	vdtree_expand_by_data(vd, fd, TRUE);
 	vdtree_populate_path(vd, fd, FALSE, FALSE);
@@ -1041,6 +1514,13 @@ void vdtree_destroy_cb(GtkWidget *widget, gpointer data)
 	vd_dnd_drop_scroll_cancel(vd);
 	widget_auto_scroll_stop(vd->view);
 
+#ifdef HAVE_GTHREAD
+	/* the jobs free themselves when done */
+	g_list_foreach(VDTREE(vd)->read_jobs, (GFunc)vdtree_read_job_detach, NULL);
+	g_list_free(VDTREE(vd)->read_jobs);
+	VDTREE(vd)->read_jobs = NULL;
+#endif
+
 	store = gtk_tree_view_get_model(GTK_TREE_VIEW(vd->view));
 	gtk_tree_model_foreach(store, vdtree_destroy_node_cb, vd);
 }
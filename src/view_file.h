@@ -24,6 +24,9 @@
 #define VFLIST(_vf_) ((ViewFileInfoList *)(_vf_->info))
 #define VFICON(_vf_) ((ViewFileInfoIcon *)(_vf_->info))
 
+/* pages of rows before and after the visible ones that get thumbnails */
+#define VF_THUMB_PREFETCH_PAGES 1
+
 void vf_send_update(ViewFile *vf);
 
 ViewFile *vf_new(FileViewType type, FileData *dir_fd);
@@ -74,6 +77,7 @@ void vf_notify_cb(FileData *fd, NotifyType type, gpointer data);
 void vf_thumb_update(ViewFile *vf);
 void vf_thumb_cleanup(ViewFile *vf);
 void vf_thumb_stop(ViewFile *vf);
+void vf_thumb_request(ViewFile *vf);
 void vf_read_metadata_in_idle(ViewFile *vf);
 void vf_file_filter_set(ViewFile *vf, gboolean enable);
 GRegex *vf_file_filter_get_filter(ViewFile *vf);
@@ -38,6 +38,8 @@
 #include "view_file/view_file_icon.h"
 #include "window.h"
 
+static void vf_thumb_scroll_cb(GtkAdjustment *adjustment, gpointer data);
+
 /*
  *-----------------------------------------------------------------------------
  * signals
@@ -743,6 +745,9 @@ static void vf_destroy_cb(GtkWidget *widget, gpointer data)
 		{
 		g_idle_remove_by_data(vf);
 		}
+	if (vf->thumbs_idle_id) g_source_remove(vf->thumbs_idle_id);
+	g_signal_handlers_disconnect_by_func(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(vf->scrolled)),
+					     vf_thumb_scroll_cb, vf);
 	file_data_unref(vf->dir_fd);
 	g_free(vf->info);
 	g_free(vf);
@@ -1183,6 +1188,9 @@ ViewFile *vf_new(FileViewType type, FileData *dir_fd)
 	gtk_container_add(GTK_CONTAINER(vf->scrolled), vf->listview);
 	gtk_widget_show(vf->listview);
 
+	g_signal_connect(G_OBJECT(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(vf->scrolled))), "value-changed",
+			 G_CALLBACK(vf_thumb_scroll_cb), vf);
+
 	if (dir_fd) vf_set_fd(vf, dir_fd);
 
 	return vf;
@@ -1219,11 +1227,12 @@ static gdouble vf_thumb_progress(ViewFile *vf)
 
 	switch (vf->type)
 	{
-	case FILEVIEW_LIST: vflist_thumb_progress_count(vf->list, &count, &done); break;
-	case FILEVIEW_ICON: vficon_thumb_progress_count(vf->list, &count, &done); break;
+	case FILEVIEW_LIST: vflist_thumb_progress_count(vf, &count, &done); break;
+	case FILEVIEW_ICON: vficon_thumb_progress_count(vf, &count, &done); break;
 	}
 
 	DEBUG_1("thumb progress: %d of %d", done, count);
+	if (!count) return 0.0;
 	return (gdouble)done / count;
 }
 
@@ -1358,11 +1367,8 @@ static void vf_thumb_reset_all(ViewFile *vf)
 	for (work = vf->list; work; work = work->next)
 		{
 		FileData *fd = work->data;
-		if (fd->thumb_pixbuf)
-			{
-			g_object_unref(fd->thumb_pixbuf);
-			fd->thumb_pixbuf = NULL;
-			}
+
+		file_data_set_thumb_pixbuf(fd, NULL);
 		}
 }
 
@@ -1384,6 +1390,35 @@ void vf_thumb_update(ViewFile *vf)
 	while (vf_thumb_next(vf));
 }
 
+static gboolean vf_thumb_request_cb(gpointer data)
+{
+	ViewFile *vf = data;
+
+	vf->thumbs_idle_id = 0;
+	if (!vf->thumbs_running) vf_thumb_update(vf);
+
+	return FALSE;
+}
+
+/**
+ * \brief Loads the missing thumbnails around the visible rows once idle
+ *
+ * Only the rows near the visible ones are given thumbnails, the thumbnails
+ * of others may be dropped for the memory budget. Call when a row without
+ * one is drawn, or when the view scrolled.
+ */
+void vf_thumb_request(ViewFile *vf)
+{
+	if (vf->thumbs_running || vf->thumbs_idle_id) return;
+
+	vf->thumbs_idle_id = g_idle_add_full(G_PRIORITY_LOW, vf_thumb_request_cb, vf, NULL);
+}
+
+static void vf_thumb_scroll_cb(GtkAdjustment *adjustment, gpointer data)
+{
+	vf_thumb_request(data);
+}
+
 
 void vf_marks_set(ViewFile *vf, gboolean enable)
 {
@@ -1540,6 +1575,13 @@ void vf_notify_cb(FileData *fd, NotifyType type, gpointer data)
 	ViewFile *vf = data;
 	gboolean refresh;
 
+	if (type & NOTIFY_THUMBNAIL)
+		{
+		/* only loads thumbnails missing around the visible rows */
+		vf_thumb_request(vf);
+		return;
+		}
+
 	NotifyType interested = NOTIFY_CHANGE | NOTIFY_REREAD | NOTIFY_GROUPING;
 	if (vf->marks_enabled) interested |= NOTIFY_MARKS | NOTIFY_METADATA;
 	/* FIXME: NOTIFY_METADATA should be checked by the keyword-to-mark functions and converted to NOTIFY_MARKS only if there was a change */
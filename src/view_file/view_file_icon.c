@@ -1714,13 +1714,42 @@ void vficon_sort_set(ViewFile *vf, SortType type, gboolean ascend)
  *-----------------------------------------------------------------------------
  */
 
-void vficon_thumb_progress_count(GList *list, gint *count, gint *done)
+/* The part of vf->list that keeps thumbnails, [start, end): the visible
+ * rows and VF_THUMB_PREFETCH_PAGES times as many rows before and after them. */
+static gboolean vficon_thumb_range(ViewFile *vf, gint *start, gint *end)
 {
-	GList *work = list;
-	while (work)
+	GtkTreePath *first;
+	GtkTreePath *last;
+	gint first_row;
+	gint last_row;
+	gint rows;
+
+	if (!gtk_tree_view_get_visible_range(GTK_TREE_VIEW(vf->listview), &first, &last)) return FALSE;
+
+	first_row = gtk_tree_path_get_indices(first)[0];
+	last_row = gtk_tree_path_get_indices(last)[0];
+	gtk_tree_path_free(first);
+	gtk_tree_path_free(last);
+
+	rows = (last_row - first_row + 1) * VF_THUMB_PREFETCH_PAGES;
+	*start = MAX(first_row - rows, 0) * VFICON(vf)->columns;
+	*end = (last_row + rows + 1) * VFICON(vf)->columns;
+
+	return TRUE;
+}
+
+void vficon_thumb_progress_count(ViewFile *vf, gint *count, gint *done)
+{
+	GList *work;
+	gint start;
+	gint end;
+	gint i;
+
+	if (!vficon_thumb_range(vf, &start, &end)) return;
+
+	for (work = g_list_nth(vf->list, start), i = start; work && i < end; work = work->next, i++)
 		{
 		FileData *fd = work->data;
-		work = work->next;
 
 		if (fd->thumb_pixbuf) (*done)++;
 		(*count)++;
@@ -1788,9 +1817,14 @@ FileData *vficon_thumb_next_fd(ViewFile *vf)
 			}
 		}
 
-	/* Then iterate through the entire list to load all of them. */
+	/* Then the rows around them, the others are loaded when scrolled to. */
+	gint start;
+	gint end;
+	if (!vficon_thumb_range(vf, &start, &end)) return NULL;
+
 	GList *work;
-	for (work = vf->list; work; work = work->next)
+	gint i;
+	for (work = g_list_nth(vf->list, start), i = start; work && i < end; work = work->next, i++)
 		{
 		FileData *fd = work->data;
 
@@ -2068,6 +2102,9 @@ static void vficon_cell_data_cb(GtkTreeViewColumn *tree_column, GtkCellRenderer
 			shift_color(&color_bg, -1, 0);
 			}
 
+		file_data_touch_thumb_pixbuf(fd);
+		if (!fd->thumb_pixbuf) vf_thumb_request(vf);
+
 		g_object_set(cell,	"pixbuf", fd->thumb_pixbuf,
 					"text", name_sidecars,
 					"marks", file_data_get_marks(fd),
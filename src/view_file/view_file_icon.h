@@ -69,7 +69,7 @@ void vficon_mark_to_selection(ViewFile *vf, gint mark, MarkToSelectionMode mode)
 void vficon_selection_to_mark(ViewFile *vf, gint mark, SelectionToMarkMode mode);
 
 
-void vficon_thumb_progress_count(GList *list, gint *count, gint *done);
+void vficon_thumb_progress_count(ViewFile *vf, gint *count, gint *done);
 void vficon_read_metadata_progress_count(GList *list, gint *count, gint *done);
 void vficon_set_thumb_fd(ViewFile *vf, FileData *fd);
 FileData *vficon_thumb_next_fd(ViewFile *vf);
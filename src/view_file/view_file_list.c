@@ -48,7 +48,7 @@
 enum {
 	FILE_COLUMN_POINTER = 0,
 	FILE_COLUMN_VERSION,
-	FILE_COLUMN_THUMB,
+	FILE_COLUMN_THUMB, /* not set, the thumbnail is drawn from fd->thumb_pixbuf */
 	FILE_COLUMN_FORMATTED,
 	FILE_COLUMN_FORMATTED_WITH_STARS,
 	FILE_COLUMN_NAME,
@@ -934,7 +934,6 @@ static void vflist_setup_iter(ViewFile *vf, GtkTreeStore *store, GtkTreeIter *it
 
 	gtk_tree_store_set(store, iter, FILE_COLUMN_POINTER, fd,
 					FILE_COLUMN_VERSION, fd->version,
-					FILE_COLUMN_THUMB, fd->thumb_pixbuf,
 					FILE_COLUMN_FORMATTED, formatted,
 					FILE_COLUMN_FORMATTED_WITH_STARS, formatted_with_stars,
 					FILE_COLUMN_SIDECARS, sidecars,
@@ -1158,10 +1157,36 @@ void vflist_sort_set(ViewFile *vf, SortType type, gboolean ascend)
  */
 
 
-void vflist_thumb_progress_count(GList *list, gint *count, gint *done)
+/* The part of vf->list that keeps thumbnails, [start, end): the visible
+ * rows and VF_THUMB_PREFETCH_PAGES times as many rows before and after them. */
+static gboolean vflist_thumb_range(ViewFile *vf, gint *start, gint *end)
+{
+	GtkTreePath *first;
+	GtkTreePath *last;
+	gint first_row;
+	gint last_row;
+	gint rows;
+
+	if (!gtk_tree_view_get_visible_range(GTK_TREE_VIEW(vf->listview), &first, &last)) return FALSE;
+
+	/* sidecars are children of the row of their file */
+	first_row = gtk_tree_path_get_indices(first)[0];
+	last_row = gtk_tree_path_get_indices(last)[0];
+	gtk_tree_path_free(first);
+	gtk_tree_path_free(last);
+
+	rows = (last_row - first_row + 1) * VF_THUMB_PREFETCH_PAGES;
+	*start = MAX(first_row - rows, 0);
+	*end = last_row + rows + 1;
+
+	return TRUE;
+}
+
+/* n files of list and their sidecars, all if n is negative */
+static void vflist_thumb_progress_count_list(GList *list, gint n, gint *count, gint *done)
 {
 	GList *work = list;
-	while (work)
+	while (work && n != 0)
 		{
 		FileData *fd = work->data;
 		work = work->next;
@@ -1170,12 +1195,23 @@ void vflist_thumb_progress_count(GList *list, gint *count, gint *done)
 
 		if (fd->sidecar_files)
 			{
-			vflist_thumb_progress_count(fd->sidecar_files, count, done);
+			vflist_thumb_progress_count_list(fd->sidecar_files, -1, count, done);
 			}
 		(*count)++;
+		n--;
 		}
 }
 
+void vflist_thumb_progress_count(ViewFile *vf, gint *count, gint *done)
+{
+	gint start;
+	gint end;
+
+	if (!vflist_thumb_range(vf, &start, &end)) return;
+
+	vflist_thumb_progress_count_list(g_list_nth(vf->list, start), end - start, count, done);
+}
+
 void vflist_read_metadata_progress_count(GList *list, gint *count, gint *done)
 {
 	GList *work = list;
@@ -1196,19 +1232,25 @@ void vflist_read_metadata_progress_count(GList *list, gint *count, gint *done)
 
 void vflist_set_thumb_fd(ViewFile *vf, FileData *fd)
 {
-	GtkTreeStore *store;
+	GtkTreeModel *store;
 	GtkTreeIter iter;
+	GtkTreePath *tpath;
 
 	if (!fd || vflist_find_row(vf, fd, &iter) < 0) return;
 
-	store = GTK_TREE_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(vf->listview)));
-	gtk_tree_store_set(store, &iter, FILE_COLUMN_THUMB, fd->thumb_pixbuf, -1);
+	/* redraw the row, the thumbnail column reads fd->thumb_pixbuf */
+	store = gtk_tree_view_get_model(GTK_TREE_VIEW(vf->listview));
+	tpath = gtk_tree_model_get_path(store, &iter);
+	gtk_tree_model_row_changed(store, tpath, &iter);
+	gtk_tree_path_free(tpath);
 }
 
 FileData *vflist_thumb_next_fd(ViewFile *vf)
 {
 	GtkTreePath *tpath;
 	FileData *fd = NULL;
+	gint start;
+	gint end;
 
 	/* first check the visible files */
 
@@ -1235,12 +1277,14 @@ FileData *vflist_thumb_next_fd(ViewFile *vf)
 			}
 		}
 
-	/* then find first undone */
+	/* then find first undone around them, the others are loaded when scrolled to */
 
-	if (!fd)
+	if (!fd && vflist_thumb_range(vf, &start, &end))
 		{
-		GList *work = vf->list;
-		while (work && !fd)
+		GList *work = g_list_nth(vf->list, start);
+		gint i = start;
+
+		while (work && i < end && !fd)
 			{
 			FileData *fd_p = work->data;
 			if (!fd_p->thumb_pixbuf)
@@ -1257,6 +1301,7 @@ FileData *vflist_thumb_next_fd(ViewFile *vf)
 					}
 				}
 			work = work->next;
+			i++;
 			}
 		}
 
@@ -1884,6 +1929,23 @@ static void vflist_listview_color_cb(GtkTreeViewColumn *tree_column, GtkCellRend
 		     "cell-background-set", set, NULL);
 }
 
+static void vflist_listview_thumb_cb(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
+				     GtkTreeModel *tree_model, GtkTreeIter *iter, gpointer data)
+{
+	ViewFile *vf = data;
+	FileData *fd;
+
+	gtk_tree_model_get(tree_model, iter, FILE_COLUMN_POINTER, &fd, -1);
+	if (fd)
+		{
+		file_data_touch_thumb_pixbuf(fd);
+		if (!fd->thumb_pixbuf) vf_thumb_request(vf);
+		}
+	g_object_set(G_OBJECT(cell), "pixbuf", fd ? fd->thumb_pixbuf : NULL, NULL);
+
+	vflist_listview_color_cb(tree_column, cell, tree_model, iter, data);
+}
+
 static void vflist_listview_add_column(ViewFile *vf, gint n, const gchar *title, gboolean image, gboolean right_justify, gboolean expand)
 {
 	GtkTreeViewColumn *column;
@@ -1912,10 +1974,10 @@ static void vflist_listview_add_column(ViewFile *vf, gint n, const gchar *title,
 		renderer = gtk_cell_renderer_pixbuf_new();
 		cell_renderer_height_override(renderer);
 		gtk_tree_view_column_pack_start(column, renderer, TRUE);
-		gtk_tree_view_column_add_attribute(column, renderer, "pixbuf", n);
 		}
 
-	gtk_tree_view_column_set_cell_data_func(column, renderer, vflist_listview_color_cb, vf, NULL);
+	gtk_tree_view_column_set_cell_data_func(column, renderer,
+						image ? vflist_listview_thumb_cb : vflist_listview_color_cb, vf, NULL);
 	g_object_set_data(G_OBJECT(column), "column_store_idx", GUINT_TO_POINTER(n));
 	g_object_set_data(G_OBJECT(renderer), "column_store_idx", GUINT_TO_POINTER(n));
 